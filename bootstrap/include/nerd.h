@@ -12,6 +12,11 @@
 #include <stdint.h>
 #include <stddef.h>
 #include <stdbool.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+
+#define NERD_VERSION "3.0.0"
 
 /*
  * Token Types - All English words, each tokenizes as 1 LLM token
@@ -36,6 +41,7 @@ typedef enum {
     TOK_NEG,        // neg - negation
     TOK_INC,        // inc - increment
     TOK_DEC,        // dec - decrement
+    TOK_IMPORT,     // import - use functions from another file
 
     // Types
     TOK_NUM,        // num - f64
@@ -130,6 +136,7 @@ typedef enum {
     NODE_PROGRAM,
     NODE_FUNC_DEF,
     NODE_TYPE_DEF,
+    NODE_IMPORT,
     NODE_PARAM,
     NODE_RETURN,
     NODE_IF,
@@ -177,6 +184,7 @@ struct ASTNode {
         struct {
             ASTList types;
             ASTList functions;
+            ASTList imports;    // NODE_IMPORT, in source order
         } program;
 
         // Function definition
@@ -185,8 +193,15 @@ struct ASTNode {
             ASTList params;
             ASTNode *return_type;
             ASTList body;
+            bool specialized;   // clone created by specialize_program
+            bool imported;      // defined in an imported module
         } func_def;
 
+        // Import of another source file
+        struct {
+            char *name;         // module name, resolved to name.nerd
+        } import;
+
         // Type definition
         struct {
             char *name;
@@ -284,6 +299,7 @@ struct ASTNode {
         // String literal
         struct {
             char *value;
+            int id;             // @.strN index, assigned by codegen
         } str;
 
         // Boolean literal
@@ -312,6 +328,30 @@ typedef struct {
     size_t pos;
 } Parser;
 
+/*
+ * Exported function signature (modules, interface files)
+ */
+typedef struct {
+    char *name;
+    size_t arity;
+} ModuleSig;
+
+/*
+ * Execution profile of one function (nerd build --pgo)
+ */
+typedef struct {
+    char *name;
+    uint64_t *counts;       // calls, then per branch site: times false, times true
+    size_t count;
+    bool hot;               // among the functions taking 99% of all calls
+    bool cold;              // never called
+} ProfileFunc;
+
+typedef struct {
+    ProfileFunc *funcs;     // sorted by name
+    size_t count;
+} Profile;
+
 /*
  * Compiler context
  */
@@ -323,8 +363,160 @@ typedef struct {
     // Error handling
     char *error_msg;
     int error_line;
+
+    // Options
+    bool no_specialize;     // skip constant-argument specialization
+    bool fast_math;         // fast-math flags on floating-point ops
+    const char *march;      // target CPU ("native" or LLVM CPU name), or NULL
+    bool emit_entry;        // emit an i32 @main entry point (nerd run)
+    const ModuleSig *externs;   // functions defined in other objects, sorted by name
+    size_t extern_count;
+    bool instrument;        // count calls and branches, written at exit to $NERD_PROFILE
+    const Profile *profile; // branch weights and hot/cold placement, or NULL
 } NerdContext;
 
+/*
+ * Target description (for --march)
+ */
+typedef struct {
+    const char *triple;
+    const char *datalayout;     // NULL: let clang derive it from the triple
+    char cpu[32];
+    char features[512];
+} TargetInfo;
+
+/*
+ * Growable text buffer for generated IR
+ */
+typedef struct {
+    char *data;
+    size_t size;
+    size_t capacity;
+} IRBuf;
+
+/*
+ * Bytecode (interpreter)
+ *
+ * Register machine: every value is a double in a per-frame register file.
+ * Parameters occupy r0..rN-1, locals and loop counters follow, temporaries
+ * sit above. Jump targets are instruction indices within the function.
+ */
+#define BC_OPS(X)                                                       \
+    X(CONST)        /* r[a] = K[b]                               */     \
+    X(MOV)          /* r[a] = r[b]                               */     \
+    X(ADD) X(SUB) X(MUL) X(DIV) X(MOD)      /* r[a] = r[b] op r[c] */   \
+    X(EQ) X(NEQ) X(LT) X(GT) X(LTE) X(GTE)  /* r[a] = r[b] op r[c] */   \
+    X(AND) X(OR)                            /* r[a] = r[b] op r[c] */   \
+    X(NOT) X(NEG)                           /* r[a] = op r[b]      */   \
+    X(ABS) X(SQRT) X(FLOOR) X(CEIL) X(SIN) X(COS)                       \
+    X(MIN) X(MAX) X(POW)                                                \
+    X(JMP)          /* pc = a                                    */     \
+    X(JMPF)         /* if !r[a] pc = b                           */     \
+    X(FORPREP)      /* if !(r[a] <= r[b]) pc = c                 */     \
+    X(FORLOOP)      /* r[a] += 1; if r[a] <= r[b] pc = c         */     \
+    X(CALL)         /* r[a] = funcs[b](r[c], r[c+1], ...)        */     \
+    X(RET)          /* return r[a]                               */     \
+    X(OUT_NUM)      /* print r[a]                                */     \
+    X(OUT_STR)      /* print strings[a]                          */     \
+    X(HTTP_GET)     /* http get strings[a]                       */     \
+    X(HTTP_GETALL)  /* http getall strings[a] (newline-separated) */    \
+    X(HTTP_POST)    /* http post strings[a] strings[b]           */     \
+    X(MCP_TOOLS)    /* mcp tools strings[a]                      */     \
+    X(MCP_SEND)     /* mcp send strings[a] strings[b] strings[c] */     \
+    X(MCP_INIT)     /* mcp init strings[a]                       */     \
+    X(LLM_CLAUDE)   /* llm claude strings[a]                     */     \
+    X(LLM_SYSTEM)   /* llm claude strings[b], system strings[a]  */
+
+#define BC_ENUM(name) BC_##name,
+typedef enum {
+    BC_OPS(BC_ENUM)
+    BC_OP_COUNT
+} BcOp;
+#undef BC_ENUM
+
+typedef struct {
+    uint8_t op;
+    uint16_t a, b, c;
+} BcInstr;
+
+typedef struct {
+    char *name;
+    int param_count;
+    int reg_count;
+    bool specialized;       // clone from specialize_program (skipped by harness)
+    bool imported;          // defined in an imported module (skipped by harness)
+
+    BcInstr *code;
+    size_t code_count;
+    size_t code_capacity;
+
+    double *consts;
+    size_t const_count;
+    size_t const_capacity;
+
+    uint32_t heat;          // calls + loop back-edges (--tiered)
+    _Atomic(void *) native; // compiled entry point once tiered up
+} BcFunc;
+
+typedef struct {
+    BcFunc *funcs;
+    size_t func_count;
+
+    char **strings;         // unescaped string literals
+    size_t string_count;
+    size_t string_capacity;
+
+    int main_index;         // -1 if the program has no main
+    bool uses_runtime;      // has http/mcp/llm instructions
+} BcProgram;
+
+/*
+ * ELF64 relocatable object (x86 backend)
+ */
+enum {
+    ELF_UNDEF,              // external symbol
+    ELF_TEXT,
+    ELF_RODATA,
+};
+
+#define R_X86_64_PC32 2
+#define R_X86_64_PLT32 4
+
+typedef struct {
+    uint8_t *data;
+    size_t size;
+    size_t capacity;
+} ElfSection;
+
+typedef struct {
+    char *name;
+    int section;            // ELF_TEXT, ELF_RODATA or ELF_UNDEF
+    uint64_t value;
+    uint64_t size;
+    bool global;
+    bool func;
+} ElfSymbol;
+
+typedef struct {
+    uint64_t offset;        // patched location in .text
+    size_t symbol;          // index into ElfObject.symbols
+    uint32_t type;          // R_X86_64_*
+    int64_t addend;
+} ElfReloc;
+
+typedef struct {
+    ElfSection text;
+    ElfSection rodata;
+
+    ElfSymbol *symbols;
+    size_t symbol_count;
+    size_t symbol_capacity;
+
+    ElfReloc *relocs;
+    size_t reloc_count;
+    size_t reloc_capacity;
+} ElfObject;
+
 /*
  * Lexer functions
  */
@@ -347,16 +539,259 @@ void ast_free(ASTNode *node);
 void ast_list_init(ASTList *list);
 void ast_list_push(ASTList *list, ASTNode *node);
 void ast_list_free(ASTList *list);
+ASTNode *ast_clone(const ASTNode *node);
+void ast_list_clone(ASTList *dst, const ASTList *src);
+bool ast_stmt_writes(ASTNode *node, const char *name);
+bool ast_list_writes(ASTList *list, const char *name);
+
+/*
+ * Optimization passes
+ */
+void specialize_program(ASTNode *program);
+
+/*
+ * Bytecode compiler and interpreter
+ */
+BcProgram *bc_compile(ASTNode *program);
+void bc_free(BcProgram *prog);
+const char *bc_op_name(int op);
+int bc_run(BcProgram *prog, ASTNode *tier_source);
+
+/*
+ * Tiered execution
+ */
+typedef struct Tier Tier;
+Tier *tier_start(BcProgram *prog, ASTNode *program);
+void tier_hot(Tier *tier, int func);
+void tier_stop(Tier *tier);
+bool tier_closure(BcProgram *prog, int root, int **out, size_t *count);
+
+/*
+ * Native x86-64 backend
+ */
+size_t elf_append(ElfSection *sec, const void *data, size_t len);
+size_t elf_add_symbol(ElfObject *obj, const char *name, int section, uint64_t value, bool global, bool func);
+void elf_add_reloc(ElfObject *obj, uint64_t offset, size_t symbol, uint32_t type, int64_t addend);
+bool elf_write(const ElfObject *obj, const char *path);
+void elf_free(ElfObject *obj);
+bool x86_compile(BcProgram *prog, bool emit_entry, const char *path);
+
+/*
+ * Target description
+ */
+bool target_host(const char *march, TargetInfo *t);
+
+/*
+ * IR text buffer
+ */
+void irbuf_init(IRBuf *b);
+void irbuf_free(IRBuf *b);
+void irbuf_put(IRBuf *b, const char *s, size_t len);
+void irbuf_puts(IRBuf *b, const char *s);
+void irbuf_putc(IRBuf *b, char c);
+void irbuf_int(IRBuf *b, long long v);
+void irbuf_uint(IRBuf *b, unsigned long long v);
+void irbuf_vprintf(IRBuf *b, const char *fmt, va_list ap);
+void irbuf_printf(IRBuf *b, const char *fmt, ...);
+bool irbuf_write(const IRBuf *b, FILE *out);
 
 /*
  * Code generation (LLVM)
  */
 bool codegen_llvm(NerdContext *ctx, const char *output_path);
+bool codegen_llvm_stream(NerdContext *ctx, FILE *out);
+bool codegen_llvm_buffer(NerdContext *ctx, IRBuf *out);
+bool codegen_llvm_split(NerdContext *ctx, int parts, IRBuf *modules, int *module_count);
+bool codegen_llvm_functions(NerdContext *ctx, const bool *wanted, IRBuf *modules, IRBuf *entry);
+bool codegen_bitcode(NerdContext *ctx, const char *output_path);
+bool codegen_bitcode_stream(NerdContext *ctx, FILE *out);
+
+/*
+ * Toolchain (temp dirs, runtime lookup, process spawning)
+ */
+char *toolchain_tmpdir(void);
+void toolchain_rmdir(const char *dir);
+bool toolchain_exe_path(char *buf, size_t size);
+bool toolchain_runtime_dir(char *buf, size_t size);
+bool toolchain_spawn(char *const argv[], FILE **stdin_pipe, int *pid);
+bool toolchain_spawn_in(char *const argv[], const char *dir, int *pid);
+int toolchain_wait(int pid);
+void toolchain_exec(char *const argv[]);
+
+/*
+ * Compilation cache (nerd run, nerd build)
+ */
+typedef struct {
+    uint64_t a, b;
+} CacheKey;
+
+void cache_key_init(CacheKey *k);
+void cache_key_add(CacheKey *k, const void *data, size_t len);
+void cache_key_add_str(CacheKey *k, const char *s);
+void cache_key_add_file(CacheKey *k, const char *path);
+bool cache_dir(char *buf, size_t size);
+bool cache_lookup(const CacheKey *k, char *path, size_t size);
+bool cache_tmp_path(const CacheKey *k, char *path, size_t size);
+bool cache_store(const char *tmp, const CacheKey *k, char *path, size_t size);
+bool cache_entry_path(const CacheKey *k, const char *ext, char *path, size_t size);
+bool cache_meta_path(const CacheKey *k, const char *ext, char *path, size_t size);
+bool cache_lookup_object(const CacheKey *k, const char *dir, char *path, size_t size);
+bool cache_store_object(const char *tmp, const CacheKey *k);
+void cache_evict(const char *keep);
+int cache_stats(void);
+int cache_clear(void);
+
+/*
+ * Modules (import): one source file each, loaded in dependency order
+ */
+typedef struct {
+    char *name;             // import name (file name without .nerd)
+    char *path;             // canonical path of the source file
+    char *source;
+    size_t source_len;
+    CacheKey source_key;    // hash of the source text
+    ASTNode *ast;           // NULL until module_parse
+    char **imports;         // import names, as written
+    size_t import_count;
+    size_t *deps;           // module indices of the imports
+    ModuleSig *exports;     // every function, in source order
+    size_t export_count;
+    bool uses_http, uses_mcp, uses_llm;
+} Module;
+
+typedef struct {
+    Module *modules;        // dependencies before dependents
+    size_t count;
+    size_t capacity;
+} ModuleGraph;
+
+bool module_graph_load(ModuleGraph *g, const char *root_path, ASTNode *root);
+void module_graph_free(ModuleGraph *g);
+bool module_parse(Module *m);
+bool module_merge(ModuleGraph *g, ASTNode *program);
+bool module_import_all(const char *path, ASTNode *program, bool *http, bool *mcp, bool *llm);
+void module_visible(const ModuleGraph *g, size_t index, bool *visible);
+ModuleSig *module_externs(const ModuleGraph *g, const bool *visible, size_t *count);
+void module_uses(const ModuleGraph *g, bool *http, bool *mcp, bool *llm);
+void module_hash_imports(CacheKey *key, const char *source, const char *path);
+
+/*
+ * Single-file and batch compilation (nerd compile)
+ */
+typedef struct {
+    bool no_specialize;
+    bool fast_math;
+    const char *march;
+    bool x86;               // x86-64 object instead of LLVM IR
+    bool bitcode;           // LLVM bitcode instead of text
+} CompileOptions;
+
+bool compile_x86_object(ASTNode *ast, bool no_specialize, bool emit_entry, const char *path);
+void compile_output_path(const char *input, const char *dir, const CompileOptions *opts,
+                         char *buf, size_t size);
+bool compile_file(const char *input, const char *output, const CompileOptions *opts);
+size_t compile_batch(char **inputs, char **outputs, size_t count, const CompileOptions *opts, int jobs);
+
+/*
+ * Source to cached executable (nerd run)
+ */
+typedef struct {
+    const char *opt_level;  // "-O2" etc., or NULL
+    bool no_specialize;
+    bool fast_math;
+    const char *march;
+    bool x86;               // x86 backend, linked with cc
+    bool bitcode;           // stream bitcode into clang instead of text
+    bool instrument;        // profile-collecting build (nerd build --pgo)
+} RunOptions;
+
+typedef struct {
+    char http_lib[1100];    // runtime objects next to the executable
+    char mcp_lib[1100];
+    char llm_lib[1100];
+    CacheKey prefix;        // hash of the compiler and runtime objects
+} RunEnv;
+
+void run_env_init(RunEnv *env);
+void run_cache_key(CacheKey *key, const RunEnv *env, const RunOptions *opts,
+                   const char *input, const char *source, size_t source_len);
+bool run_build(const RunEnv *env, const RunOptions *opts, const char *input,
+               const char *source, size_t source_len, const CacheKey *key,
+               char *bin, size_t size, bool *cached, char **tmp_dir);
+
+/*
+ * Profile-guided builds (nerd build --pgo)
+ */
+bool profile_load(const char *path, Profile *profile);
+bool profile_save(const Profile *profile, const char *path);
+void profile_free(Profile *profile);
+const ProfileFunc *profile_find(const Profile *profile, const char *name);
+void profile_key(const Profile *profile, const char *name, CacheKey *key);
+void profile_path(const char *input, char *buf, size_t size);
+bool pgo_train(const char *input, const char *source, size_t source_len, const RunOptions *opts,
+               char **runs, size_t run_count, const char *output);
+
+/*
+ * Per-function benchmarks (nerd bench)
+ */
+#define BENCH_MAX_ARGS 8
+
+typedef struct {
+    char *func;                 // only for this function, or NULL for all
+    double values[BENCH_MAX_ARGS];
+    int count;
+} BenchArgs;
+
+typedef struct {
+    const char *opt_level;      // "-O2" etc.
+    bool no_specialize;
+    bool fast_math;
+    const char *march;
+    double warmup_ms;           // per function and argument set
+    double time_ms;             // measuring budget per function and argument set
+    size_t calls;               // measure this many calls instead (0 = use time_ms)
+    const char **only;          // functions to time (none = all)
+    size_t only_count;
+    BenchArgs *args;            // argument sets (none = 5, 3, 1, ...)
+    size_t arg_count;
+    bool json;
+} BenchOptions;
+
+bool bench_parse_args(const char *spec, BenchArgs *out);
+int bench_run(const char *input, const char *source, size_t source_len, const BenchOptions *opts);
+
+/*
+ * Compiler daemon (nerd serve) and its client
+ */
+bool serve_socket_path(char *buf, size_t size);
+bool serve_build(const char *input, const RunOptions *opts, char *bin, size_t size);
+int serve_main(int jobs);
+int serve_stop(void);
+int serve_status(void);
+
+/*
+ * Native build from split modules (nerd build)
+ */
+typedef struct {
+    const char *output;         // executable path
+    const char *opt_level;      // "-O2" etc., or NULL
+    int jobs;                   // modules / concurrent clang processes, 0 = one per CPU
+    bool thinlto;               // compile with ThinLTO summaries, optimize at link time
+    bool use_cache;             // reuse per-function objects from the cache
+    bool explain;               // list the functions that had to be recompiled
+    const char **link_args;     // runtime objects and libraries
+    size_t link_count;
+    ModuleGraph *modules;       // imported modules, or NULL
+} BuildOptions;
+
+bool build_native(NerdContext *ctx, const BuildOptions *opts);
 
 /*
  * Utility functions
  */
 char *nerd_strdup(const char *s);
 char *nerd_strndup(const char *s, size_t n);
+FILE *nerd_diag(void);
+void nerd_set_diag(FILE *stream);   // this thread's diagnostics; NULL for stderr
 
 #endif /* NERD_H */
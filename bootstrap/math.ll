@@ -0,0 +1,117 @@
+; NERD Compiled Program
+; Generated by NERD Bootstrap Compiler
+
+declare double @llvm.fabs.f64(double)
+declare double @llvm.sqrt.f64(double)
+declare double @llvm.floor.f64(double)
+declare double @llvm.ceil.f64(double)
+declare double @llvm.sin.f64(double)
+declare double @llvm.cos.f64(double)
+declare double @llvm.pow.f64(double, double)
+declare double @llvm.minnum.f64(double, double)
+declare double @llvm.maxnum.f64(double, double)
+
+declare i32 @printf(i8*, ...)
+
+declare i8* @nerd_http_get(i8*)
+declare i8* @nerd_http_getall(i8*)
+declare i8* @nerd_http_post(i8*, i8*)
+declare void @nerd_http_free(i8*)
+declare i8* @nerd_http_get_start(i8*)
+declare i8* @nerd_http_getall_start(i8*)
+declare i8* @nerd_http_post_start(i8*, i8*)
+declare i8* @nerd_http_wait(i8*)
+
+declare i8* @nerd_mcp_list(i8*)
+declare i8* @nerd_mcp_send(i8*, i8*, i8*)
+declare i8* @nerd_mcp_init(i8*)
+declare void @nerd_mcp_free(i8*)
+declare i8* @nerd_mcp_list_start(i8*)
+declare i8* @nerd_mcp_send_start(i8*, i8*, i8*)
+declare i8* @nerd_mcp_init_start(i8*)
+declare i8* @nerd_mcp_wait(i8*)
+
+declare i8* @nerd_llm_claude(i8*)
+declare i8* @nerd_llm_claude_system(i8*, i8*)
+declare void @nerd_llm_free(i8*)
+declare i8* @nerd_llm_claude_start(i8*)
+declare i8* @nerd_llm_claude_system_start(i8*, i8*)
+declare i8* @nerd_llm_wait(i8*)
+
+@.fmt_num = private constant [4 x i8] c"%g\0A\00"
+@.fmt_str = private constant [4 x i8] c"%s\0A\00"
+@.fmt_int = private constant [6 x i8] c"%.0f\0A\00"
+
+define double @add(double %arg0, double %arg1) {
+entry:
+  %t0 = fadd double 0.0, %arg0
+  %t1 = fadd double 0.0, %arg1
+  %t2 = fadd double %t0, %t1
+  ret double %t2
+}
+
+define double @sub(double %arg0, double %arg1) {
+entry:
+  %t0 = fadd double 0.0, %arg0
+  %t1 = fadd double 0.0, %arg1
+  %t2 = fsub double %t0, %t1
+  ret double %t2
+}
+
+define double @mul(double %arg0, double %arg1) {
+entry:
+  %t0 = fadd double 0.0, %arg0
+  %t1 = fadd double 0.0, %arg1
+  %t2 = fmul double %t0, %t1
+  ret double %t2
+}
+
+define double @div(double %arg0, double %arg1) {
+entry:
+  %t0 = fadd double 0.0, %arg0
+  %t1 = fadd double 0.0, %arg1
+  %t2 = fdiv double %t0, %t1
+  ret double %t2
+}
+
+define double @main() {
+entry:
+  ; call add.spec0
+  %t0 = call double @add.spec0()
+  call i32 (i8*, ...) @printf(i8* getelementptr ([4 x i8], [4 x i8]* @.fmt_num, i32 0, i32 0), double %t0)
+  ; call sub.spec0
+  %t1 = call double @sub.spec0()
+  call i32 (i8*, ...) @printf(i8* getelementptr ([4 x i8], [4 x i8]* @.fmt_num, i32 0, i32 0), double %t1)
+  ; call mul.spec0
+  %t2 = call double @mul.spec0()
+  call i32 (i8*, ...) @printf(i8* getelementptr ([4 x i8], [4 x i8]* @.fmt_num, i32 0, i32 0), double %t2)
+  ; call div.spec0
+  %t3 = call double @div.spec0()
+  call i32 (i8*, ...) @printf(i8* getelementptr ([4 x i8], [4 x i8]* @.fmt_num, i32 0, i32 0), double %t3)
+  ret double 0.0
+}
+
+define double @add.spec0() {
+entry:
+  %t0 = fadd double 0.0, 8.0
+  ret double %t0
+}
+
+define double @sub.spec0() {
+entry:
+  %t0 = fadd double 0.0, 6.0
+  ret double %t0
+}
+
+define double @mul.spec0() {
+entry:
+  %t0 = fadd double 0.0, 42.0
+  ret double %t0
+}
+
+define double @div.spec0() {
+entry:
+  %t0 = fadd double 0.0, 5.0
+  ret double %t0
+}
+
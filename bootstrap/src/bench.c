@@ -0,0 +1,504 @@
+/*
+ * NERD Bench - Per-function timing of a NERD program
+ *
+ * `nerd bench` compiles every function of the file (with what it calls)
+ * into a shared object, the way tier.c does, dlopens it and calls each one
+ * from a timing loop. For each function and argument set it warms up,
+ * estimates the cost of a call, then takes samples of enough calls to last
+ * about BENCH_SAMPLE_NS each, until the call count or time budget is used.
+ *
+ * Samples beyond 3 interquartile ranges from the quartiles (Tukey's far
+ * fences: preemption, page faults, frequency changes) are dropped before
+ * min, median, p99 and mean ns/call are reported, as a table or as JSON.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+#include <signal.h>
+#include <time.h>
+#include <dlfcn.h>
+#include "nerd.h"
+
+#define BENCH_SAMPLE_NS 20000.0     // target length of one sample
+#define BENCH_MIN_SAMPLES 100       // with -n, batches are made small enough for this many
+#define BENCH_MAX_SAMPLES 1000000
+#define BENCH_FENCE 3.0             // outliers: beyond Q1/Q3 -+ 3 IQR
+
+typedef struct {
+    const char *name;
+    const double *args;
+    int argc;
+    double result;
+    size_t calls;
+    size_t samples;
+    size_t outliers;
+    double min, median, p99, mean;  // ns per call
+} BenchResult;
+
+// Results are summed into this so no call can be optimized out
+static volatile double bench_sink;
+
+/*
+ * [fn=]v1,v2,...
+ */
+bool bench_parse_args(const char *spec, BenchArgs *out) {
+    memset(out, 0, sizeof(*out));
+    const char *eq = strchr(spec, '=');
+    if (eq) {
+        out->func = nerd_strndup(spec, eq - spec);
+        spec = eq + 1;
+    }
+
+    while (*spec) {
+        char *end;
+        double v = strtod(spec, &end);
+        if (end == spec || (*end && *end != ',') || out->count >= BENCH_MAX_ARGS) {
+            fprintf(stderr, "Error: Bad argument set '%s' (expected [fn=]n,n,... with up to %d values)\n",
+                    spec, BENCH_MAX_ARGS);
+            free(out->func);
+            return false;
+        }
+        out->values[out->count++] = v;
+        spec = *end ? end + 1 : end;
+    }
+    return true;
+}
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+typedef double (*Fn0)(void);
+typedef double (*Fn1)(double);
+typedef double (*Fn2)(double, double);
+typedef double (*Fn3)(double, double, double);
+typedef double (*Fn4)(double, double, double, double);
+typedef double (*Fn5)(double, double, double, double, double);
+typedef double (*Fn6)(double, double, double, double, double, double);
+typedef double (*Fn7)(double, double, double, double, double, double, double);
+typedef double (*Fn8)(double, double, double, double, double, double, double, double);
+
+#define BATCH(type, ...) { \
+        type f = (type)entry; \
+        for (size_t i = 0; i < n; i++) sum += f(__VA_ARGS__); \
+    } break
+
+/*
+ * Call `entry` n times and return the sum of the results; the dispatch on
+ * arity stays outside the loop
+ */
+static double run_batch(void *entry, int argc, const double *a, size_t n) {
+    double sum = 0;
+    switch (argc) {
+        case 0: BATCH(Fn0);
+        case 1: BATCH(Fn1, a[0]);
+        case 2: BATCH(Fn2, a[0], a[1]);
+        case 3: BATCH(Fn3, a[0], a[1], a[2]);
+        case 4: BATCH(Fn4, a[0], a[1], a[2], a[3]);
+        case 5: BATCH(Fn5, a[0], a[1], a[2], a[3], a[4]);
+        case 6: BATCH(Fn6, a[0], a[1], a[2], a[3], a[4], a[5]);
+        case 7: BATCH(Fn7, a[0], a[1], a[2], a[3], a[4], a[5], a[6]);
+        default: BATCH(Fn8, a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7]);
+    }
+    return sum;
+}
+
+static int double_cmp(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+// Nearest-rank percentile of sorted values
+static double percentile(const double *v, size_t n, double p) {
+    size_t rank = (size_t)ceil(p * n);
+    return v[rank > 0 ? rank - 1 : 0];
+}
+
+/*
+ * Reject outliers from the samples and fill in the statistics
+ */
+static void summarize(double *samples, size_t n, BenchResult *r) {
+    qsort(samples, n, sizeof(double), double_cmp);
+    double q1 = percentile(samples, n, 0.25);
+    double q3 = percentile(samples, n, 0.75);
+    double lo = q1 - BENCH_FENCE * (q3 - q1);
+    double hi = q3 + BENCH_FENCE * (q3 - q1);
+
+    size_t first = 0, last = n;
+    while (first < n && samples[first] < lo) first++;
+    while (last > first && samples[last - 1] > hi) last--;
+    const double *kept = samples + first;
+    size_t count = last - first;
+
+    double total = 0;
+    for (size_t i = 0; i < count; i++) total += kept[i];
+    r->samples = count;
+    r->outliers = n - count;
+    r->min = kept[0];
+    r->median = percentile(kept, count, 0.5);
+    r->p99 = percentile(kept, count, 0.99);
+    r->mean = total / count;
+}
+
+/*
+ * Time one function with one argument set
+ */
+static bool measure(void *entry, const BenchOptions *opts, BenchResult *r) {
+    r->result = run_batch(entry, r->argc, r->args, 1);
+
+    // Warm up with doubling batches, which also estimates the cost of a call
+    size_t warm_calls = 0;
+    double start = now_ns(), elapsed = 0;
+    for (size_t batch = 1; elapsed < opts->warmup_ms * 1e6 || warm_calls == 0; batch *= 2) {
+        bench_sink += run_batch(entry, r->argc, r->args, batch);
+        warm_calls += batch;
+        elapsed = now_ns() - start;
+    }
+    double per_call = elapsed / warm_calls;
+
+    size_t batch = per_call > 0 ? (size_t)ceil(BENCH_SAMPLE_NS / per_call) : 1;
+    if (batch < 1) batch = 1;
+    if (opts->calls > 0 && batch > opts->calls / BENCH_MIN_SAMPLES) {
+        batch = opts->calls / BENCH_MIN_SAMPLES ? opts->calls / BENCH_MIN_SAMPLES : 1;
+    }
+
+    size_t capacity = 1024, n = 0;
+    double *samples = malloc(sizeof(double) * capacity);
+    if (!samples) return false;
+
+    r->calls = 0;
+    start = now_ns();
+    for (;;) {
+        if (opts->calls > 0 && opts->calls - r->calls < batch) batch = opts->calls - r->calls;
+        double t0 = now_ns();
+        bench_sink += run_batch(entry, r->argc, r->args, batch);
+        double t1 = now_ns();
+
+        if (n == capacity) {
+            capacity *= 2;
+            double *grown = realloc(samples, sizeof(double) * capacity);
+            if (!grown) break;
+            samples = grown;
+        }
+        samples[n++] = (t1 - t0) / batch;
+        r->calls += batch;
+
+        if (n >= BENCH_MAX_SAMPLES) break;
+        if (opts->calls > 0 ? r->calls >= opts->calls : t1 - start >= opts->time_ms * 1e6) break;
+    }
+
+    summarize(samples, n, r);
+    free(samples);
+    return true;
+}
+
+/*
+ * Argument sets for `name` of the given arity: the ones given for it by
+ * name, else the ones for every function, else the harness's 5, 3, 1...
+ * Missing trailing values are 1.
+ */
+static size_t args_for(const BenchOptions *opts, const char *name, int arity,
+                       double (*out)[BENCH_MAX_ARGS]) {
+    size_t n = 0;
+    bool named = false;
+    for (size_t i = 0; i < opts->arg_count; i++) {
+        if (opts->args[i].func && strcmp(opts->args[i].func, name) == 0) named = true;
+    }
+    for (size_t i = 0; i < opts->arg_count; i++) {
+        const BenchArgs *set = &opts->args[i];
+        if (named ? !set->func || strcmp(set->func, name) != 0 : set->func != NULL) continue;
+        for (int j = 0; j < arity; j++) {
+            out[n][j] = j < set->count ? set->values[j] : 1.0;
+        }
+        n++;
+    }
+    if (n == 0) {
+        for (int j = 0; j < arity; j++) {
+            out[0][j] = j == 0 ? 5.0 : j == 1 ? 3.0 : 1.0;
+        }
+        n = 1;
+    }
+    return n;
+}
+
+/*
+ * Whether any function in the closure prints: timing it would time printf
+ * and flood the table (or the JSON) with its output
+ */
+static bool closure_prints(const BcProgram *prog, const int *closure, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        const BcFunc *fn = &prog->funcs[closure[i]];
+        for (size_t pc = 0; pc < fn->code_count; pc++) {
+            if (fn->code[pc].op == BC_OUT_NUM || fn->code[pc].op == BC_OUT_STR) return true;
+        }
+    }
+    return false;
+}
+
+static bool selected(const BenchOptions *opts, const char *name) {
+    if (opts->only_count == 0) return true;
+    for (size_t i = 0; i < opts->only_count; i++) {
+        if (strcmp(opts->only[i], name) == 0) return true;
+    }
+    return false;
+}
+
+// JSON has no NaN or infinity
+static void json_number(double v) {
+    if (isfinite(v)) printf("%.17g", v);
+    else printf("null");
+}
+
+static void format_args(const BenchResult *r, char *buf, size_t size) {
+    size_t len = 0;
+    buf[0] = '\0';
+    for (int j = 0; j < r->argc && len < size; j++) {
+        len += snprintf(buf + len, size - len, "%s%g", j ? "," : "", r->args[j]);
+    }
+}
+
+static void print_table(const BenchResult *results, size_t count) {
+    printf("%-20s %-14s %10s %10s %10s %10s %10s %8s  %s\n",
+           "function", "args", "calls", "min", "median", "p99", "ns/call", "outliers", "result");
+    for (size_t i = 0; i < count; i++) {
+        const BenchResult *r = &results[i];
+        char args[64];
+        format_args(r, args, sizeof(args));
+        printf("%-20s %-14s %10zu %10.1f %10.1f %10.1f %10.1f %8zu  %g\n",
+               r->name, args, r->calls, r->min, r->median, r->p99, r->mean, r->outliers, r->result);
+    }
+}
+
+static void print_json(const char *input, const BenchResult *results, size_t count,
+                       const char **skipped, const char **reasons, size_t skipped_count) {
+    printf("{\"file\": \"");
+    for (const char *p = input; *p; p++) {
+        if (*p == '"' || *p == '\\') putchar('\\');
+        putchar(*p);
+    }
+    printf("\", \"results\": [");
+    for (size_t i = 0; i < count; i++) {
+        const BenchResult *r = &results[i];
+        printf("%s\n  {\"function\": \"%s\", \"args\": [", i ? "," : "", r->name);
+        for (int j = 0; j < r->argc; j++) {
+            if (j) printf(", ");
+            json_number(r->args[j]);
+        }
+        printf("], \"result\": ");
+        json_number(r->result);
+        printf(", \"calls\": %zu, \"samples\": %zu, \"outliers\": %zu, ", r->calls, r->samples, r->outliers);
+        printf("\"min_ns\": %.3f, \"median_ns\": %.3f, \"p99_ns\": %.3f, \"mean_ns\": %.3f}",
+               r->min, r->median, r->p99, r->mean);
+    }
+    printf("%s], \"skipped\": [", count ? "\n" : "");
+    for (size_t i = 0; i < skipped_count; i++) {
+        printf("%s\n  {\"function\": \"%s\", \"reason\": \"%s\"}", i ? "," : "", skipped[i], reasons[i]);
+    }
+    printf("%s]}\n", skipped_count ? "\n" : "");
+}
+
+/*
+ * Compile the functions flagged in `wanted` into a shared object
+ */
+static void *build_library(ASTNode *program, const bool *wanted, const BenchOptions *opts, const char *dir) {
+    ASTNode module = {0};
+    module.type = NODE_PROGRAM;
+    ast_list_init(&module.data.program.types);
+    ast_list_init(&module.data.program.functions);
+    ASTList *funcs = &program->data.program.functions;
+    for (size_t i = 0; i < funcs->count; i++) {
+        if (wanted[i]) ast_list_push(&module.data.program.functions, funcs->nodes[i]);
+    }
+
+    char so_path[4096];
+    snprintf(so_path, sizeof(so_path), "%s/bench.so", dir);
+
+    char *clang_argv[16];
+    int n = 0;
+    clang_argv[n++] = "clang";
+    clang_argv[n++] = "-w";
+    clang_argv[n++] = (char *)opts->opt_level;
+    clang_argv[n++] = "-shared";
+    clang_argv[n++] = "-fPIC";
+#ifndef __APPLE__
+    clang_argv[n++] = "-Wl,-Bsymbolic";   // calls inside the module must not bind to libm & co
+#endif
+    clang_argv[n++] = "-o";
+    clang_argv[n++] = so_path;
+    clang_argv[n++] = "-x";
+    clang_argv[n++] = "ir";
+    clang_argv[n++] = "-";
+    clang_argv[n] = NULL;
+
+    // Already specialized (or not) by the caller
+    NerdContext ctx = {0};
+    ctx.ast = &module;
+    ctx.no_specialize = true;
+    ctx.fast_math = opts->fast_math;
+    ctx.march = opts->march;
+
+    FILE *ir = NULL;
+    int pid;
+    bool ok = false;
+    signal(SIGPIPE, SIG_IGN);
+    if (toolchain_spawn(clang_argv, &ir, &pid)) {
+        bool generated = codegen_llvm_stream(&ctx, ir);
+        fclose(ir);
+        int status = toolchain_wait(pid);
+        if (!generated) {
+            fprintf(stderr, "Error: %s\n", ctx.error_msg ? ctx.error_msg : "code generation failed");
+        } else if (status != 0) {
+            fprintf(stderr, "Error: clang compilation failed\n");
+        } else {
+            ok = true;
+        }
+    }
+    free(ctx.error_msg);
+    free(module.data.program.functions.nodes);
+
+    void *handle = ok ? dlopen(so_path, RTLD_NOW | RTLD_LOCAL) : NULL;
+    if (ok && !handle) {
+        fprintf(stderr, "Error: Cannot load %s: %s\n", so_path, dlerror());
+    }
+    return handle;
+}
+
+/*
+ * `nerd bench`: time every selected function of the program in `input`
+ */
+int bench_run(const char *input, const char *source, size_t source_len, const BenchOptions *opts) {
+    Lexer *lexer = lexer_create(source, source_len);
+    if (!lexer || !lexer_tokenize(lexer)) {
+        if (lexer) lexer_free(lexer);
+        return 1;
+    }
+    Parser *parser = parser_create(lexer->tokens, lexer->token_count);
+    ASTNode *ast = parser ? parser_parse(parser) : NULL;
+    if (!ast || !module_import_all(input, ast, NULL, NULL, NULL)) {
+        ast_free(ast);
+        if (parser) parser_free(parser);
+        lexer_free(lexer);
+        return 1;
+    }
+    if (!opts->no_specialize) {
+        specialize_program(ast);
+    }
+
+    int result = 1;
+    BcProgram *prog = bc_compile(ast);
+    ASTList *funcs = &ast->data.program.functions;
+    bool *wanted = calloc(funcs->count ? funcs->count : 1, sizeof(bool));
+    size_t *targets = malloc(sizeof(size_t) * (funcs->count ? funcs->count : 1));
+    const char **skipped = malloc(sizeof(char *) * (funcs->count ? funcs->count : 1));
+    const char **reasons = malloc(sizeof(char *) * (funcs->count ? funcs->count : 1));
+    size_t target_count = 0, skipped_count = 0;
+    char *dir = NULL;
+    void *handle = NULL;
+    BenchResult *results = NULL;
+    double (*arg_sets)[BENCH_MAX_ARGS] = malloc(sizeof(*arg_sets) * (opts->arg_count + 1));
+    if (!prog || !wanted || !targets || !skipped || !reasons || !arg_sets) goto done;
+
+    // The file's own functions, each with everything it calls
+    for (size_t i = 0; i < funcs->count; i++) {
+        ASTNode *func = funcs->nodes[i];
+        const char *name = func->data.func_def.name;
+        if (func->data.func_def.specialized || func->data.func_def.imported ||
+            strcmp(name, "main") == 0 || !selected(opts, name)) {
+            continue;
+        }
+
+        int *closure;
+        size_t closure_count;
+        if (func->data.func_def.params.count > BENCH_MAX_ARGS) {
+            skipped[skipped_count] = name;
+            reasons[skipped_count++] = "more than 8 parameters";
+        } else if (!tier_closure(prog, (int)i, &closure, &closure_count)) {
+            skipped[skipped_count] = name;
+            reasons[skipped_count++] = "uses http, mcp or llm";
+        } else if (closure_prints(prog, closure, closure_count)) {
+            free(closure);
+            skipped[skipped_count] = name;
+            reasons[skipped_count++] = "uses out";
+        } else {
+            for (size_t j = 0; j < closure_count; j++) wanted[closure[j]] = true;
+            free(closure);
+            targets[target_count++] = i;
+        }
+    }
+    if (!opts->json) {
+        for (size_t i = 0; i < skipped_count; i++) {
+            fprintf(stderr, "Skipping %s: %s\n", skipped[i], reasons[i]);
+        }
+    }
+    if (target_count == 0) {
+        fprintf(stderr, "Error: No functions to benchmark in %s\n", input);
+        goto done;
+    }
+
+    dir = toolchain_tmpdir();
+    handle = dir ? build_library(ast, wanted, opts, dir) : NULL;
+    if (!handle) goto done;
+
+    // One result per function and argument set
+    size_t capacity = target_count * (opts->arg_count + 1), count = 0;
+    results = calloc(capacity, sizeof(BenchResult));
+    double (*values)[BENCH_MAX_ARGS] = malloc(sizeof(*values) * capacity);
+    if (!results || !values) {
+        free(values);
+        goto done;
+    }
+
+    for (size_t t = 0; t < target_count; t++) {
+        ASTNode *func = funcs->nodes[targets[t]];
+        const char *name = func->data.func_def.name;
+        int arity = (int)func->data.func_def.params.count;
+        void *entry = dlsym(handle, name);
+        if (!entry) {
+            fprintf(stderr, "Error: '%s' missing from the compiled library\n", name);
+            continue;
+        }
+
+        size_t sets = args_for(opts, name, arity, arg_sets);
+        for (size_t s = 0; s < sets; s++) {
+            memcpy(values[count], arg_sets[s], sizeof(arg_sets[s]));
+            BenchResult *r = &results[count];
+            r->name = name;
+            r->args = values[count];
+            r->argc = arity;
+            if (measure(entry, opts, r)) count++;
+        }
+    }
+
+    if (opts->json) {
+        print_json(input, results, count, skipped, reasons, skipped_count);
+    } else {
+        print_table(results, count);
+    }
+    fflush(stdout);
+    free(values);
+    result = 0;
+
+done:
+    if (handle) dlclose(handle);
+    if (dir) {
+        toolchain_rmdir(dir);
+        free(dir);
+    }
+    free(results);
+    free(arg_sets);
+    free(reasons);
+    free(skipped);
+    free(targets);
+    free(wanted);
+    if (prog) bc_free(prog);
+    ast_free(ast);
+    parser_free(parser);
+    lexer_free(lexer);
+    return result;
+}
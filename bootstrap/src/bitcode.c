@@ -0,0 +1,1083 @@
+/*
+ * NERD Bitcode Writer - LLVM bitcode without libLLVM
+ *
+ * `--emit=bc` hands clang a bitcode module instead of textual IR: no .ll
+ * parser on clang's side and a fraction of the bytes. The bitstream
+ * container (abbreviation ids, VBR fields, back-patched block lengths) is
+ * written by hand; records are unabbreviated except the string table blob.
+ *
+ * Like the x86 backend, the module is lowered from the register bytecode.
+ * Each bytecode register becomes an alloca that clang's mem2reg promotes.
+ * Typed pointers plus explicit types on every load, GEP and call keep the
+ * file readable by LLVM 14 and by releases that upgrade to opaque `ptr`.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include "nerd.h"
+
+// Block ids
+#define BLOCK_PARAMATTR 9
+#define BLOCK_PARAMATTR_GROUP 10
+#define BLOCK_CONSTANTS 11
+#define BLOCK_FUNCTION 12
+#define BLOCK_MODULE 8
+#define BLOCK_TYPE 17
+#define BLOCK_STRTAB 23
+
+// Abbreviation ids
+#define ABBREV_END_BLOCK 0
+#define ABBREV_ENTER_SUBBLOCK 1
+#define ABBREV_DEFINE 2
+#define ABBREV_UNABBREV_RECORD 3
+#define ABBREV_FIRST_USER 4
+
+// Record codes
+#define MODULE_VERSION 1
+#define MODULE_TRIPLE 2
+#define MODULE_DATALAYOUT 3
+#define MODULE_GLOBALVAR 7
+#define MODULE_FUNCTION 8
+#define PARAMATTR_ENTRY 2
+#define PARAMATTR_GRP_ENTRY 3
+#define TYPE_NUMENTRY 1
+#define TYPE_VOID 2
+#define TYPE_DOUBLE 4
+#define TYPE_INTEGER 7
+#define TYPE_POINTER 8
+#define TYPE_ARRAY 11
+#define TYPE_FUNCTION 21
+#define CST_SETTYPE 1
+#define CST_NULL 2
+#define CST_INTEGER 4
+#define CST_FLOAT 6
+#define CST_CSTRING 9
+#define INST_DECLAREBLOCKS 1
+#define INST_BINOP 2
+#define INST_CAST 3
+#define INST_RET 10
+#define INST_BR 11
+#define INST_ALLOCA 19
+#define INST_LOAD 20
+#define INST_CMP2 28
+#define INST_CALL 34
+#define INST_GEP 43
+#define INST_STORE 44
+#define STRTAB_BLOB 1
+
+// Operand encodings
+#define BINOP_ADD 0
+#define BINOP_SUB 1
+#define BINOP_MUL 2
+#define BINOP_SDIV 4            // fdiv for FP operands
+#define BINOP_SREM 6            // frem for FP operands
+#define BINOP_AND 10
+#define BINOP_OR 11
+#define CAST_UITOFP 5
+#define FCMP_OEQ 1
+#define FCMP_OGT 2
+#define FCMP_OGE 3
+#define FCMP_OLT 4
+#define FCMP_OLE 5
+#define FCMP_ONE 6
+#define ICMP_EQ 32
+#define CALL_EXPLICIT_TYPE (1 << 15)
+#define CALL_FMF (1 << 17)
+#define FMF_FAST 0xE0           // contract afn reassoc
+#define ALIGN_8 4               // log2(8) + 1
+#define ALLOCA_EXPLICIT_TYPE (1 << 6)
+#define LINKAGE_EXTERNAL 0
+#define LINKAGE_PRIVATE 9
+
+// Fixed type table entries; NERD function types and strings follow
+enum {
+    T_VOID,
+    T_DOUBLE,
+    T_I1,
+    T_I8,
+    T_I32,
+    T_PTR,                      // i8*
+    T_PRINTF,                   // i32 (i8*, ...)
+    T_D_D,                      // double (double)
+    T_D_DD,
+    T_P_P,                      // i8* (i8*)
+    T_P_PP,
+    T_P_PPP,
+    T_V_P,                      // void (i8*)
+    T_MAIN,                     // i32 ()
+    T_FIXED_COUNT,
+};
+
+// External declarations, in value-id order after the globals
+enum {
+    D_PRINTF,
+    D_FABS, D_SQRT, D_FLOOR, D_CEIL, D_SIN, D_COS,
+    D_POW, D_MINNUM, D_MAXNUM,
+    D_HTTP_GET, D_HTTP_GETALL, D_HTTP_POST, D_HTTP_FREE,
+    D_MCP_LIST, D_MCP_SEND, D_MCP_INIT, D_MCP_FREE,
+    D_LLM_CLAUDE, D_LLM_SYSTEM, D_LLM_FREE,
+    D_COUNT,
+};
+
+static const struct {
+    const char *name;
+    int type;
+} decls[D_COUNT] = {
+    {"printf", T_PRINTF},
+    {"llvm.fabs.f64", T_D_D}, {"llvm.sqrt.f64", T_D_D}, {"llvm.floor.f64", T_D_D},
+    {"llvm.ceil.f64", T_D_D}, {"llvm.sin.f64", T_D_D}, {"llvm.cos.f64", T_D_D},
+    {"llvm.pow.f64", T_D_DD}, {"llvm.minnum.f64", T_D_DD}, {"llvm.maxnum.f64", T_D_DD},
+    {"nerd_http_get", T_P_P}, {"nerd_http_getall", T_P_P}, {"nerd_http_post", T_P_PP},
+    {"nerd_http_free", T_V_P},
+    {"nerd_mcp_list", T_P_P}, {"nerd_mcp_send", T_P_PPP}, {"nerd_mcp_init", T_P_P},
+    {"nerd_mcp_free", T_V_P},
+    {"nerd_llm_claude", T_P_P}, {"nerd_llm_claude_system", T_P_PP}, {"nerd_llm_free", T_V_P},
+};
+
+/*
+ * Bitstream writer
+ */
+#define BIT_MAX_DEPTH 8
+
+typedef struct {
+    uint8_t *data;
+    size_t size;
+    size_t capacity;
+    uint64_t pending;           // bits not yet flushed, LSB first
+    int pending_bits;
+    int width;                  // abbreviation id width of the current block
+    size_t block_start[BIT_MAX_DEPTH];  // offset of each open block's length word
+    int outer_width[BIT_MAX_DEPTH];
+    int depth;
+} BitWriter;
+
+static void put_word(BitWriter *w, uint32_t v) {
+    if (w->size + 4 > w->capacity) {
+        w->capacity = w->capacity ? w->capacity * 2 : 4096;
+        w->data = realloc(w->data, w->capacity);
+    }
+    for (int i = 0; i < 4; i++) {
+        w->data[w->size++] = (uint8_t)(v >> (8 * i));
+    }
+}
+
+static void emit(BitWriter *w, uint32_t v, int bits) {
+    w->pending |= (uint64_t)v << w->pending_bits;
+    w->pending_bits += bits;
+    if (w->pending_bits >= 32) {
+        put_word(w, (uint32_t)w->pending);
+        w->pending >>= 32;
+        w->pending_bits -= 32;
+    }
+}
+
+static void emit_vbr(BitWriter *w, uint64_t v, int bits) {
+    uint64_t high = 1ULL << (bits - 1);
+    while (v >= high) {
+        emit(w, (uint32_t)((v & (high - 1)) | high), bits);
+        v >>= bits - 1;
+    }
+    emit(w, (uint32_t)v, bits);
+}
+
+static void align32(BitWriter *w) {
+    if (w->pending_bits) emit(w, 0, 32 - w->pending_bits);
+}
+
+static void enter_block(BitWriter *w, int id, int width) {
+    emit(w, ABBREV_ENTER_SUBBLOCK, w->width);
+    emit_vbr(w, id, 8);
+    emit_vbr(w, width, 4);
+    align32(w);
+    w->block_start[w->depth] = w->size;
+    w->outer_width[w->depth] = w->width;
+    w->depth++;
+    put_word(w, 0);             // length in words, patched by end_block
+    w->width = width;
+}
+
+static void end_block(BitWriter *w) {
+    emit(w, ABBREV_END_BLOCK, w->width);
+    align32(w);
+    w->depth--;
+    size_t start = w->block_start[w->depth];
+    uint32_t words = (uint32_t)((w->size - start - 4) / 4);
+    for (int i = 0; i < 4; i++) {
+        w->data[start + i] = (uint8_t)(words >> (8 * i));
+    }
+    w->width = w->outer_width[w->depth];
+}
+
+/*
+ * Record operands
+ */
+typedef struct {
+    uint64_t *v;
+    size_t count;
+    size_t capacity;
+} Ops;
+
+static void op(Ops *ops, uint64_t v) {
+    if (ops->count >= ops->capacity) {
+        ops->capacity = ops->capacity ? ops->capacity * 2 : 64;
+        ops->v = realloc(ops->v, sizeof(uint64_t) * ops->capacity);
+    }
+    ops->v[ops->count++] = v;
+}
+
+static void op_chars(Ops *ops, const char *s) {
+    for (; *s; s++) op(ops, (uint8_t)*s);
+}
+
+static void record(BitWriter *w, unsigned code, Ops *ops) {
+    emit(w, ABBREV_UNABBREV_RECORD, w->width);
+    emit_vbr(w, code, 6);
+    emit_vbr(w, ops->count, 6);
+    for (size_t i = 0; i < ops->count; i++) {
+        emit_vbr(w, ops->v[i], 6);
+    }
+    ops->count = 0;
+}
+
+/*
+ * Module writer
+ */
+typedef struct {
+    const char *name;
+    const char *bytes;
+    size_t len;                 // without the terminating NUL
+} Global;
+
+typedef struct {
+    BitWriter w;
+    Ops ops;
+    BcProgram *prog;
+    bool emit_entry;
+    uint64_t fmf;               // FMF_FAST with --fast-math, else 0
+    bool has_attrs;             // functions use attribute list 1
+    char *error;
+
+    Global *globals;
+    size_t global_count;
+    int fmt_num, fmt_str, fmt_entry;
+    int *entry_name;            // harness name global per function
+
+    ElfSection strtab;          // symbol names (STRTAB blob)
+
+    // Value ids: globals, declarations, NERD functions, main, constants
+    unsigned decl_base;
+    unsigned func_base;
+    unsigned main_id;
+    unsigned i32_zero, i32_one, null_ptr;
+    unsigned double_base;
+    uint64_t *doubles;          // sorted bit patterns
+    size_t double_count;
+    unsigned string_base;
+    unsigned value_count;
+
+    // Types
+    unsigned fn_type_base;      // double (double x k) is fn_type_base + k
+    unsigned string_type_base;  // [len+1 x i8] of global i
+
+    // Current function
+    BcFunc *fn;
+    unsigned next;              // id the next value-producing instruction gets
+    unsigned *slot;             // alloca per register
+    int *block_of;              // basic block starting at pc, or -1
+    int *extra_block;           // first extra block of an http op, or -1
+    bool open;                  // current block has no terminator yet
+} Bitcode;
+
+static int add_global(Bitcode *b, const char *name, const char *bytes) {
+    b->globals = realloc(b->globals, sizeof(Global) * (b->global_count + 1));
+    Global *g = &b->globals[b->global_count];
+    g->name = name;
+    g->bytes = bytes;
+    g->len = strlen(bytes);
+    return (int)b->global_count++;
+}
+
+static int cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static uint64_t double_bits(double v) {
+    uint64_t bits;
+    memcpy(&bits, &v, sizeof(bits));
+    return bits;
+}
+
+static void add_double(Bitcode *b, double v, size_t *capacity) {
+    if (b->double_count >= *capacity) {
+        *capacity = *capacity ? *capacity * 2 : 64;
+        b->doubles = realloc(b->doubles, sizeof(uint64_t) * *capacity);
+    }
+    b->doubles[b->double_count++] = double_bits(v);
+}
+
+static unsigned double_id(Bitcode *b, double v) {
+    uint64_t key = double_bits(v);
+    uint64_t *found = bsearch(&key, b->doubles, b->double_count, sizeof(uint64_t), cmp_u64);
+    return b->double_base + (unsigned)(found - b->doubles);
+}
+
+static const char *func_name(Bitcode *b, int index) {
+    const char *name = b->prog->funcs[index].name;
+    return b->emit_entry && strcmp(name, "main") == 0 ? "nerd_main" : name;
+}
+
+/*
+ * Number every module-level value before anything is written
+ */
+static void layout_values(Bitcode *b) {
+    BcProgram *prog = b->prog;
+
+    b->fmt_num = add_global(b, ".fmt_num", "%g\n");
+    b->fmt_str = add_global(b, ".fmt_str", "%s\n");
+    b->fmt_entry = -1;
+    for (size_t i = 0; i < prog->string_count; i++) {
+        add_global(b, "", prog->strings[i]);
+    }
+    b->entry_name = malloc(sizeof(int) * (prog->func_count + 1));
+    if (b->emit_entry && prog->main_index < 0) {
+        b->fmt_entry = add_global(b, ".fmt_entry", "%s = %.0f\n");
+        for (size_t i = 0; i < prog->func_count; i++) {
+            bool skip = prog->funcs[i].specialized || prog->funcs[i].imported;
+            b->entry_name[i] = skip ? -1 : add_global(b, "", prog->funcs[i].name);
+        }
+    }
+
+    b->decl_base = (unsigned)b->global_count;
+    b->func_base = b->decl_base + D_COUNT;
+    b->main_id = b->func_base + (unsigned)prog->func_count;
+    unsigned id = b->main_id + (b->emit_entry ? 1 : 0);
+
+    b->i32_zero = id++;
+    b->i32_one = id++;
+    b->null_ptr = id++;
+
+    size_t capacity = 0;
+    add_double(b, 0.0, &capacity);
+    add_double(b, 1.0, &capacity);
+    add_double(b, 3.0, &capacity);
+    add_double(b, 5.0, &capacity);
+    for (size_t i = 0; i < prog->func_count; i++) {
+        BcFunc *fn = &prog->funcs[i];
+        for (size_t k = 0; k < fn->const_count; k++) {
+            add_double(b, fn->consts[k], &capacity);
+        }
+    }
+    qsort(b->doubles, b->double_count, sizeof(uint64_t), cmp_u64);
+    size_t unique = 0;
+    for (size_t i = 0; i < b->double_count; i++) {
+        if (unique == 0 || b->doubles[unique - 1] != b->doubles[i]) {
+            b->doubles[unique++] = b->doubles[i];
+        }
+    }
+    b->double_count = unique;
+    b->double_base = id;
+    id += (unsigned)unique;
+
+    b->string_base = id;
+    id += (unsigned)b->global_count;
+    b->value_count = id;
+}
+
+static void write_types(Bitcode *b) {
+    BitWriter *w = &b->w;
+    Ops *o = &b->ops;
+    int max_params = 0;
+    for (size_t i = 0; i < b->prog->func_count; i++) {
+        if (b->prog->funcs[i].param_count > max_params) max_params = b->prog->funcs[i].param_count;
+    }
+    b->fn_type_base = T_FIXED_COUNT;
+    b->string_type_base = b->fn_type_base + (unsigned)max_params + 1;
+
+    enter_block(w, BLOCK_TYPE, 4);
+    op(o, b->string_type_base + b->global_count);
+    record(w, TYPE_NUMENTRY, o);
+
+    record(w, TYPE_VOID, o);
+    record(w, TYPE_DOUBLE, o);
+    op(o, 1);
+    record(w, TYPE_INTEGER, o);
+    op(o, 8);
+    record(w, TYPE_INTEGER, o);
+    op(o, 32);
+    record(w, TYPE_INTEGER, o);
+    op(o, T_I8);
+    op(o, 0);                   // address space
+    record(w, TYPE_POINTER, o);
+
+    // T_PRINTF..T_MAIN as [vararg, return, params...]
+    static const int fixed[][6] = {
+        {1, T_I32, T_PTR, -1},
+        {0, T_DOUBLE, T_DOUBLE, -1},
+        {0, T_DOUBLE, T_DOUBLE, T_DOUBLE, -1},
+        {0, T_PTR, T_PTR, -1},
+        {0, T_PTR, T_PTR, T_PTR, -1},
+        {0, T_PTR, T_PTR, T_PTR, T_PTR, -1},
+        {0, T_VOID, T_PTR, -1},
+        {0, T_I32, -1},
+    };
+    for (size_t i = 0; i < sizeof(fixed) / sizeof(fixed[0]); i++) {
+        for (int j = 0; fixed[i][j] >= 0; j++) op(o, (uint64_t)fixed[i][j]);
+        record(w, TYPE_FUNCTION, o);
+    }
+
+    for (int k = 0; k <= max_params; k++) {
+        op(o, 0);
+        op(o, T_DOUBLE);
+        for (int j = 0; j < k; j++) op(o, T_DOUBLE);
+        record(w, TYPE_FUNCTION, o);
+    }
+
+    for (size_t i = 0; i < b->global_count; i++) {
+        op(o, b->globals[i].len + 1);
+        op(o, T_I8);
+        record(w, TYPE_ARRAY, o);
+    }
+    end_block(w);
+}
+
+// String attribute in a PARAMATTR_GRP_ENTRY record
+static void op_attr(Ops *o, const char *key, const char *value) {
+    op(o, 4);                   // key and value
+    op_chars(o, key);
+    op(o, 0);
+    op_chars(o, value);
+    op(o, 0);
+}
+
+/*
+ * `attributes #0` of codegen.c: target CPU and features
+ */
+static void write_attributes(Bitcode *b, const TargetInfo *target) {
+    BitWriter *w = &b->w;
+    Ops *o = &b->ops;
+
+    enter_block(w, BLOCK_PARAMATTR_GROUP, 3);
+    op(o, 1);                   // group id
+    op(o, 0xFFFFFFFF);          // function attributes
+    op_attr(o, "target-cpu", target->cpu);
+    if (target->features[0]) op_attr(o, "target-features", target->features);
+    record(w, PARAMATTR_GRP_ENTRY, o);
+    end_block(w);
+
+    enter_block(w, BLOCK_PARAMATTR, 3);
+    op(o, 1);
+    record(w, PARAMATTR_ENTRY, o);
+    end_block(w);
+}
+
+// [strtab offset, size] prefix of global value records
+static void op_name(Bitcode *b, const char *name) {
+    size_t len = strlen(name);
+    size_t offset = len ? elf_append(&b->strtab, name, len) : 0;
+    op(&b->ops, offset);
+    op(&b->ops, len);
+}
+
+static void write_function_record(Bitcode *b, const char *name, unsigned type, bool proto, bool attrs) {
+    op_name(b, name);
+    op(&b->ops, type);
+    op(&b->ops, 0);             // C calling convention
+    op(&b->ops, proto);
+    op(&b->ops, LINKAGE_EXTERNAL);
+    op(&b->ops, attrs ? 1 : 0);
+    op(&b->ops, 0);             // alignment
+    op(&b->ops, 0);             // section
+    op(&b->ops, 0);             // visibility
+    record(&b->w, MODULE_FUNCTION, &b->ops);
+}
+
+static void write_globals(Bitcode *b) {
+    for (size_t i = 0; i < b->global_count; i++) {
+        op_name(b, b->globals[i].name);
+        op(&b->ops, b->string_type_base + i);
+        op(&b->ops, 1 | 2);     // constant, explicit value type
+        op(&b->ops, b->string_base + i + 1);
+        op(&b->ops, LINKAGE_PRIVATE);
+        op(&b->ops, 0);         // alignment
+        op(&b->ops, 0);         // section
+        record(&b->w, MODULE_GLOBALVAR, &b->ops);
+    }
+
+    for (int i = 0; i < D_COUNT; i++) {
+        write_function_record(b, decls[i].name, (unsigned)decls[i].type, true, false);
+    }
+    for (size_t i = 0; i < b->prog->func_count; i++) {
+        write_function_record(b, func_name(b, (int)i),
+                              b->fn_type_base + (unsigned)b->prog->funcs[i].param_count, false, b->has_attrs);
+    }
+    if (b->emit_entry) {
+        write_function_record(b, "main", T_MAIN, false, b->has_attrs);
+    }
+}
+
+static void write_constants(Bitcode *b) {
+    BitWriter *w = &b->w;
+    Ops *o = &b->ops;
+
+    enter_block(w, BLOCK_CONSTANTS, 4);
+    op(o, T_I32);
+    record(w, CST_SETTYPE, o);
+    op(o, 0);
+    record(w, CST_INTEGER, o);
+    op(o, 1 << 1);              // sign-rotated
+    record(w, CST_INTEGER, o);
+    op(o, T_PTR);
+    record(w, CST_SETTYPE, o);
+    record(w, CST_NULL, o);
+
+    op(o, T_DOUBLE);
+    record(w, CST_SETTYPE, o);
+    for (size_t i = 0; i < b->double_count; i++) {
+        op(o, b->doubles[i]);
+        record(w, CST_FLOAT, o);
+    }
+
+    for (size_t i = 0; i < b->global_count; i++) {
+        op(o, b->string_type_base + i);
+        record(w, CST_SETTYPE, o);
+        if (b->globals[i].len == 0) {
+            record(w, CST_NULL, o);     // CSTRING needs at least one byte
+        } else {
+            for (size_t j = 0; j < b->globals[i].len; j++) op(o, (uint8_t)b->globals[i].bytes[j]);
+            record(w, CST_CSTRING, o);
+        }
+    }
+    end_block(w);
+}
+
+/*
+ * Function bodies
+ */
+
+// Operand relative to the instruction being written
+static uint64_t rel(Bitcode *b, unsigned id) {
+    return b->next - id;
+}
+
+// Write an instruction; returns its value id when it produces one
+static unsigned inst(Bitcode *b, unsigned code, bool has_value) {
+    record(&b->w, code, &b->ops);
+    return has_value ? b->next++ : 0;
+}
+
+static void terminate(Bitcode *b, unsigned code) {
+    inst(b, code, false);
+    b->open = false;
+}
+
+static unsigned load(Bitcode *b, int reg) {
+    op(&b->ops, rel(b, b->slot[reg]));
+    op(&b->ops, T_DOUBLE);
+    op(&b->ops, ALIGN_8);
+    op(&b->ops, 0);
+    return inst(b, INST_LOAD, true);
+}
+
+static void store(Bitcode *b, int reg, unsigned value) {
+    op(&b->ops, rel(b, b->slot[reg]));
+    op(&b->ops, rel(b, value));
+    op(&b->ops, ALIGN_8);
+    op(&b->ops, 0);
+    inst(b, INST_STORE, false);
+}
+
+static unsigned binop(Bitcode *b, unsigned lhs, unsigned rhs, unsigned opcode, bool fp) {
+    op(&b->ops, rel(b, lhs));
+    op(&b->ops, rel(b, rhs));
+    op(&b->ops, opcode);
+    if (fp && b->fmf) op(&b->ops, b->fmf);
+    return inst(b, INST_BINOP, true);
+}
+
+static unsigned compare(Bitcode *b, unsigned lhs, unsigned rhs, unsigned pred) {
+    op(&b->ops, rel(b, lhs));
+    op(&b->ops, rel(b, rhs));
+    op(&b->ops, pred);
+    return inst(b, INST_CMP2, true);
+}
+
+// i1 -> 0.0 / 1.0
+static unsigned to_double(Bitcode *b, unsigned flag) {
+    op(&b->ops, rel(b, flag));
+    op(&b->ops, T_DOUBLE);
+    op(&b->ops, CAST_UITOFP);
+    return inst(b, INST_CAST, true);
+}
+
+// fcmp one x, 0.0
+static unsigned truthy(Bitcode *b, unsigned value) {
+    return compare(b, value, double_id(b, 0.0), FCMP_ONE);
+}
+
+static unsigned call(Bitcode *b, unsigned type, unsigned callee, const unsigned *args, int nargs,
+                     bool has_value, bool fp) {
+    bool fast = fp && b->fmf;
+    op(&b->ops, 0);             // no call-site attributes
+    op(&b->ops, CALL_EXPLICIT_TYPE | (fast ? CALL_FMF : 0));
+    if (fast) op(&b->ops, b->fmf);
+    op(&b->ops, type);
+    op(&b->ops, rel(b, callee));
+    for (int i = 0; i < nargs; i++) op(&b->ops, rel(b, args[i]));
+    return inst(b, INST_CALL, has_value);
+}
+
+static unsigned call_decl(Bitcode *b, int decl, const unsigned *args, int nargs) {
+    int type = decls[decl].type;
+    bool fp = type == T_D_D || type == T_D_DD;
+    return call(b, (unsigned)type, b->decl_base + (unsigned)decl, args, nargs, type != T_V_P, fp);
+}
+
+// i8* to the first byte of global string `index`
+static unsigned string_ptr(Bitcode *b, int index) {
+    op(&b->ops, 1);             // inbounds
+    op(&b->ops, b->string_type_base + (unsigned)index);
+    op(&b->ops, rel(b, (unsigned)index));
+    op(&b->ops, rel(b, b->i32_zero));
+    op(&b->ops, rel(b, b->i32_zero));
+    return inst(b, INST_GEP, true);
+}
+
+static void printf_string(Bitcode *b, unsigned str) {
+    unsigned args[2] = {string_ptr(b, b->fmt_str), str};
+    call_decl(b, D_PRINTF, args, 2);
+}
+
+static void branch(Bitcode *b, int block) {
+    op(&b->ops, (uint64_t)block);
+    terminate(b, INST_BR);
+}
+
+static void cond_branch(Bitcode *b, unsigned cond, int if_true, int if_false) {
+    op(&b->ops, (uint64_t)if_true);
+    op(&b->ops, (uint64_t)if_false);
+    op(&b->ops, rel(b, cond));
+    terminate(b, INST_BR);
+}
+
+// Runtime string argument for bytecode string operand `index`
+static unsigned program_string(Bitcode *b, int index) {
+    return string_ptr(b, 2 + index);    // after .fmt_num and .fmt_str
+}
+
+/*
+ * Basic blocks: entry (allocas), then one per jump target or instruction
+ * after a jump, plus two per http op (print, continue)
+ */
+static int number_blocks(Bitcode *b) {
+    BcFunc *fn = b->fn;
+    bool *leader = calloc(fn->code_count + 1, sizeof(bool));
+    leader[0] = true;
+    for (size_t pc = 0; pc < fn->code_count; pc++) {
+        const BcInstr *ins = &fn->code[pc];
+        int target = -1;
+        switch (ins->op) {
+            case BC_JMP: target = ins->a; break;
+            case BC_JMPF: target = ins->b; break;
+            case BC_FORPREP: case BC_FORLOOP: target = ins->c; break;
+            case BC_RET: break;
+            default: continue;
+        }
+        bool falls_through = ins->op != BC_JMP && ins->op != BC_RET;
+        if (target >= (int)fn->code_count || (falls_through && pc + 1 >= fn->code_count)) {
+            free(leader);
+            return -1;
+        }
+        if (target >= 0) leader[target] = true;
+        leader[pc + 1] = true;
+    }
+
+    int blocks = 1;
+    for (size_t pc = 0; pc < fn->code_count; pc++) {
+        b->block_of[pc] = leader[pc] ? blocks++ : -1;
+        b->extra_block[pc] = -1;
+        if (fn->code[pc].op == BC_HTTP_GET || fn->code[pc].op == BC_HTTP_GETALL ||
+            fn->code[pc].op == BC_HTTP_POST) {
+            b->extra_block[pc] = blocks;
+            blocks += 2;
+        }
+    }
+    free(leader);
+    return blocks;
+}
+
+// Print and free an http response unless it is NULL
+static void print_response(Bitcode *b, size_t pc, unsigned response) {
+    int print_block = b->extra_block[pc], done_block = print_block + 1;
+    unsigned is_null = compare(b, response, b->null_ptr, ICMP_EQ);
+    cond_branch(b, is_null, done_block, print_block);
+
+    b->open = true;
+    printf_string(b, response);
+    call_decl(b, D_HTTP_FREE, &response, 1);
+    branch(b, done_block);
+    b->open = true;
+}
+
+static void lower(Bitcode *b, size_t pc) {
+    const BcInstr *ins = &b->fn->code[pc];
+    unsigned v, args[3];
+
+    switch (ins->op) {
+        case BC_CONST:
+            store(b, ins->a, double_id(b, b->fn->consts[ins->b]));
+            break;
+
+        case BC_MOV:
+            store(b, ins->a, load(b, ins->b));
+            break;
+
+        case BC_ADD: case BC_SUB: case BC_MUL: case BC_DIV: case BC_MOD: {
+            static const unsigned opcodes[] = {BINOP_ADD, BINOP_SUB, BINOP_MUL, BINOP_SDIV, BINOP_SREM};
+            unsigned lhs = load(b, ins->b), rhs = load(b, ins->c);
+            store(b, ins->a, binop(b, lhs, rhs, opcodes[ins->op - BC_ADD], true));
+            break;
+        }
+
+        case BC_EQ: case BC_NEQ: case BC_LT: case BC_GT: case BC_LTE: case BC_GTE: {
+            static const unsigned preds[] = {FCMP_OEQ, FCMP_ONE, FCMP_OLT, FCMP_OGT, FCMP_OLE, FCMP_OGE};
+            unsigned lhs = load(b, ins->b), rhs = load(b, ins->c);
+            store(b, ins->a, to_double(b, compare(b, lhs, rhs, preds[ins->op - BC_EQ])));
+            break;
+        }
+
+        case BC_AND: case BC_OR: {
+            unsigned lhs = truthy(b, load(b, ins->b));
+            unsigned rhs = truthy(b, load(b, ins->c));
+            v = binop(b, lhs, rhs, ins->op == BC_AND ? BINOP_AND : BINOP_OR, false);
+            store(b, ins->a, to_double(b, v));
+            break;
+        }
+
+        case BC_NOT:
+            v = compare(b, load(b, ins->b), double_id(b, 0.0), FCMP_OEQ);
+            store(b, ins->a, to_double(b, v));
+            break;
+
+        case BC_NEG:
+            v = load(b, ins->b);
+            store(b, ins->a, binop(b, double_id(b, 0.0), v, BINOP_SUB, true));
+            break;
+
+        case BC_ABS: case BC_SQRT: case BC_FLOOR: case BC_CEIL: case BC_SIN: case BC_COS:
+            args[0] = load(b, ins->b);
+            store(b, ins->a, call_decl(b, D_FABS + (ins->op - BC_ABS), args, 1));
+            break;
+
+        case BC_MIN: case BC_MAX: case BC_POW: {
+            int decl = ins->op == BC_MIN ? D_MINNUM : ins->op == BC_MAX ? D_MAXNUM : D_POW;
+            args[0] = load(b, ins->b);
+            args[1] = load(b, ins->c);
+            store(b, ins->a, call_decl(b, decl, args, 2));
+            break;
+        }
+
+        case BC_JMP:
+            branch(b, b->block_of[ins->a]);
+            break;
+
+        case BC_JMPF:
+            v = truthy(b, load(b, ins->a));
+            cond_branch(b, v, b->block_of[pc + 1], b->block_of[ins->b]);
+            break;
+
+        case BC_FORPREP:
+            v = compare(b, load(b, ins->a), load(b, ins->b), FCMP_OLE);
+            cond_branch(b, v, b->block_of[pc + 1], b->block_of[ins->c]);
+            break;
+
+        case BC_FORLOOP:
+            v = binop(b, load(b, ins->a), double_id(b, 1.0), BINOP_ADD, true);
+            store(b, ins->a, v);
+            v = compare(b, v, load(b, ins->b), FCMP_OLE);
+            cond_branch(b, v, b->block_of[ins->c], b->block_of[pc + 1]);
+            break;
+
+        case BC_CALL: {
+            BcFunc *callee = &b->prog->funcs[ins->b];
+            unsigned *call_args = malloc(sizeof(unsigned) * (callee->param_count + 1));
+            for (int i = 0; i < callee->param_count; i++) {
+                call_args[i] = load(b, ins->c + i);
+            }
+            v = call(b, b->fn_type_base + (unsigned)callee->param_count, b->func_base + ins->b,
+                     call_args, callee->param_count, true, false);
+            store(b, ins->a, v);
+            free(call_args);
+            break;
+        }
+
+        case BC_RET:
+            op(&b->ops, rel(b, load(b, ins->a)));
+            terminate(b, INST_RET);
+            break;
+
+        case BC_OUT_NUM:
+            args[0] = string_ptr(b, b->fmt_num);
+            args[1] = load(b, ins->a);
+            call_decl(b, D_PRINTF, args, 2);
+            break;
+
+        case BC_OUT_STR:
+            printf_string(b, program_string(b, ins->a));
+            break;
+
+        case BC_HTTP_GET: case BC_HTTP_GETALL:
+            args[0] = program_string(b, ins->a);
+            print_response(b, pc, call_decl(b, ins->op == BC_HTTP_GET ? D_HTTP_GET : D_HTTP_GETALL, args, 1));
+            break;
+
+        case BC_HTTP_POST:
+            args[0] = program_string(b, ins->a);
+            args[1] = program_string(b, ins->b);
+            print_response(b, pc, call_decl(b, D_HTTP_POST, args, 2));
+            break;
+
+        case BC_MCP_TOOLS: case BC_MCP_INIT:
+            args[0] = program_string(b, ins->a);
+            v = call_decl(b, ins->op == BC_MCP_TOOLS ? D_MCP_LIST : D_MCP_INIT, args, 1);
+            call_decl(b, D_MCP_FREE, &v, 1);
+            break;
+
+        case BC_MCP_SEND:
+            args[0] = program_string(b, ins->a);
+            args[1] = program_string(b, ins->b);
+            args[2] = program_string(b, ins->c);
+            v = call_decl(b, D_MCP_SEND, args, 3);
+            call_decl(b, D_MCP_FREE, &v, 1);
+            break;
+
+        case BC_LLM_CLAUDE:
+            args[0] = program_string(b, ins->a);
+            v = call_decl(b, D_LLM_CLAUDE, args, 1);
+            call_decl(b, D_LLM_FREE, &v, 1);
+            break;
+
+        case BC_LLM_SYSTEM:
+            args[0] = program_string(b, ins->a);
+            args[1] = program_string(b, ins->b);
+            v = call_decl(b, D_LLM_SYSTEM, args, 2);
+            call_decl(b, D_LLM_FREE, &v, 1);
+            break;
+
+        default:
+            b->error = nerd_strdup("Unsupported bytecode instruction in bitcode writer");
+            break;
+    }
+}
+
+static void write_function(Bitcode *b, int index) {
+    BcFunc *fn = &b->prog->funcs[index];
+    Ops *o = &b->ops;
+    b->fn = fn;
+    b->block_of = malloc(sizeof(int) * (fn->code_count + 1));
+    b->extra_block = malloc(sizeof(int) * (fn->code_count + 1));
+    b->slot = malloc(sizeof(unsigned) * (fn->reg_count + 1));
+
+    int blocks = number_blocks(b);
+    if (blocks < 0) {
+        b->error = nerd_strdup("Jump past the end of a function in bitcode writer");
+    } else {
+        enter_block(&b->w, BLOCK_FUNCTION, 4);
+        op(o, (uint64_t)blocks);
+        record(&b->w, INST_DECLAREBLOCKS, o);
+
+        // Arguments follow the module-level values
+        b->next = b->value_count + (unsigned)fn->param_count;
+        for (int r = 0; r < fn->reg_count; r++) {
+            op(o, T_DOUBLE);
+            op(o, T_I32);
+            op(o, b->i32_one);  // absolute id
+            op(o, ALIGN_8 | ALLOCA_EXPLICIT_TYPE);
+            b->slot[r] = inst(b, INST_ALLOCA, true);
+        }
+        for (int r = 0; r < fn->param_count; r++) {
+            store(b, r, b->value_count + (unsigned)r);
+        }
+        b->open = true;
+
+        for (size_t pc = 0; pc < fn->code_count && !b->error; pc++) {
+            if (b->block_of[pc] >= 0) {
+                if (b->open) branch(b, b->block_of[pc]);
+                b->open = true;
+            }
+            if (b->open) lower(b, pc);
+        }
+        end_block(&b->w);
+    }
+
+    free(b->block_of);
+    free(b->extra_block);
+    free(b->slot);
+}
+
+/*
+ * i32 main(): call nerd_main, or the 5/3/1 harness of codegen.c
+ */
+static void write_entry(Bitcode *b) {
+    BcProgram *prog = b->prog;
+    Ops *o = &b->ops;
+
+    enter_block(&b->w, BLOCK_FUNCTION, 4);
+    op(o, 1);
+    record(&b->w, INST_DECLAREBLOCKS, o);
+    b->next = b->value_count;
+
+    if (prog->main_index >= 0) {
+        call(b, b->fn_type_base + (unsigned)prog->funcs[prog->main_index].param_count,
+             b->func_base + (unsigned)prog->main_index, NULL, 0, true, false);
+    } else {
+        for (size_t i = 0; i < prog->func_count; i++) {
+            BcFunc *fn = &prog->funcs[i];
+            if (fn->specialized || fn->imported) continue;
+
+            unsigned *call_args = malloc(sizeof(unsigned) * (fn->param_count + 1));
+            for (int j = 0; j < fn->param_count; j++) {
+                call_args[j] = double_id(b, j == 0 ? 5.0 : j == 1 ? 3.0 : 1.0);
+            }
+            unsigned result = call(b, b->fn_type_base + (unsigned)fn->param_count, b->func_base + (unsigned)i,
+                                   call_args, fn->param_count, true, false);
+            free(call_args);
+
+            unsigned args[3];
+            args[0] = string_ptr(b, b->fmt_entry);
+            args[1] = string_ptr(b, b->entry_name[i]);
+            args[2] = result;
+            call(b, T_PRINTF, b->decl_base + D_PRINTF, args, 3, true, false);
+        }
+    }
+    op(o, rel(b, b->i32_zero));
+    terminate(b, INST_RET);
+    end_block(&b->w);
+}
+
+static void write_strtab(Bitcode *b) {
+    BitWriter *w = &b->w;
+    enter_block(w, BLOCK_STRTAB, 3);
+
+    // Abbreviation: [literal STRTAB_BLOB, blob]
+    emit(w, ABBREV_DEFINE, w->width);
+    emit_vbr(w, 2, 5);
+    emit(w, 1, 1);
+    emit_vbr(w, STRTAB_BLOB, 8);
+    emit(w, 0, 1);
+    emit(w, 5, 3);              // blob encoding
+
+    emit(w, ABBREV_FIRST_USER, w->width);
+    emit_vbr(w, b->strtab.size, 6);
+    align32(w);
+    for (size_t i = 0; i < b->strtab.size; i++) {
+        emit(w, b->strtab.data[i], 8);
+    }
+    align32(w);
+    end_block(w);
+}
+
+/*
+ * Write `prog` as an LLVM bitcode module
+ */
+static bool write_module(Bitcode *b, NerdContext *ctx, FILE *out) {
+    TargetInfo target = {0};
+    if (ctx->march && !target_host(ctx->march, &target)) {
+        ctx->error_msg = nerd_strdup("Unsupported host or CPU name for --march");
+        return false;
+    }
+    b->emit_entry = ctx->emit_entry;
+    b->fmf = ctx->fast_math ? FMF_FAST : 0;
+    b->has_attrs = ctx->march != NULL;
+    layout_values(b);
+
+    BitWriter *w = &b->w;
+    Ops *o = &b->ops;
+    w->width = 2;
+    emit(w, 'B', 8);
+    emit(w, 'C', 8);
+    emit(w, 0x0, 4);
+    emit(w, 0xC, 4);
+    emit(w, 0xE, 4);
+    emit(w, 0xD, 4);
+
+    enter_block(w, BLOCK_MODULE, 3);
+    op(o, 2);                   // names live in the string table
+    record(w, MODULE_VERSION, o);
+    if (b->has_attrs) write_attributes(b, &target);
+    write_types(b);
+    if (ctx->march) {
+        op_chars(o, target.triple);
+        record(w, MODULE_TRIPLE, o);
+        if (target.datalayout) {
+            op_chars(o, target.datalayout);
+            record(w, MODULE_DATALAYOUT, o);
+        }
+    }
+    write_globals(b);
+    write_constants(b);
+    for (size_t i = 0; i < b->prog->func_count && !b->error; i++) {
+        write_function(b, (int)i);
+    }
+    if (b->emit_entry && !b->error) write_entry(b);
+    end_block(w);
+    write_strtab(b);
+
+    if (b->error) {
+        ctx->error_msg = b->error;
+        b->error = NULL;
+        return false;
+    }
+    if (fwrite(w->data, 1, w->size, out) != w->size) {
+        ctx->error_msg = nerd_strdup("Failed to write bitcode");
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Generate LLVM bitcode for program into an open stream
+ */
+bool codegen_bitcode_stream(NerdContext *ctx, FILE *out) {
+    if (!ctx->no_specialize) {
+        specialize_program(ctx->ast);
+    }
+    BcProgram *prog = bc_compile(ctx->ast);
+    if (!prog) {
+        ctx->error_msg = nerd_strdup("Failed to lower program to bytecode");
+        return false;
+    }
+
+    Bitcode b = {0};
+    b.prog = prog;
+    bool ok = write_module(&b, ctx, out);
+
+    free(b.w.data);
+    free(b.ops.v);
+    free(b.globals);
+    free(b.entry_name);
+    free(b.doubles);
+    free(b.strtab.data);
+    free(b.error);
+    bc_free(prog);
+    return ok;
+}
+
+/*
+ * Generate LLVM bitcode for program
+ */
+bool codegen_bitcode(NerdContext *ctx, const char *output_path) {
+    FILE *out = fopen(output_path, "wb");
+    if (!out) {
+        ctx->error_msg = nerd_strdup("Failed to open output file");
+        return false;
+    }
+
+    bool ok = codegen_bitcode_stream(ctx, out);
+    if (fclose(out) != 0 && ok) {
+        ctx->error_msg = nerd_strdup("Failed to write output file");
+        ok = false;
+    }
+    return ok;
+}
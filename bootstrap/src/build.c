@@ -0,0 +1,792 @@
+/*
+ * NERD Build - Native executables from split modules
+ *
+ * `nerd build` caches one object per function. A function's key hashes its
+ * AST (after specialization), the name and arity of every function it calls
+ * (its `declare`s), the flags and the compiler. Only functions whose key
+ * missed are generated, each as a module of its own. They are compiled in
+ * -j batches (several inputs per clang process) and the objects are stored
+ * in the cache. The entry point is regenerated every time, then everything
+ * is linked. Editing one function recompiles that function, plus its
+ * callers if its arity changed.
+ *
+ * A manifest per output path remembers each function's body hash and key,
+ * so --explain-rebuild can say why a function missed.
+ *
+ * Imported modules (module.c) are compiled whole, one cached object per
+ * source file, declaring what they call in the modules they import.
+ *
+ * With --no-cache (or no cache directory) codegen instead splits the
+ * program into -j modules of about equal size, one clang each.
+ *
+ * Splitting hides callees from the optimizer, so calls across modules are
+ * not inlined. With --thinlto the objects carry ThinLTO summaries instead
+ * of machine code and the linker imports and inlines across modules, still
+ * in parallel.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include "nerd.h"
+
+#define MAX_BUILD_JOBS 64
+#define MANIFEST_HEADER "nerd-build 1"
+
+/*
+ * Write a module to `path`
+ */
+static bool write_module(const IRBuf *module, const char *path) {
+    FILE *f = fopen(path, "w");
+    if (!f) {
+        fprintf(stderr, "Error: Cannot write '%s'\n", path);
+        return false;
+    }
+    bool ok = irbuf_write(module, f);
+    if (fclose(f) != 0) ok = false;
+    if (!ok) fprintf(stderr, "Error: Cannot write '%s'\n", path);
+    return ok;
+}
+
+/*
+ * Start `clang -c` on one module
+ */
+static bool spawn_compile(const BuildOptions *opts, const char *ll_path, const char *obj_path, int *pid) {
+    char *argv[16];
+    int n = 0;
+    argv[n++] = "clang";
+    argv[n++] = "-c";
+    argv[n++] = "-w";
+    if (opts->opt_level) argv[n++] = (char *)opts->opt_level;
+    if (opts->thinlto) argv[n++] = "-flto=thin";
+    argv[n++] = "-x";
+    argv[n++] = "ir";
+    argv[n++] = (char *)ll_path;
+    argv[n++] = "-o";
+    argv[n++] = (char *)obj_path;
+    argv[n] = NULL;
+    return toolchain_spawn(argv, NULL, pid);
+}
+
+/*
+ * Link the objects and runtime into opts->output. Large object lists go
+ * through a response file in `work_dir`.
+ */
+static bool link_objects(const BuildOptions *opts, char **objs, size_t count, int jobs,
+                         const char *work_dir) {
+    char rsp_arg[4096 + 16] = "";
+    if (count > 64) {
+        snprintf(rsp_arg, sizeof(rsp_arg), "%s/objects.rsp", work_dir);
+        FILE *rsp = fopen(rsp_arg, "w");
+        if (!rsp) {
+            fprintf(stderr, "Error: Cannot write '%s'\n", rsp_arg);
+            return false;
+        }
+        for (size_t i = 0; i < count; i++) {
+            fprintf(rsp, "%s\n", objs[i]);
+        }
+        fclose(rsp);
+        memmove(rsp_arg + 1, rsp_arg, strlen(rsp_arg) + 1);
+        rsp_arg[0] = '@';
+    }
+
+    char **argv = malloc(sizeof(char *) * (count + opts->link_count + 16));
+    if (!argv) return false;
+
+    char lto_jobs[32];
+    snprintf(lto_jobs, sizeof(lto_jobs), "-flto-jobs=%d", jobs);
+
+    int n = 0;
+    argv[n++] = "clang";
+    argv[n++] = "-w";
+    if (opts->opt_level) argv[n++] = (char *)opts->opt_level;
+    if (opts->thinlto) {
+        argv[n++] = "-flto=thin";
+        argv[n++] = lto_jobs;
+        argv[n++] = "-fuse-ld=lld";
+    }
+    argv[n++] = "-o";
+    argv[n++] = (char *)opts->output;
+    if (rsp_arg[0]) {
+        argv[n++] = rsp_arg;
+    } else {
+        for (size_t i = 0; i < count; i++) {
+            argv[n++] = objs[i];
+        }
+    }
+    for (size_t i = 0; i < opts->link_count; i++) {
+        argv[n++] = (char *)opts->link_args[i];
+    }
+    argv[n++] = "-lm";
+    argv[n] = NULL;
+
+    int pid;
+    bool ok = toolchain_spawn(argv, NULL, &pid) && toolchain_wait(pid) == 0;
+    if (!ok) fprintf(stderr, "Error: Linking failed\n");
+    free(argv);
+    return ok;
+}
+
+static int build_jobs(const BuildOptions *opts) {
+    int jobs = opts->jobs;
+    if (jobs <= 0) jobs = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (jobs < 1) jobs = 1;
+    if (jobs > MAX_BUILD_JOBS) jobs = MAX_BUILD_JOBS;
+    return jobs;
+}
+
+/*
+ * Uncached build: split codegen, one clang per module, one link. Imported
+ * modules are merged in and split like the rest of the program.
+ */
+static bool build_split(NerdContext *ctx, const BuildOptions *opts, int jobs) {
+    if (opts->modules && !module_merge(opts->modules, ctx->ast)) {
+        return false;
+    }
+
+    IRBuf *modules = calloc((size_t)jobs, sizeof(IRBuf));
+    char **objs = calloc((size_t)jobs, sizeof(char *));
+    int *pids = calloc((size_t)jobs, sizeof(int));
+    char *tmp_dir = toolchain_tmpdir();
+    int count = 0;
+    bool ok = modules && objs && pids && tmp_dir;
+
+    if (ok && !codegen_llvm_split(ctx, jobs, modules, &count)) {
+        fprintf(stderr, "Error: %s\n", ctx->error_msg ? ctx->error_msg : "code generation failed");
+        ok = false;
+    }
+
+    // Start each compile as soon as its module is on disk
+    int started = 0;
+    for (int i = 0; ok && i < count; i++) {
+        size_t len = strlen(tmp_dir) + 32;
+        char *ll_path = malloc(len);
+        objs[i] = malloc(len);
+        if (!ll_path || !objs[i]) {
+            free(ll_path);
+            ok = false;
+            break;
+        }
+        snprintf(ll_path, len, "%s/part%d.ll", tmp_dir, i);
+        snprintf(objs[i], len, "%s/part%d.o", tmp_dir, i);
+
+        ok = write_module(&modules[i], ll_path) &&
+             spawn_compile(opts, ll_path, objs[i], &pids[i]);
+        irbuf_free(&modules[i]);
+        free(ll_path);
+        if (ok) started++;
+    }
+
+    bool compiled = true;
+    for (int i = 0; i < started; i++) {
+        if (toolchain_wait(pids[i]) != 0) compiled = false;
+    }
+    if (ok && !compiled) {
+        fprintf(stderr, "Error: clang compilation failed (re-run with `nerd compile` to inspect the IR)\n");
+        ok = false;
+    }
+
+    if (ok) {
+        ok = link_objects(opts, objs, (size_t)count, jobs, tmp_dir);
+    }
+
+    for (int i = 0; i < count; i++) {
+        irbuf_free(&modules[i]);
+        free(objs[i]);
+    }
+    if (tmp_dir) {
+        toolchain_rmdir(tmp_dir);
+        free(tmp_dir);
+    }
+    free(modules);
+    free(objs);
+    free(pids);
+    return ok;
+}
+
+/*
+ * Function name -> arity, sorted for bsearch
+ */
+typedef struct {
+    const char *name;
+    size_t arity;
+} Signature;
+
+static int signature_cmp(const void *a, const void *b) {
+    return strcmp(((const Signature *)a)->name, ((const Signature *)b)->name);
+}
+
+static const Signature *find_signature(const Signature *sigs, size_t count, const char *name) {
+    Signature probe = { .name = name };
+    return bsearch(&probe, sigs, count, sizeof(Signature), signature_cmp);
+}
+
+/*
+ * Function hashing. `body` gets the AST itself; `callees` gets the name and
+ * arity of every user function called.
+ */
+typedef struct {
+    CacheKey body;
+    CacheKey callees;
+    const Signature *sigs;
+    size_t sig_count;
+} FuncHash;
+
+static void hash_node(FuncHash *h, ASTNode *node);
+
+static void hash_int(CacheKey *k, long long v) {
+    cache_key_add(k, &v, sizeof(v));
+}
+
+static void hash_list(FuncHash *h, ASTList *list) {
+    hash_int(&h->body, (long long)list->count);
+    for (size_t i = 0; i < list->count; i++) {
+        hash_node(h, list->nodes[i]);
+    }
+}
+
+static void hash_node(FuncHash *h, ASTNode *node) {
+    CacheKey *k = &h->body;
+    hash_int(k, node ? (long long)node->type : -1);
+    if (!node) return;
+
+    switch (node->type) {
+        case NODE_FUNC_DEF:
+            cache_key_add_str(k, node->data.func_def.name);
+            hash_list(h, &node->data.func_def.params);
+            hash_list(h, &node->data.func_def.body);
+            break;
+        case NODE_PARAM:
+            cache_key_add_str(k, node->data.param.name);
+            break;
+        case NODE_RETURN:
+            hash_int(k, node->data.ret.variant);
+            hash_node(h, node->data.ret.value);
+            break;
+        case NODE_IF:
+            hash_node(h, node->data.if_stmt.condition);
+            hash_node(h, node->data.if_stmt.then_stmt);
+            hash_node(h, node->data.if_stmt.else_stmt);
+            break;
+        case NODE_OUT:
+            hash_node(h, node->data.out.value);
+            break;
+        case NODE_REPEAT:
+            hash_node(h, node->data.repeat.count);
+            cache_key_add_str(k, node->data.repeat.var_name);
+            hash_list(h, &node->data.repeat.body);
+            break;
+        case NODE_WHILE:
+            hash_node(h, node->data.while_loop.condition);
+            hash_list(h, &node->data.while_loop.body);
+            break;
+        case NODE_INC:
+            cache_key_add_str(k, node->data.inc.var_name);
+            hash_node(h, node->data.inc.amount);
+            break;
+        case NODE_DEC:
+            cache_key_add_str(k, node->data.dec.var_name);
+            hash_node(h, node->data.dec.amount);
+            break;
+        case NODE_LET:
+            cache_key_add_str(k, node->data.let.name);
+            hash_node(h, node->data.let.value);
+            break;
+        case NODE_EXPR_STMT:
+            hash_node(h, node->data.expr_stmt.expr);
+            break;
+        case NODE_BINOP:
+            cache_key_add_str(k, node->data.binop.op);
+            hash_node(h, node->data.binop.left);
+            hash_node(h, node->data.binop.right);
+            break;
+        case NODE_UNARYOP:
+            cache_key_add_str(k, node->data.unaryop.op);
+            hash_node(h, node->data.unaryop.operand);
+            break;
+        case NODE_CALL: {
+            cache_key_add_str(k, node->data.call.module);
+            cache_key_add_str(k, node->data.call.func);
+            hash_list(h, &node->data.call.args);
+            if (!node->data.call.module) {
+                const Signature *sig = find_signature(h->sigs, h->sig_count, node->data.call.func);
+                cache_key_add_str(&h->callees, node->data.call.func);
+                hash_int(&h->callees, sig ? (long long)sig->arity : -1);
+            }
+            break;
+        }
+        case NODE_NUM:
+            cache_key_add(k, &node->data.num.value, sizeof(double));
+            break;
+        case NODE_STR:
+            cache_key_add_str(k, node->data.str.value);
+            break;
+        case NODE_BOOL:
+            hash_int(k, node->data.boolean.value);
+            break;
+        case NODE_VAR:
+            cache_key_add_str(k, node->data.var.name);
+            break;
+        case NODE_POSITIONAL:
+            hash_int(k, node->data.positional.index);
+            break;
+        default:
+            break;
+    }
+}
+
+/*
+ * Everything besides the function itself that goes into its object
+ */
+static void base_key(CacheKey *key, NerdContext *ctx, const BuildOptions *opts) {
+    cache_key_init(key);
+    cache_key_add_str(key, "function-object");
+
+    char exe[1024];
+    if (toolchain_exe_path(exe, sizeof(exe))) {
+        cache_key_add_file(key, exe);
+    }
+    cache_key_add_str(key, opts->opt_level);
+    cache_key_add_str(key, opts->thinlto ? "thinlto" : "");
+    cache_key_add_str(key, ctx->fast_math ? "fast-math" : "");
+    cache_key_add_str(key, ctx->march);
+
+    TargetInfo target;
+    if (ctx->march && target_host(ctx->march, &target)) {
+        cache_key_add_str(key, target.cpu);
+        cache_key_add_str(key, target.features);
+    }
+}
+
+/*
+ * Previous build of the same output: function name, body hash, key
+ */
+typedef struct {
+    char *name;
+    CacheKey body;
+    CacheKey key;
+} ManifestEntry;
+
+typedef struct {
+    ManifestEntry *entries;
+    size_t count;
+    bool found;
+} Manifest;
+
+static int manifest_cmp(const void *a, const void *b) {
+    return strcmp(((const ManifestEntry *)a)->name, ((const ManifestEntry *)b)->name);
+}
+
+static bool manifest_path(const BuildOptions *opts, char *path, size_t size) {
+    char cwd[4096] = "";
+    if (opts->output[0] != '/' && !getcwd(cwd, sizeof(cwd))) return false;
+
+    CacheKey key;
+    cache_key_init(&key);
+    cache_key_add_str(&key, "build-manifest");
+    cache_key_add_str(&key, cwd);
+    cache_key_add_str(&key, opts->output);
+    return cache_meta_path(&key, ".manifest", path, size);
+}
+
+static void manifest_load(Manifest *m, const BuildOptions *opts) {
+    memset(m, 0, sizeof(*m));
+    char path[4096];
+    if (!manifest_path(opts, path, sizeof(path))) return;
+    FILE *f = fopen(path, "r");
+    if (!f) return;
+
+    char line[4096];
+    if (!fgets(line, sizeof(line), f) || strncmp(line, MANIFEST_HEADER, strlen(MANIFEST_HEADER)) != 0) {
+        fclose(f);
+        return;
+    }
+    m->found = true;
+
+    size_t capacity = 0;
+    while (fgets(line, sizeof(line), f)) {
+        unsigned long long ba, bb, ka, kb;
+        int name_at = 0;
+        if (sscanf(line, "%16llx%16llx %16llx%16llx %n", &ba, &bb, &ka, &kb, &name_at) != 4 || !name_at) continue;
+        line[strcspn(line, "\n")] = '\0';
+
+        if (m->count >= capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            ManifestEntry *grown = realloc(m->entries, sizeof(ManifestEntry) * capacity);
+            if (!grown) break;
+            m->entries = grown;
+        }
+        ManifestEntry *e = &m->entries[m->count++];
+        e->name = nerd_strdup(line + name_at);
+        e->body.a = ba;
+        e->body.b = bb;
+        e->key.a = ka;
+        e->key.b = kb;
+    }
+    fclose(f);
+    qsort(m->entries, m->count, sizeof(ManifestEntry), manifest_cmp);
+}
+
+static void manifest_save(const BuildOptions *opts, char **names, size_t count,
+                          const CacheKey *bodies, const CacheKey *keys) {
+    char path[4096];
+    if (!manifest_path(opts, path, sizeof(path))) return;
+    FILE *f = fopen(path, "w");
+    if (!f) return;
+
+    fprintf(f, "%s\n", MANIFEST_HEADER);
+    for (size_t i = 0; i < count; i++) {
+        fprintf(f, "%016llx%016llx %016llx%016llx %s\n",
+                (unsigned long long)bodies[i].a, (unsigned long long)bodies[i].b,
+                (unsigned long long)keys[i].a, (unsigned long long)keys[i].b,
+                names[i]);
+    }
+    fclose(f);
+}
+
+static void manifest_free(Manifest *m) {
+    for (size_t i = 0; i < m->count; i++) {
+        free(m->entries[i].name);
+    }
+    free(m->entries);
+}
+
+static bool key_eq(const CacheKey *a, const CacheKey *b) {
+    return a->a == b->a && a->b == b->b;
+}
+
+/*
+ * Why a function (or imported module) missed the cache, judged against the
+ * previous build
+ */
+static const char *miss_reason(const Manifest *m, const char *name, bool module,
+                               const CacheKey *body, const CacheKey *key) {
+    if (!m->found) return "no previous build";
+    ManifestEntry probe = { .name = (char *)name };
+    const ManifestEntry *e = bsearch(&probe, m->entries, m->count, sizeof(ManifestEntry), manifest_cmp);
+    if (!e) return module ? "new import" : "new function";
+    if (!key_eq(&e->body, body)) return module ? "source changed" : "body changed";
+    if (!key_eq(&e->key, key)) {
+        return module ? "imported signature or build flags changed"
+                      : "callee signature or build flags changed";
+    }
+    return "object evicted from cache";
+}
+
+/*
+ * Name of unit `u` in the work directory: root functions are f<i>, imported
+ * modules m<i>
+ */
+static void unit_file(size_t u, size_t n, const char *ext, char *buf, size_t size) {
+    if (u < n) snprintf(buf, size, "f%zu%s", u, ext);
+    else snprintf(buf, size, "m%zu%s", u - n, ext);
+}
+
+/*
+ * Incremental build: per-function objects from the cache, misses compiled
+ * in batches inside `work_dir`. It is in the cache directory, so hits are
+ * hard-linked in and finished objects hard-linked out: the link step only
+ * reads work_dir, which eviction never touches. Each imported module is
+ * one more unit: its object is keyed on its source and the signatures of
+ * the modules it imports, so editing a module's function bodies rebuilds
+ * only that module.
+ */
+static bool build_cached(NerdContext *ctx, const BuildOptions *opts, int jobs, const char *work_dir) {
+    // Hash the functions as codegen will see them
+    if (!ctx->no_specialize) {
+        specialize_program(ctx->ast);
+    }
+    ASTList *funcs = &ctx->ast->data.program.functions;
+    size_t n = funcs->count;
+    ModuleGraph *graph = opts->modules;
+    size_t module_count = graph ? graph->count : 0;
+    size_t total = n + module_count;
+
+    // Imported functions are declared, and linked from the modules' objects
+    size_t extern_count = 0;
+    ModuleSig *externs = graph ? module_externs(graph, NULL, &extern_count) : NULL;
+    NerdContext gen = *ctx;
+    gen.no_specialize = true;
+    gen.externs = externs;
+    gen.extern_count = extern_count;
+
+    Signature *sigs = malloc(sizeof(Signature) * (n + extern_count + 1));
+    CacheKey *bodies = malloc(sizeof(CacheKey) * (total ? total : 1));
+    CacheKey *keys = malloc(sizeof(CacheKey) * (total ? total : 1));
+    char **names = calloc(total ? total : 1, sizeof(char *));
+    bool *wanted = calloc(total ? total : 1, sizeof(bool));
+    bool *visible = calloc(module_count ? module_count : 1, sizeof(bool));
+    char **objs = calloc(total + 1, sizeof(char *));
+    IRBuf *modules = calloc(total ? total : 1, sizeof(IRBuf));
+    size_t *misses = malloc(sizeof(size_t) * (total ? total : 1));
+    int *pids = calloc((size_t)jobs, sizeof(int));
+    IRBuf entry;
+    irbuf_init(&entry);
+    bool ok = sigs && bodies && keys && names && wanted && visible && objs && modules && misses && pids &&
+              (externs || !graph);
+    size_t miss_count = 0, module_misses = 0;
+
+    if (ok) {
+        for (size_t i = 0; i < n; i++) {
+            sigs[i].name = funcs->nodes[i]->data.func_def.name;
+            sigs[i].arity = funcs->nodes[i]->data.func_def.params.count;
+        }
+        for (size_t i = 0; i < extern_count; i++) {
+            sigs[n + i].name = externs[i].name;
+            sigs[n + i].arity = externs[i].arity;
+        }
+        qsort(sigs, n + extern_count, sizeof(Signature), signature_cmp);
+
+        CacheKey base;
+        base_key(&base, ctx, opts);
+
+        Manifest manifest;
+        manifest_load(&manifest, opts);
+
+        for (size_t i = 0; i < n && ok; i++) {
+            ASTNode *func = funcs->nodes[i];
+            FuncHash h = { .sigs = sigs, .sig_count = n + extern_count };
+            cache_key_init(&h.body);
+            cache_key_init(&h.callees);
+            hash_node(&h, func);
+
+            names[i] = nerd_strdup(func->data.func_def.name);
+            bodies[i] = h.body;
+            keys[i] = base;
+            cache_key_add(&keys[i], &h.body, sizeof(CacheKey));
+            cache_key_add(&keys[i], &h.callees, sizeof(CacheKey));
+            profile_key(ctx->profile, names[i], &keys[i]);
+
+            char path[4096];
+            if (cache_lookup_object(&keys[i], work_dir, path, sizeof(path))) {
+                objs[i + 1] = nerd_strdup(path);
+                continue;
+            }
+            wanted[i] = true;
+            misses[miss_count++] = i;
+            if (opts->explain) {
+                printf("rebuild %s: %s\n", names[i],
+                       miss_reason(&manifest, names[i], false, &bodies[i], &keys[i]));
+            }
+        }
+
+        for (size_t i = 0; i < module_count && ok; i++) {
+            Module *m = &graph->modules[i];
+            size_t u = n + i;
+            size_t len = strlen(m->path) + 8;
+            names[u] = malloc(len);
+            if (!names[u]) {
+                ok = false;
+                break;
+            }
+            snprintf(names[u], len, "module:%s", m->path);
+
+            bodies[u] = m->source_key;
+            keys[u] = base;
+            cache_key_add_str(&keys[u], "module");
+            cache_key_add(&keys[u], &m->source_key, sizeof(CacheKey));
+            for (size_t e = 0; e < m->export_count; e++) {
+                profile_key(ctx->profile, m->exports[e].name, &keys[u]);
+            }
+            memset(visible, 0, sizeof(bool) * module_count);
+            module_visible(graph, i, visible);
+            for (size_t d = 0; d < module_count; d++) {
+                if (!visible[d]) continue;
+                for (size_t e = 0; e < graph->modules[d].export_count; e++) {
+                    cache_key_add_str(&keys[u], graph->modules[d].exports[e].name);
+                    hash_int(&keys[u], (long long)graph->modules[d].exports[e].arity);
+                }
+            }
+
+            char path[4096];
+            if (cache_lookup_object(&keys[u], work_dir, path, sizeof(path))) {
+                objs[u + 1] = nerd_strdup(path);
+                continue;
+            }
+            wanted[u] = true;
+            misses[miss_count++] = u;
+            module_misses++;
+            if (opts->explain) {
+                printf("rebuild module %s: %s\n", m->name,
+                       miss_reason(&manifest, names[u], true, &bodies[u], &keys[u]));
+            }
+        }
+        manifest_free(&manifest);
+        if (opts->explain) {
+            printf("%zu of %zu function%s", miss_count - module_misses, n, n == 1 ? "" : "s");
+            if (module_count > 0) {
+                printf(" and %zu of %zu module%s", module_misses, module_count, module_count == 1 ? "" : "s");
+            }
+            printf(" rebuilt\n");
+        }
+    }
+
+    if (ok && !codegen_llvm_functions(&gen, wanted, modules, &entry)) {
+        fprintf(stderr, "Error: %s\n", gen.error_msg ? gen.error_msg : "code generation failed");
+        free(gen.error_msg);
+        ok = false;
+    }
+
+    // Missed modules: one LLVM module each, specialized within the module
+    for (size_t i = 0; ok && i < module_count; i++) {
+        Module *m = &graph->modules[i];
+        if (!wanted[n + i]) continue;
+        if (!module_parse(m)) {
+            ok = false;
+            break;
+        }
+
+        memset(visible, 0, sizeof(bool) * module_count);
+        module_visible(graph, i, visible);
+        NerdContext mod = {0};
+        mod.filename = m->path;
+        mod.source = m->source;
+        mod.ast = m->ast;
+        mod.no_specialize = ctx->no_specialize;
+        mod.fast_math = ctx->fast_math;
+        mod.march = ctx->march;
+        mod.profile = ctx->profile;
+        mod.externs = module_externs(graph, visible, &mod.extern_count);
+
+        irbuf_init(&modules[n + i]);
+        if (!mod.externs || !codegen_llvm_buffer(&mod, &modules[n + i])) {
+            fprintf(stderr, "Error: %s: %s\n", m->path, mod.error_msg ? mod.error_msg : "code generation failed");
+            ok = false;
+        }
+        free((ModuleSig *)mod.externs);
+        free(mod.error_msg);
+    }
+
+    // Batch b compiles every jobs-th share of the misses; batch 0 also
+    // takes the entry point. clang -c names each object after its input.
+    int started = 0;
+    for (int b = 0; ok && b < jobs; b++) {
+        size_t first = miss_count * (size_t)b / (size_t)jobs;
+        size_t last = miss_count * (size_t)(b + 1) / (size_t)jobs;
+        if (first == last && b > 0) continue;
+
+        char **argv = malloc(sizeof(char *) * (last - first + 16));
+        char **inputs = calloc(last - first + 1, sizeof(char *));
+        if (!argv || !inputs) {
+            free(argv);
+            free(inputs);
+            ok = false;
+            break;
+        }
+        int argc = 0, input_count = 0;
+        argv[argc++] = "clang";
+        argv[argc++] = "-c";
+        argv[argc++] = "-w";
+        if (opts->opt_level) argv[argc++] = (char *)opts->opt_level;
+        if (opts->thinlto) argv[argc++] = "-flto=thin";
+        argv[argc++] = "-x";
+        argv[argc++] = "ir";
+
+        if (b == 0) {
+            char path[8192];
+            snprintf(path, sizeof(path), "%s/entry.ll", work_dir);
+            ok = write_module(&entry, path);
+            irbuf_free(&entry);
+            argv[argc++] = inputs[input_count++] = nerd_strdup("entry.ll");
+        }
+        for (size_t m = first; ok && m < last; m++) {
+            size_t u = misses[m];
+            char name[32], path[8192];
+            unit_file(u, n, ".ll", name, sizeof(name));
+            snprintf(path, sizeof(path), "%s/%s", work_dir, name);
+            ok = write_module(&modules[u], path);
+            irbuf_free(&modules[u]);
+            argv[argc++] = inputs[input_count++] = nerd_strdup(name);
+        }
+        argv[argc] = NULL;
+
+        if (ok && toolchain_spawn_in(argv, work_dir, &pids[started])) {
+            started++;
+        } else {
+            ok = false;
+        }
+        for (int j = 0; j < input_count; j++) {
+            free(inputs[j]);
+        }
+        free(inputs);
+        free(argv);
+    }
+
+    bool compiled = true;
+    for (int i = 0; i < started; i++) {
+        if (toolchain_wait(pids[i]) != 0) compiled = false;
+    }
+    if (ok && !compiled) {
+        fprintf(stderr, "Error: clang compilation failed (re-run with `nerd compile` to inspect the IR)\n");
+        ok = false;
+    }
+
+    // Publish the new objects, then link entry + functions in program order
+    // + modules
+    if (ok) {
+        char entry_obj[8192];
+        snprintf(entry_obj, sizeof(entry_obj), "%s/entry.o", work_dir);
+        objs[0] = nerd_strdup(entry_obj);
+        for (size_t m = 0; m < miss_count; m++) {
+            size_t u = misses[m];
+            char name[32], tmp[8192];
+            unit_file(u, n, ".o", name, sizeof(name));
+            snprintf(tmp, sizeof(tmp), "%s/%s", work_dir, name);
+            cache_store_object(tmp, &keys[u]);
+            objs[u + 1] = nerd_strdup(tmp);
+        }
+        ok = link_objects(opts, objs, total + 1, jobs, work_dir);
+    }
+    if (ok) {
+        manifest_save(opts, names, total, bodies, keys);
+    }
+
+    for (size_t i = 0; i <= total && objs; i++) {
+        free(objs[i]);
+    }
+    for (size_t i = 0; i < total && modules; i++) {
+        irbuf_free(&modules[i]);
+    }
+    for (size_t i = 0; i < total && names; i++) {
+        free(names[i]);
+    }
+    irbuf_free(&entry);
+    free(externs);
+    free(sigs);
+    free(bodies);
+    free(keys);
+    free(names);
+    free(wanted);
+    free(visible);
+    free(objs);
+    free(modules);
+    free(misses);
+    free(pids);
+    return ok;
+}
+
+/*
+ * Build an executable
+ */
+bool build_native(NerdContext *ctx, const BuildOptions *opts) {
+    int jobs = build_jobs(opts);
+
+    char dir[4096];
+    if (!opts->use_cache || !cache_dir(dir, sizeof(dir))) {
+        return build_split(ctx, opts, jobs);
+    }
+
+    char work_dir[4096 + 32];
+    snprintf(work_dir, sizeof(work_dir), "%s/tmp-build-XXXXXX", dir);
+    if (!mkdtemp(work_dir)) {
+        return build_split(ctx, opts, jobs);
+    }
+
+    bool ok = build_cached(ctx, opts, jobs, work_dir);
+    toolchain_rmdir(work_dir);
+    cache_evict(NULL);
+    return ok;
+}
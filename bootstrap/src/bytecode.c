@@ -0,0 +1,559 @@
+/*
+ * NERD Bytecode Compiler - Lowers the AST to register bytecode
+ *
+ * Mirrors codegen.c statement for statement so `nerd interp` prints what
+ * the native binary prints. Variables get fixed registers for the whole
+ * function (like codegen's allocas); temporaries are reused per statement.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include "nerd.h"
+
+#define BC_MAX_OPERAND 0xFFFF
+
+typedef struct {
+    BcProgram *prog;
+    BcFunc *fn;
+
+    // Name -> register bindings (searched backwards, innermost wins)
+    char **names;
+    int *regs;
+    size_t count;
+    size_t capacity;
+
+    int local_top;      // registers reserved for params, locals and counters
+    int next_reg;       // next free temporary
+    bool failed;
+} BcCompiler;
+
+#define BC_NAME(name) #name,
+static const char *op_names[] = { BC_OPS(BC_NAME) };
+#undef BC_NAME
+
+const char *bc_op_name(int op) {
+    return (op >= 0 && op < BC_OP_COUNT) ? op_names[op] : "?";
+}
+
+static void fail(BcCompiler *c, const char *fmt, const char *arg) {
+    if (!c->failed) {
+        fprintf(nerd_diag(), "Error: ");
+        fprintf(nerd_diag(), fmt, arg);
+        fprintf(nerd_diag(), " (in function '%s')\n", c->fn->name);
+    }
+    c->failed = true;
+}
+
+/*
+ * Emit an instruction; returns its index (for patching jumps)
+ */
+static int emit(BcCompiler *c, BcOp op, int a, int b, int cc) {
+    BcFunc *fn = c->fn;
+    if (fn->code_count >= BC_MAX_OPERAND) {
+        fail(c, "%s", "function too large for the interpreter");
+        return 0;
+    }
+    if (fn->code_count >= fn->code_capacity) {
+        fn->code_capacity = fn->code_capacity ? fn->code_capacity * 2 : 64;
+        fn->code = realloc(fn->code, sizeof(BcInstr) * fn->code_capacity);
+    }
+    BcInstr *ins = &fn->code[fn->code_count];
+    ins->op = (uint8_t)op;
+    ins->a = (uint16_t)a;
+    ins->b = (uint16_t)b;
+    ins->c = (uint16_t)cc;
+    return (int)fn->code_count++;
+}
+
+static int here(BcCompiler *c) {
+    return (int)c->fn->code_count;
+}
+
+static int add_const(BcCompiler *c, double value) {
+    BcFunc *fn = c->fn;
+    for (size_t i = 0; i < fn->const_count; i++) {
+        if (fn->consts[i] == value && (value != 0 || 1 / fn->consts[i] == 1 / value)) return (int)i;
+    }
+    if (fn->const_count >= BC_MAX_OPERAND) {
+        fail(c, "%s", "too many constants for the interpreter");
+        return 0;
+    }
+    if (fn->const_count >= fn->const_capacity) {
+        fn->const_capacity = fn->const_capacity ? fn->const_capacity * 2 : 16;
+        fn->consts = realloc(fn->consts, sizeof(double) * fn->const_capacity);
+    }
+    fn->consts[fn->const_count] = value;
+    return (int)fn->const_count++;
+}
+
+/*
+ * Intern a string literal, resolving escapes the way codegen does
+ */
+static int add_string(BcCompiler *c, const char *s) {
+    BcProgram *prog = c->prog;
+    size_t len = strlen(s);
+    char *buf = malloc(len + 1);
+    size_t n = 0;
+    for (size_t j = 0; j < len; j++) {
+        if (s[j] == '\\' && j + 1 < len) {
+            char next = s[j + 1];
+            if (next == '"') { buf[n++] = '"'; j++; continue; }
+            if (next == '\\') { buf[n++] = '\\'; j++; continue; }
+            if (next == 'n') { buf[n++] = '\n'; j++; continue; }
+            if (next == 't') { buf[n++] = '\t'; j++; continue; }
+        }
+        buf[n++] = s[j];
+    }
+    buf[n] = '\0';
+
+    for (size_t i = 0; i < prog->string_count; i++) {
+        if (strcmp(prog->strings[i], buf) == 0) {
+            free(buf);
+            return (int)i;
+        }
+    }
+    if (prog->string_count >= BC_MAX_OPERAND) {
+        free(buf);
+        fail(c, "%s", "too many strings for the interpreter");
+        return 0;
+    }
+    if (prog->string_count >= prog->string_capacity) {
+        prog->string_capacity = prog->string_capacity ? prog->string_capacity * 2 : 16;
+        prog->strings = realloc(prog->strings, sizeof(char *) * prog->string_capacity);
+    }
+    prog->strings[prog->string_count] = buf;
+    return (int)prog->string_count++;
+}
+
+static int alloc_reg(BcCompiler *c) {
+    int reg = c->next_reg++;
+    if (reg >= BC_MAX_OPERAND) {
+        fail(c, "%s", "too many registers for the interpreter");
+        return 0;
+    }
+    if (c->next_reg > c->fn->reg_count) c->fn->reg_count = c->next_reg;
+    return reg;
+}
+
+/*
+ * Reserve a register that stays live for the rest of the function
+ */
+static int alloc_local(BcCompiler *c) {
+    int reg = c->local_top++;
+    if (c->next_reg < c->local_top) c->next_reg = c->local_top;
+    if (c->local_top > c->fn->reg_count) c->fn->reg_count = c->local_top;
+    if (reg >= BC_MAX_OPERAND) fail(c, "%s", "too many registers for the interpreter");
+    return reg;
+}
+
+static void bind(BcCompiler *c, const char *name, int reg) {
+    if (c->count >= c->capacity) {
+        c->capacity = c->capacity ? c->capacity * 2 : 16;
+        c->names = realloc(c->names, sizeof(char *) * c->capacity);
+        c->regs = realloc(c->regs, sizeof(int) * c->capacity);
+    }
+    c->names[c->count] = (char *)name;
+    c->regs[c->count] = reg;
+    c->count++;
+}
+
+static int lookup(BcCompiler *c, const char *name) {
+    for (size_t i = c->count; i > 0; i--) {
+        if (strcmp(c->names[i - 1], name) == 0) return c->regs[i - 1];
+    }
+    return -1;
+}
+
+/*
+ * Locals only (params are read-only targets for inc/dec, as in codegen)
+ */
+static int lookup_local(BcCompiler *c, const char *name) {
+    for (size_t i = c->count; i > (size_t)c->fn->param_count; i--) {
+        if (strcmp(c->names[i - 1], name) == 0) return c->regs[i - 1];
+    }
+    return -1;
+}
+
+static int find_func(BcProgram *prog, const char *name) {
+    for (size_t i = 0; i < prog->func_count; i++) {
+        if (strcmp(prog->funcs[i].name, name) == 0) return (int)i;
+    }
+    return -1;
+}
+
+static int const_reg(BcCompiler *c, double value) {
+    int reg = alloc_reg(c);
+    emit(c, BC_CONST, reg, add_const(c, value), 0);
+    return reg;
+}
+
+static bool is_str(ASTNode *node) {
+    return node && node->type == NODE_STR;
+}
+
+static void compile_stmt(BcCompiler *c, ASTNode *node);
+
+/*
+ * Compile expression; returns the register holding its value
+ */
+static int compile_expr(BcCompiler *c, ASTNode *node) {
+    if (!node) {
+        fail(c, "%s", "missing expression");
+        return 0;
+    }
+
+    switch (node->type) {
+        case NODE_NUM:
+            return const_reg(c, node->data.num.value);
+
+        case NODE_STR:
+            // Strings have no numeric value (codegen yields 0 too)
+            return const_reg(c, 0.0);
+
+        case NODE_BOOL:
+            return const_reg(c, node->data.boolean.value ? 1.0 : 0.0);
+
+        case NODE_VAR: {
+            int reg = lookup(c, node->data.var.name);
+            if (reg < 0) fail(c, "Unknown variable '%s'", node->data.var.name);
+            return reg < 0 ? 0 : reg;
+        }
+
+        case NODE_POSITIONAL:
+            if (node->data.positional.index >= c->fn->param_count) {
+                fail(c, "%s", "positional parameter out of range");
+                return 0;
+            }
+            return node->data.positional.index;
+
+        case NODE_BINOP: {
+            int left = compile_expr(c, node->data.binop.left);
+            int right = compile_expr(c, node->data.binop.right);
+            const char *op = node->data.binop.op;
+
+            static const struct { const char *name; BcOp op; } ops[] = {
+                {"plus", BC_ADD}, {"minus", BC_SUB}, {"times", BC_MUL}, {"over", BC_DIV},
+                {"mod", BC_MOD}, {"eq", BC_EQ}, {"neq", BC_NEQ}, {"lt", BC_LT}, {"gt", BC_GT},
+                {"lte", BC_LTE}, {"gte", BC_GTE}, {"and", BC_AND}, {"or", BC_OR},
+            };
+            for (size_t i = 0; i < sizeof(ops) / sizeof(ops[0]); i++) {
+                if (strcmp(op, ops[i].name) == 0) {
+                    int result = alloc_reg(c);
+                    emit(c, ops[i].op, result, left, right);
+                    return result;
+                }
+            }
+            fail(c, "Unknown operator '%s'", op);
+            return 0;
+        }
+
+        case NODE_UNARYOP: {
+            int operand = compile_expr(c, node->data.unaryop.operand);
+            int result = alloc_reg(c);
+            if (strcmp(node->data.unaryop.op, "not") == 0) {
+                emit(c, BC_NOT, result, operand, 0);
+            } else if (strcmp(node->data.unaryop.op, "neg") == 0) {
+                emit(c, BC_NEG, result, operand, 0);
+            } else {
+                fail(c, "Unknown operator '%s'", node->data.unaryop.op);
+            }
+            return result;
+        }
+
+        case NODE_CALL: {
+            const char *module = node->data.call.module;
+            const char *func = node->data.call.func;
+            ASTList *args = &node->data.call.args;
+
+            // User-defined function: arguments go in consecutive registers
+            // at the top of the frame, which become the callee's r0..rN-1
+            if (!module) {
+                int index = find_func(c->prog, func);
+                if (index < 0) {
+                    fail(c, "Unknown function '%s'", func);
+                    return 0;
+                }
+                if ((size_t)c->prog->funcs[index].param_count != args->count) {
+                    fail(c, "Wrong number of arguments to '%s'", func);
+                    return 0;
+                }
+
+                int *values = malloc(sizeof(int) * (args->count ? args->count : 1));
+                for (size_t i = 0; i < args->count; i++) {
+                    values[i] = compile_expr(c, args->nodes[i]);
+                }
+                int base = c->next_reg;
+                for (size_t i = 0; i < args->count; i++) {
+                    int slot = alloc_reg(c);
+                    if (slot != values[i]) emit(c, BC_MOV, slot, values[i], 0);
+                }
+                free(values);
+                if (args->count == 0) alloc_reg(c);  // result slot
+                emit(c, BC_CALL, base, index, base);
+                c->next_reg = base + 1;
+                return base;
+            }
+
+            if (strcmp(module, "math") == 0 && args->count >= 1) {
+                int arg = compile_expr(c, args->nodes[0]);
+                static const struct { const char *name; BcOp op; } unary[] = {
+                    {"abs", BC_ABS}, {"sqrt", BC_SQRT}, {"floor", BC_FLOOR},
+                    {"ceil", BC_CEIL}, {"sin", BC_SIN}, {"cos", BC_COS},
+                };
+                for (size_t i = 0; i < sizeof(unary) / sizeof(unary[0]); i++) {
+                    if (strcmp(func, unary[i].name) == 0) {
+                        int result = alloc_reg(c);
+                        emit(c, unary[i].op, result, arg, 0);
+                        return result;
+                    }
+                }
+                if (args->count >= 2) {
+                    int arg2 = compile_expr(c, args->nodes[1]);
+                    static const struct { const char *name; BcOp op; } binary[] = {
+                        {"min", BC_MIN}, {"max", BC_MAX}, {"pow", BC_POW},
+                    };
+                    for (size_t i = 0; i < sizeof(binary) / sizeof(binary[0]); i++) {
+                        if (strcmp(func, binary[i].name) == 0) {
+                            int result = alloc_reg(c);
+                            emit(c, binary[i].op, result, arg, arg2);
+                            return result;
+                        }
+                    }
+                }
+                return const_reg(c, 0.0);
+            }
+
+            // Network modules take string literals and print their results
+            ASTNode *a0 = args->count > 0 ? args->nodes[0] : NULL;
+            ASTNode *a1 = args->count > 1 ? args->nodes[1] : NULL;
+            ASTNode *a2 = args->count > 2 ? args->nodes[2] : NULL;
+            if (strcmp(module, "http") == 0) {
+                if (strcmp(func, "get") == 0 && is_str(a0)) {
+                    emit(c, BC_HTTP_GET, add_string(c, a0->data.str.value), 0, 0);
+                    c->prog->uses_runtime = true;
+                } else if (strcmp(func, "getall") == 0 && is_str(a0)) {
+                    emit(c, BC_HTTP_GETALL, add_string(c, a0->data.str.value), 0, 0);
+                    c->prog->uses_runtime = true;
+                } else if (strcmp(func, "post") == 0 && is_str(a0) && is_str(a1)) {
+                    int url = add_string(c, a0->data.str.value);
+                    emit(c, BC_HTTP_POST, url, add_string(c, a1->data.str.value), 0);
+                    c->prog->uses_runtime = true;
+                }
+            } else if (strcmp(module, "mcp") == 0) {
+                if (strcmp(func, "tools") == 0 && is_str(a0)) {
+                    emit(c, BC_MCP_TOOLS, add_string(c, a0->data.str.value), 0, 0);
+                    c->prog->uses_runtime = true;
+                } else if (strcmp(func, "send") == 0 && is_str(a0) && is_str(a1) && is_str(a2)) {
+                    int url = add_string(c, a0->data.str.value);
+                    int tool = add_string(c, a1->data.str.value);
+                    emit(c, BC_MCP_SEND, url, tool, add_string(c, a2->data.str.value));
+                    c->prog->uses_runtime = true;
+                } else if (strcmp(func, "init") == 0 && is_str(a0)) {
+                    emit(c, BC_MCP_INIT, add_string(c, a0->data.str.value), 0, 0);
+                    c->prog->uses_runtime = true;
+                }
+            } else if (strcmp(module, "llm") == 0) {
+                if (strcmp(func, "claude") == 0 && is_str(a0) && is_str(a1)) {
+                    int system = add_string(c, a0->data.str.value);
+                    emit(c, BC_LLM_SYSTEM, system, add_string(c, a1->data.str.value), 0);
+                    c->prog->uses_runtime = true;
+                } else if (strcmp(func, "claude") == 0 && is_str(a0)) {
+                    emit(c, BC_LLM_CLAUDE, add_string(c, a0->data.str.value), 0, 0);
+                    c->prog->uses_runtime = true;
+                }
+            }
+            return const_reg(c, 0.0);
+        }
+
+        default:
+            fail(c, "%s", "unsupported expression");
+            return 0;
+    }
+}
+
+static void patch_jump(BcCompiler *c, int at, int target) {
+    BcInstr *ins = &c->fn->code[at];
+    switch (ins->op) {
+        case BC_JMP: ins->a = (uint16_t)target; break;
+        case BC_JMPF: ins->b = (uint16_t)target; break;
+        default: ins->c = (uint16_t)target; break;
+    }
+}
+
+static void compile_body(BcCompiler *c, ASTList *body) {
+    for (size_t i = 0; i < body->count; i++) {
+        compile_stmt(c, body->nodes[i]);
+    }
+}
+
+/*
+ * Compile statement; temporaries are released afterwards
+ */
+static void compile_stmt(BcCompiler *c, ASTNode *node) {
+    if (!node) return;
+    c->next_reg = c->local_top;
+
+    switch (node->type) {
+        case NODE_RETURN: {
+            int reg = node->data.ret.value ? compile_expr(c, node->data.ret.value) : const_reg(c, 0.0);
+            emit(c, BC_RET, reg, 0, 0);
+            break;
+        }
+
+        case NODE_IF: {
+            int cond = compile_expr(c, node->data.if_stmt.condition);
+            int jump_else = emit(c, BC_JMPF, cond, 0, 0);
+            compile_stmt(c, node->data.if_stmt.then_stmt);
+            if (node->data.if_stmt.else_stmt) {
+                int jump_end = emit(c, BC_JMP, 0, 0, 0);
+                patch_jump(c, jump_else, here(c));
+                compile_stmt(c, node->data.if_stmt.else_stmt);
+                patch_jump(c, jump_end, here(c));
+            } else {
+                patch_jump(c, jump_else, here(c));
+            }
+            break;
+        }
+
+        case NODE_LET: {
+            int value = compile_expr(c, node->data.let.value);
+            int reg = lookup_local(c, node->data.let.name);
+            if (reg < 0) {
+                reg = alloc_local(c);
+                bind(c, node->data.let.name, reg);
+            }
+            if (reg != value) emit(c, BC_MOV, reg, value, 0);
+            break;
+        }
+
+        case NODE_INC:
+        case NODE_DEC: {
+            bool inc = node->type == NODE_INC;
+            const char *name = inc ? node->data.inc.var_name : node->data.dec.var_name;
+            ASTNode *amount = inc ? node->data.inc.amount : node->data.dec.amount;
+
+            int reg = lookup_local(c, name);
+            if (reg < 0) {
+                fail(c, inc ? "Unknown variable '%s' in inc" : "Unknown variable '%s' in dec", name);
+                break;
+            }
+            int delta = amount ? compile_expr(c, amount) : const_reg(c, 1.0);
+            emit(c, inc ? BC_ADD : BC_SUB, reg, reg, delta);
+            break;
+        }
+
+        case NODE_EXPR_STMT:
+            compile_expr(c, node->data.expr_stmt.expr);
+            break;
+
+        case NODE_OUT: {
+            ASTNode *value = node->data.out.value;
+            if (is_str(value)) {
+                emit(c, BC_OUT_STR, add_string(c, value->data.str.value), 0, 0);
+            } else {
+                emit(c, BC_OUT_NUM, compile_expr(c, value), 0, 0);
+            }
+            break;
+        }
+
+        case NODE_REPEAT: {
+            // Count is evaluated once; counter runs 1..count
+            int count = compile_expr(c, node->data.repeat.count);
+            int limit = alloc_local(c);
+            if (limit != count) emit(c, BC_MOV, limit, count, 0);
+            int counter = alloc_local(c);
+            if (node->data.repeat.var_name) bind(c, node->data.repeat.var_name, counter);
+            emit(c, BC_CONST, counter, add_const(c, 1.0), 0);
+
+            int prep = emit(c, BC_FORPREP, counter, limit, 0);
+            int body = here(c);
+            compile_body(c, &node->data.repeat.body);
+            emit(c, BC_FORLOOP, counter, limit, body);
+            patch_jump(c, prep, here(c));
+            break;
+        }
+
+        case NODE_WHILE: {
+            int top = here(c);
+            int cond = compile_expr(c, node->data.while_loop.condition);
+            int exit = emit(c, BC_JMPF, cond, 0, 0);
+            compile_body(c, &node->data.while_loop.body);
+            emit(c, BC_JMP, top, 0, 0);
+            patch_jump(c, exit, here(c));
+            break;
+        }
+
+        default:
+            fail(c, "%s", "unsupported statement");
+            break;
+    }
+}
+
+static bool compile_func(BcProgram *prog, int index, ASTNode *func) {
+    BcCompiler c = {0};
+    c.prog = prog;
+    c.fn = &prog->funcs[index];
+
+    ASTList *params = &func->data.func_def.params;
+    for (size_t i = 0; i < params->count; i++) {
+        bind(&c, params->nodes[i]->data.param.name, alloc_local(&c));
+    }
+
+    compile_body(&c, &func->data.func_def.body);
+
+    // Implicit `ret 0` (codegen's default return)
+    c.next_reg = c.local_top;
+    emit(&c, BC_RET, const_reg(&c, 0.0), 0, 0);
+
+    free(c.names);
+    free(c.regs);
+    return !c.failed;
+}
+
+/*
+ * Compile a parsed program to bytecode. Returns NULL on error.
+ */
+BcProgram *bc_compile(ASTNode *program) {
+    BcProgram *prog = calloc(1, sizeof(BcProgram));
+    if (!prog) return NULL;
+
+    ASTList *funcs = &program->data.program.functions;
+    prog->funcs = calloc(funcs->count ? funcs->count : 1, sizeof(BcFunc));
+    prog->func_count = funcs->count;
+    prog->main_index = -1;
+
+    // Declare every function first so calls can refer forward
+    for (size_t i = 0; i < funcs->count; i++) {
+        ASTNode *func = funcs->nodes[i];
+        prog->funcs[i].name = nerd_strdup(func->data.func_def.name);
+        prog->funcs[i].param_count = (int)func->data.func_def.params.count;
+        prog->funcs[i].specialized = func->data.func_def.specialized;
+        prog->funcs[i].imported = func->data.func_def.imported;
+        atomic_init(&prog->funcs[i].native, NULL);
+        if (strcmp(func->data.func_def.name, "main") == 0) prog->main_index = (int)i;
+    }
+
+    for (size_t i = 0; i < funcs->count; i++) {
+        if (!compile_func(prog, (int)i, funcs->nodes[i])) {
+            bc_free(prog);
+            return NULL;
+        }
+    }
+    return prog;
+}
+
+void bc_free(BcProgram *prog) {
+    if (!prog) return;
+    for (size_t i = 0; i < prog->func_count; i++) {
+        free(prog->funcs[i].name);
+        free(prog->funcs[i].code);
+        free(prog->funcs[i].consts);
+    }
+    free(prog->funcs);
+    for (size_t i = 0; i < prog->string_count; i++) {
+        free(prog->strings[i]);
+    }
+    free(prog->strings);
+    free(prog);
+}
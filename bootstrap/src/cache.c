@@ -0,0 +1,369 @@
+/*
+ * NERD Compilation Cache - Linked executables keyed by content hash
+ *
+ * `nerd run` hashes everything that can change the produced binary
+ * (source, compiler, runtime objects, flags) and keeps the executable in
+ * $XDG_CACHE_HOME/nerd/<key>. A hit execs the cached binary directly.
+ * `nerd build` keeps one object per function next to them as <key>.o.
+ * These entries are bounded by NERD_CACHE_MAX_MB and evicted least
+ * recently used first (hits refresh the file's mtime). Small metadata
+ * (build manifests, module interfaces) lives in meta/ and is never
+ * evicted, only removed by `nerd cache clear`.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "nerd.h"
+
+#define CACHE_DEFAULT_MAX_MB 256
+#define CACHE_TMP_MAX_AGE 3600     // seconds before a stray tmp- file is removed
+
+#define FNV_PRIME 0x100000001b3ULL
+
+/*
+ * Key: two FNV-1a 64 streams with different offset bases (128 bits)
+ */
+void cache_key_init(CacheKey *k) {
+    k->a = 0xcbf29ce484222325ULL;
+    k->b = 0x84222325cbf29ce4ULL;
+}
+
+void cache_key_add(CacheKey *k, const void *data, size_t len) {
+    const unsigned char *p = data;
+    uint64_t a = k->a, b = k->b;
+    for (size_t i = 0; i < len; i++) {
+        a = (a ^ p[i]) * FNV_PRIME;
+        b = (b ^ p[i]) * FNV_PRIME;
+        b ^= b >> 29;
+    }
+    k->a = a;
+    k->b = b;
+}
+
+// Strings include their terminator so adjacent fields can't run together
+void cache_key_add_str(CacheKey *k, const char *s) {
+    if (!s) s = "";
+    cache_key_add(k, s, strlen(s) + 1);
+}
+
+/*
+ * Mix in a file's contents; a missing file mixes in a fixed marker
+ */
+void cache_key_add_file(CacheKey *k, const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        cache_key_add_str(k, "<missing>");
+        return;
+    }
+
+    unsigned char buf[65536];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) {
+        cache_key_add(k, buf, n);
+    }
+    fclose(f);
+    cache_key_add_str(k, path);
+}
+
+static int mkdir_p(char *path, mode_t mode) {
+    for (char *p = path + 1; *p; p++) {
+        if (*p != '/') continue;
+        *p = '\0';
+        int rc = mkdir(path, mode);
+        *p = '/';
+        if (rc != 0 && errno != EEXIST) return -1;
+    }
+    if (mkdir(path, mode) != 0 && errno != EEXIST) return -1;
+    return 0;
+}
+
+/*
+ * Cache directory: $XDG_CACHE_HOME/nerd, else ~/.cache/nerd (created)
+ */
+bool cache_dir(char *buf, size_t size) {
+    const char *xdg = getenv("XDG_CACHE_HOME");
+    const char *home = getenv("HOME");
+    int len;
+    if (xdg && xdg[0] == '/') {
+        len = snprintf(buf, size, "%s/nerd", xdg);
+    } else if (home && home[0]) {
+        len = snprintf(buf, size, "%s/.cache/nerd", home);
+    } else {
+        return false;
+    }
+    if (len < 0 || (size_t)len >= size) return false;
+
+    return mkdir_p(buf, 0700) == 0;
+}
+
+/*
+ * Path of the entry for `k`; `ext` (may be empty) is appended to the name
+ */
+bool cache_entry_path(const CacheKey *k, const char *ext, char *path, size_t size) {
+    char dir[4096];
+    if (!cache_dir(dir, sizeof(dir))) return false;
+    int len = snprintf(path, size, "%s/%016llx%016llx%s", dir,
+                       (unsigned long long)k->a, (unsigned long long)k->b, ext);
+    return len > 0 && (size_t)len < size;
+}
+
+static bool entry_path(const CacheKey *k, char *path, size_t size) {
+    return cache_entry_path(k, "", path, size);
+}
+
+/*
+ * Path of the metadata file for `k` in the meta/ subdirectory (created)
+ */
+bool cache_meta_path(const CacheKey *k, const char *ext, char *path, size_t size) {
+    char dir[4096];
+    if (!cache_dir(dir, sizeof(dir))) return false;
+    int len = snprintf(path, size, "%s/meta", dir);
+    if (len < 0 || (size_t)len >= size) return false;
+    if (mkdir(path, 0700) != 0 && errno != EEXIST) return false;
+    len = snprintf(path, size, "%s/meta/%016llx%016llx%s", dir,
+                   (unsigned long long)k->a, (unsigned long long)k->b, ext);
+    return len > 0 && (size_t)len < size;
+}
+
+/*
+ * Look up an executable. On a hit, refresh its mtime (LRU) and return true.
+ */
+bool cache_lookup(const CacheKey *k, char *path, size_t size) {
+    if (!entry_path(k, path, size)) return false;
+    if (access(path, X_OK) != 0) return false;
+    utimensat(AT_FDCWD, path, NULL, 0);
+    return true;
+}
+
+/*
+ * Scratch path inside the cache dir for the linker to write to, so
+ * cache_store can publish it with an atomic rename. Unique per call, as
+ * `nerd serve` may build the same key on two threads at once.
+ */
+bool cache_tmp_path(const CacheKey *k, char *path, size_t size) {
+    static atomic_uint serial;
+    char dir[4096];
+    if (!cache_dir(dir, sizeof(dir))) return false;
+    int len = snprintf(path, size, "%s/tmp-%016llx-%ld-%u", dir,
+                       (unsigned long long)k->a, (long)getpid(), atomic_fetch_add(&serial, 1));
+    return len > 0 && (size_t)len < size;
+}
+
+/*
+ * Publish a finished executable under its key. `path` receives the entry.
+ */
+bool cache_store(const char *tmp, const CacheKey *k, char *path, size_t size) {
+    if (!entry_path(k, path, size)) return false;
+    if (rename(tmp, path) != 0) {
+        fprintf(stderr, "Warning: Cannot store '%s' in cache: %s\n", path, strerror(errno));
+        return false;
+    }
+    cache_evict(path);
+    return true;
+}
+
+/*
+ * Look up a per-function object. On a hit, refresh its mtime (LRU) and
+ * hard-link it into `dir` (the build's work directory), so a concurrent
+ * run evicting it can't pull it from under the link step. `path`
+ * receives the link. A failed link counts as a miss.
+ */
+bool cache_lookup_object(const CacheKey *k, const char *dir, char *path, size_t size) {
+    char entry[4096];
+    if (!cache_entry_path(k, ".o", entry, sizeof(entry))) return false;
+    int len = snprintf(path, size, "%s/%016llx%016llx.o", dir,
+                       (unsigned long long)k->a, (unsigned long long)k->b);
+    if (len < 0 || (size_t)len >= size) return false;
+    if (link(entry, path) != 0 && errno != EEXIST) return false;
+    utimensat(AT_FDCWD, entry, NULL, 0);
+    return true;
+}
+
+/*
+ * Publish a compiled object as a hard link to `tmp`, which stays in place
+ * for the caller to link. Unlike cache_store this doesn't evict: a build
+ * stores many objects and calls cache_evict once after linking.
+ */
+bool cache_store_object(const char *tmp, const CacheKey *k) {
+    char path[4096];
+    if (!cache_entry_path(k, ".o", path, sizeof(path))) return false;
+    if (link(tmp, path) != 0 && errno != EEXIST) {
+        fprintf(stderr, "Warning: Cannot store '%s' in cache: %s\n", path, strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+typedef struct {
+    char name[64];
+    off_t size;
+    time_t mtime;
+} CacheEntry;
+
+static int entry_cmp_mtime(const void *a, const void *b) {
+    time_t ta = ((const CacheEntry *)a)->mtime;
+    time_t tb = ((const CacheEntry *)b)->mtime;
+    return (ta > tb) - (ta < tb);
+}
+
+/*
+ * Entries are named by their key: 32 hex digits, then nothing or ".o"
+ */
+static bool is_entry_name(const char *name) {
+    for (int i = 0; i < 32; i++) {
+        char c = name[i];
+        if (!((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f'))) return false;
+    }
+    return name[32] == '\0' || strcmp(name + 32, ".o") == 0;
+}
+
+/*
+ * List cache entries; stray tmp- files past their age limit are removed
+ */
+static CacheEntry *scan_entries(const char *dir, size_t *count, off_t *total) {
+    *count = 0;
+    *total = 0;
+
+    DIR *d = opendir(dir);
+    if (!d) return NULL;
+
+    size_t capacity = 64;
+    CacheEntry *entries = malloc(sizeof(CacheEntry) * capacity);
+    time_t now = time(NULL);
+
+    struct dirent *ent;
+    while (entries && (ent = readdir(d)) != NULL) {
+        if (ent->d_name[0] == '.' || strlen(ent->d_name) >= sizeof(entries[0].name)) continue;
+
+        char path[4096 + 64];
+        snprintf(path, sizeof(path), "%s/%s", dir, ent->d_name);
+        struct stat st;
+        if (stat(path, &st) != 0 || !S_ISREG(st.st_mode)) continue;
+
+        if (strncmp(ent->d_name, "tmp-", 4) == 0) {
+            if (now - st.st_mtime > CACHE_TMP_MAX_AGE) unlink(path);
+            continue;
+        }
+        if (!is_entry_name(ent->d_name)) continue;
+
+        if (*count >= capacity) {
+            capacity *= 2;
+            CacheEntry *grown = realloc(entries, sizeof(CacheEntry) * capacity);
+            if (!grown) break;
+            entries = grown;
+        }
+        CacheEntry *e = &entries[(*count)++];
+        memcpy(e->name, ent->d_name, strlen(ent->d_name) + 1);
+        e->size = st.st_size;
+        e->mtime = st.st_mtime;
+        *total += st.st_size;
+    }
+    closedir(d);
+    return entries;
+}
+
+static off_t cache_limit(void) {
+    const char *env = getenv("NERD_CACHE_MAX_MB");
+    long mb = env ? strtol(env, NULL, 10) : 0;
+    if (mb <= 0) mb = CACHE_DEFAULT_MAX_MB;
+    return (off_t)mb * 1024 * 1024;
+}
+
+/*
+ * Drop least recently used entries until the cache fits its size limit.
+ * `keep` (full path, may be NULL) is never evicted.
+ */
+void cache_evict(const char *keep) {
+    char dir[4096];
+    if (!cache_dir(dir, sizeof(dir))) return;
+
+    size_t count;
+    off_t total;
+    CacheEntry *entries = scan_entries(dir, &count, &total);
+    if (!entries) return;
+
+    off_t limit = cache_limit();
+    if (total > limit) {
+        qsort(entries, count, sizeof(CacheEntry), entry_cmp_mtime);
+        const char *keep_name = keep ? strrchr(keep, '/') : NULL;
+        keep_name = keep_name ? keep_name + 1 : keep;
+
+        for (size_t i = 0; i < count && total > limit; i++) {
+            if (keep_name && strcmp(entries[i].name, keep_name) == 0) continue;
+            char path[4096 + 64];
+            snprintf(path, sizeof(path), "%s/%s", dir, entries[i].name);
+            if (unlink(path) == 0) total -= entries[i].size;
+        }
+    }
+    free(entries);
+}
+
+/*
+ * `nerd cache stats`
+ */
+int cache_stats(void) {
+    char dir[4096];
+    if (!cache_dir(dir, sizeof(dir))) {
+        fprintf(stderr, "Error: No cache directory (set XDG_CACHE_HOME or HOME)\n");
+        return 1;
+    }
+
+    size_t count;
+    off_t total;
+    CacheEntry *entries = scan_entries(dir, &count, &total);
+    free(entries);
+
+    printf("Cache directory: %s\n", dir);
+    printf("Entries:         %zu\n", count);
+    printf("Size:            %.1f MB\n", (double)total / (1024 * 1024));
+    printf("Limit:           %.1f MB\n", (double)cache_limit() / (1024 * 1024));
+    return 0;
+}
+
+/*
+ * `nerd cache clear`
+ */
+int cache_clear(void) {
+    char dir[4096];
+    if (!cache_dir(dir, sizeof(dir))) {
+        fprintf(stderr, "Error: No cache directory (set XDG_CACHE_HOME or HOME)\n");
+        return 1;
+    }
+
+    size_t count;
+    off_t total;
+    CacheEntry *entries = scan_entries(dir, &count, &total);
+    size_t removed = 0;
+    for (size_t i = 0; i < count; i++) {
+        char path[4096 + 64];
+        snprintf(path, sizeof(path), "%s/%s", dir, entries[i].name);
+        if (unlink(path) == 0) removed++;
+    }
+    free(entries);
+
+    // Metadata goes too: manifests and interfaces are rebuilt on demand
+    char meta[4096 + 8];
+    snprintf(meta, sizeof(meta), "%s/meta", dir);
+    DIR *d = opendir(meta);
+    struct dirent *ent;
+    while (d && (ent = readdir(d)) != NULL) {
+        if (ent->d_name[0] == '.') continue;
+        char path[4096 + 8 + 256];
+        snprintf(path, sizeof(path), "%s/%s", meta, ent->d_name);
+        unlink(path);
+    }
+    if (d) closedir(d);
+
+    printf("Removed %zu cached file%s\n", removed, removed == 1 ? "" : "s");
+    return 0;
+}
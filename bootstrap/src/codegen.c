@@ -1,52 +1,105 @@
 /*
  * NERD Code Generator - Generates LLVM IR
+ *
+ * Each function is generated into its own buffer with its own counters and
+ * locals, so large programs are split across a pool of threads. String
+ * literals are numbered up front and loop metadata ids are patched in when
+ * the function buffers are concatenated, keeping the output identical
+ * whatever the thread count.
  */
 
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <pthread.h>
+#include <unistd.h>
 #include "nerd.h"
 
+/*
+ * Shared loop hint metadata; per-loop nodes are numbered after these
+ */
+#define LOOP_MD_MUSTPROGRESS 0
+#define LOOP_MD_VECTORIZE 1
+#define LOOP_MD_UNROLL 2
+#define LOOP_MD_FIRST 3
+
+/*
+ * Functions are only spread over threads past this count; NERD_CODEGEN_THREADS
+ * overrides the thread count (1 generates sequentially)
+ */
+#define PARALLEL_MIN_FUNCS 64
+#define MAX_CODEGEN_THREADS 16
+
 /*
  * Code generator state
  */
 typedef struct {
-    FILE *out;
+    IRBuf *out;
     int temp_counter;
     int label_counter;
-    int string_counter;
 
     // Current function context
     ASTNode *current_func;
     char **param_names;
     size_t param_count;
 
-    // Local variables
+    // Local variables (loop induction variables are SSA i64 values)
     char **local_names;
     int *local_regs;
+    bool *local_iv;
     size_t local_count;
     size_t local_capacity;
 
+    // Loop metadata nodes of the current function: whether each is hinted,
+    // and where its id goes in the output (filled in on concatenation)
+    bool *loop_md_hinted;
+    size_t *loop_md_offset;
+    int loop_md_count;
+    int loop_md_capacity;
+
+    // User functions called by the current function (for split modules)
+    const char **callees;
+    size_t callee_count;
+    size_t callee_capacity;
+
+    // Fast-math flags prefix for FP instructions ("" or "reassoc contract afn ")
+    const char *fmf;
+    bool has_attrs;     // functions reference attribute group #0 (--march)
+    bool emit_entry;    // rename main to nerd_main and emit an i32 @main
+
+    // Profiling: count branches (instrument) or weight them (profile). The
+    // current function has prof_slots counters: calls, then false/true per
+    // branch site, numbered in emission order.
+    bool instrument;
+    const Profile *profile;
+    const ProfileFunc *func_profile;    // NULL if missing or stale
+    size_t prof_slots;
+    size_t prof_site;
+
     // String literals (deferred output)
     char **string_literals;
     size_t string_count;
     size_t string_capacity;
+    size_t *func_string_start;  // first literal of each function, plus the total
 } CodeGen;
 
 /*
  * Create code generator
  */
-static CodeGen *codegen_create(FILE *out) {
+static CodeGen *codegen_create(IRBuf *out) {
     CodeGen *cg = calloc(1, sizeof(CodeGen));
     if (!cg) return NULL;
 
     cg->out = out;
     cg->temp_counter = 0;
     cg->label_counter = 0;
-    cg->string_counter = 0;
+    cg->fmf = "";
     cg->local_capacity = 16;
     cg->local_names = malloc(sizeof(char*) * cg->local_capacity);
     cg->local_regs = malloc(sizeof(int) * cg->local_capacity);
+    cg->local_iv = malloc(sizeof(bool) * cg->local_capacity);
     cg->string_capacity = 16;
     cg->string_literals = malloc(sizeof(char*) * cg->string_capacity);
     cg->string_count = 0;
@@ -61,6 +114,11 @@ static void codegen_free(CodeGen *cg) {
     }
     free(cg->local_names);
     free(cg->local_regs);
+    free(cg->local_iv);
+    free(cg->loop_md_hinted);
+    free(cg->loop_md_offset);
+    free(cg->callees);
+    free(cg->func_string_start);
     for (size_t i = 0; i < cg->string_count; i++) {
         free(cg->string_literals[i]);
     }
@@ -98,31 +156,67 @@ static int next_label(CodeGen *cg) {
 }
 
 /*
- * Add local variable
+ * Add a name binding: an alloca'd local (%localN) or an induction
+ * variable (%ivN)
  */
-static void add_local(CodeGen *cg, const char *name, int reg) {
+static void add_binding(CodeGen *cg, const char *name, int reg, bool is_iv) {
     if (cg->local_count >= cg->local_capacity) {
         cg->local_capacity *= 2;
         cg->local_names = realloc(cg->local_names, sizeof(char*) * cg->local_capacity);
         cg->local_regs = realloc(cg->local_regs, sizeof(int) * cg->local_capacity);
+        cg->local_iv = realloc(cg->local_iv, sizeof(bool) * cg->local_capacity);
     }
     cg->local_names[cg->local_count] = nerd_strdup(name);
     cg->local_regs[cg->local_count] = reg;
+    cg->local_iv[cg->local_count] = is_iv;
     cg->local_count++;
 }
 
 /*
- * Find local variable
+ * Add local variable
  */
-static int find_local(CodeGen *cg, const char *name) {
-    for (size_t i = 0; i < cg->local_count; i++) {
-        if (strcmp(cg->local_names[i], name) == 0) {
-            return cg->local_regs[i];
+static void add_local(CodeGen *cg, const char *name, int reg) {
+    add_binding(cg, name, reg, false);
+}
+
+/*
+ * Find the innermost binding for a name, returns its index
+ */
+static int find_binding(CodeGen *cg, const char *name) {
+    for (size_t i = cg->local_count; i > 0; i--) {
+        if (strcmp(cg->local_names[i - 1], name) == 0) {
+            return (int)(i - 1);
         }
     }
     return -1;
 }
 
+/*
+ * Find local variable (alloca'd, assignable)
+ */
+static int find_local(CodeGen *cg, const char *name) {
+    int idx = find_binding(cg, name);
+    if (idx < 0 || cg->local_iv[idx]) return -1;
+    return cg->local_regs[idx];
+}
+
+/*
+ * Copy an induction variable that outlived its loop into an assignable
+ * local. Returns the local id, or -1 if the name isn't an induction variable.
+ */
+static int spill_induction(CodeGen *cg, const char *name) {
+    int idx = find_binding(cg, name);
+    if (idx < 0 || !cg->local_iv[idx]) return -1;
+
+    int local_id = (int)cg->local_count;
+    int reg = next_temp(cg);
+    irbuf_printf(cg->out, "  %%t%d = sitofp i64 %%iv%d to double\n", reg, cg->local_regs[idx]);
+    irbuf_printf(cg->out, "  %%local%d = alloca double\n", local_id);
+    irbuf_printf(cg->out, "  store double %%t%d, double* %%local%d\n", reg, local_id);
+    add_local(cg, name, local_id);
+    return local_id;
+}
+
 /*
  * Find parameter index
  */
@@ -144,6 +238,96 @@ static void clear_locals(CodeGen *cg) {
     }
     cg->local_count = 0;
     cg->temp_counter = 0;
+    cg->label_counter = 0;
+}
+
+/*
+ * Allocate a loop metadata node referenced at the current output position;
+ * `hinted` loops also get an unroll hint, and a vectorize hint under
+ * --fast-math. The id itself is written when the function is concatenated
+ * into the module.
+ */
+static void add_loop_md(CodeGen *cg, bool hinted) {
+    if (cg->loop_md_count >= cg->loop_md_capacity) {
+        cg->loop_md_capacity = cg->loop_md_capacity ? cg->loop_md_capacity * 2 : 16;
+        cg->loop_md_hinted = realloc(cg->loop_md_hinted, sizeof(bool) * cg->loop_md_capacity);
+        cg->loop_md_offset = realloc(cg->loop_md_offset, sizeof(size_t) * cg->loop_md_capacity);
+    }
+    cg->loop_md_hinted[cg->loop_md_count] = hinted;
+    cg->loop_md_offset[cg->loop_md_count] = cg->out->size;
+    cg->loop_md_count++;
+}
+
+/*
+ * Record a call to a user function
+ */
+static void add_callee(CodeGen *cg, const char *name) {
+    if (cg->callee_count >= cg->callee_capacity) {
+        cg->callee_capacity = cg->callee_capacity ? cg->callee_capacity * 2 : 8;
+        cg->callees = realloc(cg->callees, sizeof(char *) * cg->callee_capacity);
+    }
+    cg->callees[cg->callee_count++] = name;
+}
+
+/*
+ * A tight loop is an innermost loop doing only arithmetic: no output, no
+ * calls other than math, no early return. Only those get unroll/vectorize
+ * hints, so they go to loops the optimizer can usually transform.
+ */
+static bool expr_is_pure(ASTNode *node) {
+    if (!node) return true;
+
+    switch (node->type) {
+        case NODE_BINOP:
+            return expr_is_pure(node->data.binop.left) && expr_is_pure(node->data.binop.right);
+        case NODE_UNARYOP:
+            return expr_is_pure(node->data.unaryop.operand);
+        case NODE_CALL:
+            if (!node->data.call.module || strcmp(node->data.call.module, "math") != 0) return false;
+            for (size_t i = 0; i < node->data.call.args.count; i++) {
+                if (!expr_is_pure(node->data.call.args.nodes[i])) return false;
+            }
+            return true;
+        default:
+            return true;
+    }
+}
+
+static bool stmt_is_tight(ASTNode *node) {
+    if (!node) return true;
+
+    switch (node->type) {
+        case NODE_LET:
+            return expr_is_pure(node->data.let.value);
+        case NODE_INC:
+            return expr_is_pure(node->data.inc.amount);
+        case NODE_DEC:
+            return expr_is_pure(node->data.dec.amount);
+        case NODE_EXPR_STMT:
+            return expr_is_pure(node->data.expr_stmt.expr);
+        case NODE_IF:
+            return expr_is_pure(node->data.if_stmt.condition) &&
+                   stmt_is_tight(node->data.if_stmt.then_stmt) &&
+                   stmt_is_tight(node->data.if_stmt.else_stmt);
+        default:
+            return false;
+    }
+}
+
+static bool loop_is_tight(ASTList *body) {
+    for (size_t i = 0; i < body->count; i++) {
+        if (!stmt_is_tight(body->nodes[i])) return false;
+    }
+    return true;
+}
+
+/*
+ * LLVM symbol for a NERD function. With an entry point the user's main
+ * becomes nerd_main, leaving @main for the i32 wrapper.
+ */
+static const char *func_symbol(CodeGen *cg, const char *name) {
+    if (cg->emit_entry && strcmp(name, "main") == 0) return "nerd_main";
+    return name;
 }
 
 /*
@@ -168,6 +352,7 @@ static void collect_strings_expr(CodeGen *cg, ASTNode *node) {
             cg->string_literals = realloc(cg->string_literals,
                 sizeof(char*) * cg->string_capacity);
         }
+        node->data.str.id = (int)cg->string_count;
         cg->string_literals[cg->string_count++] = nerd_strdup(node->data.str.value);
     } else if (node->type == NODE_BINOP) {
         collect_strings_expr(cg, node->data.binop.left);
@@ -226,9 +411,13 @@ static void collect_strings_func(CodeGen *cg, ASTNode *func) {
 }
 
 static void collect_strings(CodeGen *cg, ASTNode *program) {
-    for (size_t i = 0; i < program->data.program.functions.count; i++) {
-        collect_strings_func(cg, program->data.program.functions.nodes[i]);
+    ASTList *funcs = &program->data.program.functions;
+    cg->func_string_start = malloc(sizeof(size_t) * (funcs->count + 1));
+    for (size_t i = 0; i < funcs->count; i++) {
+        cg->func_string_start[i] = cg->string_count;
+        collect_strings_func(cg, funcs->nodes[i]);
     }
+    cg->func_string_start[funcs->count] = cg->string_count;
 }
 
 /*
@@ -241,11 +430,15 @@ static int codegen_expr(CodeGen *cg, ASTNode *node) {
         case NODE_NUM: {
             int reg = next_temp(cg);
             double val = node->data.num.value;
-            // Ensure the number has a decimal point for LLVM IR
-            if (val == (long long)val && val >= -1e15 && val <= 1e15) {
-                fprintf(cg->out, "  %%t%d = fadd double 0.0, %.1f\n", reg, val);
+            // Integers as decimals; anything else (1/3, inf, NaN from folding)
+            // as the exact bit pattern in LLVM's hex form
+            if (val >= -1e15 && val <= 1e15 && val == (long long)val) {
+                irbuf_printf(cg->out, "  %%t%d = fadd double 0.0, %.1f\n", reg, val);
             } else {
-                fprintf(cg->out, "  %%t%d = fadd double 0.0, %e\n", reg, val);
+                uint64_t bits;
+                memcpy(&bits, &val, sizeof(bits));
+                irbuf_printf(cg->out, "  %%t%d = fadd double 0.0, 0x%016llX\n", reg,
+                             (unsigned long long)bits);
             }
             return reg;
         }
@@ -253,23 +446,31 @@ static int codegen_expr(CodeGen *cg, ASTNode *node) {
         case NODE_STR: {
             // Strings need runtime support - for now, just return 0
             int reg = next_temp(cg);
-            fprintf(cg->out, "  ; string: \"%s\"\n", node->data.str.value);
-            fprintf(cg->out, "  %%t%d = fadd double 0.0, 0.0\n", reg);
+            irbuf_printf(cg->out, "  ; string: \"%s\"\n", node->data.str.value);
+            irbuf_printf(cg->out, "  %%t%d = fadd double 0.0, 0.0\n", reg);
             return reg;
         }
 
         case NODE_BOOL: {
             int reg = next_temp(cg);
-            fprintf(cg->out, "  %%t%d = fadd double 0.0, %d.0\n", reg, node->data.boolean.value ? 1 : 0);
+            irbuf_printf(cg->out, "  %%t%d = fadd double 0.0, %d.0\n", reg, node->data.boolean.value ? 1 : 0);
             return reg;
         }
 
         case NODE_VAR: {
+            // Loop induction variables are i64, convert on read
+            int binding = find_binding(cg, node->data.var.name);
+            if (binding >= 0 && cg->local_iv[binding]) {
+                int reg = next_temp(cg);
+                irbuf_printf(cg->out, "  %%t%d = sitofp i64 %%iv%d to double\n", reg, cg->local_regs[binding]);
+                return reg;
+            }
+
             // Check locals first
             int local_reg = find_local(cg, node->data.var.name);
             if (local_reg >= 0) {
                 int reg = next_temp(cg);
-                fprintf(cg->out, "  %%t%d = load double, double* %%local%d\n", reg, local_reg);
+                irbuf_printf(cg->out, "  %%t%d = load double, double* %%local%d\n", reg, local_reg);
                 return reg;
             }
 
@@ -278,18 +479,18 @@ static int codegen_expr(CodeGen *cg, ASTNode *node) {
             if (param_idx >= 0) {
                 // Parameters are already in registers
                 int reg = next_temp(cg);
-                fprintf(cg->out, "  %%t%d = fadd double 0.0, %%arg%d\n", reg, param_idx);
+                irbuf_printf(cg->out, "  %%t%d = fadd double 0.0, %%arg%d\n", reg, param_idx);
                 return reg;
             }
 
-            fprintf(stderr, "Error: Unknown variable '%s'\n", node->data.var.name);
+            fprintf(nerd_diag(), "Error: Unknown variable '%s'\n", node->data.var.name);
             return -1;
         }
 
         case NODE_POSITIONAL: {
             // Positional parameter reference (first, second, etc.)
             int reg = next_temp(cg);
-            fprintf(cg->out, "  %%t%d = fadd double 0.0, %%arg%d\n", reg, node->data.positional.index);
+            irbuf_printf(cg->out, "  %%t%d = fadd double 0.0, %%arg%d\n", reg, node->data.positional.index);
             return reg;
         }
 
@@ -302,59 +503,59 @@ static int codegen_expr(CodeGen *cg, ASTNode *node) {
             const char *op = node->data.binop.op;
 
             if (strcmp(op, "plus") == 0) {
-                fprintf(cg->out, "  %%t%d = fadd double %%t%d, %%t%d\n", result_reg, left_reg, right_reg);
+                irbuf_printf(cg->out, "  %%t%d = fadd %sdouble %%t%d, %%t%d\n", result_reg, cg->fmf, left_reg, right_reg);
             } else if (strcmp(op, "minus") == 0) {
-                fprintf(cg->out, "  %%t%d = fsub double %%t%d, %%t%d\n", result_reg, left_reg, right_reg);
+                irbuf_printf(cg->out, "  %%t%d = fsub %sdouble %%t%d, %%t%d\n", result_reg, cg->fmf, left_reg, right_reg);
             } else if (strcmp(op, "times") == 0) {
-                fprintf(cg->out, "  %%t%d = fmul double %%t%d, %%t%d\n", result_reg, left_reg, right_reg);
+                irbuf_printf(cg->out, "  %%t%d = fmul %sdouble %%t%d, %%t%d\n", result_reg, cg->fmf, left_reg, right_reg);
             } else if (strcmp(op, "over") == 0) {
-                fprintf(cg->out, "  %%t%d = fdiv double %%t%d, %%t%d\n", result_reg, left_reg, right_reg);
+                irbuf_printf(cg->out, "  %%t%d = fdiv %sdouble %%t%d, %%t%d\n", result_reg, cg->fmf, left_reg, right_reg);
             } else if (strcmp(op, "mod") == 0) {
-                fprintf(cg->out, "  %%t%d = frem double %%t%d, %%t%d\n", result_reg, left_reg, right_reg);
+                irbuf_printf(cg->out, "  %%t%d = frem %sdouble %%t%d, %%t%d\n", result_reg, cg->fmf, left_reg, right_reg);
             } else if (strcmp(op, "eq") == 0) {
                 int cmp_reg = next_temp(cg);
-                fprintf(cg->out, "  %%t%d = fcmp oeq double %%t%d, %%t%d\n", cmp_reg, left_reg, right_reg);
-                fprintf(cg->out, "  %%t%d = uitofp i1 %%t%d to double\n", result_reg, cmp_reg);
+                irbuf_printf(cg->out, "  %%t%d = fcmp oeq double %%t%d, %%t%d\n", cmp_reg, left_reg, right_reg);
+                irbuf_printf(cg->out, "  %%t%d = uitofp i1 %%t%d to double\n", result_reg, cmp_reg);
             } else if (strcmp(op, "neq") == 0) {
                 int cmp_reg = next_temp(cg);
-                fprintf(cg->out, "  %%t%d = fcmp one double %%t%d, %%t%d\n", cmp_reg, left_reg, right_reg);
-                fprintf(cg->out, "  %%t%d = uitofp i1 %%t%d to double\n", result_reg, cmp_reg);
+                irbuf_printf(cg->out, "  %%t%d = fcmp one double %%t%d, %%t%d\n", cmp_reg, left_reg, right_reg);
+                irbuf_printf(cg->out, "  %%t%d = uitofp i1 %%t%d to double\n", result_reg, cmp_reg);
             } else if (strcmp(op, "lt") == 0) {
                 int cmp_reg = next_temp(cg);
-                fprintf(cg->out, "  %%t%d = fcmp olt double %%t%d, %%t%d\n", cmp_reg, left_reg, right_reg);
-                fprintf(cg->out, "  %%t%d = uitofp i1 %%t%d to double\n", result_reg, cmp_reg);
+                irbuf_printf(cg->out, "  %%t%d = fcmp olt double %%t%d, %%t%d\n", cmp_reg, left_reg, right_reg);
+                irbuf_printf(cg->out, "  %%t%d = uitofp i1 %%t%d to double\n", result_reg, cmp_reg);
             } else if (strcmp(op, "gt") == 0) {
                 int cmp_reg = next_temp(cg);
-                fprintf(cg->out, "  %%t%d = fcmp ogt double %%t%d, %%t%d\n", cmp_reg, left_reg, right_reg);
-                fprintf(cg->out, "  %%t%d = uitofp i1 %%t%d to double\n", result_reg, cmp_reg);
+                irbuf_printf(cg->out, "  %%t%d = fcmp ogt double %%t%d, %%t%d\n", cmp_reg, left_reg, right_reg);
+                irbuf_printf(cg->out, "  %%t%d = uitofp i1 %%t%d to double\n", result_reg, cmp_reg);
             } else if (strcmp(op, "lte") == 0) {
                 int cmp_reg = next_temp(cg);
-                fprintf(cg->out, "  %%t%d = fcmp ole double %%t%d, %%t%d\n", cmp_reg, left_reg, right_reg);
-                fprintf(cg->out, "  %%t%d = uitofp i1 %%t%d to double\n", result_reg, cmp_reg);
+                irbuf_printf(cg->out, "  %%t%d = fcmp ole double %%t%d, %%t%d\n", cmp_reg, left_reg, right_reg);
+                irbuf_printf(cg->out, "  %%t%d = uitofp i1 %%t%d to double\n", result_reg, cmp_reg);
             } else if (strcmp(op, "gte") == 0) {
                 int cmp_reg = next_temp(cg);
-                fprintf(cg->out, "  %%t%d = fcmp oge double %%t%d, %%t%d\n", cmp_reg, left_reg, right_reg);
-                fprintf(cg->out, "  %%t%d = uitofp i1 %%t%d to double\n", result_reg, cmp_reg);
+                irbuf_printf(cg->out, "  %%t%d = fcmp oge double %%t%d, %%t%d\n", cmp_reg, left_reg, right_reg);
+                irbuf_printf(cg->out, "  %%t%d = uitofp i1 %%t%d to double\n", result_reg, cmp_reg);
             } else if (strcmp(op, "and") == 0) {
                 // Logical and: both non-zero
                 int left_bool = next_temp(cg);
                 int right_bool = next_temp(cg);
                 int and_reg = next_temp(cg);
-                fprintf(cg->out, "  %%t%d = fcmp one double %%t%d, 0.0\n", left_bool, left_reg);
-                fprintf(cg->out, "  %%t%d = fcmp one double %%t%d, 0.0\n", right_bool, right_reg);
-                fprintf(cg->out, "  %%t%d = and i1 %%t%d, %%t%d\n", and_reg, left_bool, right_bool);
-                fprintf(cg->out, "  %%t%d = uitofp i1 %%t%d to double\n", result_reg, and_reg);
+                irbuf_printf(cg->out, "  %%t%d = fcmp one double %%t%d, 0.0\n", left_bool, left_reg);
+                irbuf_printf(cg->out, "  %%t%d = fcmp one double %%t%d, 0.0\n", right_bool, right_reg);
+                irbuf_printf(cg->out, "  %%t%d = and i1 %%t%d, %%t%d\n", and_reg, left_bool, right_bool);
+                irbuf_printf(cg->out, "  %%t%d = uitofp i1 %%t%d to double\n", result_reg, and_reg);
             } else if (strcmp(op, "or") == 0) {
                 // Logical or: either non-zero
                 int left_bool = next_temp(cg);
                 int right_bool = next_temp(cg);
                 int or_reg = next_temp(cg);
-                fprintf(cg->out, "  %%t%d = fcmp one double %%t%d, 0.0\n", left_bool, left_reg);
-                fprintf(cg->out, "  %%t%d = fcmp one double %%t%d, 0.0\n", right_bool, right_reg);
-                fprintf(cg->out, "  %%t%d = or i1 %%t%d, %%t%d\n", or_reg, left_bool, right_bool);
-                fprintf(cg->out, "  %%t%d = uitofp i1 %%t%d to double\n", result_reg, or_reg);
+                irbuf_printf(cg->out, "  %%t%d = fcmp one double %%t%d, 0.0\n", left_bool, left_reg);
+                irbuf_printf(cg->out, "  %%t%d = fcmp one double %%t%d, 0.0\n", right_bool, right_reg);
+                irbuf_printf(cg->out, "  %%t%d = or i1 %%t%d, %%t%d\n", or_reg, left_bool, right_bool);
+                irbuf_printf(cg->out, "  %%t%d = uitofp i1 %%t%d to double\n", result_reg, or_reg);
             } else {
-                fprintf(stderr, "Error: Unknown operator '%s'\n", op);
+                fprintf(nerd_diag(), "Error: Unknown operator '%s'\n", op);
                 return -1;
             }
 
@@ -368,11 +569,11 @@ static int codegen_expr(CodeGen *cg, ASTNode *node) {
             int result_reg = next_temp(cg);
             if (strcmp(node->data.unaryop.op, "not") == 0) {
                 int bool_reg = next_temp(cg);
-                fprintf(cg->out, "  %%t%d = fcmp oeq double %%t%d, 0.0\n", bool_reg, operand_reg);
-                fprintf(cg->out, "  %%t%d = uitofp i1 %%t%d to double\n", result_reg, bool_reg);
+                irbuf_printf(cg->out, "  %%t%d = fcmp oeq double %%t%d, 0.0\n", bool_reg, operand_reg);
+                irbuf_printf(cg->out, "  %%t%d = uitofp i1 %%t%d to double\n", result_reg, bool_reg);
             } else if (strcmp(node->data.unaryop.op, "neg") == 0) {
                 // Negate: 0 - x
-                fprintf(cg->out, "  %%t%d = fsub double 0.0, %%t%d\n", result_reg, operand_reg);
+                irbuf_printf(cg->out, "  %%t%d = fsub %sdouble 0.0, %%t%d\n", result_reg, cg->fmf, operand_reg);
             }
 
             return result_reg;
@@ -383,13 +584,14 @@ static int codegen_expr(CodeGen *cg, ASTNode *node) {
 
             // User-defined function call (no module)
             if (node->data.call.module == NULL) {
-                fprintf(cg->out, "  ; call %s\n", node->data.call.func);
+                irbuf_printf(cg->out, "  ; call %s\n", node->data.call.func);
+                add_callee(cg, node->data.call.func);
 
                 // Evaluate all arguments first
                 size_t argc = node->data.call.args.count;
                 int *arg_regs = argc > 0 ? malloc(sizeof(int) * argc) : NULL;
                 if (argc > 0 && !arg_regs) {
-                    fprintf(stderr, "Error: Out of memory\n");
+                    fprintf(nerd_diag(), "Error: Out of memory\n");
                     return -1;
                 }
                 for (size_t i = 0; i < argc; i++) {
@@ -397,19 +599,19 @@ static int codegen_expr(CodeGen *cg, ASTNode *node) {
                 }
 
                 // Generate call instruction
-                fprintf(cg->out, "  %%t%d = call double @%s(", result_reg, node->data.call.func);
+                irbuf_printf(cg->out, "  %%t%d = call double @%s(", result_reg, func_symbol(cg, node->data.call.func));
                 for (size_t i = 0; i < node->data.call.args.count; i++) {
-                    if (i > 0) fprintf(cg->out, ", ");
-                    fprintf(cg->out, "double %%t%d", arg_regs[i]);
+                    if (i > 0) irbuf_printf(cg->out, ", ");
+                    irbuf_printf(cg->out, "double %%t%d", arg_regs[i]);
                 }
-                fprintf(cg->out, ")\n");
+                irbuf_printf(cg->out, ")\n");
 
                 free(arg_regs);
                 return result_reg;
             }
 
             // Module calls
-            fprintf(cg->out, "  ; call %s.%s\n", node->data.call.module, node->data.call.func);
+            irbuf_printf(cg->out, "  ; call %s.%s\n", node->data.call.module, node->data.call.func);
 
             // For math functions, we can use LLVM intrinsics
             if (strcmp(node->data.call.module, "math") == 0) {
@@ -417,38 +619,38 @@ static int codegen_expr(CodeGen *cg, ASTNode *node) {
                     int arg_reg = codegen_expr(cg, node->data.call.args.nodes[0]);
 
                     if (strcmp(node->data.call.func, "abs") == 0) {
-                        fprintf(cg->out, "  %%t%d = call double @llvm.fabs.f64(double %%t%d)\n", result_reg, arg_reg);
+                        irbuf_printf(cg->out, "  %%t%d = call %sdouble @llvm.fabs.f64(double %%t%d)\n", result_reg, cg->fmf, arg_reg);
                         return result_reg;
                     } else if (strcmp(node->data.call.func, "sqrt") == 0) {
-                        fprintf(cg->out, "  %%t%d = call double @llvm.sqrt.f64(double %%t%d)\n", result_reg, arg_reg);
+                        irbuf_printf(cg->out, "  %%t%d = call %sdouble @llvm.sqrt.f64(double %%t%d)\n", result_reg, cg->fmf, arg_reg);
                         return result_reg;
                     } else if (strcmp(node->data.call.func, "floor") == 0) {
-                        fprintf(cg->out, "  %%t%d = call double @llvm.floor.f64(double %%t%d)\n", result_reg, arg_reg);
+                        irbuf_printf(cg->out, "  %%t%d = call %sdouble @llvm.floor.f64(double %%t%d)\n", result_reg, cg->fmf, arg_reg);
                         return result_reg;
                     } else if (strcmp(node->data.call.func, "ceil") == 0) {
-                        fprintf(cg->out, "  %%t%d = call double @llvm.ceil.f64(double %%t%d)\n", result_reg, arg_reg);
+                        irbuf_printf(cg->out, "  %%t%d = call %sdouble @llvm.ceil.f64(double %%t%d)\n", result_reg, cg->fmf, arg_reg);
                         return result_reg;
                     } else if (strcmp(node->data.call.func, "sin") == 0) {
-                        fprintf(cg->out, "  %%t%d = call double @llvm.sin.f64(double %%t%d)\n", result_reg, arg_reg);
+                        irbuf_printf(cg->out, "  %%t%d = call %sdouble @llvm.sin.f64(double %%t%d)\n", result_reg, cg->fmf, arg_reg);
                         return result_reg;
                     } else if (strcmp(node->data.call.func, "cos") == 0) {
-                        fprintf(cg->out, "  %%t%d = call double @llvm.cos.f64(double %%t%d)\n", result_reg, arg_reg);
+                        irbuf_printf(cg->out, "  %%t%d = call %sdouble @llvm.cos.f64(double %%t%d)\n", result_reg, cg->fmf, arg_reg);
                         return result_reg;
                     }
 
                     if (node->data.call.args.count > 1) {
                         int arg2_reg = codegen_expr(cg, node->data.call.args.nodes[1]);
                         if (strcmp(node->data.call.func, "min") == 0) {
-                            fprintf(cg->out, "  %%t%d = call double @llvm.minnum.f64(double %%t%d, double %%t%d)\n",
-                                    result_reg, arg_reg, arg2_reg);
+                            irbuf_printf(cg->out, "  %%t%d = call %sdouble @llvm.minnum.f64(double %%t%d, double %%t%d)\n",
+                                         result_reg, cg->fmf, arg_reg, arg2_reg);
                             return result_reg;
                         } else if (strcmp(node->data.call.func, "max") == 0) {
-                            fprintf(cg->out, "  %%t%d = call double @llvm.maxnum.f64(double %%t%d, double %%t%d)\n",
-                                    result_reg, arg_reg, arg2_reg);
+                            irbuf_printf(cg->out, "  %%t%d = call %sdouble @llvm.maxnum.f64(double %%t%d, double %%t%d)\n",
+                                         result_reg, cg->fmf, arg_reg, arg2_reg);
                             return result_reg;
                         } else if (strcmp(node->data.call.func, "pow") == 0) {
-                            fprintf(cg->out, "  %%t%d = call double @llvm.pow.f64(double %%t%d, double %%t%d)\n",
-                                    result_reg, arg_reg, arg2_reg);
+                            irbuf_printf(cg->out, "  %%t%d = call %sdouble @llvm.pow.f64(double %%t%d, double %%t%d)\n",
+                                         result_reg, cg->fmf, arg_reg, arg2_reg);
                             return result_reg;
                         }
                     }
@@ -461,45 +663,48 @@ static int codegen_expr(CodeGen *cg, ASTNode *node) {
                     // Get URL argument (must be a string literal)
                     ASTNode *url_node = node->data.call.args.nodes[0];
 
-                    if (strcmp(node->data.call.func, "get") == 0) {
+                    // getall: the parser joined its URLs into one newline-separated literal
+                    bool getall = strcmp(node->data.call.func, "getall") == 0;
+                    if (getall || strcmp(node->data.call.func, "get") == 0) {
                         // Use string counter (same as out statement)
                         if (url_node->type == NODE_STR) {
-                            int str_idx = cg->string_counter++;
+                            int str_idx = url_node->data.str.id;
 
                             size_t len = actual_string_len(url_node->data.str.value) + 1;
                             int url_ptr = next_temp(cg);
-                            fprintf(cg->out, "  %%t%d = getelementptr [%zu x i8], [%zu x i8]* @.str%d, i32 0, i32 0\n",
-                                    url_ptr, len, len, str_idx);
+                            irbuf_printf(cg->out, "  %%t%d = getelementptr [%zu x i8], [%zu x i8]* @.str%d, i32 0, i32 0\n",
+                                         url_ptr, len, len, str_idx);
 
-                            // Call http_get
+                            // Call http_get (or http_getall)
                             int response_ptr = next_temp(cg);
-                            fprintf(cg->out, "  %%t%d = call i8* @nerd_http_get(i8* %%t%d)\n", response_ptr, url_ptr);
+                            irbuf_printf(cg->out, "  %%t%d = call i8* @nerd_http_%s(i8* %%t%d)\n",
+                                         response_ptr, getall ? "getall" : "get", url_ptr);
 
                             // Print response if not null
                             int is_null = next_temp(cg);
-                            fprintf(cg->out, "  %%t%d = icmp eq i8* %%t%d, null\n", is_null, response_ptr);
+                            irbuf_printf(cg->out, "  %%t%d = icmp eq i8* %%t%d, null\n", is_null, response_ptr);
 
                             int then_label = next_label(cg);
                             int else_label = next_label(cg);
                             int end_label = next_label(cg);
 
-                            fprintf(cg->out, "  br i1 %%t%d, label %%http_err%d, label %%http_ok%d\n",
-                                    is_null, then_label, else_label);
+                            irbuf_printf(cg->out, "  br i1 %%t%d, label %%http_err%d, label %%http_ok%d\n",
+                                         is_null, then_label, else_label);
 
                             // Error case
-                            fprintf(cg->out, "http_err%d:\n", then_label);
-                            fprintf(cg->out, "  br label %%http_end%d\n", end_label);
+                            irbuf_printf(cg->out, "http_err%d:\n", then_label);
+                            irbuf_printf(cg->out, "  br label %%http_end%d\n", end_label);
 
                             // Success case - print response
-                            fprintf(cg->out, "http_ok%d:\n", else_label);
-                            fprintf(cg->out, "  call i32 (i8*, ...) @printf(i8* getelementptr ([4 x i8], [4 x i8]* @.fmt_str, i32 0, i32 0), i8* %%t%d)\n", response_ptr);
-                            fprintf(cg->out, "  call void @nerd_http_free(i8* %%t%d)\n", response_ptr);
-                            fprintf(cg->out, "  br label %%http_end%d\n", end_label);
+                            irbuf_printf(cg->out, "http_ok%d:\n", else_label);
+                            irbuf_printf(cg->out, "  call i32 (i8*, ...) @printf(i8* getelementptr ([4 x i8], [4 x i8]* @.fmt_str, i32 0, i32 0), i8* %%t%d)\n", response_ptr);
+                            irbuf_printf(cg->out, "  call void @nerd_http_free(i8* %%t%d)\n", response_ptr);
+                            irbuf_printf(cg->out, "  br label %%http_end%d\n", end_label);
 
-                            fprintf(cg->out, "http_end%d:\n", end_label);
+                            irbuf_printf(cg->out, "http_end%d:\n", end_label);
                         }
 
-                        fprintf(cg->out, "  %%t%d = fadd double 0.0, 0.0\n", result_reg);
+                        irbuf_printf(cg->out, "  %%t%d = fadd double 0.0, 0.0\n", result_reg);
                         return result_reg;
                     }
 
@@ -508,48 +713,48 @@ static int codegen_expr(CodeGen *cg, ASTNode *node) {
                         ASTNode *body_node = node->data.call.args.nodes[1];
 
                         if (url_node->type == NODE_STR && body_node->type == NODE_STR) {
-                            int url_idx = cg->string_counter++;
-                            int body_idx = cg->string_counter++;
+                            int url_idx = url_node->data.str.id;
+                            int body_idx = body_node->data.str.id;
 
                             size_t url_len = actual_string_len(url_node->data.str.value) + 1;
                             size_t body_len = actual_string_len(body_node->data.str.value) + 1;
 
                             int url_ptr = next_temp(cg);
-                            fprintf(cg->out, "  %%t%d = getelementptr [%zu x i8], [%zu x i8]* @.str%d, i32 0, i32 0\n",
-                                    url_ptr, url_len, url_len, url_idx);
+                            irbuf_printf(cg->out, "  %%t%d = getelementptr [%zu x i8], [%zu x i8]* @.str%d, i32 0, i32 0\n",
+                                         url_ptr, url_len, url_len, url_idx);
 
                             int body_ptr = next_temp(cg);
-                            fprintf(cg->out, "  %%t%d = getelementptr [%zu x i8], [%zu x i8]* @.str%d, i32 0, i32 0\n",
-                                    body_ptr, body_len, body_len, body_idx);
+                            irbuf_printf(cg->out, "  %%t%d = getelementptr [%zu x i8], [%zu x i8]* @.str%d, i32 0, i32 0\n",
+                                         body_ptr, body_len, body_len, body_idx);
 
                             // Call http_post
                             int response_ptr = next_temp(cg);
-                            fprintf(cg->out, "  %%t%d = call i8* @nerd_http_post(i8* %%t%d, i8* %%t%d)\n",
-                                    response_ptr, url_ptr, body_ptr);
+                            irbuf_printf(cg->out, "  %%t%d = call i8* @nerd_http_post(i8* %%t%d, i8* %%t%d)\n",
+                                         response_ptr, url_ptr, body_ptr);
 
                             // Print response if not null
                             int is_null = next_temp(cg);
-                            fprintf(cg->out, "  %%t%d = icmp eq i8* %%t%d, null\n", is_null, response_ptr);
+                            irbuf_printf(cg->out, "  %%t%d = icmp eq i8* %%t%d, null\n", is_null, response_ptr);
 
                             int then_label = next_label(cg);
                             int else_label = next_label(cg);
                             int end_label = next_label(cg);
 
-                            fprintf(cg->out, "  br i1 %%t%d, label %%http_err%d, label %%http_ok%d\n",
-                                    is_null, then_label, else_label);
+                            irbuf_printf(cg->out, "  br i1 %%t%d, label %%http_err%d, label %%http_ok%d\n",
+                                         is_null, then_label, else_label);
 
-                            fprintf(cg->out, "http_err%d:\n", then_label);
-                            fprintf(cg->out, "  br label %%http_end%d\n", end_label);
+                            irbuf_printf(cg->out, "http_err%d:\n", then_label);
+                            irbuf_printf(cg->out, "  br label %%http_end%d\n", end_label);
 
-                            fprintf(cg->out, "http_ok%d:\n", else_label);
-                            fprintf(cg->out, "  call i32 (i8*, ...) @printf(i8* getelementptr ([4 x i8], [4 x i8]* @.fmt_str, i32 0, i32 0), i8* %%t%d)\n", response_ptr);
-                            fprintf(cg->out, "  call void @nerd_http_free(i8* %%t%d)\n", response_ptr);
-                            fprintf(cg->out, "  br label %%http_end%d\n", end_label);
+                            irbuf_printf(cg->out, "http_ok%d:\n", else_label);
+                            irbuf_printf(cg->out, "  call i32 (i8*, ...) @printf(i8* getelementptr ([4 x i8], [4 x i8]* @.fmt_str, i32 0, i32 0), i8* %%t%d)\n", response_ptr);
+                            irbuf_printf(cg->out, "  call void @nerd_http_free(i8* %%t%d)\n", response_ptr);
+                            irbuf_printf(cg->out, "  br label %%http_end%d\n", end_label);
 
-                            fprintf(cg->out, "http_end%d:\n", end_label);
+                            irbuf_printf(cg->out, "http_end%d:\n", end_label);
                         }
 
-                        fprintf(cg->out, "  %%t%d = fadd double 0.0, 0.0\n", result_reg);
+                        irbuf_printf(cg->out, "  %%t%d = fadd double 0.0, 0.0\n", result_reg);
                         return result_reg;
                     }
                 }
@@ -563,22 +768,22 @@ static int codegen_expr(CodeGen *cg, ASTNode *node) {
                     // mcp tools url - list tools from MCP server
                     if (strcmp(node->data.call.func, "tools") == 0) {
                         if (url_node->type == NODE_STR) {
-                            int url_idx = cg->string_counter++;
+                            int url_idx = url_node->data.str.id;
                             size_t url_len = actual_string_len(url_node->data.str.value) + 1;
 
                             int url_ptr = next_temp(cg);
-                            fprintf(cg->out, "  %%t%d = getelementptr [%zu x i8], [%zu x i8]* @.str%d, i32 0, i32 0\n",
-                                    url_ptr, url_len, url_len, url_idx);
+                            irbuf_printf(cg->out, "  %%t%d = getelementptr [%zu x i8], [%zu x i8]* @.str%d, i32 0, i32 0\n",
+                                         url_ptr, url_len, url_len, url_idx);
 
                             // Call mcp_list
                             int response_ptr = next_temp(cg);
-                            fprintf(cg->out, "  %%t%d = call i8* @nerd_mcp_list(i8* %%t%d)\n", response_ptr, url_ptr);
+                            irbuf_printf(cg->out, "  %%t%d = call i8* @nerd_mcp_list(i8* %%t%d)\n", response_ptr, url_ptr);
 
                             // Free response
-                            fprintf(cg->out, "  call void @nerd_mcp_free(i8* %%t%d)\n", response_ptr);
+                            irbuf_printf(cg->out, "  call void @nerd_mcp_free(i8* %%t%d)\n", response_ptr);
                         }
 
-                        fprintf(cg->out, "  %%t%d = fadd double 0.0, 0.0\n", result_reg);
+                        irbuf_printf(cg->out, "  %%t%d = fadd double 0.0, 0.0\n", result_reg);
                         return result_reg;
                     }
 
@@ -588,64 +793,64 @@ static int codegen_expr(CodeGen *cg, ASTNode *node) {
                         ASTNode *args_node = node->data.call.args.nodes[2];
 
                         if (url_node->type == NODE_STR && tool_node->type == NODE_STR && args_node->type == NODE_STR) {
-                            int url_idx = cg->string_counter++;
-                            int tool_idx = cg->string_counter++;
-                            int args_idx = cg->string_counter++;
+                            int url_idx = url_node->data.str.id;
+                            int tool_idx = tool_node->data.str.id;
+                            int args_idx = args_node->data.str.id;
 
                             size_t url_len = actual_string_len(url_node->data.str.value) + 1;
                             size_t tool_len = actual_string_len(tool_node->data.str.value) + 1;
                             size_t args_len = actual_string_len(args_node->data.str.value) + 1;
 
                             int url_ptr = next_temp(cg);
-                            fprintf(cg->out, "  %%t%d = getelementptr [%zu x i8], [%zu x i8]* @.str%d, i32 0, i32 0\n",
-                                    url_ptr, url_len, url_len, url_idx);
+                            irbuf_printf(cg->out, "  %%t%d = getelementptr [%zu x i8], [%zu x i8]* @.str%d, i32 0, i32 0\n",
+                                         url_ptr, url_len, url_len, url_idx);
 
                             int tool_ptr = next_temp(cg);
-                            fprintf(cg->out, "  %%t%d = getelementptr [%zu x i8], [%zu x i8]* @.str%d, i32 0, i32 0\n",
-                                    tool_ptr, tool_len, tool_len, tool_idx);
+                            irbuf_printf(cg->out, "  %%t%d = getelementptr [%zu x i8], [%zu x i8]* @.str%d, i32 0, i32 0\n",
+                                         tool_ptr, tool_len, tool_len, tool_idx);
 
                             int args_ptr = next_temp(cg);
-                            fprintf(cg->out, "  %%t%d = getelementptr [%zu x i8], [%zu x i8]* @.str%d, i32 0, i32 0\n",
-                                    args_ptr, args_len, args_len, args_idx);
+                            irbuf_printf(cg->out, "  %%t%d = getelementptr [%zu x i8], [%zu x i8]* @.str%d, i32 0, i32 0\n",
+                                         args_ptr, args_len, args_len, args_idx);
 
                             // Call mcp_send
                             int response_ptr = next_temp(cg);
-                            fprintf(cg->out, "  %%t%d = call i8* @nerd_mcp_send(i8* %%t%d, i8* %%t%d, i8* %%t%d)\n",
-                                    response_ptr, url_ptr, tool_ptr, args_ptr);
+                            irbuf_printf(cg->out, "  %%t%d = call i8* @nerd_mcp_send(i8* %%t%d, i8* %%t%d, i8* %%t%d)\n",
+                                         response_ptr, url_ptr, tool_ptr, args_ptr);
 
                             // Free response
-                            fprintf(cg->out, "  call void @nerd_mcp_free(i8* %%t%d)\n", response_ptr);
+                            irbuf_printf(cg->out, "  call void @nerd_mcp_free(i8* %%t%d)\n", response_ptr);
                         }
 
-                        fprintf(cg->out, "  %%t%d = fadd double 0.0, 0.0\n", result_reg);
+                        irbuf_printf(cg->out, "  %%t%d = fadd double 0.0, 0.0\n", result_reg);
                         return result_reg;
                     }
 
                     // mcp init url - initialize MCP session (optional)
                     if (strcmp(node->data.call.func, "init") == 0) {
                         if (url_node->type == NODE_STR) {
-                            int url_idx = cg->string_counter++;
+                            int url_idx = url_node->data.str.id;
                             size_t url_len = actual_string_len(url_node->data.str.value) + 1;
 
                             int url_ptr = next_temp(cg);
-                            fprintf(cg->out, "  %%t%d = getelementptr [%zu x i8], [%zu x i8]* @.str%d, i32 0, i32 0\n",
-                                    url_ptr, url_len, url_len, url_idx);
+                            irbuf_printf(cg->out, "  %%t%d = getelementptr [%zu x i8], [%zu x i8]* @.str%d, i32 0, i32 0\n",
+                                         url_ptr, url_len, url_len, url_idx);
 
                             // Call mcp_init
                             int response_ptr = next_temp(cg);
-                            fprintf(cg->out, "  %%t%d = call i8* @nerd_mcp_init(i8* %%t%d)\n", response_ptr, url_ptr);
+                            irbuf_printf(cg->out, "  %%t%d = call i8* @nerd_mcp_init(i8* %%t%d)\n", response_ptr, url_ptr);
 
                             // Free response
-                            fprintf(cg->out, "  call void @nerd_mcp_free(i8* %%t%d)\n", response_ptr);
+                            irbuf_printf(cg->out, "  call void @nerd_mcp_free(i8* %%t%d)\n", response_ptr);
                         }
 
-                        fprintf(cg->out, "  %%t%d = fadd double 0.0, 0.0\n", result_reg);
+                        irbuf_printf(cg->out, "  %%t%d = fadd double 0.0, 0.0\n", result_reg);
                         return result_reg;
                     }
                 }
 
                 // Default for mcp module
-                fprintf(cg->out, "  %%t%d = fadd double 0.0, 0.0\n", result_reg);
+                irbuf_printf(cg->out, "  %%t%d = fadd double 0.0, 0.0\n", result_reg);
                 return result_reg;
             }
 
@@ -654,44 +859,359 @@ static int codegen_expr(CodeGen *cg, ASTNode *node) {
                 if (node->data.call.args.count >= 1) {
                     ASTNode *prompt_node = node->data.call.args.nodes[0];
 
+                    // llm claude "system" "prompt" - Call Claude with a system prompt
+                    ASTNode *system_node = node->data.call.args.count >= 2 ? node->data.call.args.nodes[0] : NULL;
+                    if (strcmp(node->data.call.func, "claude") == 0 && system_node &&
+                        system_node->type == NODE_STR && node->data.call.args.nodes[1]->type == NODE_STR) {
+                        prompt_node = node->data.call.args.nodes[1];
+                        size_t system_len = actual_string_len(system_node->data.str.value) + 1;
+                        size_t prompt_len = actual_string_len(prompt_node->data.str.value) + 1;
+
+                        int system_ptr = next_temp(cg);
+                        irbuf_printf(cg->out, "  %%t%d = getelementptr [%zu x i8], [%zu x i8]* @.str%d, i32 0, i32 0\n",
+                                     system_ptr, system_len, system_len, system_node->data.str.id);
+                        int prompt_ptr = next_temp(cg);
+                        irbuf_printf(cg->out, "  %%t%d = getelementptr [%zu x i8], [%zu x i8]* @.str%d, i32 0, i32 0\n",
+                                     prompt_ptr, prompt_len, prompt_len, prompt_node->data.str.id);
+
+                        // Call llm_claude_system
+                        int response_ptr = next_temp(cg);
+                        irbuf_printf(cg->out, "  %%t%d = call i8* @nerd_llm_claude_system(i8* %%t%d, i8* %%t%d)\n",
+                                     response_ptr, system_ptr, prompt_ptr);
+
+                        // Free response
+                        irbuf_printf(cg->out, "  call void @nerd_llm_free(i8* %%t%d)\n", response_ptr);
+                        irbuf_printf(cg->out, "  %%t%d = fadd double 0.0, 0.0\n", result_reg);
+                        return result_reg;
+                    }
+
                     // llm claude "prompt" - Call Claude
                     if (strcmp(node->data.call.func, "claude") == 0) {
                         if (prompt_node->type == NODE_STR) {
-                            int prompt_idx = cg->string_counter++;
+                            int prompt_idx = prompt_node->data.str.id;
                             size_t prompt_len = actual_string_len(prompt_node->data.str.value) + 1;
 
                             int prompt_ptr = next_temp(cg);
-                            fprintf(cg->out, "  %%t%d = getelementptr [%zu x i8], [%zu x i8]* @.str%d, i32 0, i32 0\n",
-                                    prompt_ptr, prompt_len, prompt_len, prompt_idx);
+                            irbuf_printf(cg->out, "  %%t%d = getelementptr [%zu x i8], [%zu x i8]* @.str%d, i32 0, i32 0\n",
+                                         prompt_ptr, prompt_len, prompt_len, prompt_idx);
 
                             // Call llm_claude
                             int response_ptr = next_temp(cg);
-                            fprintf(cg->out, "  %%t%d = call i8* @nerd_llm_claude(i8* %%t%d)\n", response_ptr, prompt_ptr);
+                            irbuf_printf(cg->out, "  %%t%d = call i8* @nerd_llm_claude(i8* %%t%d)\n", response_ptr, prompt_ptr);
 
                             // Free response
-                            fprintf(cg->out, "  call void @nerd_llm_free(i8* %%t%d)\n", response_ptr);
+                            irbuf_printf(cg->out, "  call void @nerd_llm_free(i8* %%t%d)\n", response_ptr);
                         }
 
-                        fprintf(cg->out, "  %%t%d = fadd double 0.0, 0.0\n", result_reg);
+                        irbuf_printf(cg->out, "  %%t%d = fadd double 0.0, 0.0\n", result_reg);
                         return result_reg;
                     }
                 }
 
-                fprintf(cg->out, "  %%t%d = fadd double 0.0, 0.0\n", result_reg);
+                irbuf_printf(cg->out, "  %%t%d = fadd double 0.0, 0.0\n", result_reg);
                 return result_reg;
             }
 
             // Default: return 0 for unimplemented calls
-            fprintf(cg->out, "  %%t%d = fadd double 0.0, 0.0\n", result_reg);
+            irbuf_printf(cg->out, "  %%t%d = fadd double 0.0, 0.0\n", result_reg);
             return result_reg;
         }
 
         default:
-            fprintf(stderr, "Error: Unknown expression node type %d\n", node->type);
+            fprintf(nerd_diag(), "Error: Unknown expression node type %d\n", node->type);
             return -1;
     }
 }
 
+/*
+ * Branch sites (if, while and repeat conditions) in a statement list; an
+ * upper bound on the sites codegen_stmt emits for it
+ */
+static size_t count_sites(ASTList *body);
+
+static size_t count_stmt_sites(ASTNode *node) {
+    if (!node) return 0;
+    switch (node->type) {
+        case NODE_IF:
+            return 1 + count_stmt_sites(node->data.if_stmt.then_stmt) +
+                   count_stmt_sites(node->data.if_stmt.else_stmt);
+        case NODE_REPEAT:
+            return 1 + count_sites(&node->data.repeat.body);
+        case NODE_WHILE:
+            return 1 + count_sites(&node->data.while_loop.body);
+        default:
+            return 0;
+    }
+}
+
+static size_t count_sites(ASTList *body) {
+    size_t n = 0;
+    for (size_t i = 0; i < body->count; i++) {
+        n += count_stmt_sites(body->nodes[i]);
+    }
+    return n;
+}
+
+/*
+ * Increment the current function's counter at `slot_reg` (-1: the call count)
+ */
+static void emit_count(CodeGen *cg, int slot_reg) {
+    const char *name = cg->current_func->data.func_def.name;
+    int ptr = next_temp(cg);
+    int old = next_temp(cg);
+    int inc = next_temp(cg);
+    irbuf_printf(cg->out, "  %%t%d = getelementptr inbounds [%zu x i64], [%zu x i64]* @__nerd_prof.%s, i64 0, i64 ",
+                 ptr, cg->prof_slots, cg->prof_slots, name);
+    if (slot_reg < 0) {
+        irbuf_printf(cg->out, "0\n");
+    } else {
+        irbuf_printf(cg->out, "%%t%d\n", slot_reg);
+    }
+    irbuf_printf(cg->out, "  %%t%d = load i64, i64* %%t%d\n", old, ptr);
+    irbuf_printf(cg->out, "  %%t%d = add i64 %%t%d, 1\n", inc, old);
+    irbuf_printf(cg->out, "  store i64 %%t%d, i64* %%t%d\n", inc, ptr);
+}
+
+/*
+ * Conditional branch of a branch site: counted when instrumenting, and
+ * weighted with the profile's counts when it has them
+ */
+static void emit_cond_br(CodeGen *cg, int bool_reg, const char *then_name, int then_label,
+                         const char *else_name, int else_label) {
+    size_t site = cg->prof_site++;
+    if (cg->instrument) {
+        int taken = next_temp(cg);
+        int slot = next_temp(cg);
+        irbuf_printf(cg->out, "  %%t%d = zext i1 %%t%d to i64\n", taken, bool_reg);
+        irbuf_printf(cg->out, "  %%t%d = add i64 %%t%d, %zu\n", slot, taken, 1 + 2 * site);
+        emit_count(cg, slot);
+    }
+
+    irbuf_printf(cg->out, "  br i1 %%t%d, label %%%s%d, label %%%s%d",
+                 bool_reg, then_name, then_label, else_name, else_label);
+    if (cg->func_profile) {
+        uint64_t no = cg->func_profile->counts[1 + 2 * site];
+        uint64_t yes = cg->func_profile->counts[2 + 2 * site];
+        if (yes || no) {
+            // Weights are 32-bit: scale both down together
+            uint64_t scale = (yes > no ? yes : no) / UINT32_MAX + 1;
+            irbuf_printf(cg->out, ", !prof !{!\"branch_weights\", i32 %llu, i32 %llu}",
+                         (unsigned long long)(yes / scale), (unsigned long long)(no / scale));
+        }
+    }
+    irbuf_printf(cg->out, "\n");
+}
+
+/*
+ * Store a let's value: into the variable if it exists, else a new one
+ */
+static void store_let(CodeGen *cg, const char *name, int val_reg) {
+    // Check if variable already exists (reassignment)
+    int existing = find_local(cg, name);
+    if (existing >= 0) {
+        // Update existing variable
+        irbuf_printf(cg->out, "  store double %%t%d, double* %%local%d\n", val_reg, existing);
+    } else {
+        // Create new variable
+        int local_id = (int)cg->local_count;
+        irbuf_printf(cg->out, "  %%local%d = alloca double\n", local_id);
+        irbuf_printf(cg->out, "  store double %%t%d, double* %%local%d\n", val_reg, local_id);
+        add_local(cg, name, local_id);
+    }
+}
+
+/*
+ * Concurrent network statements
+ *
+ * Consecutive statements that each make one network call (http, mcp or llm
+ * with literal arguments, alone or as a let) are issued together: each call
+ * is started on a runtime thread once the earlier calls it depends on are
+ * done, and all are waited for in program order where the run ends. The
+ * responses are printed at the wait, so output keeps program order. Calls
+ * read nothing but their literals and evaluate to 0, so the only
+ * dependencies are through the server: a call depends on an earlier one to
+ * the same URL unless both are GETs. llm calls with the same system prompt
+ * wait for the first of them, which puts the prompt in the API's prompt
+ * cache for the rest to read.
+ */
+#define NET_RUN_MAX 64      // calls in flight per run
+
+typedef struct {
+    ASTNode *stmt;
+    ASTNode *call;
+    const char *runtime;    // http, mcp or llm
+    const char *func;       // nerd_<runtime>_<func>_start
+    size_t argc;            // leading string literals passed to it
+    const char *target;     // URL, or the system prompt of an llm call
+    bool reads;             // GET: may overlap other GETs of the URL
+    bool prefix;            // llm call with a cached system prompt
+    bool first;             // first call of the run with its system prompt
+} NetCall;
+
+static bool net_call(ASTNode *stmt, NetCall *nc) {
+    ASTNode *call;
+    if (stmt->type == NODE_EXPR_STMT) {
+        call = stmt->data.expr_stmt.expr;
+    } else if (stmt->type == NODE_LET) {
+        call = stmt->data.let.value;
+    } else {
+        return false;
+    }
+    if (!call || call->type != NODE_CALL || !call->data.call.module) return false;
+
+    memset(nc, 0, sizeof(*nc));
+    const char *module = call->data.call.module;
+    const char *func = call->data.call.func;
+    if (strcmp(module, "http") == 0) {
+        nc->reads = strcmp(func, "get") == 0 || strcmp(func, "getall") == 0;
+        if (!nc->reads && strcmp(func, "post") != 0) return false;
+        nc->argc = nc->reads ? 1 : 2;
+    } else if (strcmp(module, "mcp") == 0) {
+        if (strcmp(func, "tools") == 0) {
+            func = "list";
+            nc->argc = 1;
+        } else if (strcmp(func, "init") == 0) {
+            nc->argc = 1;
+        } else if (strcmp(func, "send") == 0) {
+            nc->argc = 3;
+        } else {
+            return false;
+        }
+    } else if (strcmp(module, "llm") == 0) {
+        if (strcmp(func, "claude") != 0) return false;
+        // With two literals, the first is the system prompt
+        ASTList *args = &call->data.call.args;
+        bool system = args->count >= 2 && args->nodes[0]->type == NODE_STR && args->nodes[1]->type == NODE_STR;
+        func = system ? "claude_system" : "claude";
+        nc->argc = system ? 2 : 1;
+    } else {
+        return false;
+    }
+
+    ASTList *args = &call->data.call.args;
+    if (args->count < nc->argc) return false;
+    for (size_t i = 0; i < nc->argc; i++) {
+        if (args->nodes[i]->type != NODE_STR) return false;
+    }
+    nc->stmt = stmt;
+    nc->call = call;
+    nc->runtime = module;
+    nc->func = func;
+    nc->prefix = strcmp(func, "claude_system") == 0;
+    nc->target = strcmp(module, "llm") != 0 || nc->prefix ? args->nodes[0]->data.str.value : NULL;
+    return true;
+}
+
+static bool net_depends(const NetCall *later, const NetCall *earlier) {
+    if (!later->target || !earlier->target) return false;
+    if (strcmp(later->target, earlier->target) != 0) return false;
+    if (later->prefix || earlier->prefix) return later->prefix && earlier->prefix && earlier->first;
+    return !(later->reads && earlier->reads);
+}
+
+static int net_start(CodeGen *cg, const NetCall *nc) {
+    int ptrs[3];
+    for (size_t i = 0; i < nc->argc; i++) {
+        ASTNode *arg = nc->call->data.call.args.nodes[i];
+        size_t len = actual_string_len(arg->data.str.value) + 1;
+        ptrs[i] = next_temp(cg);
+        irbuf_printf(cg->out, "  %%t%d = getelementptr [%zu x i8], [%zu x i8]* @.str%d, i32 0, i32 0\n",
+                     ptrs[i], len, len, arg->data.str.id);
+    }
+
+    int task = next_temp(cg);
+    irbuf_printf(cg->out, "  %%t%d = call i8* @nerd_%s_%s_start(", task, nc->runtime, nc->func);
+    for (size_t i = 0; i < nc->argc; i++) {
+        irbuf_printf(cg->out, "%si8* %%t%d", i > 0 ? ", " : "", ptrs[i]);
+    }
+    irbuf_printf(cg->out, ")\n");
+
+    if (nc->stmt->type == NODE_LET) {
+        int zero = next_temp(cg);
+        irbuf_printf(cg->out, "  %%t%d = fadd double 0.0, 0.0\n", zero);
+        store_let(cg, nc->stmt->data.let.name, zero);
+    }
+    return task;
+}
+
+// Wait for a call and print its response as the blocking call would
+static void net_wait(CodeGen *cg, const NetCall *nc, int task) {
+    int response_ptr = next_temp(cg);
+    irbuf_printf(cg->out, "  %%t%d = call i8* @nerd_%s_wait(i8* %%t%d)\n", response_ptr, nc->runtime, task);
+    if (strcmp(nc->runtime, "http") != 0) {
+        // mcp and llm print in the runtime
+        irbuf_printf(cg->out, "  call void @nerd_%s_free(i8* %%t%d)\n", nc->runtime, response_ptr);
+        return;
+    }
+
+    int is_null = next_temp(cg);
+    int then_label = next_label(cg);
+    int else_label = next_label(cg);
+    int end_label = next_label(cg);
+    irbuf_printf(cg->out, "  %%t%d = icmp eq i8* %%t%d, null\n", is_null, response_ptr);
+    irbuf_printf(cg->out, "  br i1 %%t%d, label %%http_err%d, label %%http_ok%d\n",
+                 is_null, then_label, else_label);
+    irbuf_printf(cg->out, "http_err%d:\n", then_label);
+    irbuf_printf(cg->out, "  br label %%http_end%d\n", end_label);
+    irbuf_printf(cg->out, "http_ok%d:\n", else_label);
+    irbuf_printf(cg->out, "  call i32 (i8*, ...) @printf(i8* getelementptr ([4 x i8], [4 x i8]* @.fmt_str, i32 0, i32 0), i8* %%t%d)\n", response_ptr);
+    irbuf_printf(cg->out, "  call void @nerd_http_free(i8* %%t%d)\n", response_ptr);
+    irbuf_printf(cg->out, "  br label %%http_end%d\n", end_label);
+    irbuf_printf(cg->out, "http_end%d:\n", end_label);
+}
+
+/*
+ * Issue the run of network statements starting at body[first], if there
+ * are at least two; returns the number of statements generated
+ */
+static size_t codegen_net_run(CodeGen *cg, ASTList *body, size_t first) {
+    NetCall calls[NET_RUN_MAX];
+    int tasks[NET_RUN_MAX];
+    size_t n = 0;
+    while (first + n < body->count && n < NET_RUN_MAX && net_call(body->nodes[first + n], &calls[n])) {
+        calls[n].first = true;
+        for (size_t j = 0; j < n && calls[n].prefix; j++) {
+            if (calls[j].prefix && strcmp(calls[j].target, calls[n].target) == 0) calls[n].first = false;
+        }
+        n++;
+    }
+    if (n < 2) return 0;
+
+    size_t waited = 0;
+    for (size_t i = 0; i < n; i++) {
+        // Wait for the latest call this one depends on, and the ones before it
+        for (size_t j = i; j-- > waited;) {
+            if (net_depends(&calls[i], &calls[j])) {
+                while (waited <= j) {
+                    net_wait(cg, &calls[waited], tasks[waited]);
+                    waited++;
+                }
+                break;
+            }
+        }
+        tasks[i] = net_start(cg, &calls[i]);
+    }
+    while (waited < n) {
+        net_wait(cg, &calls[waited], tasks[waited]);
+        waited++;
+    }
+    return n;
+}
+
+/*
+ * Generate a statement list
+ */
+static void codegen_block(CodeGen *cg, ASTList *body, int *result_reg) {
+    for (size_t i = 0; i < body->count;) {
+        size_t n = codegen_net_run(cg, body, i);
+        if (n == 0) {
+            codegen_stmt(cg, body->nodes[i], result_reg);
+            n = 1;
+        }
+        i += n;
+    }
+}
+
 /*
  * Generate code for statement
  */
@@ -702,7 +1222,7 @@ static void codegen_stmt(CodeGen *cg, ASTNode *node, int *result_reg) {
         case NODE_RETURN: {
             int val_reg = codegen_expr(cg, node->data.ret.value);
             if (val_reg >= 0) {
-                fprintf(cg->out, "  ret double %%t%d\n", val_reg);
+                irbuf_printf(cg->out, "  ret double %%t%d\n", val_reg);
             }
             break;
         }
@@ -716,22 +1236,22 @@ static void codegen_stmt(CodeGen *cg, ASTNode *node, int *result_reg) {
             int else_label = next_label(cg);
             int end_label = next_label(cg);
 
-            fprintf(cg->out, "  %%t%d = fcmp one double %%t%d, 0.0\n", bool_reg, cond_reg);
+            irbuf_printf(cg->out, "  %%t%d = fcmp one double %%t%d, 0.0\n", bool_reg, cond_reg);
 
             if (node->data.if_stmt.else_stmt) {
                 // Has else branch
-                fprintf(cg->out, "  br i1 %%t%d, label %%then%d, label %%else%d\n", bool_reg, then_label, else_label);
+                emit_cond_br(cg, bool_reg, "then", then_label, "else", else_label);
 
                 // Then block
-                fprintf(cg->out, "then%d:\n", then_label);
+                irbuf_printf(cg->out, "then%d:\n", then_label);
                 codegen_stmt(cg, node->data.if_stmt.then_stmt, result_reg);
                 bool then_returns = (node->data.if_stmt.then_stmt->type == NODE_RETURN);
                 if (!then_returns) {
-                    fprintf(cg->out, "  br label %%end%d\n", end_label);
+                    irbuf_printf(cg->out, "  br label %%end%d\n", end_label);
                 }
 
                 // Else block
-                fprintf(cg->out, "else%d:\n", else_label);
+                irbuf_printf(cg->out, "else%d:\n", else_label);
                 codegen_stmt(cg, node->data.if_stmt.else_stmt, result_reg);
 
                 // Check if else needs a branch to end
@@ -739,23 +1259,23 @@ static void codegen_stmt(CodeGen *cg, ASTNode *node, int *result_reg) {
 
                 if (!else_returns) {
                     // Always branch to end after else block (including after nested if)
-                    fprintf(cg->out, "  br label %%end%d\n", end_label);
+                    irbuf_printf(cg->out, "  br label %%end%d\n", end_label);
                 }
 
                 // Always emit end label for if-else (needed for merging control flow)
-                fprintf(cg->out, "end%d:\n", end_label);
+                irbuf_printf(cg->out, "end%d:\n", end_label);
             } else {
                 // No else branch
-                fprintf(cg->out, "  br i1 %%t%d, label %%then%d, label %%end%d\n", bool_reg, then_label, end_label);
+                emit_cond_br(cg, bool_reg, "then", then_label, "end", end_label);
 
-                fprintf(cg->out, "then%d:\n", then_label);
+                irbuf_printf(cg->out, "then%d:\n", then_label);
                 codegen_stmt(cg, node->data.if_stmt.then_stmt, result_reg);
 
                 if (node->data.if_stmt.then_stmt->type != NODE_RETURN) {
-                    fprintf(cg->out, "  br label %%end%d\n", end_label);
+                    irbuf_printf(cg->out, "  br label %%end%d\n", end_label);
                 }
 
-                fprintf(cg->out, "end%d:\n", end_label);
+                irbuf_printf(cg->out, "end%d:\n", end_label);
             }
             break;
         }
@@ -763,19 +1283,7 @@ static void codegen_stmt(CodeGen *cg, ASTNode *node, int *result_reg) {
         case NODE_LET: {
             int val_reg = codegen_expr(cg, node->data.let.value);
             if (val_reg < 0) return;
-
-            // Check if variable already exists (reassignment)
-            int existing = find_local(cg, node->data.let.name);
-            if (existing >= 0) {
-                // Update existing variable
-                fprintf(cg->out, "  store double %%t%d, double* %%local%d\n", val_reg, existing);
-            } else {
-                // Create new variable
-                int local_id = (int)cg->local_count;
-                fprintf(cg->out, "  %%local%d = alloca double\n", local_id);
-                fprintf(cg->out, "  store double %%t%d, double* %%local%d\n", val_reg, local_id);
-                add_local(cg, node->data.let.name, local_id);
-            }
+            store_let(cg, node->data.let.name, val_reg);
             break;
         }
 
@@ -795,46 +1303,80 @@ static void codegen_stmt(CodeGen *cg, ASTNode *node, int *result_reg) {
             int loop_body = next_label(cg);
             int loop_end = next_label(cg);
 
-            // Allocate counter variable (starts at 1)
-            int counter_id = (int)cg->local_count;
-            fprintf(cg->out, "  %%local%d = alloca double\n", counter_id);
-            fprintf(cg->out, "  store double 1.0, double* %%local%d\n", counter_id);
+            const char *var_name = node->data.repeat.var_name;
+            if (var_name && ast_list_writes(&node->data.repeat.body, var_name)) {
+                // Body assigns the loop variable: keep a double counter in memory
+                int counter_id = (int)cg->local_count;
+                irbuf_printf(cg->out, "  %%local%d = alloca double\n", counter_id);
+                irbuf_printf(cg->out, "  store double 1.0, double* %%local%d\n", counter_id);
+                add_local(cg, var_name, counter_id);
 
-            // If there's an 'as' variable, set up the binding
-            if (node->data.repeat.var_name) {
-                add_local(cg, node->data.repeat.var_name, counter_id);
-            } else {
-                // Need to track the counter even without a name
-                cg->local_count++;
-            }
+                irbuf_printf(cg->out, "  br label %%loop_start%d\n", loop_start);
+                irbuf_printf(cg->out, "loop_start%d:\n", loop_start);
 
-            // Loop condition check
-            fprintf(cg->out, "  br label %%loop_start%d\n", loop_start);
-            fprintf(cg->out, "loop_start%d:\n", loop_start);
+                int counter_val = next_temp(cg);
+                irbuf_printf(cg->out, "  %%t%d = load double, double* %%local%d\n", counter_val, counter_id);
+
+                int cmp_reg = next_temp(cg);
+                irbuf_printf(cg->out, "  %%t%d = fcmp ole double %%t%d, %%t%d\n", cmp_reg, counter_val, count_reg);
+                emit_cond_br(cg, cmp_reg, "loop_body", loop_body, "loop_end", loop_end);
 
-            int counter_val = next_temp(cg);
-            fprintf(cg->out, "  %%t%d = load double, double* %%local%d\n", counter_val, counter_id);
+                irbuf_printf(cg->out, "loop_body%d:\n", loop_body);
+                codegen_block(cg, &node->data.repeat.body, result_reg);
+
+                int inc_load = next_temp(cg);
+                int inc_add = next_temp(cg);
+                irbuf_printf(cg->out, "  %%t%d = load double, double* %%local%d\n", inc_load, counter_id);
+                irbuf_printf(cg->out, "  %%t%d = fadd double %%t%d, 1.0\n", inc_add, inc_load);
+                irbuf_printf(cg->out, "  store double %%t%d, double* %%local%d\n", inc_add, counter_id);
+                irbuf_printf(cg->out, "  br label %%loop_start%d\n", loop_start);
+
+                irbuf_printf(cg->out, "loop_end%d:\n", loop_end);
+                break;
+            }
 
+            // Trip count: floor(n) iterations when n >= 1, else none. The
+            // clamp keeps fptosi defined for absurdly large counts.
+            int floor_reg = next_temp(cg);
+            int ge_reg = next_temp(cg);
+            int sel_reg = next_temp(cg);
+            int clamp_reg = next_temp(cg);
+            int trip_reg = next_temp(cg);
+            irbuf_printf(cg->out, "  %%t%d = call double @llvm.floor.f64(double %%t%d)\n", floor_reg, count_reg);
+            irbuf_printf(cg->out, "  %%t%d = fcmp oge double %%t%d, 1.0\n", ge_reg, count_reg);
+            irbuf_printf(cg->out, "  %%t%d = select i1 %%t%d, double %%t%d, double 0.0\n", sel_reg, ge_reg, floor_reg);
+            irbuf_printf(cg->out, "  %%t%d = call double @llvm.minnum.f64(double %%t%d, double 9.0e18)\n", clamp_reg, sel_reg);
+            irbuf_printf(cg->out, "  %%t%d = fptosi double %%t%d to i64\n", trip_reg, clamp_reg);
+
+            // Preheader gives the induction phi a known predecessor
+            irbuf_printf(cg->out, "  br label %%loop_pre%d\n", loop_start);
+            irbuf_printf(cg->out, "loop_pre%d:\n", loop_start);
+            irbuf_printf(cg->out, "  br label %%loop_start%d\n", loop_start);
+
+            irbuf_printf(cg->out, "loop_start%d:\n", loop_start);
+            irbuf_printf(cg->out, "  %%iv%d = phi i64 [ 1, %%loop_pre%d ], [ %%iv%d.next, %%loop_latch%d ]\n",
+                         loop_start, loop_start, loop_start, loop_start);
             int cmp_reg = next_temp(cg);
-            fprintf(cg->out, "  %%t%d = fcmp ole double %%t%d, %%t%d\n", cmp_reg, counter_val, count_reg);
-            fprintf(cg->out, "  br i1 %%t%d, label %%loop_body%d, label %%loop_end%d\n", cmp_reg, loop_body, loop_end);
+            irbuf_printf(cg->out, "  %%t%d = icmp sle i64 %%iv%d, %%t%d\n", cmp_reg, loop_start, trip_reg);
+            emit_cond_br(cg, cmp_reg, "loop_body", loop_body, "loop_end", loop_end);
 
-            // Loop body
-            fprintf(cg->out, "loop_body%d:\n", loop_body);
-            for (size_t i = 0; i < node->data.repeat.body.count; i++) {
-                codegen_stmt(cg, node->data.repeat.body.nodes[i], result_reg);
+            // Loop body ('as' variable reads convert the i64 on demand)
+            irbuf_printf(cg->out, "loop_body%d:\n", loop_body);
+            if (var_name) {
+                add_binding(cg, var_name, loop_start, true);
             }
+            codegen_block(cg, &node->data.repeat.body, result_reg);
+            irbuf_printf(cg->out, "  br label %%loop_latch%d\n", loop_start);
 
-            // Increment counter
-            int inc_load = next_temp(cg);
-            int inc_add = next_temp(cg);
-            fprintf(cg->out, "  %%t%d = load double, double* %%local%d\n", inc_load, counter_id);
-            fprintf(cg->out, "  %%t%d = fadd double %%t%d, 1.0\n", inc_add, inc_load);
-            fprintf(cg->out, "  store double %%t%d, double* %%local%d\n", inc_add, counter_id);
-            fprintf(cg->out, "  br label %%loop_start%d\n", loop_start);
+            // Latch carries the loop metadata
+            irbuf_printf(cg->out, "loop_latch%d:\n", loop_start);
+            irbuf_printf(cg->out, "  %%iv%d.next = add nuw nsw i64 %%iv%d, 1\n", loop_start, loop_start);
+            irbuf_printf(cg->out, "  br label %%loop_start%d, !llvm.loop !", loop_start);
+            add_loop_md(cg, loop_is_tight(&node->data.repeat.body));
+            irbuf_printf(cg->out, "\n");
 
             // Loop end
-            fprintf(cg->out, "loop_end%d:\n", loop_end);
+            irbuf_printf(cg->out, "loop_end%d:\n", loop_end);
             break;
         }
 
@@ -846,25 +1388,23 @@ static void codegen_stmt(CodeGen *cg, ASTNode *node, int *result_reg) {
             int loop_end = next_label(cg);
 
             // Loop condition check
-            fprintf(cg->out, "  br label %%while_start%d\n", loop_start);
-            fprintf(cg->out, "while_start%d:\n", loop_start);
+            irbuf_printf(cg->out, "  br label %%while_start%d\n", loop_start);
+            irbuf_printf(cg->out, "while_start%d:\n", loop_start);
 
             int cond_reg = codegen_expr(cg, node->data.while_loop.condition);
             if (cond_reg < 0) return;
 
             int bool_reg = next_temp(cg);
-            fprintf(cg->out, "  %%t%d = fcmp one double %%t%d, 0.0\n", bool_reg, cond_reg);
-            fprintf(cg->out, "  br i1 %%t%d, label %%while_body%d, label %%while_end%d\n", bool_reg, loop_body, loop_end);
+            irbuf_printf(cg->out, "  %%t%d = fcmp one double %%t%d, 0.0\n", bool_reg, cond_reg);
+            emit_cond_br(cg, bool_reg, "while_body", loop_body, "while_end", loop_end);
 
             // Loop body
-            fprintf(cg->out, "while_body%d:\n", loop_body);
-            for (size_t i = 0; i < node->data.while_loop.body.count; i++) {
-                codegen_stmt(cg, node->data.while_loop.body.nodes[i], result_reg);
-            }
-            fprintf(cg->out, "  br label %%while_start%d\n", loop_start);
+            irbuf_printf(cg->out, "while_body%d:\n", loop_body);
+            codegen_block(cg, &node->data.while_loop.body, result_reg);
+            irbuf_printf(cg->out, "  br label %%while_start%d\n", loop_start);
 
             // Loop end
-            fprintf(cg->out, "while_end%d:\n", loop_end);
+            irbuf_printf(cg->out, "while_end%d:\n", loop_end);
             break;
         }
 
@@ -872,24 +1412,27 @@ static void codegen_stmt(CodeGen *cg, ASTNode *node, int *result_reg) {
             // inc var [amount] - increment variable
             int existing = find_local(cg, node->data.inc.var_name);
             if (existing < 0) {
-                fprintf(stderr, "Error: Unknown variable '%s' in inc\n", node->data.inc.var_name);
+                existing = spill_induction(cg, node->data.inc.var_name);
+            }
+            if (existing < 0) {
+                fprintf(nerd_diag(), "Error: Unknown variable '%s' in inc\n", node->data.inc.var_name);
                 return;
             }
 
             int load_reg = next_temp(cg);
-            fprintf(cg->out, "  %%t%d = load double, double* %%local%d\n", load_reg, existing);
+            irbuf_printf(cg->out, "  %%t%d = load double, double* %%local%d\n", load_reg, existing);
 
             int amount_reg;
             if (node->data.inc.amount) {
                 amount_reg = codegen_expr(cg, node->data.inc.amount);
             } else {
                 amount_reg = next_temp(cg);
-                fprintf(cg->out, "  %%t%d = fadd double 0.0, 1.0\n", amount_reg);
+                irbuf_printf(cg->out, "  %%t%d = fadd double 0.0, 1.0\n", amount_reg);
             }
 
             int result_reg = next_temp(cg);
-            fprintf(cg->out, "  %%t%d = fadd double %%t%d, %%t%d\n", result_reg, load_reg, amount_reg);
-            fprintf(cg->out, "  store double %%t%d, double* %%local%d\n", result_reg, existing);
+            irbuf_printf(cg->out, "  %%t%d = fadd %sdouble %%t%d, %%t%d\n", result_reg, cg->fmf, load_reg, amount_reg);
+            irbuf_printf(cg->out, "  store double %%t%d, double* %%local%d\n", result_reg, existing);
             break;
         }
 
@@ -897,24 +1440,27 @@ static void codegen_stmt(CodeGen *cg, ASTNode *node, int *result_reg) {
             // dec var [amount] - decrement variable
             int existing = find_local(cg, node->data.dec.var_name);
             if (existing < 0) {
-                fprintf(stderr, "Error: Unknown variable '%s' in dec\n", node->data.dec.var_name);
+                existing = spill_induction(cg, node->data.dec.var_name);
+            }
+            if (existing < 0) {
+                fprintf(nerd_diag(), "Error: Unknown variable '%s' in dec\n", node->data.dec.var_name);
                 return;
             }
 
             int load_reg = next_temp(cg);
-            fprintf(cg->out, "  %%t%d = load double, double* %%local%d\n", load_reg, existing);
+            irbuf_printf(cg->out, "  %%t%d = load double, double* %%local%d\n", load_reg, existing);
 
             int amount_reg;
             if (node->data.dec.amount) {
                 amount_reg = codegen_expr(cg, node->data.dec.amount);
             } else {
                 amount_reg = next_temp(cg);
-                fprintf(cg->out, "  %%t%d = fadd double 0.0, 1.0\n", amount_reg);
+                irbuf_printf(cg->out, "  %%t%d = fadd double 0.0, 1.0\n", amount_reg);
             }
 
             int result_reg = next_temp(cg);
-            fprintf(cg->out, "  %%t%d = fsub double %%t%d, %%t%d\n", result_reg, load_reg, amount_reg);
-            fprintf(cg->out, "  store double %%t%d, double* %%local%d\n", result_reg, existing);
+            irbuf_printf(cg->out, "  %%t%d = fsub %sdouble %%t%d, %%t%d\n", result_reg, cg->fmf, load_reg, amount_reg);
+            irbuf_printf(cg->out, "  store double %%t%d, double* %%local%d\n", result_reg, existing);
             break;
         }
 
@@ -922,29 +1468,29 @@ static void codegen_stmt(CodeGen *cg, ASTNode *node, int *result_reg) {
             ASTNode *val = node->data.out.value;
 
             if (val->type == NODE_STR) {
-                // Output string literal - find its index in pre-collected strings
-                int str_id = cg->string_counter++;
+                // Output string literal (index assigned by collect_strings)
+                int str_id = val->data.str.id;
                 size_t len = actual_string_len(val->data.str.value);
 
                 // Get string pointer and call printf
                 int ptr_reg = next_temp(cg);
-                fprintf(cg->out, "  %%t%d = getelementptr [%zu x i8], [%zu x i8]* @.str%d, i32 0, i32 0\n",
-                        ptr_reg, len + 1, len + 1, str_id);
-                fprintf(cg->out, "  call i32 (i8*, ...) @printf(i8* getelementptr ([4 x i8], [4 x i8]* @.fmt_str, i32 0, i32 0), i8* %%t%d)\n",
-                        ptr_reg);
+                irbuf_printf(cg->out, "  %%t%d = getelementptr [%zu x i8], [%zu x i8]* @.str%d, i32 0, i32 0\n",
+                             ptr_reg, len + 1, len + 1, str_id);
+                irbuf_printf(cg->out, "  call i32 (i8*, ...) @printf(i8* getelementptr ([4 x i8], [4 x i8]* @.fmt_str, i32 0, i32 0), i8* %%t%d)\n",
+                             ptr_reg);
             } else {
                 // Output number
                 int val_reg = codegen_expr(cg, val);
                 if (val_reg >= 0) {
-                    fprintf(cg->out, "  call i32 (i8*, ...) @printf(i8* getelementptr ([4 x i8], [4 x i8]* @.fmt_num, i32 0, i32 0), double %%t%d)\n",
-                            val_reg);
+                    irbuf_printf(cg->out, "  call i32 (i8*, ...) @printf(i8* getelementptr ([4 x i8], [4 x i8]* @.fmt_num, i32 0, i32 0), double %%t%d)\n",
+                                 val_reg);
                 }
             }
             break;
         }
 
         default:
-            fprintf(stderr, "Error: Unknown statement node type %d\n", node->type);
+            fprintf(nerd_diag(), "Error: Unknown statement node type %d\n", node->type);
             break;
     }
 }
@@ -963,31 +1509,58 @@ static void codegen_func(CodeGen *cg, ASTNode *func) {
         cg->param_names[i] = func->data.func_def.params.nodes[i]->data.param.name;
     }
 
+    // Profile counters, and the counts from a profile taken with the same
+    // sites (a function edited since is left unannotated)
+    cg->prof_site = 0;
+    cg->prof_slots = 1 + 2 * count_sites(&func->data.func_def.body);
+    cg->func_profile = NULL;
+    if (cg->profile) {
+        const ProfileFunc *prof = profile_find(cg->profile, func->data.func_def.name);
+        if (prof && prof->count == cg->prof_slots) cg->func_profile = prof;
+    }
+
     // Function signature
-    fprintf(cg->out, "define double @%s(", func->data.func_def.name);
+    const char *symbol = func_symbol(cg, func->data.func_def.name);
+    irbuf_printf(cg->out, "define double @%s(", symbol);
     for (size_t i = 0; i < cg->param_count; i++) {
-        if (i > 0) fprintf(cg->out, ", ");
-        fprintf(cg->out, "double %%arg%zu", i);
+        if (i > 0) irbuf_printf(cg->out, ", ");
+        irbuf_printf(cg->out, "double %%arg%zu", i);
+    }
+    irbuf_printf(cg->out, ")%s", cg->has_attrs ? " #0" : "");
+    if (cg->func_profile) {
+        // Hot and never-called functions are grouped apart by the linker
+        const ProfileFunc *prof = cg->func_profile;
+        const char *placement = prof->hot ? "hot" : prof->cold ? "unlikely" : NULL;
+        if (placement) {
+            irbuf_printf(cg->out, " %s", prof->hot ? "hot" : "cold");
+#ifndef __APPLE__
+            irbuf_printf(cg->out, " section \".text.%s.%s\"", placement, symbol);
+#endif
+        }
+        irbuf_printf(cg->out, " !prof !{!\"function_entry_count\", i64 %llu}",
+                     (unsigned long long)prof->counts[0]);
+    }
+    irbuf_printf(cg->out, " {\n");
+    irbuf_printf(cg->out, "entry:\n");
+    if (cg->instrument) {
+        emit_count(cg, -1);
     }
-    fprintf(cg->out, ") {\n");
-    fprintf(cg->out, "entry:\n");
 
     // Generate body
     int result_reg = -1;
     bool has_return = false;
+    codegen_block(cg, &func->data.func_def.body, &result_reg);
     for (size_t i = 0; i < func->data.func_def.body.count; i++) {
-        ASTNode *stmt = func->data.func_def.body.nodes[i];
-        codegen_stmt(cg, stmt, &result_reg);
-        if (stmt->type == NODE_RETURN) {
+        if (func->data.func_def.body.nodes[i]->type == NODE_RETURN) {
             has_return = true;
         }
     }
 
     // Default return if no explicit return (required for valid LLVM IR)
     if (!has_return) {
-        fprintf(cg->out, "  ret double 0.0\n");
+        irbuf_printf(cg->out, "  ret double 0.0\n");
     }
-    fprintf(cg->out, "}\n\n");
+    irbuf_printf(cg->out, "}\n\n");
 
     free(cg->param_names);
     cg->param_names = NULL;
@@ -995,126 +1568,830 @@ static void codegen_func(CodeGen *cg, ASTNode *func) {
 }
 
 /*
- * Generate LLVM IR for program
+ * Generated text of one function, the loop metadata it references and the
+ * user functions it calls
  */
-bool codegen_llvm(NerdContext *ctx, const char *output_path) {
-    FILE *out = fopen(output_path, "w");
-    if (!out) {
-        ctx->error_msg = nerd_strdup("Failed to open output file");
-        return false;
+typedef struct {
+    IRBuf text;
+    bool *loop_md_hinted;
+    size_t *loop_md_offset;
+    int loop_md_count;
+    const char **callees;
+    size_t callee_count;
+} FuncIR;
+
+/*
+ * Functions waiting for a codegen thread; each thread claims the next index
+ */
+typedef struct {
+    ASTList *funcs;
+    const bool *wanted;         // functions to generate, NULL for all
+    FuncIR *results;
+    const CodeGen *config;
+    FILE *diag;                 // the caller's diagnostics stream
+    atomic_size_t next;
+} FuncQueue;
+
+/*
+ * Generate one function into its own buffer, handing over its loop
+ * metadata and callees to `ir`
+ */
+static void codegen_func_ir(CodeGen *cg, ASTNode *func, FuncIR *ir) {
+    irbuf_init(&ir->text);
+    cg->out = &ir->text;
+    cg->loop_md_count = 0;
+    cg->callee_count = 0;
+    codegen_func(cg, func);
+
+    ir->loop_md_count = cg->loop_md_count;
+    ir->loop_md_hinted = cg->loop_md_hinted;
+    ir->loop_md_offset = cg->loop_md_offset;
+    cg->loop_md_hinted = NULL;
+    cg->loop_md_offset = NULL;
+    cg->loop_md_count = 0;
+    cg->loop_md_capacity = 0;
+
+    ir->callee_count = cg->callee_count;
+    ir->callees = cg->callees;
+    cg->callees = NULL;
+    cg->callee_count = 0;
+    cg->callee_capacity = 0;
+}
+
+static void *codegen_worker(void *arg) {
+    FuncQueue *queue = arg;
+    nerd_set_diag(queue->diag);
+    CodeGen *cg = codegen_create(NULL);
+    if (!cg) return NULL;
+    cg->fmf = queue->config->fmf;
+    cg->has_attrs = queue->config->has_attrs;
+    cg->emit_entry = queue->config->emit_entry;
+    cg->instrument = queue->config->instrument;
+    cg->profile = queue->config->profile;
+
+    for (;;) {
+        size_t i = atomic_fetch_add(&queue->next, 1);
+        if (i >= queue->funcs->count) break;
+        if (queue->wanted && !queue->wanted[i]) continue;
+        codegen_func_ir(cg, queue->funcs->nodes[i], &queue->results[i]);
     }
+    codegen_free(cg);
+    return NULL;
+}
 
-    CodeGen *cg = codegen_create(out);
+/*
+ * Number of codegen threads for a program with `func_count` functions
+ */
+static int codegen_threads(size_t func_count) {
+    const char *env = getenv("NERD_CODEGEN_THREADS");
+    long n = env ? strtol(env, NULL, 10) : 0;
+    if (n <= 0) {
+        if (func_count < PARALLEL_MIN_FUNCS) return 1;
+        n = sysconf(_SC_NPROCESSORS_ONLN);
+        if (n > MAX_CODEGEN_THREADS) n = MAX_CODEGEN_THREADS;
+    }
+    if ((size_t)n > func_count) n = (long)func_count;
+    return n < 1 ? 1 : (int)n;
+}
+
+/*
+ * Generate every function (or those flagged in `wanted`) into its own
+ * FuncIR, in parallel when there are enough of them
+ */
+static FuncIR *generate_functions(CodeGen *cg, ASTList *funcs, const bool *wanted) {
+    FuncIR *results = calloc(funcs->count ? funcs->count : 1, sizeof(FuncIR));
+    if (!results) return NULL;
+    FuncQueue queue = { .funcs = funcs, .wanted = wanted, .results = results, .config = cg,
+                        .diag = nerd_diag() };
+    atomic_init(&queue.next, 0);
+
+    // The calling thread works the queue too
+    int nthreads = codegen_threads(funcs->count);
+    pthread_t *threads = malloc(sizeof(pthread_t) * (size_t)nthreads);
+    int started = 0;
+    for (int t = 1; threads && t < nthreads; t++) {
+        if (pthread_create(&threads[started], NULL, codegen_worker, &queue) != 0) break;
+        started++;
+    }
+    codegen_worker(&queue);
+    for (int t = 0; t < started; t++) {
+        pthread_join(threads[t], NULL);
+    }
+    free(threads);
+    return results;
+}
+
+/*
+ * Append a generated function to cg->out. Its loop metadata is numbered
+ * after the nodes already in cg, so the ids come out as if the module had
+ * been generated sequentially.
+ */
+static void append_function(CodeGen *cg, const FuncIR *ir) {
+    size_t pos = 0;
+    for (int j = 0; j < ir->loop_md_count; j++) {
+        irbuf_put(cg->out, ir->text.data + pos, ir->loop_md_offset[j] - pos);
+        add_loop_md(cg, ir->loop_md_hinted[j]);
+        irbuf_int(cg->out, LOOP_MD_FIRST + cg->loop_md_count - 1);
+        pos = ir->loop_md_offset[j];
+    }
+    if (ir->text.size > pos) {
+        irbuf_put(cg->out, ir->text.data + pos, ir->text.size - pos);
+    }
+}
+
+static void free_functions(FuncIR *results, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        irbuf_free(&results[i].text);
+        free(results[i].loop_md_hinted);
+        free(results[i].loop_md_offset);
+        free(results[i].callees);
+    }
+    free(results);
+}
+
+/*
+ * Counters of an instrumented build, and __nerd_prof_dump, which the entry
+ * point calls on exit to append them to $NERD_PROFILE: one line per
+ * function, `name slots calls false0 true0 false1 true1 ...`
+ */
+static void emit_profile_dump(IRBuf *out, ASTNode *program) {
+    ASTList *funcs = &program->data.program.functions;
+
+    irbuf_printf(out, "; Profile counters\n");
+    for (size_t i = 0; i < funcs->count; i++) {
+        const char *name = funcs->nodes[i]->data.func_def.name;
+        size_t slots = 1 + 2 * count_sites(&funcs->nodes[i]->data.func_def.body);
+        irbuf_printf(out, "@__nerd_prof.%s = internal global [%zu x i64] zeroinitializer\n", name, slots);
+        irbuf_printf(out, "@.prof_name%zu = private constant [%zu x i8] c\"%s\\00\"\n",
+                     i, strlen(name) + 1, name);
+    }
+    irbuf_printf(out, "@.prof_env = private constant [13 x i8] c\"NERD_PROFILE\\00\"\n");
+    irbuf_printf(out, "@.prof_mode = private constant [2 x i8] c\"a\\00\"\n");
+    irbuf_printf(out, "@.prof_head = private constant [8 x i8] c\"%%s %%llu\\00\"\n");
+    irbuf_printf(out, "@.prof_count = private constant [6 x i8] c\" %%llu\\00\"\n");
+    irbuf_printf(out, "@.prof_end = private constant [2 x i8] c\"\\0A\\00\"\n\n");
+    irbuf_printf(out, "declare i8* @getenv(i8*)\n");
+    irbuf_printf(out, "declare i8* @fopen(i8*, i8*)\n");
+    irbuf_printf(out, "declare i32 @fprintf(i8*, i8*, ...)\n");
+    irbuf_printf(out, "declare i32 @fclose(i8*)\n\n");
+
+    irbuf_printf(out, "define private void @__nerd_prof_write(i8* %%f, i8* %%name, i64* %%counts, i64 %%n) {\n");
+    irbuf_printf(out, "entry:\n");
+    irbuf_printf(out, "  call i32 (i8*, i8*, ...) @fprintf(i8* %%f, i8* getelementptr ([8 x i8], [8 x i8]* @.prof_head, i32 0, i32 0), i8* %%name, i64 %%n)\n");
+    irbuf_printf(out, "  br label %%loop\n");
+    irbuf_printf(out, "loop:\n");
+    irbuf_printf(out, "  %%i = phi i64 [ 0, %%entry ], [ %%next, %%loop ]\n");
+    irbuf_printf(out, "  %%p = getelementptr i64, i64* %%counts, i64 %%i\n");
+    irbuf_printf(out, "  %%c = load i64, i64* %%p\n");
+    irbuf_printf(out, "  call i32 (i8*, i8*, ...) @fprintf(i8* %%f, i8* getelementptr ([6 x i8], [6 x i8]* @.prof_count, i32 0, i32 0), i64 %%c)\n");
+    irbuf_printf(out, "  %%next = add i64 %%i, 1\n");
+    irbuf_printf(out, "  %%more = icmp ult i64 %%next, %%n\n");
+    irbuf_printf(out, "  br i1 %%more, label %%loop, label %%done\n");
+    irbuf_printf(out, "done:\n");
+    irbuf_printf(out, "  call i32 (i8*, i8*, ...) @fprintf(i8* %%f, i8* getelementptr ([2 x i8], [2 x i8]* @.prof_end, i32 0, i32 0))\n");
+    irbuf_printf(out, "  ret void\n");
+    irbuf_printf(out, "}\n\n");
+
+    irbuf_printf(out, "define private void @__nerd_prof_dump() {\n");
+    irbuf_printf(out, "entry:\n");
+    irbuf_printf(out, "  %%path = call i8* @getenv(i8* getelementptr ([13 x i8], [13 x i8]* @.prof_env, i32 0, i32 0))\n");
+    irbuf_printf(out, "  %%unset = icmp eq i8* %%path, null\n");
+    irbuf_printf(out, "  br i1 %%unset, label %%done, label %%open\n");
+    irbuf_printf(out, "open:\n");
+    irbuf_printf(out, "  %%f = call i8* @fopen(i8* %%path, i8* getelementptr ([2 x i8], [2 x i8]* @.prof_mode, i32 0, i32 0))\n");
+    irbuf_printf(out, "  %%failed = icmp eq i8* %%f, null\n");
+    irbuf_printf(out, "  br i1 %%failed, label %%done, label %%write\n");
+    irbuf_printf(out, "write:\n");
+    for (size_t i = 0; i < funcs->count; i++) {
+        const char *name = funcs->nodes[i]->data.func_def.name;
+        size_t slots = 1 + 2 * count_sites(&funcs->nodes[i]->data.func_def.body);
+        size_t len = strlen(name) + 1;
+        irbuf_printf(out, "  call void @__nerd_prof_write(i8* %%f, i8* getelementptr ([%zu x i8], [%zu x i8]* @.prof_name%zu, i32 0, i32 0), ",
+                     len, len, i);
+        irbuf_printf(out, "i64* getelementptr ([%zu x i64], [%zu x i64]* @__nerd_prof.%s, i32 0, i32 0), i64 %zu)\n",
+                     slots, slots, name, slots);
+    }
+    irbuf_printf(out, "  call i32 @fclose(i8* %%f)\n");
+    irbuf_printf(out, "  br label %%done\n");
+    irbuf_printf(out, "done:\n");
+    irbuf_printf(out, "  ret void\n");
+    irbuf_printf(out, "}\n\n");
+}
+
+/*
+ * Generate the process entry point. A program with main gets an i32 main
+ * that calls it; a library-style program gets a harness that calls every
+ * function with sample arguments (5, 3, 1, ...) and prints the results.
+ */
+static void codegen_entry(CodeGen *cg, ASTNode *program) {
+    IRBuf *out = cg->out;
+    ASTList *funcs = &program->data.program.functions;
+
+    bool has_main = false;
+    for (size_t i = 0; i < funcs->count; i++) {
+        if (strcmp(funcs->nodes[i]->data.func_def.name, "main") == 0) {
+            has_main = true;
+            break;
+        }
+    }
+
+    if (cg->instrument) {
+        emit_profile_dump(out, program);
+    }
+
+    irbuf_printf(out, "; Entry point\n");
+    if (has_main) {
+        irbuf_printf(out, "define i32 @main() {\n");
+        irbuf_printf(out, "entry:\n");
+        irbuf_printf(out, "  call double @nerd_main()\n");
+        if (cg->instrument) irbuf_printf(out, "  call void @__nerd_prof_dump()\n");
+        irbuf_printf(out, "  ret i32 0\n");
+        irbuf_printf(out, "}\n\n");
+        return;
+    }
+
+    irbuf_printf(out, "@.fmt_entry = private constant [11 x i8] c\"%%s = %%.0f\\0A\\00\"\n");
+    for (size_t i = 0; i < funcs->count; i++) {
+        ASTNode *func = funcs->nodes[i];
+        const char *name = func->data.func_def.name;
+        if (func->data.func_def.specialized || func->data.func_def.imported) continue;
+        irbuf_printf(out, "@.entry_name%zu = private constant [%zu x i8] c\"%s\\00\"\n",
+                     i, strlen(name) + 1, name);
+    }
+
+    irbuf_printf(out, "\ndefine i32 @main() {\n");
+    irbuf_printf(out, "entry:\n");
+    for (size_t i = 0; i < funcs->count; i++) {
+        ASTNode *func = funcs->nodes[i];
+        const char *name = func->data.func_def.name;
+        size_t param_count = func->data.func_def.params.count;
+        if (func->data.func_def.specialized || func->data.func_def.imported) continue;
+
+        irbuf_printf(out, "  %%r%zu = call double @%s(", i, name);
+        for (size_t j = 0; j < param_count; j++) {
+            if (j > 0) irbuf_printf(out, ", ");
+            if (j == 0) irbuf_printf(out, "double 5.0");
+            else if (j == 1) irbuf_printf(out, "double 3.0");
+            else irbuf_printf(out, "double 1.0");
+        }
+        irbuf_printf(out, ")\n");
+
+        size_t len = strlen(name) + 1;
+        irbuf_printf(out, "  %%nm%zu = getelementptr [%zu x i8], [%zu x i8]* @.entry_name%zu, i32 0, i32 0\n",
+                     i, len, len, i);
+        irbuf_printf(out, "  call i32 (i8*, ...) @printf(i8* getelementptr ([11 x i8], [11 x i8]* @.fmt_entry, i32 0, i32 0), i8* %%nm%zu, double %%r%zu)\n",
+                     i, i);
+    }
+    if (cg->instrument) irbuf_printf(out, "  call void @__nerd_prof_dump()\n");
+    irbuf_printf(out, "  ret i32 0\n");
+    irbuf_printf(out, "}\n\n");
+}
+
+/*
+ * Create the code generator for ctx: resolve the target, specialize and
+ * number the string literals. Returns NULL with ctx->error_msg set.
+ */
+static CodeGen *codegen_setup(NerdContext *ctx, TargetInfo *target) {
+    CodeGen *cg = codegen_create(NULL);
     if (!cg) {
-        fclose(out);
         ctx->error_msg = nerd_strdup("Failed to create code generator");
-        return false;
+        return NULL;
+    }
+    cg->emit_entry = ctx->emit_entry;
+    cg->instrument = ctx->instrument;
+    cg->profile = ctx->profile;
+
+    // The counters are defined and written out by the entry point
+    if (ctx->instrument && !ctx->emit_entry) {
+        codegen_free(cg);
+        ctx->error_msg = nerd_strdup("Instrumented code needs an entry point");
+        return NULL;
     }
 
-    // Header
-    fprintf(out, "; NERD Compiled Program\n");
-    fprintf(out, "; Generated by NERD Bootstrap Compiler\n\n");
+    // Target description for --march
+    if (ctx->march) {
+        if (!target_host(ctx->march, target)) {
+            codegen_free(cg);
+            ctx->error_msg = nerd_strdup("Unsupported host or CPU name for --march");
+            return NULL;
+        }
+        cg->has_attrs = true;
+    }
+    if (ctx->fast_math) {
+        cg->fmf = "reassoc contract afn ";
+    }
+
+    // Clone functions for constant arguments and fold constants
+    if (!ctx->no_specialize) {
+        specialize_program(ctx->ast);
+    }
+
+    // Collect all string literals from AST
+    collect_strings(cg, ctx->ast);
+    return cg;
+}
+
+/*
+ * Module header: target, intrinsic and runtime declarations, format strings
+ */
+static void emit_header(IRBuf *out, NerdContext *ctx, const TargetInfo *target) {
+    irbuf_printf(out, "; NERD Compiled Program\n");
+    irbuf_printf(out, "; Generated by NERD Bootstrap Compiler\n\n");
+
+    if (ctx->march) {
+        if (target->datalayout) {
+            irbuf_printf(out, "target datalayout = \"%s\"\n", target->datalayout);
+        }
+        irbuf_printf(out, "target triple = \"%s\"\n\n", target->triple);
+    }
 
     // Declare LLVM intrinsics
-    fprintf(out, "declare double @llvm.fabs.f64(double)\n");
-    fprintf(out, "declare double @llvm.sqrt.f64(double)\n");
-    fprintf(out, "declare double @llvm.floor.f64(double)\n");
-    fprintf(out, "declare double @llvm.ceil.f64(double)\n");
-    fprintf(out, "declare double @llvm.sin.f64(double)\n");
-    fprintf(out, "declare double @llvm.cos.f64(double)\n");
-    fprintf(out, "declare double @llvm.pow.f64(double, double)\n");
-    fprintf(out, "declare double @llvm.minnum.f64(double, double)\n");
-    fprintf(out, "declare double @llvm.maxnum.f64(double, double)\n");
-    fprintf(out, "\n");
+    irbuf_printf(out, "declare double @llvm.fabs.f64(double)\n");
+    irbuf_printf(out, "declare double @llvm.sqrt.f64(double)\n");
+    irbuf_printf(out, "declare double @llvm.floor.f64(double)\n");
+    irbuf_printf(out, "declare double @llvm.ceil.f64(double)\n");
+    irbuf_printf(out, "declare double @llvm.sin.f64(double)\n");
+    irbuf_printf(out, "declare double @llvm.cos.f64(double)\n");
+    irbuf_printf(out, "declare double @llvm.pow.f64(double, double)\n");
+    irbuf_printf(out, "declare double @llvm.minnum.f64(double, double)\n");
+    irbuf_printf(out, "declare double @llvm.maxnum.f64(double, double)\n");
+    irbuf_printf(out, "\n");
 
     // Declare printf for output
-    fprintf(out, "declare i32 @printf(i8*, ...)\n");
-    fprintf(out, "\n");
+    irbuf_printf(out, "declare i32 @printf(i8*, ...)\n");
+    irbuf_printf(out, "\n");
 
     // HTTP runtime declarations
-    fprintf(out, "declare i8* @nerd_http_get(i8*)\n");
-    fprintf(out, "declare i8* @nerd_http_post(i8*, i8*)\n");
-    fprintf(out, "declare void @nerd_http_free(i8*)\n");
-    fprintf(out, "\n");
+    irbuf_printf(out, "declare i8* @nerd_http_get(i8*)\n");
+    irbuf_printf(out, "declare i8* @nerd_http_getall(i8*)\n");
+    irbuf_printf(out, "declare i8* @nerd_http_post(i8*, i8*)\n");
+    irbuf_printf(out, "declare void @nerd_http_free(i8*)\n");
+    irbuf_printf(out, "declare i8* @nerd_http_get_start(i8*)\n");
+    irbuf_printf(out, "declare i8* @nerd_http_getall_start(i8*)\n");
+    irbuf_printf(out, "declare i8* @nerd_http_post_start(i8*, i8*)\n");
+    irbuf_printf(out, "declare i8* @nerd_http_wait(i8*)\n");
+    irbuf_printf(out, "\n");
 
     // MCP runtime declarations
-    fprintf(out, "declare i8* @nerd_mcp_list(i8*)\n");
-    fprintf(out, "declare i8* @nerd_mcp_send(i8*, i8*, i8*)\n");
-    fprintf(out, "declare i8* @nerd_mcp_init(i8*)\n");
-    fprintf(out, "declare void @nerd_mcp_free(i8*)\n");
-    fprintf(out, "\n");
+    irbuf_printf(out, "declare i8* @nerd_mcp_list(i8*)\n");
+    irbuf_printf(out, "declare i8* @nerd_mcp_send(i8*, i8*, i8*)\n");
+    irbuf_printf(out, "declare i8* @nerd_mcp_init(i8*)\n");
+    irbuf_printf(out, "declare void @nerd_mcp_free(i8*)\n");
+    irbuf_printf(out, "declare i8* @nerd_mcp_list_start(i8*)\n");
+    irbuf_printf(out, "declare i8* @nerd_mcp_send_start(i8*, i8*, i8*)\n");
+    irbuf_printf(out, "declare i8* @nerd_mcp_init_start(i8*)\n");
+    irbuf_printf(out, "declare i8* @nerd_mcp_wait(i8*)\n");
+    irbuf_printf(out, "\n");
 
     // LLM runtime declarations
-    fprintf(out, "declare i8* @nerd_llm_claude(i8*)\n");
-    fprintf(out, "declare void @nerd_llm_free(i8*)\n");
-    fprintf(out, "\n");
+    irbuf_printf(out, "declare i8* @nerd_llm_claude(i8*)\n");
+    irbuf_printf(out, "declare i8* @nerd_llm_claude_system(i8*, i8*)\n");
+    irbuf_printf(out, "declare void @nerd_llm_free(i8*)\n");
+    irbuf_printf(out, "declare i8* @nerd_llm_claude_start(i8*)\n");
+    irbuf_printf(out, "declare i8* @nerd_llm_claude_system_start(i8*, i8*)\n");
+    irbuf_printf(out, "declare i8* @nerd_llm_wait(i8*)\n");
+    irbuf_printf(out, "\n");
 
     // Format strings for output
-    fprintf(out, "@.fmt_num = private constant [4 x i8] c\"%%g\\0A\\00\"\n");
-    fprintf(out, "@.fmt_str = private constant [4 x i8] c\"%%s\\0A\\00\"\n");
-    fprintf(out, "@.fmt_int = private constant [6 x i8] c\"%%.0f\\0A\\00\"\n");
-    fprintf(out, "\n");
+    irbuf_printf(out, "@.fmt_num = private constant [4 x i8] c\"%%g\\0A\\00\"\n");
+    irbuf_printf(out, "@.fmt_str = private constant [4 x i8] c\"%%s\\0A\\00\"\n");
+    irbuf_printf(out, "@.fmt_int = private constant [6 x i8] c\"%%.0f\\0A\\00\"\n");
+    irbuf_printf(out, "\n");
+}
 
-    // Collect all string literals from AST
-    ASTNode *program = ctx->ast;
-    collect_strings(cg, program);
+/*
+ * String literal declaration @.str<id>
+ */
+static void emit_string(IRBuf *out, size_t id, const char *s) {
+    size_t src_len = strlen(s);
 
-    // Output string literal declarations
-    for (size_t i = 0; i < cg->string_count; i++) {
-        const char *s = cg->string_literals[i];
-        size_t src_len = strlen(s);
-
-        // First pass: count actual length after processing escapes
-        size_t actual_len = 0;
-        for (size_t j = 0; j < src_len; j++) {
-            if (s[j] == '\\' && j + 1 < src_len) {
-                j++;  // Skip escape sequence, counts as 1 char
+    irbuf_printf(out, "@.str%zu = private constant [%zu x i8] c\"", id, actual_string_len(s) + 1);
+    for (size_t j = 0; j < src_len; j++) {
+        char c = s[j];
+        if (c == '\\' && j + 1 < src_len) {
+            // Handle escape sequences
+            char next = s[j + 1];
+            if (next == '"') {
+                irbuf_printf(out, "\\22");  // Quote
+                j++;
+            } else if (next == '\\') {
+                irbuf_printf(out, "\\5C");  // Backslash
+                j++;
+            } else if (next == 'n') {
+                irbuf_printf(out, "\\0A");  // Newline
+                j++;
+            } else if (next == 't') {
+                irbuf_printf(out, "\\09");  // Tab
+                j++;
+            } else {
+                // Unknown escape, output as-is
+                irbuf_printf(out, "\\5C");
             }
-            actual_len++;
+        } else if (c == '"') {
+            irbuf_printf(out, "\\22");
+        } else if (c >= 32 && c < 127) {
+            irbuf_putc(out, c);
+        } else {
+            irbuf_printf(out, "\\%02X", (unsigned char)c);
         }
+    }
+    irbuf_printf(out, "\\00\"\n");
+}
 
-        fprintf(out, "@.str%zu = private constant [%zu x i8] c\"", i, actual_len + 1);
-        for (size_t j = 0; j < src_len; j++) {
-            char c = s[j];
-            if (c == '\\' && j + 1 < src_len) {
-                // Handle escape sequences
-                char next = s[j + 1];
-                if (next == '"') {
-                    fprintf(out, "\\22");  // Quote
-                    j++;
-                } else if (next == '\\') {
-                    fprintf(out, "\\5C");  // Backslash
-                    j++;
-                } else if (next == 'n') {
-                    fprintf(out, "\\0A");  // Newline
-                    j++;
-                } else if (next == 't') {
-                    fprintf(out, "\\09");  // Tab
-                    j++;
-                } else {
-                    // Unknown escape, output as-is
-                    fprintf(out, "\\5C");
-                }
-            } else if (c == '"') {
-                fprintf(out, "\\22");
-            } else if (c >= 32 && c < 127) {
-                fputc(c, out);
+/*
+ * Module footer: function attributes and the loop metadata nodes in cg
+ */
+static void emit_footer(CodeGen *cg, NerdContext *ctx, const TargetInfo *target) {
+    IRBuf *out = cg->out;
+
+    // Function attributes (target CPU)
+    if (cg->has_attrs) {
+        irbuf_printf(out, "attributes #0 = {");
+        if (ctx->march) {
+            irbuf_printf(out, " \"target-cpu\"=\"%s\"", target->cpu);
+            if (target->features[0]) {
+                irbuf_printf(out, " \"target-features\"=\"%s\"", target->features);
+            }
+        }
+        irbuf_printf(out, " }\n\n");
+    }
+
+    // Loop metadata
+    if (cg->loop_md_count > 0) {
+        irbuf_printf(out, "!%d = !{!\"llvm.loop.mustprogress\"}\n", LOOP_MD_MUSTPROGRESS);
+        irbuf_printf(out, "!%d = !{!\"llvm.loop.vectorize.enable\", i1 true}\n", LOOP_MD_VECTORIZE);
+        irbuf_printf(out, "!%d = !{!\"llvm.loop.unroll.enable\"}\n", LOOP_MD_UNROLL);
+        for (int i = 0; i < cg->loop_md_count; i++) {
+            int id = LOOP_MD_FIRST + i;
+            if (cg->loop_md_hinted[i] && ctx->fast_math) {
+                // Forcing vectorization reorders FP reductions: only with --fast-math
+                irbuf_printf(out, "!%d = distinct !{!%d, !%d, !%d, !%d}\n", id, id,
+                             LOOP_MD_MUSTPROGRESS, LOOP_MD_VECTORIZE, LOOP_MD_UNROLL);
+            } else if (cg->loop_md_hinted[i]) {
+                irbuf_printf(out, "!%d = distinct !{!%d, !%d, !%d}\n", id, id,
+                             LOOP_MD_MUSTPROGRESS, LOOP_MD_UNROLL);
             } else {
-                fprintf(out, "\\%02X", (unsigned char)c);
+                irbuf_printf(out, "!%d = distinct !{!%d, !%d}\n", id, id, LOOP_MD_MUSTPROGRESS);
             }
         }
-        fprintf(out, "\\00\"\n");
+    }
+}
+
+/*
+ * `declare double @symbol(double, ...)`
+ */
+static void declare_symbol(IRBuf *out, const char *symbol, size_t arity) {
+    irbuf_printf(out, "declare double @%s(", symbol);
+    for (size_t i = 0; i < arity; i++) {
+        irbuf_printf(out, i > 0 ? ", double" : "double");
+    }
+    irbuf_printf(out, ")\n");
+}
+
+/*
+ * Generate LLVM IR for program into a buffer. Functions in ctx->externs
+ * are declared, to be resolved at link time.
+ */
+bool codegen_llvm_buffer(NerdContext *ctx, IRBuf *out) {
+    TargetInfo target = {0};
+    CodeGen *cg = codegen_setup(ctx, &target);
+    if (!cg) return false;
+    cg->out = out;
+
+    emit_header(out, ctx, &target);
+    for (size_t i = 0; i < cg->string_count; i++) {
+        emit_string(out, i, cg->string_literals[i]);
     }
     if (cg->string_count > 0) {
-        fprintf(out, "\n");
+        irbuf_printf(out, "\n");
+    }
+
+    // Functions from imported modules, linked in separately (nerd build)
+    for (size_t i = 0; i < ctx->extern_count; i++) {
+        declare_symbol(out, ctx->externs[i].name, ctx->externs[i].arity);
+    }
+    if (ctx->extern_count > 0) {
+        irbuf_printf(out, "\n");
     }
 
     // Generate functions
-    for (size_t i = 0; i < program->data.program.functions.count; i++) {
-        codegen_func(cg, program->data.program.functions.nodes[i]);
+    ASTList *funcs = &ctx->ast->data.program.functions;
+    FuncIR *results = generate_functions(cg, funcs, NULL);
+    if (!results) {
+        codegen_free(cg);
+        ctx->error_msg = nerd_strdup("Out of memory");
+        return false;
+    }
+    for (size_t i = 0; i < funcs->count; i++) {
+        append_function(cg, &results[i]);
+    }
+    free_functions(results, funcs->count);
+
+    if (cg->emit_entry) {
+        codegen_entry(cg, ctx->ast);
     }
+    emit_footer(cg, ctx, &target);
 
     codegen_free(cg);
-    fclose(out);
     return true;
 }
+
+/*
+ * Function name -> index in program order, for declaring functions that
+ * live in another module. Open addressing over a power-of-two table.
+ */
+typedef struct {
+    const char **names;
+    size_t *index;
+    size_t mask;
+} FuncTable;
+
+static size_t name_hash(const char *s) {
+    size_t h = 14695981039346656037ULL;
+    for (; *s; s++) {
+        h = (h ^ (unsigned char)*s) * 1099511628211ULL;
+    }
+    return h;
+}
+
+static bool func_table_init(FuncTable *t, ASTList *funcs) {
+    size_t size = 16;
+    while (size < funcs->count * 2) size *= 2;
+    t->names = calloc(size, sizeof(char *));
+    t->index = malloc(sizeof(size_t) * size);
+    t->mask = size - 1;
+    if (!t->names || !t->index) return false;
+
+    for (size_t i = 0; i < funcs->count; i++) {
+        const char *name = funcs->nodes[i]->data.func_def.name;
+        size_t slot = name_hash(name) & t->mask;
+        while (t->names[slot] && strcmp(t->names[slot], name) != 0) {
+            slot = (slot + 1) & t->mask;
+        }
+        if (!t->names[slot]) {
+            t->names[slot] = name;
+            t->index[slot] = i;
+        }
+    }
+    return true;
+}
+
+static long func_table_find(const FuncTable *t, const char *name) {
+    size_t slot = name_hash(name) & t->mask;
+    while (t->names[slot]) {
+        if (strcmp(t->names[slot], name) == 0) return (long)t->index[slot];
+        slot = (slot + 1) & t->mask;
+    }
+    return -1;
+}
+
+static void func_table_free(FuncTable *t) {
+    free(t->names);
+    free(t->index);
+}
+
+/*
+ * `declare` for a function defined in another module
+ */
+static void declare_function(CodeGen *cg, ASTNode *func) {
+    declare_symbol(cg->out, func_symbol(cg, func->data.func_def.name), func->data.func_def.params.count);
+}
+
+static int extern_cmp(const void *a, const void *b) {
+    return strcmp(((const ModuleSig *)a)->name, ((const ModuleSig *)b)->name);
+}
+
+/*
+ * Index of `name` in ctx->externs, or -1
+ */
+static long find_extern(NerdContext *ctx, const char *name) {
+    if (ctx->extern_count == 0) return -1;
+    ModuleSig probe = { .name = (char *)name };
+    const ModuleSig *sig = bsearch(&probe, ctx->externs, ctx->extern_count, sizeof(ModuleSig), extern_cmp);
+    return sig ? (long)(sig - ctx->externs) : -1;
+}
+
+/*
+ * Assemble one module from the functions `members` (program order). Strings
+ * and declarations are limited to what those functions use; module 0 also
+ * carries the entry point. `stamp` marks functions already defined or
+ * declared in this module and must differ between calls.
+ */
+static void emit_module(CodeGen *cg, NerdContext *ctx, const TargetInfo *target,
+                        const FuncIR *results, const FuncTable *table, int *marks, int stamp,
+                        const size_t *members, size_t member_count, bool with_entry) {
+    ASTList *funcs = &ctx->ast->data.program.functions;
+    IRBuf *out = cg->out;
+    cg->loop_md_count = 0;
+
+    emit_header(out, ctx, target);
+
+    // Each function's literals are numbered consecutively by collect_strings
+    bool any_strings = false;
+    for (size_t k = 0; k < member_count; k++) {
+        size_t f = members[k];
+        for (size_t s = cg->func_string_start[f]; s < cg->func_string_start[f + 1]; s++) {
+            emit_string(out, s, cg->string_literals[s]);
+            any_strings = true;
+        }
+    }
+    if (any_strings) {
+        irbuf_printf(out, "\n");
+    }
+
+    // Declarations for functions called here but defined elsewhere
+    for (size_t k = 0; k < member_count; k++) {
+        marks[members[k]] = stamp;
+    }
+    bool any_decls = false;
+    for (size_t k = 0; k < member_count; k++) {
+        const FuncIR *ir = &results[members[k]];
+        for (size_t c = 0; c < ir->callee_count; c++) {
+            long f = func_table_find(table, ir->callees[c]);
+            if (f < 0) {
+                // Imported: marks past the program's functions track externs
+                long e = find_extern(ctx, ir->callees[c]);
+                if (e < 0 || marks[funcs->count + e] == stamp) continue;
+                marks[funcs->count + e] = stamp;
+                declare_symbol(out, ctx->externs[e].name, ctx->externs[e].arity);
+                any_decls = true;
+                continue;
+            }
+            if (marks[f] == stamp) continue;
+            marks[f] = stamp;
+            declare_function(cg, funcs->nodes[f]);
+            any_decls = true;
+        }
+    }
+    if (with_entry) {
+        // The entry calls main, or every unspecialized function
+        for (size_t f = 0; f < funcs->count; f++) {
+            ASTNode *func = funcs->nodes[f];
+            if (marks[f] == stamp || func->data.func_def.specialized ||
+                func->data.func_def.imported) continue;
+            marks[f] = stamp;
+            declare_function(cg, func);
+            any_decls = true;
+        }
+    }
+    if (any_decls) {
+        irbuf_printf(out, "\n");
+    }
+
+    for (size_t k = 0; k < member_count; k++) {
+        append_function(cg, &results[members[k]]);
+    }
+    if (with_entry) {
+        codegen_entry(cg, ctx->ast);
+    }
+    emit_footer(cg, ctx, target);
+}
+
+/*
+ * Generate the program as up to `parts` separate LLVM modules, which can be
+ * compiled independently and linked together. Functions are split into
+ * contiguous runs of roughly equal IR size; module 0 also holds the entry
+ * point. `modules` must have room for `parts` buffers; the number used is
+ * stored in *module_count.
+ */
+bool codegen_llvm_split(NerdContext *ctx, int parts, IRBuf *modules, int *module_count) {
+    // Counters are only defined in a single module with the entry point
+    if (ctx->instrument) {
+        ctx->error_msg = nerd_strdup("Instrumented code must be generated as one module");
+        return false;
+    }
+
+    TargetInfo target = {0};
+    CodeGen *cg = codegen_setup(ctx, &target);
+    if (!cg) return false;
+
+    ASTList *funcs = &ctx->ast->data.program.functions;
+    FuncIR *results = generate_functions(cg, funcs, NULL);
+    FuncTable table = {0};
+    size_t *members = malloc(sizeof(size_t) * (funcs->count ? funcs->count : 1));
+    int *marks = calloc(funcs->count + ctx->extern_count + 1, sizeof(int));
+    if (!results || !members || !marks || !func_table_init(&table, funcs)) {
+        if (results) free_functions(results, funcs->count);
+        func_table_free(&table);
+        free(members);
+        free(marks);
+        codegen_free(cg);
+        ctx->error_msg = nerd_strdup("Out of memory");
+        return false;
+    }
+
+    if (parts < 1) parts = 1;
+    if ((size_t)parts > funcs->count) parts = funcs->count > 0 ? (int)funcs->count : 1;
+
+    size_t total = 0;
+    for (size_t i = 0; i < funcs->count; i++) {
+        total += results[i].text.size;
+    }
+
+    // Module m takes functions until the running size passes (m+1)/parts of
+    // the total, leaving at least one function for each later module
+    size_t next = 0, done = 0;
+    for (int m = 0; m < parts; m++) {
+        size_t count = 0;
+        size_t goal = (size_t)((double)total * (m + 1) / parts);
+        while (next < funcs->count && funcs->count - next > (size_t)(parts - m - 1) &&
+               (count == 0 || done < goal || m == parts - 1)) {
+            done += results[next].text.size;
+            members[count++] = next++;
+        }
+
+        irbuf_init(&modules[m]);
+        cg->out = &modules[m];
+        emit_module(cg, ctx, &target, results, &table, marks, m + 1,
+                    members, count, cg->emit_entry && m == 0);
+    }
+    *module_count = parts;
+
+    free_functions(results, funcs->count);
+    func_table_free(&table);
+    free(members);
+    free(marks);
+    codegen_free(cg);
+    return true;
+}
+
+/*
+ * Generate each function flagged in `wanted` as a module of its own
+ * (modules[i]), and the entry point alone in `entry` if ctx->emit_entry.
+ * Incremental builds use this to compile and cache one object per function.
+ */
+bool codegen_llvm_functions(NerdContext *ctx, const bool *wanted, IRBuf *modules, IRBuf *entry) {
+    // Counters are only defined in a single module with the entry point
+    if (ctx->instrument) {
+        ctx->error_msg = nerd_strdup("Instrumented code must be generated as one module");
+        return false;
+    }
+
+    TargetInfo target = {0};
+    CodeGen *cg = codegen_setup(ctx, &target);
+    if (!cg) return false;
+
+    ASTList *funcs = &ctx->ast->data.program.functions;
+    FuncIR *results = generate_functions(cg, funcs, wanted);
+    FuncTable table = {0};
+    int *marks = calloc(funcs->count + ctx->extern_count + 1, sizeof(int));
+    if (!results || !marks || !func_table_init(&table, funcs)) {
+        if (results) free_functions(results, funcs->count);
+        func_table_free(&table);
+        free(marks);
+        codegen_free(cg);
+        ctx->error_msg = nerd_strdup("Out of memory");
+        return false;
+    }
+
+    for (size_t i = 0; i < funcs->count; i++) {
+        if (!wanted[i]) continue;
+        irbuf_init(&modules[i]);
+        cg->out = &modules[i];
+        emit_module(cg, ctx, &target, results, &table, marks, (int)i + 2, &i, 1, false);
+    }
+    if (cg->emit_entry) {
+        irbuf_init(entry);
+        cg->out = entry;
+        emit_module(cg, ctx, &target, results, &table, marks, 1, NULL, 0, true);
+    }
+
+    free_functions(results, funcs->count);
+    func_table_free(&table);
+    free(marks);
+    codegen_free(cg);
+    return true;
+}
+
+/*
+ * Generate LLVM IR for program into an open stream, in one write
+ */
+bool codegen_llvm_stream(NerdContext *ctx, FILE *out) {
+    IRBuf buf;
+    irbuf_init(&buf);
+    bool ok = codegen_llvm_buffer(ctx, &buf);
+    if (ok && !irbuf_write(&buf, out)) {
+        ctx->error_msg = nerd_strdup("Failed to write IR");
+        ok = false;
+    }
+    irbuf_free(&buf);
+    return ok;
+}
+
+/*
+ * Generate LLVM IR for program
+ */
+bool codegen_llvm(NerdContext *ctx, const char *output_path) {
+    FILE *out = fopen(output_path, "w");
+    if (!out) {
+        ctx->error_msg = nerd_strdup("Failed to open output file");
+        return false;
+    }
+
+    bool ok = codegen_llvm_stream(ctx, out);
+    if (fclose(out) != 0 && ok) {
+        ctx->error_msg = nerd_strdup("Failed to write output file");
+        ok = false;
+    }
+    return ok;
+}
@@ -0,0 +1,256 @@
+/*
+ * NERD Compile - Source files to LLVM IR, bitcode or x86-64 objects
+ *
+ * `nerd compile` sends one file through the pipeline; `compile --batch`
+ * sends many through a pool of worker threads, so an orchestrator that
+ * compiles hundreds of small scripts starts one process instead of
+ * hundreds. The compiler keeps no global state, so workers share only the
+ * job counter. Diagnostics go to a per-job buffer and are printed with the
+ * job's result, prefixed with its input. Each worker keeps its source and
+ * IR buffers from one job to the next and only ever grows them: a batch of
+ * small files allocates them once per thread.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "nerd.h"
+
+#define MAX_BATCH_THREADS 64
+
+/*
+ * Buffers a worker reuses across jobs
+ */
+typedef struct {
+    char *source;
+    size_t capacity;
+    IRBuf ir;
+} Scratch;
+
+/*
+ * x86 backend: specialize, lower to bytecode and write an ELF object
+ */
+bool compile_x86_object(ASTNode *ast, bool no_specialize, bool emit_entry, const char *path) {
+    if (!no_specialize) {
+        specialize_program(ast);
+    }
+    BcProgram *prog = bc_compile(ast);
+    if (!prog) return false;
+    bool ok = x86_compile(prog, emit_entry, path);
+    bc_free(prog);
+    return ok;
+}
+
+/*
+ * Default output for `input`: its path (or, with `dir`, its file name in
+ * dir) with the extension replaced by .ll, .bc or .o, or removed when
+ * opts is NULL (the executable of `nerd build`)
+ */
+void compile_output_path(const char *input, const char *dir, const CompileOptions *opts,
+                         char *buf, size_t size) {
+    const char *name = input;
+    if (dir) {
+        const char *slash = strrchr(input, '/');
+        if (slash) name = slash + 1;
+        snprintf(buf, size, "%s/%s", dir, name);
+    } else {
+        snprintf(buf, size, "%s", input);
+    }
+
+    char *base = strrchr(buf, '/');
+    char *dot = strrchr(base ? base : buf, '.');
+    if (dot) *dot = '\0';
+    if (!opts) return;
+    size_t len = strlen(buf);
+    snprintf(buf + len, size - len, "%s", opts->x86 ? ".o" : opts->bitcode ? ".bc" : ".ll");
+}
+
+static bool read_source(const char *path, Scratch *s, size_t *len) {
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        fprintf(nerd_diag(), "Error: Cannot open file '%s'\n", path);
+        return false;
+    }
+
+    fseek(f, 0, SEEK_END);
+    *len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    if (*len + 1 > s->capacity) {
+        char *grown = realloc(s->source, *len + 1);
+        if (!grown) {
+            fclose(f);
+            return false;
+        }
+        s->source = grown;
+        s->capacity = *len + 1;
+    }
+
+    bool ok = fread(s->source, 1, *len, f) == *len;
+    fclose(f);
+    if (!ok) {
+        fprintf(nerd_diag(), "Error: Failed to read file '%s'\n", path);
+        return false;
+    }
+    s->source[*len] = '\0';
+    return true;
+}
+
+static bool compile_one(const char *input, const char *output, const CompileOptions *opts, Scratch *s) {
+    size_t source_len;
+    if (!read_source(input, s, &source_len)) return false;
+
+    Lexer *lexer = lexer_create(s->source, source_len);
+    if (!lexer || !lexer_tokenize(lexer)) {
+        if (lexer) lexer_free(lexer);
+        return false;
+    }
+    Parser *parser = parser_create(lexer->tokens, lexer->token_count);
+    ASTNode *ast = parser ? parser_parse(parser) : NULL;
+    if (!ast || !module_import_all(input, ast, NULL, NULL, NULL)) {
+        ast_free(ast);
+        if (parser) parser_free(parser);
+        lexer_free(lexer);
+        return false;
+    }
+
+    NerdContext ctx = {0};
+    ctx.filename = input;
+    ctx.source = s->source;
+    ctx.ast = ast;
+    ctx.no_specialize = opts->no_specialize;
+    ctx.fast_math = opts->fast_math;
+    ctx.march = opts->march;
+
+    bool ok;
+    if (opts->x86) {
+        ok = compile_x86_object(ast, opts->no_specialize, false, output);
+    } else if (opts->bitcode) {
+        ok = codegen_bitcode(&ctx, output);
+    } else {
+        s->ir.size = 0;
+        ok = codegen_llvm_buffer(&ctx, &s->ir);
+        if (ok) {
+            FILE *out = fopen(output, "w");
+            ok = out && irbuf_write(&s->ir, out);
+            if (out && fclose(out) != 0) ok = false;
+            if (!ok) ctx.error_msg = nerd_strdup("Failed to write output file");
+        }
+    }
+    if (!ok && ctx.error_msg) {
+        fprintf(nerd_diag(), "Error: %s\n", ctx.error_msg);
+    }
+
+    free(ctx.error_msg);
+    ast_free(ast);
+    parser_free(parser);
+    lexer_free(lexer);
+    return ok;
+}
+
+/*
+ * Compile one file
+ */
+bool compile_file(const char *input, const char *output, const CompileOptions *opts) {
+    Scratch s = {0};
+    irbuf_init(&s.ir);
+    bool ok = compile_one(input, output, opts, &s);
+    free(s.source);
+    irbuf_free(&s.ir);
+    return ok;
+}
+
+typedef struct {
+    char **inputs;
+    char **outputs;
+    bool *ok;
+    char **diags;               // each job's diagnostics, printed in input order
+    size_t count;
+    atomic_size_t next;
+    const CompileOptions *opts;
+} BatchQueue;
+
+static void *batch_worker(void *arg) {
+    BatchQueue *q = arg;
+    Scratch s = {0};
+    irbuf_init(&s.ir);
+
+    size_t i;
+    while ((i = atomic_fetch_add(&q->next, 1)) < q->count) {
+        size_t len;
+        FILE *diag = open_memstream(&q->diags[i], &len);
+        nerd_set_diag(diag);
+        q->ok[i] = compile_one(q->inputs[i], q->outputs[i], q->opts, &s);
+        nerd_set_diag(NULL);
+        if (diag) fclose(diag);
+    }
+
+    free(s.source);
+    irbuf_free(&s.ir);
+    return NULL;
+}
+
+/*
+ * A job's diagnostics, each line prefixed with its input
+ */
+static void print_diagnostics(const char *input, const char *text) {
+    if (text && *text) fflush(stdout);
+    while (text && *text) {
+        const char *end = strchr(text, '\n');
+        int len = end ? (int)(end - text) : (int)strlen(text);
+        fprintf(stderr, "%s: %.*s\n", input, len, text);
+        text += len + (end ? 1 : 0);
+    }
+}
+
+/*
+ * Compile inputs[i] to outputs[i] on `jobs` threads (0 = one per CPU).
+ * Results are reported in input order; returns the number that failed.
+ */
+size_t compile_batch(char **inputs, char **outputs, size_t count, const CompileOptions *opts, int jobs) {
+    if (jobs <= 0) jobs = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (jobs < 1) jobs = 1;
+    if (jobs > MAX_BATCH_THREADS) jobs = MAX_BATCH_THREADS;
+    if ((size_t)jobs > count) jobs = count > 0 ? (int)count : 1;
+
+    BatchQueue q = { .inputs = inputs, .outputs = outputs, .count = count, .opts = opts };
+    q.ok = calloc(count ? count : 1, sizeof(bool));
+    q.diags = calloc(count ? count : 1, sizeof(char *));
+    if (!q.ok || !q.diags) {
+        free(q.ok);
+        free(q.diags);
+        return count;
+    }
+    atomic_init(&q.next, 0);
+
+    // The calling thread is worker 0
+    pthread_t threads[MAX_BATCH_THREADS];
+    int started = 0;
+    for (int t = 1; t < jobs; t++) {
+        if (pthread_create(&threads[started], NULL, batch_worker, &q) == 0) started++;
+    }
+    batch_worker(&q);
+    for (int t = 0; t < started; t++) {
+        pthread_join(threads[t], NULL);
+    }
+
+    size_t failed = 0;
+    for (size_t i = 0; i < count; i++) {
+        print_diagnostics(inputs[i], q.diags[i]);
+        free(q.diags[i]);
+        if (q.ok[i]) {
+            printf("Compiled %s -> %s\n", inputs[i], outputs[i]);
+        } else {
+            fprintf(stderr, "Error: Failed to compile %s\n", inputs[i]);
+            failed++;
+        }
+    }
+    free(q.ok);
+    free(q.diags);
+    return failed;
+}
@@ -0,0 +1,303 @@
+/*
+ * NERD ELF Writer - ELF64 relocatable objects for the x86 backend
+ *
+ * Just enough of the format for `cc` to link what x86.c produces: .text,
+ * .rodata, their symbols and .rela.text. Fields are written byte by byte
+ * in little-endian order, so no <elf.h> is needed.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include "nerd.h"
+
+// Section header indices in the written file
+enum {
+    SH_NULL,
+    SH_TEXT,
+    SH_RODATA,
+    SH_SYMTAB,
+    SH_STRTAB,
+    SH_RELA_TEXT,
+    SH_SHSTRTAB,
+    SH_NOTE_STACK,
+    SH_COUNT,
+};
+
+#define SHT_PROGBITS 1
+#define SHT_SYMTAB 2
+#define SHT_STRTAB 3
+#define SHT_RELA 4
+
+#define SHF_ALLOC 0x2
+#define SHF_EXECINSTR 0x4
+#define SHF_INFO_LINK 0x40
+
+#define STB_LOCAL 0
+#define STB_GLOBAL 1
+#define STT_NOTYPE 0
+#define STT_OBJECT 1
+#define STT_FUNC 2
+#define STT_SECTION 3
+
+#define EHDR_SIZE 64
+#define SHDR_SIZE 64
+#define SYM_SIZE 24
+#define RELA_SIZE 24
+
+size_t elf_append(ElfSection *sec, const void *data, size_t len) {
+    if (sec->size + len > sec->capacity) {
+        size_t capacity = sec->capacity ? sec->capacity : 4096;
+        while (capacity < sec->size + len) capacity *= 2;
+        sec->data = realloc(sec->data, capacity);
+        sec->capacity = capacity;
+    }
+    size_t offset = sec->size;
+    if (data) {
+        memcpy(sec->data + offset, data, len);
+    } else {
+        memset(sec->data + offset, 0, len);
+    }
+    sec->size += len;
+    return offset;
+}
+
+size_t elf_add_symbol(ElfObject *obj, const char *name, int section, uint64_t value, bool global, bool func) {
+    if (obj->symbol_count >= obj->symbol_capacity) {
+        obj->symbol_capacity = obj->symbol_capacity ? obj->symbol_capacity * 2 : 32;
+        obj->symbols = realloc(obj->symbols, sizeof(ElfSymbol) * obj->symbol_capacity);
+    }
+    ElfSymbol *sym = &obj->symbols[obj->symbol_count];
+    sym->name = nerd_strdup(name);
+    sym->section = section;
+    sym->value = value;
+    sym->size = 0;
+    sym->global = global;
+    sym->func = func;
+    return obj->symbol_count++;
+}
+
+void elf_add_reloc(ElfObject *obj, uint64_t offset, size_t symbol, uint32_t type, int64_t addend) {
+    if (obj->reloc_count >= obj->reloc_capacity) {
+        obj->reloc_capacity = obj->reloc_capacity ? obj->reloc_capacity * 2 : 32;
+        obj->relocs = realloc(obj->relocs, sizeof(ElfReloc) * obj->reloc_capacity);
+    }
+    ElfReloc *r = &obj->relocs[obj->reloc_count++];
+    r->offset = offset;
+    r->symbol = symbol;
+    r->type = type;
+    r->addend = addend;
+}
+
+void elf_free(ElfObject *obj) {
+    for (size_t i = 0; i < obj->symbol_count; i++) {
+        free(obj->symbols[i].name);
+    }
+    free(obj->symbols);
+    free(obj->relocs);
+    free(obj->text.data);
+    free(obj->rodata.data);
+    memset(obj, 0, sizeof(*obj));
+}
+
+/*
+ * Little-endian output helpers
+ */
+static void put8(ElfSection *b, uint8_t v) {
+    elf_append(b, &v, 1);
+}
+
+static void put16(ElfSection *b, uint16_t v) {
+    put8(b, v & 0xFF);
+    put8(b, v >> 8);
+}
+
+static void put32(ElfSection *b, uint32_t v) {
+    put16(b, v & 0xFFFF);
+    put16(b, v >> 16);
+}
+
+static void put64(ElfSection *b, uint64_t v) {
+    put32(b, v & 0xFFFFFFFF);
+    put32(b, v >> 32);
+}
+
+static void align_to(ElfSection *b, size_t align) {
+    while (b->size % align) put8(b, 0);
+}
+
+static uint32_t add_string(ElfSection *strtab, const char *s) {
+    return (uint32_t)elf_append(strtab, s, strlen(s) + 1);
+}
+
+typedef struct {
+    uint32_t name;
+    uint32_t type;
+    uint64_t flags;
+    uint64_t offset;
+    uint64_t size;
+    uint32_t link;
+    uint32_t info;
+    uint64_t align;
+    uint64_t entsize;
+} SectionHeader;
+
+static uint16_t section_index(int section) {
+    switch (section) {
+        case ELF_TEXT: return SH_TEXT;
+        case ELF_RODATA: return SH_RODATA;
+        default: return 0;
+    }
+}
+
+static void put_symbol(ElfSection *symtab, uint32_t name, uint8_t bind, uint8_t type,
+                       uint16_t shndx, uint64_t value, uint64_t size) {
+    put32(symtab, name);
+    put8(symtab, (uint8_t)((bind << 4) | type));
+    put8(symtab, 0);
+    put16(symtab, shndx);
+    put64(symtab, value);
+    put64(symtab, size);
+}
+
+/*
+ * Write the object to `path`
+ */
+bool elf_write(const ElfObject *obj, const char *path) {
+    ElfSection out = {0}, symtab = {0}, strtab = {0}, rela = {0}, shstrtab = {0};
+    SectionHeader sh[SH_COUNT];
+    memset(sh, 0, sizeof(sh));
+
+    // Symbols: null, section symbols, locals, then globals (ELF requires
+    // locals first); map[] translates ElfObject indices for relocations.
+    size_t *map = malloc(sizeof(size_t) * (obj->symbol_count + 1));
+    size_t index = 0;
+    put8(&strtab, 0);
+    put_symbol(&symtab, 0, STB_LOCAL, STT_NOTYPE, 0, 0, 0);
+    put_symbol(&symtab, 0, STB_LOCAL, STT_SECTION, SH_TEXT, 0, 0);
+    put_symbol(&symtab, 0, STB_LOCAL, STT_SECTION, SH_RODATA, 0, 0);
+    index = 3;
+    for (int pass = 0; pass < 2; pass++) {
+        bool want_global = pass == 1;
+        if (want_global) sh[SH_SYMTAB].info = (uint32_t)index;
+        for (size_t i = 0; i < obj->symbol_count; i++) {
+            const ElfSymbol *sym = &obj->symbols[i];
+            if (sym->global != want_global) continue;
+            uint8_t type = sym->func ? STT_FUNC : sym->section == ELF_RODATA ? STT_OBJECT : STT_NOTYPE;
+            put_symbol(&symtab, add_string(&strtab, sym->name), sym->global ? STB_GLOBAL : STB_LOCAL,
+                       type, section_index(sym->section), sym->value, sym->size);
+            map[i] = index++;
+        }
+    }
+
+    for (size_t i = 0; i < obj->reloc_count; i++) {
+        const ElfReloc *r = &obj->relocs[i];
+        put64(&rela, r->offset);
+        put64(&rela, ((uint64_t)map[r->symbol] << 32) | r->type);
+        put64(&rela, (uint64_t)r->addend);
+    }
+    free(map);
+
+    put8(&shstrtab, 0);
+    sh[SH_TEXT].name = add_string(&shstrtab, ".text");
+    sh[SH_RODATA].name = add_string(&shstrtab, ".rodata");
+    sh[SH_SYMTAB].name = add_string(&shstrtab, ".symtab");
+    sh[SH_STRTAB].name = add_string(&shstrtab, ".strtab");
+    sh[SH_RELA_TEXT].name = add_string(&shstrtab, ".rela.text");
+    sh[SH_SHSTRTAB].name = add_string(&shstrtab, ".shstrtab");
+    sh[SH_NOTE_STACK].name = add_string(&shstrtab, ".note.GNU-stack");
+
+    // Header first (patched below), then section contents in order
+    elf_append(&out, NULL, EHDR_SIZE);
+
+    struct {
+        int index;
+        const ElfSection *data;
+        uint64_t align;
+    } layout[] = {
+        {SH_TEXT, &obj->text, 16},
+        {SH_RODATA, &obj->rodata, 8},
+        {SH_SYMTAB, &symtab, 8},
+        {SH_STRTAB, &strtab, 1},
+        {SH_RELA_TEXT, &rela, 8},
+        {SH_SHSTRTAB, &shstrtab, 1},
+    };
+    for (size_t i = 0; i < sizeof(layout) / sizeof(layout[0]); i++) {
+        align_to(&out, layout[i].align);
+        SectionHeader *h = &sh[layout[i].index];
+        h->offset = out.size;
+        h->size = layout[i].data->size;
+        h->align = layout[i].align;
+        if (layout[i].data->size) elf_append(&out, layout[i].data->data, layout[i].data->size);
+    }
+
+    sh[SH_TEXT].type = SHT_PROGBITS;
+    sh[SH_TEXT].flags = SHF_ALLOC | SHF_EXECINSTR;
+    sh[SH_RODATA].type = SHT_PROGBITS;
+    sh[SH_RODATA].flags = SHF_ALLOC;
+    sh[SH_SYMTAB].type = SHT_SYMTAB;
+    sh[SH_SYMTAB].link = SH_STRTAB;
+    sh[SH_SYMTAB].entsize = SYM_SIZE;
+    sh[SH_STRTAB].type = SHT_STRTAB;
+    sh[SH_RELA_TEXT].type = SHT_RELA;
+    sh[SH_RELA_TEXT].flags = SHF_INFO_LINK;
+    sh[SH_RELA_TEXT].link = SH_SYMTAB;
+    sh[SH_RELA_TEXT].info = SH_TEXT;
+    sh[SH_RELA_TEXT].entsize = RELA_SIZE;
+    sh[SH_SHSTRTAB].type = SHT_STRTAB;
+    sh[SH_NOTE_STACK].type = SHT_PROGBITS;   // empty: non-executable stack
+    sh[SH_NOTE_STACK].offset = out.size;
+    sh[SH_NOTE_STACK].align = 1;
+
+    align_to(&out, 8);
+    uint64_t shoff = out.size;
+    for (int i = 0; i < SH_COUNT; i++) {
+        put32(&out, sh[i].name);
+        put32(&out, sh[i].type);
+        put64(&out, sh[i].flags);
+        put64(&out, 0);             // sh_addr
+        put64(&out, sh[i].offset);
+        put64(&out, sh[i].size);
+        put32(&out, sh[i].link);
+        put32(&out, sh[i].info);
+        put64(&out, sh[i].align);
+        put64(&out, sh[i].entsize);
+    }
+
+    // ELF header
+    ElfSection hdr = {0};
+    static const uint8_t ident[16] = {0x7F, 'E', 'L', 'F', 2 /* 64-bit */, 1 /* LE */, 1 /* version */};
+    elf_append(&hdr, ident, sizeof(ident));
+    put16(&hdr, 1);                 // ET_REL
+    put16(&hdr, 62);                // EM_X86_64
+    put32(&hdr, 1);                 // EV_CURRENT
+    put64(&hdr, 0);                 // e_entry
+    put64(&hdr, 0);                 // e_phoff
+    put64(&hdr, shoff);
+    put32(&hdr, 0);                 // e_flags
+    put16(&hdr, EHDR_SIZE);
+    put16(&hdr, 0);                 // e_phentsize
+    put16(&hdr, 0);                 // e_phnum
+    put16(&hdr, SHDR_SIZE);
+    put16(&hdr, SH_COUNT);
+    put16(&hdr, SH_SHSTRTAB);
+    memcpy(out.data, hdr.data, EHDR_SIZE);
+
+    bool ok = false;
+    FILE *f = fopen(path, "wb");
+    if (!f) {
+        fprintf(nerd_diag(), "Error: Cannot write '%s'\n", path);
+    } else {
+        ok = fwrite(out.data, 1, out.size, f) == out.size;
+        ok = fclose(f) == 0 && ok;
+        if (!ok) fprintf(nerd_diag(), "Error: Failed writing '%s'\n", path);
+    }
+
+    free(out.data);
+    free(symtab.data);
+    free(strtab.data);
+    free(rela.data);
+    free(shstrtab.data);
+    free(hdr.data);
+    return ok;
+}
@@ -0,0 +1,380 @@
+/*
+ * NERD Interpreter - Executes bytecode from bytecode.c
+ *
+ * `nerd interp` (or `nerd run --interp`) skips clang entirely. Dispatch
+ * uses computed goto where the compiler supports it and falls back to a
+ * switch. Calls slide the register window: the caller's argument
+ * registers become the callee's r0..rN-1, so no copying is needed.
+ *
+ * With --tiered, calls and loop back-edges are counted per function and
+ * hot functions are handed to tier.c; once a native entry point is
+ * published, CALL jumps straight into it.
+ *
+ * The network runtime (http/mcp/llm) is loaded on first use from
+ * build/libnerd_rt.so next to the nerd executable (`make runtime-shared`),
+ * so the compiler itself keeps no libcurl dependency.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+#include <dlfcn.h>
+#include "nerd.h"
+
+#define VM_STACK_SLOTS (1 << 20)    // registers (doubles) across all frames
+#define VM_MAX_DEPTH 100000
+#define VM_TIER_THRESHOLD 1000      // default heat before a function is compiled
+
+// Build with -DVM_NO_COMPUTED_GOTO to force the portable switch dispatch
+
+#if (defined(__GNUC__) || defined(__clang__)) && !defined(VM_NO_COMPUTED_GOTO)
+#define VM_COMPUTED_GOTO 1
+#endif
+
+typedef struct {
+    const BcInstr *pc;      // return address
+    double *base;           // caller's register window
+    BcFunc *fn;
+    int dest;               // caller register receiving the result
+} VmFrame;
+
+typedef struct {
+    BcProgram *prog;
+    double *stack;
+    VmFrame *frames;
+    bool failed;
+    Tier *tier;             // NULL unless --tiered
+    uint32_t threshold;
+} Vm;
+
+/*
+ * Network runtime, resolved with dlopen
+ */
+static struct {
+    bool loaded;
+    char *(*http_get)(const char *);
+    char *(*http_getall)(const char *);
+    char *(*http_post)(const char *, const char *);
+    void (*http_free)(char *);
+    char *(*mcp_list)(const char *);
+    char *(*mcp_send)(const char *, const char *, const char *);
+    char *(*mcp_init)(const char *);
+    void (*mcp_free)(char *);
+    char *(*llm_claude)(const char *);
+    char *(*llm_claude_system)(const char *, const char *);
+    void (*llm_free)(char *);
+} rt;
+
+static bool rt_load(void) {
+    if (rt.loaded) return true;
+
+    char path[1200];
+    const char *env = getenv("NERD_RUNTIME");
+    if (env && env[0]) {
+        snprintf(path, sizeof(path), "%s", env);
+    } else {
+        char dir[1024] = "";
+        toolchain_runtime_dir(dir, sizeof(dir));
+        snprintf(path, sizeof(path), "%sbuild/libnerd_rt.so", dir);
+    }
+
+    void *handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+    if (!handle) {
+        fprintf(stderr, "Error: Cannot load network runtime (run `make runtime-shared`): %s\n", dlerror());
+        return false;
+    }
+
+    rt.http_get = (char *(*)(const char *))dlsym(handle, "nerd_http_get");
+    rt.http_getall = (char *(*)(const char *))dlsym(handle, "nerd_http_getall");
+    rt.http_post = (char *(*)(const char *, const char *))dlsym(handle, "nerd_http_post");
+    rt.http_free = (void (*)(char *))dlsym(handle, "nerd_http_free");
+    rt.mcp_list = (char *(*)(const char *))dlsym(handle, "nerd_mcp_list");
+    rt.mcp_send = (char *(*)(const char *, const char *, const char *))dlsym(handle, "nerd_mcp_send");
+    rt.mcp_init = (char *(*)(const char *))dlsym(handle, "nerd_mcp_init");
+    rt.mcp_free = (void (*)(char *))dlsym(handle, "nerd_mcp_free");
+    rt.llm_claude = (char *(*)(const char *))dlsym(handle, "nerd_llm_claude");
+    rt.llm_claude_system = (char *(*)(const char *, const char *))dlsym(handle, "nerd_llm_claude_system");
+    rt.llm_free = (void (*)(char *))dlsym(handle, "nerd_llm_free");
+
+    if (!rt.http_get || !rt.http_getall || !rt.http_post || !rt.http_free || !rt.mcp_list || !rt.mcp_send ||
+        !rt.mcp_init || !rt.mcp_free || !rt.llm_claude || !rt.llm_claude_system || !rt.llm_free) {
+        fprintf(stderr, "Error: Network runtime '%s' is incomplete\n", path);
+        dlclose(handle);
+        return false;
+    }
+    rt.loaded = true;
+    return true;
+}
+
+/*
+ * Call a tiered-up function (tier.c only publishes arities up to 8)
+ */
+static double call_native(void *entry, int argc, const double *a) {
+    switch (argc) {
+        case 0: return ((double (*)(void))entry)();
+        case 1: return ((double (*)(double))entry)(a[0]);
+        case 2: return ((double (*)(double, double))entry)(a[0], a[1]);
+        case 3: return ((double (*)(double, double, double))entry)(a[0], a[1], a[2]);
+        case 4: return ((double (*)(double, double, double, double))entry)(a[0], a[1], a[2], a[3]);
+        case 5: return ((double (*)(double, double, double, double, double))entry)(a[0], a[1], a[2], a[3], a[4]);
+        case 6: return ((double (*)(double, double, double, double, double, double))entry)(
+                    a[0], a[1], a[2], a[3], a[4], a[5]);
+        case 7: return ((double (*)(double, double, double, double, double, double, double))entry)(
+                    a[0], a[1], a[2], a[3], a[4], a[5], a[6]);
+        default: return ((double (*)(double, double, double, double, double, double, double, double))entry)(
+                    a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7]);
+    }
+}
+
+// Truthiness matches codegen's `fcmp one x, 0.0`
+static inline bool truthy(double v) {
+    return v < 0 || v > 0;
+}
+
+/*
+ * Call function `index` with `args` and run to completion
+ */
+static double vm_call(Vm *vm, int index, const double *args) {
+    BcProgram *prog = vm->prog;
+    BcFunc *fn = &prog->funcs[index];
+    double *const stack_end = vm->stack + VM_STACK_SLOTS;
+    double *R = vm->stack;
+    const double *K = fn->consts;
+    const BcInstr *pc = fn->code;
+    int depth = 0;
+
+    if (R + fn->reg_count > stack_end) goto overflow;
+    for (int i = 0; i < fn->param_count; i++) {
+        R[i] = args[i];
+    }
+
+#ifdef VM_COMPUTED_GOTO
+#define VM_LABEL(name) [BC_##name] = &&op_##name,
+    static const void *labels[BC_OP_COUNT] = { BC_OPS(VM_LABEL) };
+#undef VM_LABEL
+#define CASE(name) op_##name:
+#define DISPATCH() goto *labels[pc->op]
+#else
+#define CASE(name) case BC_##name:
+#define DISPATCH() continue
+#endif
+// Plain braces: DISPATCH() may be `continue`, which must reach the for loop
+#define NEXT() { pc++; DISPATCH(); }
+#define JUMP(target) { pc = fn->code + (target); DISPATCH(); }
+// Back-edges count toward the current function's heat
+#define HEAT() { if (++fn->heat == vm->threshold) tier_hot(vm->tier, (int)(fn - prog->funcs)); }
+#define A (pc->a)
+#define B (pc->b)
+#define C (pc->c)
+
+#ifdef VM_COMPUTED_GOTO
+    DISPATCH();
+#else
+    for (;;) switch (pc->op) {
+#endif
+
+    CASE(CONST)   R[A] = K[B]; NEXT();
+    CASE(MOV)     R[A] = R[B]; NEXT();
+    CASE(ADD)     R[A] = R[B] + R[C]; NEXT();
+    CASE(SUB)     R[A] = R[B] - R[C]; NEXT();
+    CASE(MUL)     R[A] = R[B] * R[C]; NEXT();
+    CASE(DIV)     R[A] = R[B] / R[C]; NEXT();
+    CASE(MOD)     R[A] = fmod(R[B], R[C]); NEXT();
+    CASE(EQ)      R[A] = R[B] == R[C]; NEXT();
+    CASE(NEQ)     R[A] = R[B] < R[C] || R[B] > R[C]; NEXT();
+    CASE(LT)      R[A] = R[B] < R[C]; NEXT();
+    CASE(GT)      R[A] = R[B] > R[C]; NEXT();
+    CASE(LTE)     R[A] = R[B] <= R[C]; NEXT();
+    CASE(GTE)     R[A] = R[B] >= R[C]; NEXT();
+    CASE(AND)     R[A] = truthy(R[B]) && truthy(R[C]); NEXT();
+    CASE(OR)      R[A] = truthy(R[B]) || truthy(R[C]); NEXT();
+    CASE(NOT)     R[A] = R[B] == 0; NEXT();
+    CASE(NEG)     R[A] = 0.0 - R[B]; NEXT();
+    CASE(ABS)     R[A] = fabs(R[B]); NEXT();
+    CASE(SQRT)    R[A] = sqrt(R[B]); NEXT();
+    CASE(FLOOR)   R[A] = floor(R[B]); NEXT();
+    CASE(CEIL)    R[A] = ceil(R[B]); NEXT();
+    CASE(SIN)     R[A] = sin(R[B]); NEXT();
+    CASE(COS)     R[A] = cos(R[B]); NEXT();
+    CASE(MIN)     R[A] = fmin(R[B], R[C]); NEXT();
+    CASE(MAX)     R[A] = fmax(R[B], R[C]); NEXT();
+    CASE(POW)     R[A] = pow(R[B], R[C]); NEXT();
+
+    CASE(JMP)     if (fn->code + A <= pc) HEAT(); JUMP(A);
+    CASE(JMPF)    if (!truthy(R[A])) JUMP(B); NEXT();
+    CASE(FORPREP) if (!(R[A] <= R[B])) JUMP(C); NEXT();
+    CASE(FORLOOP) R[A] += 1.0; if (R[A] <= R[B]) { HEAT(); JUMP(C); } NEXT();
+
+    CASE(CALL) {
+        if (depth >= VM_MAX_DEPTH) goto overflow;
+        BcFunc *callee = &prog->funcs[B];
+        void *native = atomic_load_explicit(&callee->native, memory_order_acquire);
+        if (native) {
+            R[A] = call_native(native, callee->param_count, R + C);
+            NEXT();
+        }
+        if (++callee->heat == vm->threshold) tier_hot(vm->tier, B);
+
+        double *callee_base = R + C;
+        if (callee_base + callee->reg_count > stack_end) goto overflow;
+
+        VmFrame *frame = &vm->frames[depth++];
+        frame->pc = pc + 1;
+        frame->base = R;
+        frame->fn = fn;
+        frame->dest = A;
+
+        R = callee_base;
+        fn = callee;
+        K = fn->consts;
+        pc = fn->code;
+        DISPATCH();
+    }
+
+    CASE(RET) {
+        double result = R[A];
+        if (depth == 0) return result;
+
+        VmFrame *frame = &vm->frames[--depth];
+        R = frame->base;
+        fn = frame->fn;
+        K = fn->consts;
+        pc = frame->pc;
+        R[frame->dest] = result;
+        DISPATCH();
+    }
+
+    CASE(OUT_NUM) printf("%g\n", R[A]); NEXT();
+    CASE(OUT_STR) printf("%s\n", prog->strings[A]); NEXT();
+
+    CASE(HTTP_GET) {
+        if (!rt_load()) goto fail;
+        char *response = rt.http_get(prog->strings[A]);
+        if (response) {
+            printf("%s\n", response);
+            rt.http_free(response);
+        }
+        NEXT();
+    }
+    CASE(HTTP_GETALL) {
+        if (!rt_load()) goto fail;
+        char *response = rt.http_getall(prog->strings[A]);
+        if (response) {
+            printf("%s\n", response);
+            rt.http_free(response);
+        }
+        NEXT();
+    }
+    CASE(HTTP_POST) {
+        if (!rt_load()) goto fail;
+        char *response = rt.http_post(prog->strings[A], prog->strings[B]);
+        if (response) {
+            printf("%s\n", response);
+            rt.http_free(response);
+        }
+        NEXT();
+    }
+    CASE(MCP_TOOLS) {
+        if (!rt_load()) goto fail;
+        rt.mcp_free(rt.mcp_list(prog->strings[A]));
+        NEXT();
+    }
+    CASE(MCP_SEND) {
+        if (!rt_load()) goto fail;
+        rt.mcp_free(rt.mcp_send(prog->strings[A], prog->strings[B], prog->strings[C]));
+        NEXT();
+    }
+    CASE(MCP_INIT) {
+        if (!rt_load()) goto fail;
+        rt.mcp_free(rt.mcp_init(prog->strings[A]));
+        NEXT();
+    }
+    CASE(LLM_CLAUDE) {
+        if (!rt_load()) goto fail;
+        rt.llm_free(rt.llm_claude(prog->strings[A]));
+        NEXT();
+    }
+    CASE(LLM_SYSTEM) {
+        if (!rt_load()) goto fail;
+        rt.llm_free(rt.llm_claude_system(prog->strings[A], prog->strings[B]));
+        NEXT();
+    }
+
+#ifndef VM_COMPUTED_GOTO
+    default:
+        fprintf(stderr, "Error: Bad opcode %d\n", pc->op);
+        goto fail;
+    }
+#endif
+
+#undef CASE
+#undef DISPATCH
+#undef NEXT
+#undef JUMP
+#undef HEAT
+#undef A
+#undef B
+#undef C
+
+overflow:
+    fprintf(stderr, "Error: Stack overflow in '%s'\n", fn->name);
+fail:
+    vm->failed = true;
+    return 0.0;
+}
+
+/*
+ * Run a program: main if present, else every function with sample
+ * arguments (5, 3, 1, ...) like `nerd run`. Returns an exit status.
+ * A non-NULL `tier_source` (the AST `prog` was compiled from) enables
+ * tiered execution.
+ */
+int bc_run(BcProgram *prog, ASTNode *tier_source) {
+    Vm vm = {0};
+    vm.prog = prog;
+    vm.stack = malloc(sizeof(double) * VM_STACK_SLOTS);
+    vm.frames = malloc(sizeof(VmFrame) * VM_MAX_DEPTH);
+    if (!vm.stack || !vm.frames) {
+        fprintf(stderr, "Error: Out of memory\n");
+        free(vm.stack);
+        free(vm.frames);
+        return 1;
+    }
+
+    if (prog->uses_runtime && !rt_load()) {
+        free(vm.stack);
+        free(vm.frames);
+        return 1;
+    }
+
+    if (tier_source) {
+        const char *env = getenv("NERD_TIER_THRESHOLD");
+        long threshold = env ? strtol(env, NULL, 10) : 0;
+        vm.threshold = threshold > 0 ? (uint32_t)threshold : VM_TIER_THRESHOLD;
+        vm.tier = tier_start(prog, tier_source);
+    }
+
+    if (prog->main_index >= 0) {
+        vm_call(&vm, prog->main_index, NULL);
+    } else {
+        for (size_t i = 0; i < prog->func_count && !vm.failed; i++) {
+            BcFunc *fn = &prog->funcs[i];
+            if (fn->specialized || fn->imported) continue;
+
+            double *args = malloc(sizeof(double) * (fn->param_count + 1));
+            for (int j = 0; j < fn->param_count; j++) {
+                args[j] = j == 0 ? 5.0 : j == 1 ? 3.0 : 1.0;
+            }
+            double result = vm_call(&vm, (int)i, args);
+            free(args);
+            if (!vm.failed) printf("%s = %.0f\n", fn->name, result);
+        }
+    }
+    fflush(stdout);
+
+    tier_stop(vm.tier);
+    free(vm.stack);
+    free(vm.frames);
+    return vm.failed ? 1 : 0;
+}
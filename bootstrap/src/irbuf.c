@@ -0,0 +1,153 @@
+/*
+ * NERD IR Buffer - In-memory text output for the code generator
+ *
+ * codegen.c formats every instruction into an IRBuf instead of calling
+ * fprintf, and the finished module leaves in a single write. The
+ * formatter understands the printf subset codegen uses: %d, %zu, %s and
+ * %% are formatted by hand; anything with flags, a width or a floating
+ * point conversion goes through snprintf.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include "nerd.h"
+
+void irbuf_init(IRBuf *b) {
+    b->data = NULL;
+    b->size = 0;
+    b->capacity = 0;
+}
+
+void irbuf_free(IRBuf *b) {
+    free(b->data);
+    irbuf_init(b);
+}
+
+static void reserve(IRBuf *b, size_t extra) {
+    if (b->size + extra <= b->capacity) return;
+    size_t capacity = b->capacity ? b->capacity : 4096;
+    while (capacity < b->size + extra) capacity *= 2;
+    b->data = realloc(b->data, capacity);
+    b->capacity = capacity;
+}
+
+void irbuf_put(IRBuf *b, const char *s, size_t len) {
+    reserve(b, len);
+    memcpy(b->data + b->size, s, len);
+    b->size += len;
+}
+
+void irbuf_puts(IRBuf *b, const char *s) {
+    irbuf_put(b, s, strlen(s));
+}
+
+void irbuf_putc(IRBuf *b, char c) {
+    reserve(b, 1);
+    b->data[b->size++] = c;
+}
+
+void irbuf_uint(IRBuf *b, unsigned long long v) {
+    char digits[24];
+    int n = 0;
+    do {
+        digits[n++] = (char)('0' + v % 10);
+        v /= 10;
+    } while (v);
+
+    reserve(b, (size_t)n);
+    while (n > 0) b->data[b->size++] = digits[--n];
+}
+
+void irbuf_int(IRBuf *b, long long v) {
+    if (v < 0) {
+        irbuf_putc(b, '-');
+        irbuf_uint(b, 0ULL - (unsigned long long)v);
+    } else {
+        irbuf_uint(b, (unsigned long long)v);
+    }
+}
+
+// One conversion that the fast path doesn't cover
+static void format_slow(IRBuf *b, const char *spec, size_t spec_len, va_list *ap) {
+    char fmt[32];
+    if (spec_len >= sizeof(fmt)) spec_len = sizeof(fmt) - 1;
+    memcpy(fmt, spec, spec_len);
+    fmt[spec_len] = '\0';
+
+    char tmp[512];
+    int n;
+    char conv = fmt[spec_len - 1];
+    bool is_long = strchr(fmt, 'l') != NULL;
+    bool is_size = strchr(fmt, 'z') != NULL;
+    switch (conv) {
+        case 'f': case 'e': case 'g': case 'E': case 'G':
+            n = snprintf(tmp, sizeof(tmp), fmt, va_arg(*ap, double));
+            break;
+        case 's':
+            n = snprintf(tmp, sizeof(tmp), fmt, va_arg(*ap, const char *));
+            break;
+        case 'u': case 'x': case 'X':
+            if (is_size) n = snprintf(tmp, sizeof(tmp), fmt, va_arg(*ap, size_t));
+            else if (is_long) n = snprintf(tmp, sizeof(tmp), fmt, va_arg(*ap, unsigned long long));
+            else n = snprintf(tmp, sizeof(tmp), fmt, va_arg(*ap, unsigned int));
+            break;
+        default:                // d, i, c
+            if (is_long) n = snprintf(tmp, sizeof(tmp), fmt, va_arg(*ap, long long));
+            else n = snprintf(tmp, sizeof(tmp), fmt, va_arg(*ap, int));
+            break;
+    }
+    if (n > 0) irbuf_put(b, tmp, (size_t)n < sizeof(tmp) ? (size_t)n : sizeof(tmp) - 1);
+}
+
+void irbuf_vprintf(IRBuf *b, const char *fmt, va_list ap) {
+    va_list args;
+    va_copy(args, ap);
+
+    const char *p = fmt;
+    while (*p) {
+        const char *run = p;
+        while (*p && *p != '%') p++;
+        if (p > run) irbuf_put(b, run, (size_t)(p - run));
+        if (!*p) break;
+
+        const char *spec = p++;
+        if (*p == '%') {
+            irbuf_putc(b, '%');
+            p++;
+        } else if (*p == 'd' || *p == 'i') {
+            irbuf_int(b, va_arg(args, int));
+            p++;
+        } else if (p[0] == 'z' && p[1] == 'u') {
+            irbuf_uint(b, va_arg(args, size_t));
+            p += 2;
+        } else if (*p == 's') {
+            irbuf_puts(b, va_arg(args, const char *));
+            p++;
+        } else if (*p == 'c') {
+            irbuf_putc(b, (char)va_arg(args, int));
+            p++;
+        } else {
+            // Flags, width, precision and length, then the conversion
+            while (*p && strchr("-+ #0123456789.lhzjt", *p)) p++;
+            if (*p) p++;
+            format_slow(b, spec, (size_t)(p - spec), &args);
+        }
+    }
+    va_end(args);
+}
+
+void irbuf_printf(IRBuf *b, const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    irbuf_vprintf(b, fmt, ap);
+    va_end(ap);
+}
+
+/*
+ * Write the buffer in one go
+ */
+bool irbuf_write(const IRBuf *b, FILE *out) {
+    return b->size == 0 || fwrite(b->data, 1, b->size, out) == b->size;
+}
@@ -36,6 +36,7 @@ static const Keyword keywords[] = {
     {"neg", TOK_NEG},
     {"inc", TOK_INC},
     {"dec", TOK_DEC},
+    {"import", TOK_IMPORT},
 
     // Types
     {"num", TOK_NUM},
@@ -250,7 +251,7 @@ static bool lexer_scan_string(Lexer *lexer) {
 
     while (lexer_current(lexer) != '"' && lexer_current(lexer) != '\0') {
         if (lexer_current(lexer) == '\n') {
-            fprintf(stderr, "Error: Unterminated string at line %d\n", lexer->line);
+            fprintf(nerd_diag(), "Error: Unterminated string at line %d\n", lexer->line);
             return false;
         }
         if (lexer_current(lexer) == '\\' && lexer_peek(lexer) == '"') {
@@ -260,7 +261,7 @@ static bool lexer_scan_string(Lexer *lexer) {
     }
 
     if (lexer_current(lexer) == '\0') {
-        fprintf(stderr, "Error: Unterminated string at line %d\n", lexer->line);
+        fprintf(nerd_diag(), "Error: Unterminated string at line %d\n", lexer->line);
         return false;
     }
 
@@ -319,7 +320,7 @@ bool lexer_tokenize(Lexer *lexer) {
         }
 
         // Unknown character
-        fprintf(stderr, "Error: Unexpected character '%c' at line %d, column %d\n",
+        fprintf(nerd_diag(), "Error: Unexpected character '%c' at line %d, column %d\n",
                 c, lexer->line, lexer->column);
         return false;
     }
@@ -329,6 +330,20 @@ bool lexer_tokenize(Lexer *lexer) {
     return true;
 }
 
+/*
+ * Compiler diagnostics go to stderr, or to the stream a batch worker set
+ * for its current job
+ */
+static _Thread_local FILE *diag_stream;
+
+FILE *nerd_diag(void) {
+    return diag_stream ? diag_stream : stderr;
+}
+
+void nerd_set_diag(FILE *stream) {
+    diag_stream = stream;
+}
+
 /*
  * String duplication utilities
  */
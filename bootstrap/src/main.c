@@ -2,18 +2,19 @@
  * NERD Bootstrap Compiler - Main Entry Point
  *
  * Usage:
- *   nerd compile <file.nerd> [-o output]    Compile to LLVM IR / native
+ *   nerd compile <file.nerd> [-o output]    Compile to LLVM IR / x86-64 object
+ *   nerd compile --batch <files...>         Compile many files on a thread pool
  *   nerd run <file.nerd> [args...]          Compile and run
+ *   nerd build <file.nerd> [-j N] [-o exe]  Build an executable in parallel
+ *   nerd interp <file.nerd>                 Run with the bytecode interpreter
+ *   nerd bench <file.nerd> [--args ...]     Time every function natively
+ *   nerd serve [-j N] [--stop|--status]     Compiler daemon used by `nerd run`
  *   nerd parse <file.nerd>                  Parse and dump AST
  */
 
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
-#include <unistd.h>
-#ifdef __APPLE__
-#include <mach-o/dyld.h>
-#endif
 #include "nerd.h"
 
 /*
@@ -72,6 +73,7 @@ static const char *token_name(TokenType type) {
         case TOK_NEG: return "NEG";
         case TOK_INC: return "INC";
         case TOK_DEC: return "DEC";
+        case TOK_IMPORT: return "IMPORT";
         case TOK_NUM: return "NUM";
         case TOK_INT: return "INT";
         case TOK_STR: return "STR";
@@ -132,6 +134,9 @@ static void print_ast(ASTNode *node, int indent) {
     switch (node->type) {
         case NODE_PROGRAM:
             printf("Program\n");
+            for (size_t i = 0; i < node->data.program.imports.count; i++) {
+                print_ast(node->data.program.imports.nodes[i], indent + 1);
+            }
             for (size_t i = 0; i < node->data.program.types.count; i++) {
                 print_ast(node->data.program.types.nodes[i], indent + 1);
             }
@@ -152,6 +157,10 @@ static void print_ast(ASTNode *node, int indent) {
             }
             break;
 
+        case NODE_IMPORT:
+            printf("Import: %s\n", node->data.import.name);
+            break;
+
         case NODE_TYPE_DEF:
             printf("Type: %s (%s)\n", node->data.type_def.name,
                    node->data.type_def.is_union ? "union" : "struct");
@@ -260,8 +269,6 @@ static void print_ast(ASTNode *node, int indent) {
     }
 }
 
-#define NERD_VERSION "3.0.0"
-
 /*
  * Print version
  */
@@ -277,31 +284,184 @@ static void print_usage(void) {
     printf("\n");
     printf("Usage:\n");
     printf("  nerd run <file.nerd>                      Compile and run\n");
+    printf("  nerd interp <file.nerd>                   Run with the bytecode interpreter\n");
     printf("  nerd compile <file.nerd> [-o output.ll]   Compile to LLVM IR\n");
+    printf("  nerd compile --batch [-j N] [-o dir] <files...|->  Compile many files on N threads\n");
+    printf("  nerd build <file.nerd> [-j N] [-o exe]    Build an executable with N parallel clangs\n");
+    printf("  nerd bench <file.nerd> [--args [fn=]a,b]  Time every function (min/median/p99 ns per call)\n");
     printf("  nerd parse <file.nerd>                    Parse and dump AST\n");
     printf("  nerd tokens <file.nerd>                   Show tokens\n");
+    printf("  nerd cache stats|clear                    Inspect or empty the run cache\n");
+    printf("  nerd serve [-j N] [--stop|--status]       Compiler daemon that `nerd run` uses when up\n");
     printf("  nerd --version                            Show version\n");
     printf("  nerd --help                               Show this help\n");
     printf("\n");
+    printf("Options:\n");
+    printf("  --no-specialize   Don't clone functions for constant arguments\n");
+    printf("  --fast-math       Allow reassociation and FMA contraction of FP math\n");
+    printf("  --march=<cpu>     Tune for a CPU (\"native\" = this host)\n");
+    printf("  -O<n>             Optimization level passed to clang (run only)\n");
+    printf("  --no-cache        Don't use the executable / object cache (run, build)\n");
+    printf("  --backend=x86     Emit x86-64 objects directly instead of going through clang\n");
+    printf("  --emit=bc         Write LLVM bitcode instead of textual IR\n");
+    printf("  --interp          Interpret instead of compiling (run only)\n");
+    printf("  --tiered          Interpret, compiling hot functions in the background\n");
+    printf("  -j <n>            Run n clang processes at once (build only)\n");
+    printf("  --thinlto         Inline across modules at link time with ThinLTO (build only)\n");
+    printf("  --explain-rebuild List functions recompiled and why (build only)\n");
+    printf("  --pgo             Build with the profile in <file>.nerdprof, training first if missing\n");
+    printf("  --pgo-run <args>  Retrain on a run with these arguments (build, repeatable)\n");
+    printf("  --fn <name>       Only time this function (bench only, repeatable)\n");
+    printf("  -n <calls>        Calls to time per function (bench only; default: --time)\n");
+    printf("  --time <ms>       Time budget per function and argument set (bench, default 200)\n");
+    printf("  --warmup <ms>     Warm-up per function and argument set (bench, default 20)\n");
+    printf("  --json            Print bench results as JSON\n");
+    printf("\n");
+    printf("Environment:\n");
+    printf("  NERD_PATH         Colon-separated directories searched by `import`\n");
+    printf("  NERD_SERVE_SOCKET Socket of `nerd serve` (default: serve.sock in the cache)\n");
+    printf("\n");
     printf("Examples:\n");
     printf("  nerd run math.nerd\n");
     printf("  nerd compile math.nerd -o math.ll\n");
 }
 
+/*
+ * --backend=llvm|x86
+ */
+static bool parse_backend(const char *name, bool *x86) {
+    if (strcmp(name, "llvm") == 0) {
+        *x86 = false;
+    } else if (strcmp(name, "x86") == 0) {
+        *x86 = true;
+    } else {
+        fprintf(stderr, "Error: Unknown backend '%s' (expected llvm or x86)\n", name);
+        return false;
+    }
+    return true;
+}
+
+/*
+ * --emit=ll|bc
+ */
+static bool parse_emit(const char *name, bool *bitcode) {
+    if (strcmp(name, "ll") == 0) {
+        *bitcode = false;
+    } else if (strcmp(name, "bc") == 0) {
+        *bitcode = true;
+    } else {
+        fprintf(stderr, "Error: Unknown output format '%s' (expected ll or bc)\n", name);
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Read a batch manifest: one "input [output]" per line, blank lines and
+ * # comments skipped
+ */
+static bool read_manifest(FILE *in, char ***inputs, char ***outputs, size_t *count, size_t *capacity) {
+    char line[8192];
+    while (fgets(line, sizeof(line), in)) {
+        char input[4096], output[4096] = "";
+        int fields = sscanf(line, "%4095s %4095s", input, output);
+        if (fields < 1 || input[0] == '#') continue;
+
+        if (*count >= *capacity) {
+            *capacity = *capacity ? *capacity * 2 : 64;
+            *inputs = realloc(*inputs, sizeof(char *) * *capacity);
+            *outputs = realloc(*outputs, sizeof(char *) * *capacity);
+            if (!*inputs || !*outputs) return false;
+        }
+        (*inputs)[*count] = nerd_strdup(input);
+        (*outputs)[*count] = fields == 2 ? nerd_strdup(output) : NULL;
+        (*count)++;
+    }
+    return true;
+}
+
 /*
  * Compile command
  */
 static int cmd_compile(int argc, char **argv) {
     const char *input_file = NULL;
     const char *output_file = NULL;
+    CompileOptions opts = {0};
+    bool batch = false;
+    int jobs = 0;
+
+    // Inputs for --batch
+    char **inputs = NULL, **outputs = NULL;
+    size_t input_count = 0, input_capacity = 0;
+    bool from_stdin = false;
 
     for (int i = 0; i < argc; i++) {
         if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
             output_file = argv[++i];
+        } else if (strncmp(argv[i], "--backend=", 10) == 0) {
+            if (!parse_backend(argv[i] + 10, &opts.x86)) return 1;
+        } else if (strncmp(argv[i], "--emit=", 7) == 0) {
+            if (!parse_emit(argv[i] + 7, &opts.bitcode)) return 1;
+        } else if (strcmp(argv[i], "--no-specialize") == 0) {
+            opts.no_specialize = true;
+        } else if (strcmp(argv[i], "--fast-math") == 0) {
+            opts.fast_math = true;
+        } else if (strncmp(argv[i], "--march=", 8) == 0) {
+            opts.march = argv[i] + 8;
+        } else if (strcmp(argv[i], "--batch") == 0) {
+            batch = true;
+        } else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            jobs = atoi(argv[++i]);
+        } else if (strncmp(argv[i], "-j", 2) == 0 && argv[i][2]) {
+            jobs = atoi(argv[i] + 2);
+        } else if (strcmp(argv[i], "-") == 0) {
+            from_stdin = true;
         } else if (argv[i][0] != '-') {
             input_file = argv[i];
+            if (input_count >= input_capacity) {
+                input_capacity = input_capacity ? input_capacity * 2 : 16;
+                inputs = realloc(inputs, sizeof(char *) * input_capacity);
+                outputs = realloc(outputs, sizeof(char *) * input_capacity);
+            }
+            inputs[input_count] = nerd_strdup(argv[i]);
+            outputs[input_count++] = NULL;
+        }
+    }
+
+    if (opts.x86 && opts.bitcode) {
+        fprintf(stderr, "Error: --emit=bc needs the LLVM backend\n");
+        return 1;
+    }
+
+    if (batch) {
+        // Files on the command line, or a manifest on stdin; -o names a directory
+        if (from_stdin || input_count == 0) {
+            read_manifest(stdin, &inputs, &outputs, &input_count, &input_capacity);
         }
+        for (size_t i = 0; i < input_count; i++) {
+            if (outputs[i]) continue;
+            char path[8192];
+            compile_output_path(inputs[i], output_file, &opts, path, sizeof(path));
+            outputs[i] = nerd_strdup(path);
+        }
+
+        size_t failed = input_count == 0 ? 1 : compile_batch(inputs, outputs, input_count, &opts, jobs);
+        if (input_count == 0) fprintf(stderr, "Error: No input files specified\n");
+
+        for (size_t i = 0; i < input_count; i++) {
+            free(inputs[i]);
+            free(outputs[i]);
+        }
+        free(inputs);
+        free(outputs);
+        return failed > 0 ? 1 : 0;
+    }
+
+    for (size_t i = 0; i < input_count; i++) {
+        free(inputs[i]);
     }
+    free(inputs);
+    free(outputs);
 
     if (!input_file) {
         fprintf(stderr, "Error: No input file specified\n");
@@ -309,31 +469,138 @@ static int cmd_compile(int argc, char **argv) {
     }
 
     // Default output file
-    char default_output[256];
+    char default_output[4096];
+    if (!output_file) {
+        compile_output_path(input_file, NULL, &opts, default_output, sizeof(default_output));
+        output_file = default_output;
+    }
+
+    if (!compile_file(input_file, output_file, &opts)) return 1;
+    printf("Compiled %s -> %s\n", input_file, output_file);
+    return 0;
+}
+
+/*
+ * Build command - native executable from per-function objects compiled in
+ * parallel and cached
+ */
+static int cmd_build(int argc, char **argv) {
+    const char *input_file = NULL;
+    const char *output_file = NULL;
+    BuildOptions opts = {0};
+    opts.use_cache = true;
+    bool no_specialize = false;
+    bool fast_math = false;
+    const char *march = NULL;
+    bool pgo = false;
+    char **pgo_runs = calloc((size_t)argc + 1, sizeof(char *));
+    size_t pgo_run_count = 0;
+    if (!pgo_runs) return 1;
+
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            output_file = argv[++i];
+        } else if (strcmp(argv[i], "--pgo") == 0) {
+            pgo = true;
+        } else if (strcmp(argv[i], "--pgo-run") == 0 && i + 1 < argc) {
+            pgo = true;
+            pgo_runs[pgo_run_count++] = argv[++i];
+        } else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            opts.jobs = atoi(argv[++i]);
+        } else if (strncmp(argv[i], "-j", 2) == 0) {
+            opts.jobs = atoi(argv[i] + 2);
+        } else if (strcmp(argv[i], "--thinlto") == 0) {
+            opts.thinlto = true;
+        } else if (strcmp(argv[i], "--no-cache") == 0) {
+            opts.use_cache = false;
+        } else if (strcmp(argv[i], "--explain-rebuild") == 0) {
+            opts.explain = true;
+        } else if (argv[i][0] == '-' && argv[i][1] == 'O' && strlen(argv[i]) <= 3) {
+            opts.opt_level = argv[i];
+        } else if (strcmp(argv[i], "--no-specialize") == 0) {
+            no_specialize = true;
+        } else if (strcmp(argv[i], "--fast-math") == 0) {
+            fast_math = true;
+        } else if (strncmp(argv[i], "--march=", 8) == 0) {
+            march = argv[i] + 8;
+        } else if (argv[i][0] != '-') {
+            input_file = argv[i];
+        }
+    }
+
+    if (!input_file) {
+        fprintf(stderr, "Error: No input file specified\n");
+        free(pgo_runs);
+        return 1;
+    }
+
+    // Default output: the source path without its extension
+    char default_output[4096];
     if (!output_file) {
-        snprintf(default_output, sizeof(default_output), "%s", input_file);
-        char *dot = strrchr(default_output, '.');
-        if (dot) *dot = '\0';
-        strcat(default_output, ".ll");
+        compile_output_path(input_file, NULL, NULL, default_output, sizeof(default_output));
         output_file = default_output;
     }
+    opts.output = output_file;
 
     // Read source
     size_t source_len;
     char *source = read_file(input_file, &source_len);
-    if (!source) return 1;
+    if (!source) {
+        free(pgo_runs);
+        return 1;
+    }
+
+    // Profile next to the source: trained on the given runs, or once with
+    // no arguments if there is none yet
+    Profile profile = {0};
+    if (pgo) {
+        char profile_file[4096];
+        profile_path(input_file, profile_file, sizeof(profile_file));
+        FILE *existing = pgo_run_count == 0 ? fopen(profile_file, "r") : NULL;
+        if (existing) {
+            fclose(existing);
+        } else {
+            RunOptions train = {0};
+            train.opt_level = opts.opt_level;
+            train.no_specialize = no_specialize;
+            train.fast_math = fast_math;
+            train.march = march;
+            if (!pgo_train(input_file, source, source_len, &train, pgo_runs, pgo_run_count, profile_file)) {
+                fprintf(stderr, "Error: Profile training failed\n");
+                free(pgo_runs);
+                free(source);
+                return 1;
+            }
+        }
+        if (!profile_load(profile_file, &profile)) {
+            free(pgo_runs);
+            free(source);
+            return 1;
+        }
+    }
+    free(pgo_runs);
 
     // Lex
     Lexer *lexer = lexer_create(source, source_len);
     if (!lexer || !lexer_tokenize(lexer)) {
+        profile_free(&profile);
         free(source);
         return 1;
     }
 
+    // Runtime modules in use
+    bool needs_http = false, needs_mcp = false, needs_llm = false;
+    for (size_t i = 0; i < lexer->token_count; i++) {
+        if (lexer->tokens[i].type == TOK_HTTP) needs_http = true;
+        if (lexer->tokens[i].type == TOK_MCP) needs_mcp = true;
+        if (lexer->tokens[i].type == TOK_LLM) needs_llm = true;
+    }
+
     // Parse
     Parser *parser = parser_create(lexer->tokens, lexer->token_count);
     if (!parser) {
         lexer_free(lexer);
+        profile_free(&profile);
         free(source);
         return 1;
     }
@@ -342,34 +609,64 @@ static int cmd_compile(int argc, char **argv) {
     if (!ast) {
         parser_free(parser);
         lexer_free(lexer);
+        profile_free(&profile);
         free(source);
         return 1;
     }
 
-    // Generate code
-    NerdContext ctx = {0};
-    ctx.filename = input_file;
-    ctx.source = source;
-    ctx.ast = ast;
-
-    if (!codegen_llvm(&ctx, output_file)) {
-        fprintf(stderr, "Error: %s\n", ctx.error_msg);
+    // Imported modules are compiled to objects of their own
+    ModuleGraph modules;
+    if (!module_graph_load(&modules, input_file, ast)) {
         ast_free(ast);
         parser_free(parser);
         lexer_free(lexer);
+        profile_free(&profile);
         free(source);
         return 1;
     }
+    module_uses(&modules, &needs_http, &needs_mcp, &needs_llm);
+    opts.modules = modules.count > 0 ? &modules : NULL;
+
+    // Runtime objects next to the nerd executable
+    char exe_dir[1024] = "";
+    toolchain_runtime_dir(exe_dir, sizeof(exe_dir));
+    char http_lib[1100], mcp_lib[1100], llm_lib[1100];
+    snprintf(http_lib, sizeof(http_lib), "%sbuild/nerd_http.o", exe_dir);
+    snprintf(mcp_lib, sizeof(mcp_lib), "%sbuild/nerd_mcp.o", exe_dir);
+    snprintf(llm_lib, sizeof(llm_lib), "%sbuild/nerd_llm.o", exe_dir);
+
+    const char *link_args[4];
+    size_t link_count = 0;
+    if (needs_http) link_args[link_count++] = http_lib;
+    if (needs_mcp) link_args[link_count++] = mcp_lib;
+    if (needs_llm) link_args[link_count++] = llm_lib;
+    if (needs_http || needs_mcp || needs_llm) link_args[link_count++] = "-lcurl";
+    opts.link_args = link_args;
+    opts.link_count = link_count;
 
-    printf("Compiled %s -> %s\n", input_file, output_file);
+    NerdContext ctx = {0};
+    ctx.filename = input_file;
+    ctx.source = source;
+    ctx.ast = ast;
+    ctx.no_specialize = no_specialize;
+    ctx.fast_math = fast_math;
+    ctx.march = march;
+    ctx.emit_entry = true;
+    ctx.profile = pgo ? &profile : NULL;
+
+    bool ok = build_native(&ctx, &opts);
+    if (ok) printf("Built %s -> %s\n", input_file, output_file);
 
     // Cleanup
+    free(ctx.error_msg);
+    profile_free(&profile);
+    module_graph_free(&modules);
     ast_free(ast);
     parser_free(parser);
     lexer_free(lexer);
     free(source);
 
-    return 0;
+    return ok ? 0 : 1;
 }
 
 /*
@@ -432,13 +729,19 @@ static int cmd_parse(int argc, char **argv) {
 }
 
 /*
- * Run command - compile and execute
+ * Interp command - run through the bytecode interpreter (no clang)
  */
-static int cmd_run(int argc, char **argv) {
+static int cmd_interp(int argc, char **argv) {
     const char *input_file = NULL;
+    bool no_specialize = false;
+    bool tiered = false;
 
     for (int i = 0; i < argc; i++) {
-        if (argv[i][0] != '-') {
+        if (strcmp(argv[i], "--no-specialize") == 0) {
+            no_specialize = true;
+        } else if (strcmp(argv[i], "--tiered") == 0) {
+            tiered = true;
+        } else if (argv[i][0] != '-') {
             input_file = argv[i];
             break;
         }
@@ -461,14 +764,6 @@ static int cmd_run(int argc, char **argv) {
         return 1;
     }
 
-    // Check which modules are used
-    bool needs_http = false, needs_mcp = false, needs_llm = false;
-    for (size_t i = 0; i < lexer->token_count; i++) {
-        if (lexer->tokens[i].type == TOK_HTTP) needs_http = true;
-        if (lexer->tokens[i].type == TOK_MCP) needs_mcp = true;
-        if (lexer->tokens[i].type == TOK_LLM) needs_llm = true;
-    }
-
     // Parse
     Parser *parser = parser_create(lexer->tokens, lexer->token_count);
     if (!parser) {
@@ -478,185 +773,268 @@ static int cmd_run(int argc, char **argv) {
     }
 
     ASTNode *ast = parser_parse(parser);
-    if (!ast) {
+    if (!ast || !module_import_all(input_file, ast, NULL, NULL, NULL)) {
+        ast_free(ast);
         parser_free(parser);
         lexer_free(lexer);
         free(source);
         return 1;
     }
 
-    // Generate code to temp file
-    const char *tmp_ll = "/tmp/nerd_out.ll";
-    const char *tmp_main = "/tmp/nerd_main.ll";
-    const char *tmp_combined = "/tmp/nerd_combined.ll";
-    const char *tmp_bin = "/tmp/nerd_run";
+    if (!no_specialize) {
+        specialize_program(ast);
+    }
 
-    NerdContext ctx = {0};
-    ctx.filename = input_file;
-    ctx.source = source;
-    ctx.ast = ast;
+    // Compile to bytecode and run
+    int result = 1;
+    BcProgram *prog = bc_compile(ast);
+    if (prog) {
+        result = bc_run(prog, tiered ? ast : NULL);
+        bc_free(prog);
+    }
 
-    if (!codegen_llvm(&ctx, tmp_ll)) {
-        fprintf(stderr, "Error: %s\n", ctx.error_msg);
-        ast_free(ast);
-        parser_free(parser);
-        lexer_free(lexer);
-        free(source);
+    // Cleanup
+    ast_free(ast);
+    parser_free(parser);
+    lexer_free(lexer);
+    free(source);
+
+    return result;
+}
+
+/*
+ * Bench command - time every function of a program natively
+ */
+static int cmd_bench(int argc, char **argv) {
+    const char *input_file = NULL;
+    BenchOptions opts = { .opt_level = "-O2", .warmup_ms = 20, .time_ms = 200 };
+    BenchArgs *sets = malloc(sizeof(BenchArgs) * (argc + 1));
+    const char **only = malloc(sizeof(char *) * (argc + 1));
+    if (!sets || !only) {
+        free(sets);
+        free(only);
         return 1;
     }
+    opts.args = sets;
+    opts.only = only;
 
-    // Check if there's a main function in the AST
-    ASTNode *program = ast;
-    bool has_main = false;
-    for (size_t i = 0; i < program->data.program.functions.count; i++) {
-        ASTNode *func = program->data.program.functions.nodes[i];
-        if (strcmp(func->data.func_def.name, "main") == 0) {
-            has_main = true;
-            break;
+    int result = 1;
+    for (int i = 0; i < argc; i++) {
+        const char *value = NULL;
+        if ((strcmp(argv[i], "--args") == 0 || strcmp(argv[i], "--fn") == 0 ||
+             strcmp(argv[i], "-n") == 0 || strcmp(argv[i], "--time") == 0 ||
+             strcmp(argv[i], "--warmup") == 0) && i + 1 < argc) {
+            value = argv[i + 1];
         }
-    }
 
-    char cmd[2048];
-    
-    if (has_main) {
-        // Program has main - create i32 wrapper that calls nerd's double main
-        // Rename the NERD main to nerd_main, then create i32 main wrapper
-        snprintf(cmd, sizeof(cmd), 
-            "sed 's/define double @main/define double @nerd_main/g' %s > %s",
-            tmp_ll, tmp_combined);
-        if (system(cmd) != 0) {
-            fprintf(stderr, "Error: Failed to process file\n");
-            ast_free(ast); parser_free(parser); lexer_free(lexer); free(source);
-            return 1;
-        }
-        
-        // Append i32 main wrapper
-        FILE *f = fopen(tmp_combined, "a");
-        if (f) {
-            fprintf(f, "\n; Entry point wrapper\n");
-            fprintf(f, "define i32 @main() {\n");
-            fprintf(f, "entry:\n");
-            fprintf(f, "  call double @nerd_main()\n");
-            fprintf(f, "  ret i32 0\n");
-            fprintf(f, "}\n");
-            fclose(f);
+        if (strcmp(argv[i], "--args") == 0 && value) {
+            if (!bench_parse_args(value, &sets[opts.arg_count])) goto done;
+            opts.arg_count++;
+            i++;
+        } else if (strncmp(argv[i], "--args=", 7) == 0) {
+            if (!bench_parse_args(argv[i] + 7, &sets[opts.arg_count])) goto done;
+            opts.arg_count++;
+        } else if (strcmp(argv[i], "--fn") == 0 && value) {
+            only[opts.only_count++] = value;
+            i++;
+        } else if (strcmp(argv[i], "-n") == 0 && value) {
+            opts.calls = strtoull(value, NULL, 10);
+            i++;
+        } else if (strcmp(argv[i], "--time") == 0 && value) {
+            opts.time_ms = atof(value);
+            i++;
+        } else if (strcmp(argv[i], "--warmup") == 0 && value) {
+            opts.warmup_ms = atof(value);
+            i++;
+        } else if (strcmp(argv[i], "--json") == 0) {
+            opts.json = true;
+        } else if (strcmp(argv[i], "--no-specialize") == 0) {
+            opts.no_specialize = true;
+        } else if (strcmp(argv[i], "--fast-math") == 0) {
+            opts.fast_math = true;
+        } else if (strncmp(argv[i], "--march=", 8) == 0) {
+            opts.march = argv[i] + 8;
+        } else if (argv[i][0] == '-' && argv[i][1] == 'O' && strlen(argv[i]) <= 3) {
+            opts.opt_level = argv[i];
+        } else if (argv[i][0] != '-') {
+            input_file = argv[i];
+        } else {
+            fprintf(stderr, "Error: Unknown bench option '%s'\n", argv[i]);
+            goto done;
         }
-    } else {
-        // No main - generate test wrapper (old behavior for library-style code)
-        FILE *main_file = fopen(tmp_main, "w");
-        if (!main_file) {
-            fprintf(stderr, "Error: Cannot create temp file\n");
-            ast_free(ast); parser_free(parser); lexer_free(lexer); free(source);
+    }
+
+    if (!input_file) {
+        fprintf(stderr, "Error: No input file specified\n");
+        goto done;
+    }
+
+    size_t source_len;
+    char *source = read_file(input_file, &source_len);
+    if (source) {
+        result = bench_run(input_file, source, source_len, &opts);
+        free(source);
+    }
+
+done:
+    for (size_t i = 0; i < opts.arg_count; i++) {
+        free(sets[i].func);
+    }
+    free(sets);
+    free(only);
+    return result;
+}
+
+/*
+ * Cache command - inspect or clear the `nerd run` cache
+ */
+static int cmd_cache(int argc, char **argv) {
+    if (argc >= 1 && strcmp(argv[0], "stats") == 0) {
+        return cache_stats();
+    } else if (argc >= 1 && strcmp(argv[0], "clear") == 0) {
+        return cache_clear();
+    }
+    fprintf(stderr, "Usage: nerd cache stats|clear\n");
+    return 1;
+}
+
+/*
+ * Serve command - run, stop or query the compiler daemon
+ */
+static int cmd_serve(int argc, char **argv) {
+    int jobs = 0;
+
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "--stop") == 0) {
+            return serve_stop();
+        } else if (strcmp(argv[i], "--status") == 0) {
+            return serve_status();
+        } else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            jobs = atoi(argv[++i]);
+        } else if (strncmp(argv[i], "-j", 2) == 0 && argv[i][2]) {
+            jobs = atoi(argv[i] + 2);
+        } else {
+            fprintf(stderr, "Usage: nerd serve [-j N] [--stop|--status]\n");
             return 1;
         }
+    }
+    return serve_main(jobs);
+}
 
-        fprintf(main_file, "; Auto-generated main for nerd run\n\n");
-        fprintf(main_file, "@.fmt = private constant [11 x i8] c\"%%s = %%.0f\\0A\\00\"\n");
-        fprintf(main_file, "declare i32 @printf(i8*, ...)\n\n");
+/*
+ * Run command - compile and execute
+ *
+ * A running `nerd serve` is asked for the executable first. Otherwise the
+ * IR is streamed straight into clang's stdin and the binary lands in the
+ * cache (or a private temp directory), so concurrent runs never collide.
+ */
+static int cmd_run(int argc, char **argv) {
+    const char *input_file = NULL;
+    RunOptions opts = {0};
+    bool use_cache = true;
+    int prog_argi = argc;
 
-        size_t func_count = program->data.program.functions.count;
-        for (size_t i = 0; i < func_count; i++) {
-            ASTNode *func = program->data.program.functions.nodes[i];
-            const char *name = func->data.func_def.name;
-            fprintf(main_file, "@.name%zu = private constant [%zu x i8] c\"%s\\00\"\n", 
-                    i, strlen(name) + 1, name);
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "--interp") == 0 || strcmp(argv[i], "--tiered") == 0) {
+            return cmd_interp(argc, argv);
+        } else if (strcmp(argv[i], "--no-specialize") == 0) {
+            opts.no_specialize = true;
+        } else if (strcmp(argv[i], "--fast-math") == 0) {
+            opts.fast_math = true;
+        } else if (strncmp(argv[i], "--march=", 8) == 0) {
+            opts.march = argv[i] + 8;
+        } else if (argv[i][0] == '-' && argv[i][1] == 'O' && strlen(argv[i]) <= 3) {
+            opts.opt_level = argv[i];
+        } else if (strcmp(argv[i], "--no-cache") == 0) {
+            use_cache = false;
+        } else if (strncmp(argv[i], "--backend=", 10) == 0) {
+            if (!parse_backend(argv[i] + 10, &opts.x86)) return 1;
+        } else if (strncmp(argv[i], "--emit=", 7) == 0) {
+            if (!parse_emit(argv[i] + 7, &opts.bitcode)) return 1;
+        } else if (argv[i][0] != '-') {
+            input_file = argv[i];
+            prog_argi = i + 1;
+            break;
         }
+    }
 
-        fprintf(main_file, "\ndefine i32 @main() {\n");
-        fprintf(main_file, "entry:\n");
-
-        for (size_t i = 0; i < func_count; i++) {
-            ASTNode *func = program->data.program.functions.nodes[i];
-            const char *name = func->data.func_def.name;
-            size_t param_count = func->data.func_def.params.count;
-            
-            fprintf(main_file, "  %%r%zu = call double @%s(", i, name);
-            for (size_t j = 0; j < param_count; j++) {
-                if (j > 0) fprintf(main_file, ", ");
-                if (j == 0) fprintf(main_file, "double 5.0");
-                else if (j == 1) fprintf(main_file, "double 3.0");
-                else fprintf(main_file, "double 1.0");
-            }
-            fprintf(main_file, ")\n");
-            
-            fprintf(main_file, "  %%fmt%zu = getelementptr [11 x i8], [11 x i8]* @.fmt, i32 0, i32 0\n", i);
-            fprintf(main_file, "  %%nm%zu = getelementptr [%zu x i8], [%zu x i8]* @.name%zu, i32 0, i32 0\n", 
-                    i, strlen(name) + 1, strlen(name) + 1, i);
-            fprintf(main_file, "  call i32 (i8*, ...) @printf(i8* %%fmt%zu, i8* %%nm%zu, double %%r%zu)\n", i, i, i);
-        }
+    if (!input_file) {
+        fprintf(stderr, "Error: No input file specified\n");
+        return 1;
+    }
+    if (opts.x86 && opts.bitcode) {
+        fprintf(stderr, "Error: --emit=bc needs the LLVM backend\n");
+        return 1;
+    }
 
-        fprintf(main_file, "  ret i32 0\n");
-        fprintf(main_file, "}\n");
-        fclose(main_file);
+#if !defined(__x86_64__) || defined(__APPLE__)
+    if (opts.x86) {
+        fprintf(stderr, "Error: The x86 backend needs an x86-64 ELF host (use `compile --backend=x86` to cross-compile)\n");
+        return 1;
+    }
+#endif
 
-        snprintf(cmd, sizeof(cmd), "cat %s %s > %s", tmp_ll, tmp_main, tmp_combined);
-        if (system(cmd) != 0) {
-            fprintf(stderr, "Error: Failed to combine files\n");
-            ast_free(ast); parser_free(parser); lexer_free(lexer); free(source);
-            return 1;
-        }
+    // Program argv: [binary, args after the source file...]
+    int prog_argc = argc - prog_argi;
+    char **prog_argv = malloc(sizeof(char *) * (prog_argc + 2));
+    if (!prog_argv) return 1;
+    for (int i = 0; i < prog_argc; i++) {
+        prog_argv[i + 1] = argv[prog_argi + i];
+    }
+    prog_argv[prog_argc + 1] = NULL;
+
+    // The daemon builds (or finds) the executable; any failure, including
+    // a compile error, falls through to a local build that reports it
+    char bin[4096];
+    if (use_cache && serve_build(input_file, &opts, bin, sizeof(bin))) {
+        prog_argv[0] = bin;
+        toolchain_exec(prog_argv);
     }
 
-    // Build clang command with required libraries
-    // Get path to nerd executable to find runtime libs
-    char exe_path[1024] = "";
-    #ifdef __APPLE__
-    uint32_t size = sizeof(exe_path);
-    _NSGetExecutablePath(exe_path, &size);
-    #else
-    readlink("/proc/self/exe", exe_path, sizeof(exe_path));
-    #endif
-    
-    // Get directory of executable
-    char *last_slash = strrchr(exe_path, '/');
-    if (last_slash) *(last_slash + 1) = '\0';
-    
-    // Build library paths
-    char http_lib[1024], mcp_lib[1024], llm_lib[1024];
-    snprintf(http_lib, sizeof(http_lib), "%sbuild/nerd_http.o", exe_path);
-    snprintf(mcp_lib, sizeof(mcp_lib), "%sbuild/nerd_mcp.o", exe_path);
-    snprintf(llm_lib, sizeof(llm_lib), "%sbuild/nerd_llm.o", exe_path);
-    
-    // Build clang command
-    char libs[2048] = "";
-    if (needs_http || needs_mcp || needs_llm) {
-        strcat(libs, " -lcurl");
-    }
-    if (needs_http) {
-        strcat(libs, " ");
-        strcat(libs, http_lib);
-    }
-    if (needs_mcp) {
-        strcat(libs, " ");
-        strcat(libs, mcp_lib);
-    }
-    if (needs_llm) {
-        strcat(libs, " ");
-        strcat(libs, llm_lib);
-    }
-    
-    snprintf(cmd, sizeof(cmd), "clang -w %s%s -o %s", tmp_combined, libs, tmp_bin);
-    if (system(cmd) != 0) {
-        fprintf(stderr, "Error: clang compilation failed. Check %s\n", tmp_combined);
-        ast_free(ast);
-        parser_free(parser);
-        lexer_free(lexer);
-        free(source);
+    // Read source
+    size_t source_len;
+    char *source = read_file(input_file, &source_len);
+    if (!source) {
+        free(prog_argv);
         return 1;
     }
 
-    // Run
-    int result = system(tmp_bin);
+    // Cache hit: exec the stored executable, nothing else to do
+    RunEnv env;
+    run_env_init(&env);
+    CacheKey key;
+    if (use_cache) {
+        run_cache_key(&key, &env, &opts, input_file, source, source_len);
+        if (cache_lookup(&key, bin, sizeof(bin))) {
+            prog_argv[0] = bin;
+            toolchain_exec(prog_argv);
+            // Evicted in the meantime: fall through and rebuild
+        }
+    }
 
-    // Cleanup
-    remove(tmp_ll);
-    remove(tmp_main);
-    remove(tmp_combined);
-    remove(tmp_bin);
+    bool cached;
+    char *tmp_dir;
+    bool built = run_build(&env, &opts, input_file, source, source_len,
+                           use_cache ? &key : NULL, bin, sizeof(bin), &cached, &tmp_dir);
+
+    // Run with the remaining arguments
+    int result = 1;
+    if (built) {
+        prog_argv[0] = bin;
+        int prog_pid;
+        if (toolchain_spawn(prog_argv, NULL, &prog_pid)) {
+            result = toolchain_wait(prog_pid);
+        }
+    }
 
-    ast_free(ast);
-    parser_free(parser);
-    lexer_free(lexer);
+    // Cleanup
+    if (tmp_dir) {
+        toolchain_rmdir(tmp_dir);
+        free(tmp_dir);
+    } else if (built && !cached) {
+        remove(bin);  // only left behind if the store failed
+    }
+    free(prog_argv);
     free(source);
 
     return result;
@@ -723,10 +1101,20 @@ int main(int argc, char **argv) {
         return cmd_run(argc - 2, argv + 2);
     } else if (strcmp(cmd, "compile") == 0) {
         return cmd_compile(argc - 2, argv + 2);
+    } else if (strcmp(cmd, "build") == 0) {
+        return cmd_build(argc - 2, argv + 2);
     } else if (strcmp(cmd, "parse") == 0) {
         return cmd_parse(argc - 2, argv + 2);
     } else if (strcmp(cmd, "tokens") == 0) {
         return cmd_tokens(argc - 2, argv + 2);
+    } else if (strcmp(cmd, "interp") == 0) {
+        return cmd_interp(argc - 2, argv + 2);
+    } else if (strcmp(cmd, "cache") == 0) {
+        return cmd_cache(argc - 2, argv + 2);
+    } else if (strcmp(cmd, "bench") == 0) {
+        return cmd_bench(argc - 2, argv + 2);
+    } else if (strcmp(cmd, "serve") == 0) {
+        return cmd_serve(argc - 2, argv + 2);
     } else if (strcmp(cmd, "--help") == 0 || strcmp(cmd, "-h") == 0) {
         print_usage();
         return 0;
@@ -0,0 +1,568 @@
+/*
+ * NERD Modules - Imports, the module graph and interface files
+ *
+ * `import tools` makes the functions of tools.nerd callable. The file is
+ * looked up next to the importing file, then in each directory listed in
+ * NERD_PATH (colon separated). Imports are transitive and share one flat
+ * namespace: a function may be defined only once in the whole program,
+ * and only the main file may have `fn main` or top-level statements.
+ *
+ * The loader follows imports depth first, rejects cycles, and lists the
+ * modules with dependencies before dependents. A module's interface (its
+ * imports, the name and arity of each function, the runtime modules it
+ * uses) is kept in the cache as <key>.nerdi, keyed on the source text, so
+ * an unchanged module is read and hashed but not parsed.
+ *
+ * `nerd run`, `interp` and `compile` merge the imported functions into the
+ * main program. `nerd build` compiles each module to an object of its own
+ * (see build.c).
+ */
+
+#define _XOPEN_SOURCE 700
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "nerd.h"
+
+#define INTERFACE_HEADER "nerd-interface 1"
+#define MAX_IMPORT_DEPTH 256
+
+typedef struct {
+    ModuleGraph *g;
+    const char *stack[MAX_IMPORT_DEPTH];   // canonical paths being loaded
+    size_t depth;
+    CacheKey interface_base;
+} Loader;
+
+static char *read_source(const char *path, size_t *len) {
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        fprintf(nerd_diag(), "Error: Cannot open file '%s'\n", path);
+        return NULL;
+    }
+
+    fseek(f, 0, SEEK_END);
+    *len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    char *buf = malloc(*len + 1);
+    if (buf && fread(buf, 1, *len, f) != *len) {
+        fprintf(nerd_diag(), "Error: Failed to read file '%s'\n", path);
+        free(buf);
+        buf = NULL;
+    }
+    if (buf) buf[*len] = '\0';
+    fclose(f);
+    return buf;
+}
+
+// Directory part of a path ("." when there is none)
+static void dir_of(const char *path, char *dir, size_t size) {
+    const char *slash = strrchr(path, '/');
+    if (!slash) {
+        snprintf(dir, size, ".");
+    } else if (slash == path) {
+        snprintf(dir, size, "/");
+    } else {
+        snprintf(dir, size, "%.*s", (int)(slash - path), path);
+    }
+}
+
+static const char *base_name(const char *path) {
+    const char *slash = strrchr(path, '/');
+    return slash ? slash + 1 : path;
+}
+
+/*
+ * `name` -> canonical path of name.nerd, next to the importer or on NERD_PATH
+ */
+static bool resolve_import(const char *dir, const char *name, char *path) {
+    char candidate[PATH_MAX + 256];
+    snprintf(candidate, sizeof(candidate), "%s/%s.nerd", dir, name);
+    if (realpath(candidate, path)) return true;
+
+    const char *search = getenv("NERD_PATH");
+    while (search && *search) {
+        size_t len = strcspn(search, ":");
+        if (len > 0) {
+            snprintf(candidate, sizeof(candidate), "%.*s/%s.nerd", (int)len, search, name);
+            if (realpath(candidate, path)) return true;
+        }
+        search += len;
+        if (*search == ':') search++;
+    }
+    return false;
+}
+
+static void module_free(Module *m) {
+    free(m->name);
+    free(m->path);
+    free(m->source);
+    ast_free(m->ast);
+    for (size_t i = 0; i < m->import_count; i++) {
+        free(m->imports[i]);
+    }
+    free(m->imports);
+    free(m->deps);
+    for (size_t i = 0; i < m->export_count; i++) {
+        free(m->exports[i].name);
+    }
+    free(m->exports);
+}
+
+static void add_import(Module *m, const char *name) {
+    m->imports = realloc(m->imports, sizeof(char *) * (m->import_count + 1));
+    m->imports[m->import_count++] = nerd_strdup(name);
+}
+
+static void add_export(Module *m, const char *name, size_t arity) {
+    m->exports = realloc(m->exports, sizeof(ModuleSig) * (m->export_count + 1));
+    m->exports[m->export_count].name = nerd_strdup(name);
+    m->exports[m->export_count].arity = arity;
+    m->export_count++;
+}
+
+/*
+ * Lex and parse a module. With `describe`, also fill in its interface.
+ */
+static bool parse_module(Module *m, bool describe) {
+    Lexer *lexer = lexer_create(m->source, m->source_len);
+    if (!lexer || !lexer_tokenize(lexer)) {
+        fprintf(nerd_diag(), "Error: in module '%s' (%s)\n", m->name, m->path);
+        if (lexer) lexer_free(lexer);
+        return false;
+    }
+    Parser *parser = parser_create(lexer->tokens, lexer->token_count);
+    ASTNode *ast = parser ? parser_parse(parser) : NULL;
+    if (!ast) {
+        fprintf(nerd_diag(), "Error: in module '%s' (%s)\n", m->name, m->path);
+        if (parser) parser_free(parser);
+        lexer_free(lexer);
+        return false;
+    }
+
+    ASTList *funcs = &ast->data.program.functions;
+    for (size_t i = 0; i < funcs->count; i++) {
+        if (strcmp(funcs->nodes[i]->data.func_def.name, "main") == 0) {
+            fprintf(nerd_diag(), "Error: %s: an imported module cannot have fn main or top-level statements\n",
+                    m->path);
+            ast_free(ast);
+            parser_free(parser);
+            lexer_free(lexer);
+            return false;
+        }
+    }
+
+    if (describe) {
+        for (size_t i = 0; i < lexer->token_count; i++) {
+            if (lexer->tokens[i].type == TOK_HTTP) m->uses_http = true;
+            if (lexer->tokens[i].type == TOK_MCP) m->uses_mcp = true;
+            if (lexer->tokens[i].type == TOK_LLM) m->uses_llm = true;
+        }
+        ASTList *imports = &ast->data.program.imports;
+        for (size_t i = 0; i < imports->count; i++) {
+            add_import(m, imports->nodes[i]->data.import.name);
+        }
+        for (size_t i = 0; i < funcs->count; i++) {
+            add_export(m, funcs->nodes[i]->data.func_def.name,
+                       funcs->nodes[i]->data.func_def.params.count);
+        }
+    }
+
+    m->ast = ast;
+    parser_free(parser);
+    lexer_free(lexer);
+    return true;
+}
+
+/*
+ * Parse a loaded module (its interface may have come from the cache)
+ */
+bool module_parse(Module *m) {
+    return m->ast || parse_module(m, false);
+}
+
+/*
+ * Interface file: header, then `uses <module>`, `import <name>` and
+ * `fn <name> <arity>` lines
+ */
+static bool interface_load(const CacheKey *key, Module *m) {
+    char path[4096];
+    if (!cache_meta_path(key, ".nerdi", path, sizeof(path))) return false;
+    FILE *f = fopen(path, "r");
+    if (!f) return false;
+
+    char line[4096];
+    bool ok = fgets(line, sizeof(line), f) &&
+              strncmp(line, INTERFACE_HEADER, strlen(INTERFACE_HEADER)) == 0;
+    while (ok && fgets(line, sizeof(line), f)) {
+        line[strcspn(line, "\n")] = '\0';
+        char name[1024];
+        size_t arity;
+        if (strcmp(line, "uses http") == 0) {
+            m->uses_http = true;
+        } else if (strcmp(line, "uses mcp") == 0) {
+            m->uses_mcp = true;
+        } else if (strcmp(line, "uses llm") == 0) {
+            m->uses_llm = true;
+        } else if (sscanf(line, "import %1023s", name) == 1) {
+            add_import(m, name);
+        } else if (sscanf(line, "fn %1023s %zu", name, &arity) == 2) {
+            add_export(m, name, arity);
+        } else {
+            ok = false;
+        }
+    }
+    fclose(f);
+
+    if (!ok) {
+        // Unreadable: start over from the source
+        for (size_t i = 0; i < m->import_count; i++) free(m->imports[i]);
+        for (size_t i = 0; i < m->export_count; i++) free(m->exports[i].name);
+        m->import_count = m->export_count = 0;
+        m->uses_http = m->uses_mcp = m->uses_llm = false;
+        return false;
+    }
+    utimensat(AT_FDCWD, path, NULL, 0);
+    return true;
+}
+
+static void interface_store(const CacheKey *key, const Module *m) {
+    char tmp[4096 + 8], path[4096];
+    if (!cache_tmp_path(key, tmp, sizeof(tmp) - 8) || !cache_meta_path(key, ".nerdi", path, sizeof(path))) return;
+
+    // Unique per thread too (compile --batch loads modules concurrently)
+    strcat(tmp, "-XXXXXX");
+    int fd = mkstemp(tmp);
+    if (fd < 0) return;
+    FILE *f = fdopen(fd, "w");
+    if (!f) {
+        close(fd);
+        remove(tmp);
+        return;
+    }
+
+    fprintf(f, "%s\n", INTERFACE_HEADER);
+    if (m->uses_http) fprintf(f, "uses http\n");
+    if (m->uses_mcp) fprintf(f, "uses mcp\n");
+    if (m->uses_llm) fprintf(f, "uses llm\n");
+    for (size_t i = 0; i < m->import_count; i++) {
+        fprintf(f, "import %s\n", m->imports[i]);
+    }
+    for (size_t i = 0; i < m->export_count; i++) {
+        fprintf(f, "fn %s %zu\n", m->exports[i].name, m->exports[i].arity);
+    }
+    if (fclose(f) != 0 || rename(tmp, path) != 0) {
+        remove(tmp);
+    }
+}
+
+/*
+ * Load the module `name` imported from `importer` (and, first, everything
+ * it imports). Returns its index in the graph, or -1.
+ */
+static long load_module(Loader *l, const char *importer, const char *name) {
+    ModuleGraph *g = l->g;
+    char dir[PATH_MAX];
+    char path[PATH_MAX];
+    dir_of(importer, dir, sizeof(dir));
+    if (!resolve_import(dir, name, path)) {
+        fprintf(nerd_diag(), "Error: %s: cannot find module '%s' (%s/%s.nerd or NERD_PATH)\n",
+                importer, name, dir, name);
+        return -1;
+    }
+
+    for (size_t i = 0; i < l->depth; i++) {
+        if (strcmp(l->stack[i], path) != 0) continue;
+        fprintf(nerd_diag(), "Error: Import cycle: ");
+        for (size_t j = i; j < l->depth; j++) {
+            fprintf(nerd_diag(), "%s -> ", base_name(l->stack[j]));
+        }
+        fprintf(nerd_diag(), "%s\n", base_name(path));
+        return -1;
+    }
+    for (size_t i = 0; i < g->count; i++) {
+        if (strcmp(g->modules[i].path, path) == 0) return (long)i;
+    }
+    if (l->depth >= MAX_IMPORT_DEPTH) {
+        fprintf(nerd_diag(), "Error: %s: imports nested too deeply\n", importer);
+        return -1;
+    }
+
+    Module m = {0};
+    m.name = nerd_strdup(name);
+    m.path = nerd_strdup(path);
+    m.source = read_source(path, &m.source_len);
+    if (!m.source) {
+        module_free(&m);
+        return -1;
+    }
+    cache_key_init(&m.source_key);
+    cache_key_add(&m.source_key, m.source, m.source_len);
+
+    CacheKey key = l->interface_base;
+    cache_key_add(&key, &m.source_key, sizeof(CacheKey));
+    if (!interface_load(&key, &m)) {
+        if (!parse_module(&m, true)) {
+            module_free(&m);
+            return -1;
+        }
+        interface_store(&key, &m);
+    }
+
+    l->stack[l->depth++] = m.path;
+    m.deps = malloc(sizeof(size_t) * (m.import_count ? m.import_count : 1));
+    bool ok = m.deps != NULL;
+    for (size_t i = 0; ok && i < m.import_count; i++) {
+        long dep = load_module(l, m.path, m.imports[i]);
+        if (dep < 0) ok = false;
+        else m.deps[i] = (size_t)dep;
+    }
+    l->depth--;
+    if (!ok) {
+        module_free(&m);
+        return -1;
+    }
+
+    if (g->count >= g->capacity) {
+        g->capacity = g->capacity ? g->capacity * 2 : 8;
+        g->modules = realloc(g->modules, sizeof(Module) * g->capacity);
+    }
+    g->modules[g->count] = m;
+    return (long)g->count++;
+}
+
+typedef struct {
+    const char *name;
+    const char *owner;
+} Definition;
+
+static int definition_cmp(const void *a, const void *b) {
+    return strcmp(((const Definition *)a)->name, ((const Definition *)b)->name);
+}
+
+/*
+ * Every function name must be defined once across the main file and its
+ * modules
+ */
+static bool check_duplicates(const ModuleGraph *g, const char *root_path, ASTNode *root) {
+    ASTList *funcs = &root->data.program.functions;
+    size_t total = funcs->count;
+    for (size_t i = 0; i < g->count; i++) {
+        total += g->modules[i].export_count;
+    }
+    Definition *defs = malloc(sizeof(Definition) * (total ? total : 1));
+    if (!defs) return false;
+
+    size_t n = 0;
+    for (size_t i = 0; i < funcs->count; i++) {
+        defs[n++] = (Definition){ funcs->nodes[i]->data.func_def.name, root_path };
+    }
+    for (size_t i = 0; i < g->count; i++) {
+        for (size_t j = 0; j < g->modules[i].export_count; j++) {
+            defs[n++] = (Definition){ g->modules[i].exports[j].name, g->modules[i].path };
+        }
+    }
+    qsort(defs, n, sizeof(Definition), definition_cmp);
+
+    bool ok = true;
+    for (size_t i = 1; i < n; i++) {
+        if (strcmp(defs[i - 1].name, defs[i].name) != 0) continue;
+        fprintf(nerd_diag(), "Error: Function '%s' is defined in both %s and %s\n",
+                defs[i].name, defs[i - 1].owner, defs[i].owner);
+        ok = false;
+    }
+    free(defs);
+    return ok;
+}
+
+/*
+ * Load every module imported (directly or not) by the program `root`,
+ * parsed from `root_path`
+ */
+bool module_graph_load(ModuleGraph *g, const char *root_path, ASTNode *root) {
+    memset(g, 0, sizeof(*g));
+    ASTList *imports = &root->data.program.imports;
+    if (imports->count == 0) return true;
+
+    char root_real[PATH_MAX];
+    if (!realpath(root_path, root_real)) {
+        fprintf(nerd_diag(), "Error: Cannot resolve '%s'\n", root_path);
+        return false;
+    }
+
+    Loader l = { .g = g };
+    l.stack[l.depth++] = root_real;
+    cache_key_init(&l.interface_base);
+    cache_key_add_str(&l.interface_base, "nerd-interface");
+    char exe[1024];
+    if (toolchain_exe_path(exe, sizeof(exe))) {
+        cache_key_add_file(&l.interface_base, exe);
+    }
+
+    for (size_t i = 0; i < imports->count; i++) {
+        if (load_module(&l, root_real, imports->nodes[i]->data.import.name) < 0) {
+            module_graph_free(g);
+            return false;
+        }
+    }
+    if (!check_duplicates(g, root_path, root)) {
+        module_graph_free(g);
+        return false;
+    }
+    return true;
+}
+
+void module_graph_free(ModuleGraph *g) {
+    for (size_t i = 0; i < g->count; i++) {
+        module_free(&g->modules[i]);
+    }
+    free(g->modules);
+    memset(g, 0, sizeof(*g));
+}
+
+/*
+ * Move every module's functions into `program`, flagged as imported so the
+ * entry harness leaves them out
+ */
+bool module_merge(ModuleGraph *g, ASTNode *program) {
+    for (size_t i = 0; i < g->count; i++) {
+        Module *m = &g->modules[i];
+        if (!module_parse(m)) return false;
+
+        ASTList *funcs = &m->ast->data.program.functions;
+        for (size_t j = 0; j < funcs->count; j++) {
+            funcs->nodes[j]->data.func_def.imported = true;
+            ast_list_push(&program->data.program.functions, funcs->nodes[j]);
+        }
+        funcs->count = 0;
+    }
+    return true;
+}
+
+/*
+ * Load the modules `program` (parsed from `path`) imports and move their
+ * functions into it, noting which runtime modules they use (the flags may
+ * be NULL)
+ */
+bool module_import_all(const char *path, ASTNode *program, bool *http, bool *mcp, bool *llm) {
+    ModuleGraph g;
+    if (!module_graph_load(&g, path, program)) return false;
+    bool ok = module_merge(&g, program);
+    if (http) module_uses(&g, http, mcp, llm);
+    module_graph_free(&g);
+    return ok;
+}
+
+/*
+ * Flag the modules that module `index` imports, directly or not
+ */
+void module_visible(const ModuleGraph *g, size_t index, bool *visible) {
+    const Module *m = &g->modules[index];
+    for (size_t i = 0; i < m->import_count; i++) {
+        if (visible[m->deps[i]]) continue;
+        visible[m->deps[i]] = true;
+        module_visible(g, m->deps[i], visible);
+    }
+}
+
+static int sig_cmp(const void *a, const void *b) {
+    return strcmp(((const ModuleSig *)a)->name, ((const ModuleSig *)b)->name);
+}
+
+/*
+ * Exports of the modules flagged in `visible` (all if NULL), sorted by name
+ * for NerdContext.externs. The names still belong to the modules.
+ */
+ModuleSig *module_externs(const ModuleGraph *g, const bool *visible, size_t *count) {
+    size_t total = 0;
+    for (size_t i = 0; i < g->count; i++) {
+        if (!visible || visible[i]) total += g->modules[i].export_count;
+    }
+    ModuleSig *sigs = malloc(sizeof(ModuleSig) * (total ? total : 1));
+    *count = 0;
+    if (!sigs) return NULL;
+
+    for (size_t i = 0; i < g->count; i++) {
+        if (visible && !visible[i]) continue;
+        memcpy(sigs + *count, g->modules[i].exports, sizeof(ModuleSig) * g->modules[i].export_count);
+        *count += g->modules[i].export_count;
+    }
+    qsort(sigs, *count, sizeof(ModuleSig), sig_cmp);
+    return sigs;
+}
+
+/*
+ * Add the runtime modules that any imported module uses
+ */
+void module_uses(const ModuleGraph *g, bool *http, bool *mcp, bool *llm) {
+    for (size_t i = 0; i < g->count; i++) {
+        if (g->modules[i].uses_http) *http = true;
+        if (g->modules[i].uses_mcp) *mcp = true;
+        if (g->modules[i].uses_llm) *llm = true;
+    }
+}
+
+/*
+ * Mix the path and text of every imported file into `key` without lexing:
+ * `import name` lines are picked out of the text. Used by `nerd run` before
+ * its cache lookup; an unresolved import just adds a marker, and the full
+ * load reports it.
+ */
+static void hash_imports(CacheKey *key, const char *source, const char *path,
+                         char ***seen, size_t *seen_count) {
+    char dir[PATH_MAX];
+    dir_of(path, dir, sizeof(dir));
+
+    for (const char *p = source; *p; ) {
+        while (*p == ' ' || *p == '\t') p++;
+        if (strncmp(p, "import", 6) == 0 && (p[6] == ' ' || p[6] == '\t')) {
+            const char *q = p + 6;
+            while (*q == ' ' || *q == '\t') q++;
+            size_t len = 0;
+            while (q[len] == '_' || (q[len] >= 'a' && q[len] <= 'z') ||
+                   (q[len] >= 'A' && q[len] <= 'Z') || (q[len] >= '0' && q[len] <= '9')) {
+                len++;
+            }
+
+            char name[256], resolved[PATH_MAX];
+            snprintf(name, sizeof(name), "%.*s", (int)(len < 255 ? len : 255), q);
+            if (!resolve_import(dir, name, resolved)) {
+                cache_key_add_str(key, name);
+                cache_key_add_str(key, "<missing>");
+            } else {
+                bool known = false;
+                for (size_t i = 0; i < *seen_count && !known; i++) {
+                    known = strcmp((*seen)[i], resolved) == 0;
+                }
+                size_t text_len;
+                char *text = known ? NULL : read_source(resolved, &text_len);
+                if (text) {
+                    *seen = realloc(*seen, sizeof(char *) * (*seen_count + 1));
+                    (*seen)[(*seen_count)++] = nerd_strdup(resolved);
+                    cache_key_add_str(key, resolved);
+                    cache_key_add(key, text, text_len);
+                    hash_imports(key, text, resolved, seen, seen_count);
+                    free(text);
+                }
+            }
+        }
+        p += strcspn(p, "\n");
+        if (*p == '\n') p++;
+    }
+}
+
+void module_hash_imports(CacheKey *key, const char *source, const char *path) {
+    char **seen = NULL;
+    size_t seen_count = 0;
+    hash_imports(key, source, path, &seen, &seen_count);
+    for (size_t i = 0; i < seen_count; i++) {
+        free(seen[i]);
+    }
+    free(seen);
+}
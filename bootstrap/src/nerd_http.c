@@ -1,12 +1,29 @@
 /*
  * NERD HTTP Runtime - libcurl wrapper
+ *
+ * Requests reuse easy handles from a small pool, and every handle is
+ * attached to one CURLSH sharing the DNS cache, the connection cache and
+ * TLS sessions. A script calling the same API in a loop pays the DNS, TCP
+ * and TLS handshakes once and keeps the connection alive between calls.
  */
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
 #include <curl/curl.h>
 
+#define HTTP_POOL_MAX 8         // idle easy handles kept for reuse
+#define HTTP_DEFAULT_CONCURRENCY 64     // transfers in flight in nerd_http_getall
+
+static pthread_once_t http_once = PTHREAD_ONCE_INIT;
+static CURLSH *http_share;
+static pthread_mutex_t http_share_locks[CURL_LOCK_DATA_LAST];
+static pthread_mutex_t http_pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static CURL *http_pool[HTTP_POOL_MAX];
+static int http_pool_count;
+
 // Response buffer
 typedef struct {
     char *data;
@@ -29,9 +46,85 @@ static size_t write_callback(void *contents, size_t size, size_t nmemb, void *us
     return realsize;
 }
 
+static void share_lock(CURL *handle, curl_lock_data data, curl_lock_access access, void *userp) {
+    (void)handle;
+    (void)access;
+    (void)userp;
+    pthread_mutex_lock(&http_share_locks[data]);
+}
+
+static void share_unlock(CURL *handle, curl_lock_data data, void *userp) {
+    (void)handle;
+    (void)userp;
+    pthread_mutex_unlock(&http_share_locks[data]);
+}
+
+// Close pooled connections cleanly at exit
+static void http_cleanup(void) {
+    pthread_mutex_lock(&http_pool_lock);
+    while (http_pool_count > 0) {
+        curl_easy_cleanup(http_pool[--http_pool_count]);
+    }
+    pthread_mutex_unlock(&http_pool_lock);
+    if (http_share) {
+        curl_share_cleanup(http_share);
+        http_share = NULL;
+    }
+}
+
+static void http_init(void) {
+    curl_global_init(CURL_GLOBAL_ALL);
+    for (int i = 0; i < CURL_LOCK_DATA_LAST; i++) {
+        pthread_mutex_init(&http_share_locks[i], NULL);
+    }
+    http_share = curl_share_init();
+    if (http_share) {
+        curl_share_setopt(http_share, CURLSHOPT_LOCKFUNC, share_lock);
+        curl_share_setopt(http_share, CURLSHOPT_UNLOCKFUNC, share_unlock);
+        curl_share_setopt(http_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+        curl_share_setopt(http_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+        curl_share_setopt(http_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+    }
+    atexit(http_cleanup);
+}
+
+/*
+ * An easy handle from the pool (or a new one) with the shared caches and
+ * the options every request uses
+ */
+static CURL *http_acquire(void) {
+    pthread_once(&http_once, http_init);
+
+    CURL *curl = NULL;
+    pthread_mutex_lock(&http_pool_lock);
+    if (http_pool_count > 0) curl = http_pool[--http_pool_count];
+    pthread_mutex_unlock(&http_pool_lock);
+    if (!curl) curl = curl_easy_init();
+    if (!curl) return NULL;
+
+    if (http_share) curl_easy_setopt(curl, CURLOPT_SHARE, http_share);
+    curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT, 30L);
+    curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+    curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+    return curl;
+}
+
+// Back to the pool; a reset clears the options, not the connections
+static void http_release(CURL *curl) {
+    curl_easy_reset(curl);
+    pthread_mutex_lock(&http_pool_lock);
+    if (http_pool_count < HTTP_POOL_MAX) {
+        http_pool[http_pool_count++] = curl;
+        curl = NULL;
+    }
+    pthread_mutex_unlock(&http_pool_lock);
+    if (curl) curl_easy_cleanup(curl);
+}
+
 // HTTP GET - returns response body as string
 char* nerd_http_get(const char *url) {
-    CURL *curl = curl_easy_init();
+    CURL *curl = http_acquire();
     if (!curl) return NULL;
 
     ResponseBuffer buf = {0};
@@ -41,11 +134,9 @@ char* nerd_http_get(const char *url) {
     curl_easy_setopt(curl, CURLOPT_URL, url);
     curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_callback);
     curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void *)&buf);
-    curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
-    curl_easy_setopt(curl, CURLOPT_TIMEOUT, 30L);
 
     CURLcode res = curl_easy_perform(curl);
-    curl_easy_cleanup(curl);
+    http_release(curl);
 
     if (res != CURLE_OK) {
         free(buf.data);
@@ -57,7 +148,7 @@ char* nerd_http_get(const char *url) {
 
 // HTTP POST - returns response body as string
 char* nerd_http_post(const char *url, const char *body) {
-    CURL *curl = curl_easy_init();
+    CURL *curl = http_acquire();
     if (!curl) return NULL;
 
     ResponseBuffer buf = {0};
@@ -74,16 +165,14 @@ char* nerd_http_post(const char *url, const char *body) {
     curl_easy_setopt(curl, CURLOPT_POSTFIELDS, body);
     curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_callback);
     curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void *)&buf);
-    curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
-    curl_easy_setopt(curl, CURLOPT_TIMEOUT, 30L);
     if (headers) {
         curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
     }
 
     CURLcode res = curl_easy_perform(curl);
 
+    http_release(curl);
     if (headers) curl_slist_free_all(headers);
-    curl_easy_cleanup(curl);
 
     if (res != CURLE_OK) {
         free(buf.data);
@@ -93,8 +182,168 @@ char* nerd_http_post(const char *url, const char *body) {
     return buf.data;
 }
 
+/*
+ * HTTP GET of every URL in a newline-separated list, NERD_HTTP_CONCURRENCY
+ * (default 64) at a time on one curl multi handle. Returns the bodies in
+ * list order, one per line, leaving out failed requests; NULL if all failed.
+ */
+char* nerd_http_getall(const char *urls) {
+    char *list = malloc(strlen(urls) + 1);
+    if (!list) return NULL;
+    strcpy(list, urls);
+
+    size_t count = 1;
+    for (const char *p = list; *p; p++) {
+        if (*p == '\n') count++;
+    }
+    char **url = malloc(sizeof(char *) * count);
+    ResponseBuffer *bufs = calloc(count, sizeof(ResponseBuffer));
+    char *ok = calloc(count, 1);
+    CURLM *multi = curl_multi_init();
+    if (!url || !bufs || !ok || !multi) {
+        if (multi) curl_multi_cleanup(multi);
+        free(ok);
+        free(bufs);
+        free(url);
+        free(list);
+        return NULL;
+    }
+    url[0] = list;
+    for (size_t i = 1; i < count; i++) {
+        url[i] = strchr(url[i - 1], '\n');
+        *url[i]++ = '\0';
+    }
+
+    long limit = HTTP_DEFAULT_CONCURRENCY;
+    const char *env = getenv("NERD_HTTP_CONCURRENCY");
+    if (env && atol(env) > 0) limit = atol(env);
+
+    // Keep `limit` transfers in flight, starting the next as each finishes
+    size_t next = 0;
+    long active = 0;
+    while (next < count || active > 0) {
+        while (active < limit && next < count) {
+            size_t i = next++;
+            CURL *curl = url[i][0] ? http_acquire() : NULL;
+            if (!curl) continue;
+            bufs[i].data = malloc(1);
+            bufs[i].size = 0;
+            curl_easy_setopt(curl, CURLOPT_URL, url[i]);
+            curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_callback);
+            curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void *)&bufs[i]);
+            curl_easy_setopt(curl, CURLOPT_PRIVATE, (void *)&bufs[i]);
+            curl_multi_add_handle(multi, curl);
+            active++;
+        }
+
+        int running;
+        curl_multi_perform(multi, &running);
+
+        CURLMsg *msg;
+        int queued;
+        while ((msg = curl_multi_info_read(multi, &queued))) {
+            if (msg->msg != CURLMSG_DONE) continue;
+            CURL *curl = msg->easy_handle;
+            ResponseBuffer *buf;
+            curl_easy_getinfo(curl, CURLINFO_PRIVATE, (char **)&buf);
+            ok[buf - bufs] = msg->data.result == CURLE_OK;
+            curl_multi_remove_handle(multi, curl);
+            http_release(curl);
+            active--;
+        }
+
+        if (active > 0) {
+            curl_multi_poll(multi, NULL, 0, 1000, NULL);
+        }
+    }
+    curl_multi_cleanup(multi);
+
+    // Successful bodies, in list order
+    size_t total = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (ok[i]) total += bufs[i].size + 1;
+    }
+    char *result = total > 0 ? malloc(total) : NULL;
+    size_t len = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (result && ok[i]) {
+            if (len > 0) result[len++] = '\n';
+            memcpy(result + len, bufs[i].data, bufs[i].size);
+            len += bufs[i].size;
+        }
+        free(bufs[i].data);
+    }
+    if (result) result[len] = '\0';
+
+    free(ok);
+    free(bufs);
+    free(url);
+    free(list);
+    return result;
+}
+
+/*
+ * Background requests for the compiler's concurrent network statements:
+ * *_start runs the request on its own thread and returns a task, and
+ * nerd_http_wait joins it and returns what the blocking call would have.
+ */
+typedef enum { HTTP_TASK_GET, HTTP_TASK_GETALL, HTTP_TASK_POST } HttpTaskKind;
+
+typedef struct {
+    pthread_t thread;
+    HttpTaskKind kind;
+    const char *url;
+    const char *body;
+    char *response;
+    bool started;
+} HttpTask;
+
+static void *http_task_run(void *arg) {
+    HttpTask *task = arg;
+    switch (task->kind) {
+        case HTTP_TASK_GET: task->response = nerd_http_get(task->url); break;
+        case HTTP_TASK_GETALL: task->response = nerd_http_getall(task->url); break;
+        case HTTP_TASK_POST: task->response = nerd_http_post(task->url, task->body); break;
+    }
+    return NULL;
+}
+
+static void *http_start(HttpTaskKind kind, const char *url, const char *body) {
+    // Global curl setup is not thread-safe: do it here, on the caller's thread
+    pthread_once(&http_once, http_init);
+
+    HttpTask *task = calloc(1, sizeof(HttpTask));
+    if (!task) return NULL;
+    task->kind = kind;
+    task->url = url;
+    task->body = body;
+    task->started = pthread_create(&task->thread, NULL, http_task_run, task) == 0;
+    if (!task->started) http_task_run(task);  // no thread to spare: run it now
+    return task;
+}
+
+void* nerd_http_get_start(const char *url) {
+    return http_start(HTTP_TASK_GET, url, NULL);
+}
+
+void* nerd_http_getall_start(const char *urls) {
+    return http_start(HTTP_TASK_GETALL, urls, NULL);
+}
+
+void* nerd_http_post_start(const char *url, const char *body) {
+    return http_start(HTTP_TASK_POST, url, body);
+}
+
+char* nerd_http_wait(void *handle) {
+    HttpTask *task = handle;
+    if (!task) return NULL;
+    if (task->started) pthread_join(task->thread, NULL);
+    char *response = task->response;
+    free(task);
+    return response;
+}
+
 // Free response
 void nerd_http_free(char *response) {
     free(response);
 }
-
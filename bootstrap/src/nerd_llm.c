@@ -3,13 +3,34 @@
  * 
  * Simple LLM calls without the boilerplate.
  * API keys from: 1) environment variables, or 2) .env file
+ *
+ * Replies are streamed and printed as they arrive (NERD_LLM_STREAM=0 waits
+ * for the whole reply). NERD_LLM_URL replaces the Messages API endpoint,
+ * e.g. with a proxy or a local stand-in. NERD_LLM_CACHE=1 answers repeated
+ * requests from a disk cache. NERD_LLM_STATS=1 prints call and token
+ * counts, prompt-cache writes and reads included, at exit.
  */
 
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <curl/curl.h>
 
+#define LLM_DEFAULT_URL "https://api.anthropic.com/v1/messages"
+
+static pthread_once_t llm_once = PTHREAD_ONCE_INIT;
+
 struct MemoryStruct {
     char *memory;
     size_t size;
@@ -56,90 +77,656 @@ static void load_env_file(void) {
     fclose(f);
 }
 
-static size_t WriteMemoryCallback(void *contents, size_t size, size_t nmemb, void *userp) {
-    size_t realsize = size * nmemb;
-    struct MemoryStruct *mem = (struct MemoryStruct *)userp;
-
-    char *ptr = realloc(mem->memory, mem->size + realsize + 1);
-    if (!ptr) return 0;
-
+static bool append(struct MemoryStruct *mem, const char *data, size_t len) {
+    char *ptr = realloc(mem->memory, mem->size + len + 1);
+    if (!ptr) return false;
     mem->memory = ptr;
-    memcpy(&(mem->memory[mem->size]), contents, realsize);
-    mem->size += realsize;
+    memcpy(&(mem->memory[mem->size]), data, len);
+    mem->size += len;
     mem->memory[mem->size] = 0;
+    return true;
+}
 
-    return realsize;
+// The string value of "key" in json: a pointer past its opening quote
+static const char* json_string_at(const char* json, const char* key) {
+    size_t key_len = strlen(key);
+    for (const char* p = strchr(json, '"'); p; p = strchr(p + 1, '"')) {
+        if (strncmp(p + 1, key, key_len) != 0 || p[key_len + 1] != '"') continue;
+        const char* v = p + key_len + 2;
+        while (*v == ' ') v++;
+        if (*v++ != ':') continue;
+        while (*v == ' ') v++;
+        if (*v == '"') return v + 1;
+    }
+    return NULL;
+}
+
+static int hex4(const char* s) {
+    int v = 0;
+    for (int i = 0; i < 4; i++) {
+        char c = s[i];
+        v <<= 4;
+        if (c >= '0' && c <= '9') v |= c - '0';
+        else if (c >= 'a' && c <= 'f') v |= c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F') v |= c - 'A' + 10;
+        else return -1;
+    }
+    return v;
+}
+
+// Append the JSON string starting at s (past the quote) to out, decoded
+static void json_unescape(const char* s, struct MemoryStruct *out) {
+    while (*s && *s != '"') {
+        const char* run = s;
+        while (*s && *s != '"' && *s != '\\') s++;
+        append(out, run, (size_t)(s - run));
+        if (*s != '\\' || !s[1]) break;
+
+        char c = s[1];
+        s += 2;
+        char ch = c;
+        if (c == 'n') ch = '\n';
+        else if (c == 't') ch = '\t';
+        else if (c == 'r') ch = '\r';
+        else if (c == 'b') ch = '\b';
+        else if (c == 'f') ch = '\f';
+        else if (c == 'u') {
+            int cp = hex4(s);
+            if (cp < 0) continue;
+            s += 4;
+            if (cp >= 0xD800 && cp < 0xDC00 && s[0] == '\\' && s[1] == 'u') {
+                int low = hex4(s + 2);
+                if (low >= 0xDC00 && low < 0xE000) {
+                    cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                    s += 6;
+                }
+            }
+            char utf8[4];
+            size_t n;
+            if (cp < 0x80) {
+                utf8[0] = (char)cp;
+                n = 1;
+            } else if (cp < 0x800) {
+                utf8[0] = (char)(0xC0 | (cp >> 6));
+                utf8[1] = (char)(0x80 | (cp & 0x3F));
+                n = 2;
+            } else if (cp < 0x10000) {
+                utf8[0] = (char)(0xE0 | (cp >> 12));
+                utf8[1] = (char)(0x80 | ((cp >> 6) & 0x3F));
+                utf8[2] = (char)(0x80 | (cp & 0x3F));
+                n = 3;
+            } else {
+                utf8[0] = (char)(0xF0 | (cp >> 18));
+                utf8[1] = (char)(0x80 | ((cp >> 12) & 0x3F));
+                utf8[2] = (char)(0x80 | ((cp >> 6) & 0x3F));
+                utf8[3] = (char)(0x80 | (cp & 0x3F));
+                n = 4;
+            }
+            append(out, utf8, n);
+            continue;
+        }
+        append(out, &ch, 1);
+    }
 }
 
 // Extract text content from Claude response
 // Looks for: "text":"..." in the response
 static char* extract_text(const char* json) {
-    const char* text_start = strstr(json, "\"text\":\"");
-    if (!text_start) return NULL;
-    
-    text_start += 8;  // Skip "text":"
-    
-    // Find the end of the text value
-    const char* text_end = text_start;
-    while (*text_end && !(*text_end == '"' && *(text_end - 1) != '\\')) {
-        text_end++;
-    }
-    
-    size_t len = text_end - text_start;
-    char* result = malloc(len + 1);
-    if (!result) return NULL;
-    
-    // Copy and unescape basic sequences
-    size_t j = 0;
+    const char* text = json_string_at(json, "text");
+    if (!text) return NULL;
+
+    struct MemoryStruct result = {0};
+    json_unescape(text, &result);
+    return result.memory ? result.memory : strdup("");
+}
+
+// The number value of "key" in json, or -1
+static long long json_number_at(const char* json, const char* key) {
+    size_t key_len = strlen(key);
+    for (const char* p = strchr(json, '"'); p; p = strchr(p + 1, '"')) {
+        if (strncmp(p + 1, key, key_len) != 0 || p[key_len + 1] != '"') continue;
+        const char* v = p + key_len + 2;
+        while (*v == ' ') v++;
+        if (*v++ != ':') continue;
+        while (*v == ' ') v++;
+        if (*v >= '0' && *v <= '9') return strtoll(v, NULL, 10);
+    }
+    return -1;
+}
+
+/*
+ * Token counts of a reply's "usage" object. Prompt-cache writes and reads
+ * are counted apart from the uncached input tokens.
+ */
+typedef struct {
+    long long input;
+    long long output;
+    long long cache_write;
+    long long cache_read;
+} LlmUsage;
+
+static void usage_parse(const char* usage, LlmUsage *u) {
+    if (!usage) return;
+    long long v;
+    if ((v = json_number_at(usage, "input_tokens")) >= 0) u->input = v;
+    if ((v = json_number_at(usage, "output_tokens")) >= 0) u->output = v;
+    if ((v = json_number_at(usage, "cache_creation_input_tokens")) >= 0) u->cache_write = v;
+    if ((v = json_number_at(usage, "cache_read_input_tokens")) >= 0) u->cache_read = v;
+}
+
+/*
+ * Runtime stats, printed to stderr at exit with NERD_LLM_STATS=1
+ */
+static struct {
+    long calls;
+    long disk_hits;
+    LlmUsage tokens;
+} llm_stats;
+
+static pthread_mutex_t llm_stats_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void stats_add(const LlmUsage *u, bool disk_hit) {
+    pthread_mutex_lock(&llm_stats_lock);
+    llm_stats.calls++;
+    if (disk_hit) llm_stats.disk_hits++;
+    if (u) {
+        llm_stats.tokens.input += u->input;
+        llm_stats.tokens.output += u->output;
+        llm_stats.tokens.cache_write += u->cache_write;
+        llm_stats.tokens.cache_read += u->cache_read;
+    }
+    pthread_mutex_unlock(&llm_stats_lock);
+}
+
+static void stats_print(void) {
+    fflush(stdout);
+    pthread_mutex_lock(&llm_stats_lock);
+    fprintf(stderr, "LLM calls:          %ld (%ld from the disk cache)\n", llm_stats.calls, llm_stats.disk_hits);
+    fprintf(stderr, "Input tokens:       %lld\n", llm_stats.tokens.input);
+    fprintf(stderr, "Output tokens:      %lld\n", llm_stats.tokens.output);
+    fprintf(stderr, "Cache write tokens: %lld\n", llm_stats.tokens.cache_write);
+    fprintf(stderr, "Cache read tokens:  %lld\n", llm_stats.tokens.cache_read);
+    pthread_mutex_unlock(&llm_stats_lock);
+}
+
+/*
+ * A streamed reply ("stream": true) is a series of server-sent events,
+ * parsed as the bytes arrive: each content_block_delta's text is added to
+ * the reply, and printed at once when echoing. A reply that is not an
+ * event stream (an HTTP error, or a server that ignores "stream") is kept
+ * whole and handled like a buffered one.
+ */
+typedef struct {
+    struct MemoryStruct raw;    // the reply as received
+    struct MemoryStruct line;   // event stream line being received
+    struct MemoryStruct text;   // text deltas so far
+    char *error;                // data of an error event
+    LlmUsage usage;
+    bool events;                // the reply is an event stream
+    bool echo;                  // print text deltas as they arrive
+} LlmStream;
+
+static void stream_data(LlmStream *st, const char* data) {
+    if (strstr(data, "\"content_block_delta\"")) {
+        const char* delta = strstr(data, "\"delta\"");
+        const char* text = delta ? json_string_at(delta, "text") : NULL;
+        if (!text) return;
+        size_t before = st->text.size;
+        json_unescape(text, &st->text);
+        if (st->echo && st->text.size > before) {
+            fwrite(st->text.memory + before, 1, st->text.size - before, stdout);
+            fflush(stdout);
+        }
+    } else if (strstr(data, "\"message_start\"")) {
+        usage_parse(strstr(data, "\"usage\""), &st->usage);
+    } else if (strstr(data, "\"message_delta\"")) {
+        // The final, cumulative output count
+        const char* usage = strstr(data, "\"usage\"");
+        long long output = usage ? json_number_at(usage, "output_tokens") : -1;
+        if (output >= 0) st->usage.output = output;
+    } else if (strstr(data, "\"type\":\"error\"") && !st->error) {
+        st->error = strdup(data);
+    }
+}
+
+static size_t StreamCallback(void *contents, size_t size, size_t nmemb, void *userp) {
+    size_t realsize = size * nmemb;
+    LlmStream *st = (LlmStream *)userp;
+    if (!append(&st->raw, contents, realsize) || !append(&st->line, contents, realsize)) return 0;
+
+    // Handle the complete lines; keep the partial last one
+    char *start = st->line.memory;
+    char *end = st->line.memory + st->line.size;
+    char *nl;
+    while ((nl = memchr(start, '\n', (size_t)(end - start)))) {
+        *nl = '\0';
+        if (nl > start && nl[-1] == '\r') nl[-1] = '\0';
+        if (strncmp(start, "data:", 5) == 0) {
+            const char* data = start + 5;
+            if (*data == ' ') data++;
+            st->events = true;
+            stream_data(st, data);
+        }
+        start = nl + 1;
+    }
+    st->line.size = (size_t)(end - start);
+    memmove(st->line.memory, start, st->line.size + 1);
+
+    return realsize;
+}
+
+/*
+ * Response cache (NERD_LLM_CACHE=1, or =path for a file of your own)
+ *
+ * Replies are kept in one append-only file, by default
+ * $XDG_CACHE_HOME/nerd-llm.cache. After an 8-byte header it is a series of
+ * records: an LlmCacheRecord, the key (the request body, so the model,
+ * parameters and prompt), then the reply text. Each process maps the file
+ * and indexes it by key hash, so a hit is a table probe and a copy. New
+ * replies are appended under flock and picked up by the next lookup in any
+ * process. Entries older than NERD_LLM_CACHE_TTL seconds (default a day)
+ * are misses. A file over NERD_LLM_CACHE_MAX_MB (default 64) is rewritten
+ * with the newest live records filling half of that.
+ */
+#define LLM_CACHE_MAGIC "nerdllm1"
+#define LLM_CACHE_DEFAULT_TTL 86400
+#define LLM_CACHE_DEFAULT_MAX_MB 64
+
+typedef struct {
+    uint64_t hash;          // FNV-1a 64 of the key
+    int64_t time;           // when stored
+    uint32_t key_len;
+    uint32_t value_len;
+} LlmCacheRecord;
+
+static struct {
+    bool opened;            // the file has been opened (or found disabled)
+    int fd;                 // -1: cache off
+    char path[4096];
+    ino_t ino;
+    char *map;              // mapping of the file's first `mapped` bytes
+    size_t mapped;
+    size_t indexed;         // bytes of whole records indexed
+    uint64_t *hashes;       // open addressing: hash -> record offset (0: empty)
+    size_t *offsets;
+    size_t slots;
+    size_t count;
+    long ttl;
+    off_t max;
+} llm_cache = { .fd = -1 };
+
+static pthread_mutex_t llm_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static uint64_t cache_hash(const char *key, size_t len) {
+    uint64_t h = 0xcbf29ce484222325ULL;
     for (size_t i = 0; i < len; i++) {
-        if (text_start[i] == '\\' && i + 1 < len) {
-            char next = text_start[i + 1];
-            if (next == 'n') { result[j++] = '\n'; i++; }
-            else if (next == 't') { result[j++] = '\t'; i++; }
-            else if (next == '"') { result[j++] = '"'; i++; }
-            else if (next == '\\') { result[j++] = '\\'; i++; }
-            else { result[j++] = text_start[i]; }
+        h = (h ^ (unsigned char)key[i]) * 0x100000001b3ULL;
+    }
+    return h;
+}
+
+static void cache_index_put(uint64_t hash, size_t offset) {
+    if ((llm_cache.count + 1) * 2 > llm_cache.slots) {
+        size_t slots = llm_cache.slots ? llm_cache.slots * 2 : 256;
+        uint64_t *hashes = calloc(slots, sizeof(uint64_t));
+        size_t *offsets = calloc(slots, sizeof(size_t));
+        if (!hashes || !offsets) {
+            free(hashes);
+            free(offsets);
+            return;
+        }
+        for (size_t i = 0; i < llm_cache.slots; i++) {
+            if (!llm_cache.offsets[i]) continue;
+            size_t j = llm_cache.hashes[i] & (slots - 1);
+            while (offsets[j]) j = (j + 1) & (slots - 1);
+            hashes[j] = llm_cache.hashes[i];
+            offsets[j] = llm_cache.offsets[i];
+        }
+        free(llm_cache.hashes);
+        free(llm_cache.offsets);
+        llm_cache.hashes = hashes;
+        llm_cache.offsets = offsets;
+        llm_cache.slots = slots;
+    }
+
+    // A later record of the same hash replaces the earlier one
+    size_t j = hash & (llm_cache.slots - 1);
+    while (llm_cache.offsets[j] && llm_cache.hashes[j] != hash) j = (j + 1) & (llm_cache.slots - 1);
+    if (!llm_cache.offsets[j]) llm_cache.count++;
+    llm_cache.hashes[j] = hash;
+    llm_cache.offsets[j] = offset;
+}
+
+static void cache_index_reset(void) {
+    if (llm_cache.map) munmap(llm_cache.map, llm_cache.mapped);
+    free(llm_cache.hashes);
+    free(llm_cache.offsets);
+    llm_cache.map = NULL;
+    llm_cache.mapped = 0;
+    llm_cache.indexed = 0;
+    llm_cache.hashes = NULL;
+    llm_cache.offsets = NULL;
+    llm_cache.slots = 0;
+    llm_cache.count = 0;
+}
+
+// Whole record at offset in the mapping: its header, or false
+static bool cache_record_at(size_t offset, LlmCacheRecord *rec) {
+    if (offset + sizeof(*rec) > llm_cache.mapped) return false;
+    memcpy(rec, llm_cache.map + offset, sizeof(*rec));
+    return (uint64_t)rec->key_len + rec->value_len <= llm_cache.mapped - offset - sizeof(*rec);
+}
+
+static void cache_open_file(void) {
+    llm_cache.fd = open(llm_cache.path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+    if (llm_cache.fd < 0) return;
+
+    struct stat st;
+    flock(llm_cache.fd, LOCK_EX);
+    if (fstat(llm_cache.fd, &st) == 0 && st.st_size == 0) {
+        if (write(llm_cache.fd, LLM_CACHE_MAGIC, 8) != 8) st.st_ino = 0;
+    }
+    flock(llm_cache.fd, LOCK_UN);
+
+    char magic[8];
+    if (st.st_ino == 0 || pread(llm_cache.fd, magic, 8, 0) != 8 || memcmp(magic, LLM_CACHE_MAGIC, 8) != 0) {
+        fprintf(stderr, "Warning: %s is not an LLM cache file; caching is off\n", llm_cache.path);
+        close(llm_cache.fd);
+        llm_cache.fd = -1;
+        return;
+    }
+    llm_cache.ino = st.st_ino;
+}
+
+/*
+ * Map and index what other writers (or this process) appended since the
+ * last call; reopen if the file was rewritten
+ */
+static bool cache_refresh(void) {
+    if (!llm_cache.opened) {
+        llm_cache.opened = true;
+        const char *env = getenv("NERD_LLM_CACHE");
+        if (!env || !*env || strcmp(env, "0") == 0) return false;
+        if (strcmp(env, "1") == 0) {
+            const char *xdg = getenv("XDG_CACHE_HOME");
+            const char *home = getenv("HOME");
+            if (xdg && xdg[0] == '/') {
+                snprintf(llm_cache.path, sizeof(llm_cache.path), "%s/nerd-llm.cache", xdg);
+            } else if (home && home[0]) {
+                snprintf(llm_cache.path, sizeof(llm_cache.path), "%s/.cache", home);
+                mkdir(llm_cache.path, 0700);
+                size_t len = strlen(llm_cache.path);
+                snprintf(llm_cache.path + len, sizeof(llm_cache.path) - len, "/nerd-llm.cache");
+            } else {
+                return false;
+            }
         } else {
-            result[j++] = text_start[i];
+            snprintf(llm_cache.path, sizeof(llm_cache.path), "%s", env);
         }
+
+        const char *ttl = getenv("NERD_LLM_CACHE_TTL");
+        llm_cache.ttl = ttl && atol(ttl) > 0 ? atol(ttl) : LLM_CACHE_DEFAULT_TTL;
+        const char *max = getenv("NERD_LLM_CACHE_MAX_MB");
+        llm_cache.max = (off_t)(max && atol(max) > 0 ? atol(max) : LLM_CACHE_DEFAULT_MAX_MB) * 1024 * 1024;
+        cache_open_file();
     }
-    result[j] = '\0';
-    
-    return result;
+    if (llm_cache.fd < 0) return false;
+
+    struct stat st;
+    if (stat(llm_cache.path, &st) == 0 && st.st_ino != llm_cache.ino) {
+        cache_index_reset();
+        close(llm_cache.fd);
+        cache_open_file();
+        if (llm_cache.fd < 0) return false;
+    }
+    if (fstat(llm_cache.fd, &st) != 0) return false;
+    if ((size_t)st.st_size <= llm_cache.mapped) return true;
+
+    if (llm_cache.map) munmap(llm_cache.map, llm_cache.mapped);
+    llm_cache.map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, llm_cache.fd, 0);
+    if (llm_cache.map == MAP_FAILED) {
+        llm_cache.map = NULL;
+        llm_cache.mapped = 0;
+        return false;
+    }
+    llm_cache.mapped = (size_t)st.st_size;
+
+    // Index the new whole records; a torn one ends the scan
+    size_t offset = llm_cache.indexed ? llm_cache.indexed : 8;
+    LlmCacheRecord rec;
+    while (cache_record_at(offset, &rec)) {
+        cache_index_put(rec.hash, offset);
+        offset += sizeof(rec) + rec.key_len + rec.value_len;
+    }
+    llm_cache.indexed = offset;
+    return true;
 }
 
-// Call Claude (Anthropic)
-// Returns extracted text response (caller must free)
-char* nerd_llm_claude(const char* prompt) {
-    // Try to load .env file
+// The cached reply for key (caller frees), or NULL
+static char* cache_get(const char *key) {
+    size_t key_len = strlen(key);
+    uint64_t hash = cache_hash(key, key_len);
+    char *value = NULL;
+
+    pthread_mutex_lock(&llm_cache_lock);
+    if (cache_refresh() && llm_cache.slots) {
+        size_t j = hash & (llm_cache.slots - 1);
+        while (llm_cache.offsets[j] && llm_cache.hashes[j] != hash) j = (j + 1) & (llm_cache.slots - 1);
+
+        LlmCacheRecord rec;
+        size_t offset = llm_cache.offsets[j];
+        if (offset && cache_record_at(offset, &rec) && rec.key_len == key_len &&
+            time(NULL) - rec.time <= llm_cache.ttl &&
+            memcmp(llm_cache.map + offset + sizeof(rec), key, key_len) == 0) {
+            value = malloc((size_t)rec.value_len + 1);
+            if (value) {
+                memcpy(value, llm_cache.map + offset + sizeof(rec) + key_len, rec.value_len);
+                value[rec.value_len] = '\0';
+            }
+        }
+    }
+    pthread_mutex_unlock(&llm_cache_lock);
+    return value;
+}
+
+/*
+ * Rewrite the file with the newest unexpired records that fit in half the
+ * size limit (called with the file locked)
+ */
+static void cache_compact(void) {
+    if (!cache_refresh()) return;
+
+    time_t now = time(NULL);
+    size_t *keep = malloc(sizeof(size_t) * (llm_cache.indexed / sizeof(LlmCacheRecord) + 1));
+    size_t kept = 0, offset = 8;
+    LlmCacheRecord rec;
+    while (keep && offset < llm_cache.indexed && cache_record_at(offset, &rec)) {
+        if (now - rec.time <= llm_cache.ttl) keep[kept++] = offset;
+        offset += sizeof(rec) + rec.key_len + rec.value_len;
+    }
+
+    size_t first = kept, total = 8;
+    while (first > 0) {
+        cache_record_at(keep[first - 1], &rec);
+        size_t size = sizeof(rec) + rec.key_len + rec.value_len;
+        if (total + size > (size_t)llm_cache.max / 2) break;
+        total += size;
+        first--;
+    }
+
+    char tmp[4096 + 16];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", llm_cache.path);
+    int fd = keep ? open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600) : -1;
+    FILE *out = fd >= 0 ? fdopen(fd, "wb") : NULL;
+    if (fd >= 0 && !out) close(fd);
+    if (out) {
+        fwrite(LLM_CACHE_MAGIC, 1, 8, out);
+        for (size_t i = first; i < kept; i++) {
+            cache_record_at(keep[i], &rec);
+            fwrite(llm_cache.map + keep[i], 1, sizeof(rec) + rec.key_len + rec.value_len, out);
+        }
+        if (fclose(out) != 0 || rename(tmp, llm_cache.path) != 0) remove(tmp);
+    }
+    free(keep);
+}
+
+static void cache_put(const char *key, const char *value) {
+    size_t key_len = strlen(key);
+    size_t value_len = strlen(value);
+    LlmCacheRecord rec = {
+        .hash = cache_hash(key, key_len),
+        .time = (int64_t)time(NULL),
+        .key_len = (uint32_t)key_len,
+        .value_len = (uint32_t)value_len,
+    };
+    size_t size = sizeof(rec) + key_len + value_len;
+    char *buf = malloc(size);
+    if (!buf) return;
+    memcpy(buf, &rec, sizeof(rec));
+    memcpy(buf + sizeof(rec), key, key_len);
+    memcpy(buf + sizeof(rec) + key_len, value, value_len);
+
+    pthread_mutex_lock(&llm_cache_lock);
+    if (cache_refresh()) {
+        int fd = llm_cache.fd;
+        ino_t ino = llm_cache.ino;
+        flock(fd, LOCK_EX);
+        bool current = cache_refresh();
+        // Not the same file if another process rewrote it meanwhile (the
+        // reopen dropped the lock): the entry is skipped
+        bool same = llm_cache.fd == fd && llm_cache.ino == ino;
+        if (current && same) {
+            struct stat st;
+            if (fstat(fd, &st) == 0 && (size_t)st.st_size > llm_cache.indexed &&
+                ftruncate(fd, (off_t)llm_cache.indexed) == 0) {
+                // Dropped a torn record left by a writer that died mid-append
+                munmap(llm_cache.map, llm_cache.mapped);
+                llm_cache.map = NULL;
+                llm_cache.mapped = 0;
+            }
+            if (write(fd, buf, size) == (ssize_t)size && fstat(fd, &st) == 0 && st.st_size > llm_cache.max) {
+                cache_compact();
+            }
+        }
+        if (same) flock(fd, LOCK_UN);
+    }
+    pthread_mutex_unlock(&llm_cache_lock);
+    free(buf);
+}
+
+// Once per process: global curl setup and the .env file (setenv is not
+// thread-safe, so this has to run before any request thread exists)
+static void llm_init(void) {
+    curl_global_init(CURL_GLOBAL_ALL);
     load_env_file();
 
+    const char* stats = getenv("NERD_LLM_STATS");
+    if (stats && *stats && strcmp(stats, "0") != 0) atexit(stats_print);
+}
+
+// Append s to out as a JSON string literal
+static void json_append_string(struct MemoryStruct *out, const char* s) {
+    append(out, "\"", 1);
+    for (const unsigned char* p = (const unsigned char*)s; *p; p++) {
+        char esc[8];
+        const char* e = NULL;
+        switch (*p) {
+            case '"': e = "\\\""; break;
+            case '\\': e = "\\\\"; break;
+            case '\n': e = "\\n"; break;
+            case '\r': e = "\\r"; break;
+            case '\t': e = "\\t"; break;
+            default:
+                if (*p < 0x20) {
+                    snprintf(esc, sizeof(esc), "\\u%04x", *p);
+                    e = esc;
+                }
+                break;
+        }
+        if (e) {
+            append(out, e, strlen(e));
+        } else {
+            append(out, (const char*)p, 1);
+        }
+    }
+    append(out, "\"", 1);
+}
+
+/*
+ * Messages API request body. A system prompt is sent as a text block
+ * marked with a cache_control breakpoint: it is the prefix that stays the
+ * same from call to call, so the API can serve it from its prompt cache
+ * (the cache is only used for prefixes long enough; shorter ones are
+ * simply not cached).
+ */
+static char* request_body(const char* system, const char* prompt, bool stream) {
+    struct MemoryStruct body = {0};
+    const char* head = "{\"model\":\"claude-sonnet-4-20250514\",\"max_tokens\":1024,";
+    append(&body, head, strlen(head));
+    if (stream) {
+        append(&body, "\"stream\":true,", 14);
+    }
+    if (system && *system) {
+        const char* open = "\"system\":[{\"type\":\"text\",\"text\":";
+        const char* close = ",\"cache_control\":{\"type\":\"ephemeral\"}}],";
+        append(&body, open, strlen(open));
+        json_append_string(&body, system);
+        append(&body, close, strlen(close));
+    }
+    const char* messages = "\"messages\":[{\"role\":\"user\",\"content\":";
+    append(&body, messages, strlen(messages));
+    json_append_string(&body, prompt);
+    append(&body, "}]}", 3);
+    return body.memory;
+}
+
+// Call Claude (Anthropic), printing the reply if echo (as it streams in)
+// Returns the reply's text, or the raw response if there is none
+static char* claude_request(const char* system, const char* prompt, bool echo) {
+    pthread_once(&llm_once, llm_init);
+
+    // Unstreamed, the request body is also the cache key
+    char* key = request_body(system, prompt, false);
+    if (!key) return NULL;
+
+    char* cached = cache_get(key);
+    if (cached) {
+        if (echo) printf("%s\n", cached);
+        stats_add(NULL, true);
+        free(key);
+        return cached;
+    }
+
     const char* api_key = getenv("ANTHROPIC_API_KEY");
     if (!api_key) {
         fprintf(stderr, "Error: ANTHROPIC_API_KEY not set\n");
         fprintf(stderr, "Set it via: export ANTHROPIC_API_KEY=... or in .env file\n");
+        free(key);
+        return NULL;
+    }
+
+    // Streamed unless NERD_LLM_STREAM=0
+    const char* stream_env = getenv("NERD_LLM_STREAM");
+    bool stream = !(stream_env && strcmp(stream_env, "0") == 0);
+    char* body = request_body(system, prompt, stream);
+    if (!body) {
+        free(key);
         return NULL;
     }
+    const char* url = getenv("NERD_LLM_URL");
+    if (!url || !*url) url = LLM_DEFAULT_URL;
 
     CURL *curl;
-    CURLcode res;
-    struct MemoryStruct chunk;
+    CURLcode res = CURLE_FAILED_INIT;
+    LlmStream st;
     struct curl_slist *headers = NULL;
 
-    chunk.memory = malloc(1);
-    chunk.size = 0;
+    memset(&st, 0, sizeof(st));
+    st.echo = echo && stream;
 
-    curl_global_init(CURL_GLOBAL_ALL);
     curl = curl_easy_init();
 
     if (curl) {
-        // Build request body
-        size_t body_size = strlen(prompt) + 512;
-        char* body = malloc(body_size);
-        snprintf(body, body_size,
-            "{\"model\":\"claude-sonnet-4-20250514\",\"max_tokens\":1024,\"messages\":[{\"role\":\"user\",\"content\":\"%s\"}]}",
-            prompt);
-
         // Set headers
         char auth_header[256];
         snprintf(auth_header, sizeof(auth_header), "x-api-key: %s", api_key);
@@ -147,41 +734,129 @@ char* nerd_llm_claude(const char* prompt) {
         headers = curl_slist_append(headers, "Content-Type: application/json");
         headers = curl_slist_append(headers, "anthropic-version: 2023-06-01");
 
-        curl_easy_setopt(curl, CURLOPT_URL, "https://api.anthropic.com/v1/messages");
+        curl_easy_setopt(curl, CURLOPT_URL, url);
         curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
         curl_easy_setopt(curl, CURLOPT_POSTFIELDS, body);
-        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteMemoryCallback);
-        curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void *)&chunk);
+        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, StreamCallback);
+        curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void *)&st);
+        curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
 
         res = curl_easy_perform(curl);
 
         if (res != CURLE_OK) {
             fprintf(stderr, "LLM request failed: %s\n", curl_easy_strerror(res));
-            free(chunk.memory);
-            chunk.memory = NULL;
         }
 
-        free(body);
         curl_easy_cleanup(curl);
         curl_slist_free_all(headers);
     }
+    free(body);
+
+    bool streamed = st.echo && st.text.size > 0;
+    bool replied = false;   // result is the model's reply (cacheable)
+    char* result = NULL;
+    if (res != CURLE_OK) {
+        // Nothing to return; end a line cut short
+        if (streamed) printf("\n");
+    } else if (st.events && (st.text.size > 0 || !st.error)) {
+        result = st.text.memory ? st.text.memory : strdup("");
+        st.text.memory = NULL;
+        replied = true;
+    } else if (st.events) {
+        result = st.error;
+        st.error = NULL;
+    } else if (st.raw.memory) {
+        // Extract the text; the raw response if extraction fails
+        result = extract_text(st.raw.memory);
+        replied = result != NULL;
+        if (!result) {
+            result = st.raw.memory;
+            st.raw.memory = NULL;
+        }
+    }
 
-    curl_global_cleanup();
+    if (echo && result) {
+        printf("%s\n", streamed ? "" : result);
+    }
+    if (replied && result) {
+        cache_put(key, result);
+    }
+    free(key);
 
-    // Extract and print the text
-    if (chunk.memory) {
-        char* text = extract_text(chunk.memory);
-        if (text) {
-            printf("%s\n", text);
-            free(chunk.memory);
-            return text;
-        } else {
-            // Print raw response if extraction fails
-            printf("%s\n", chunk.memory);
-        }
+    if (res == CURLE_OK) {
+        if (!st.events && st.raw.memory) usage_parse(strstr(st.raw.memory, "\"usage\""), &st.usage);
+        stats_add(&st.usage, false);
     }
 
-    return chunk.memory;
+    free(st.raw.memory);
+    free(st.line.memory);
+    free(st.text.memory);
+    free(st.error);
+    return result;
+}
+
+// Call Claude (Anthropic)
+// Returns extracted text response (caller must free)
+char* nerd_llm_claude(const char* prompt) {
+    return claude_request(NULL, prompt, true);
+}
+
+// Call Claude with a system prompt, cached by the API as a stable prefix
+// Returns extracted text response (caller must free)
+char* nerd_llm_claude_system(const char* system, const char* prompt) {
+    return claude_request(system, prompt, true);
+}
+
+/*
+ * Background calls for the compiler's concurrent network statements:
+ * nerd_llm_claude_start (or _system_start) runs the call on its own
+ * thread, nerd_llm_wait joins it and prints the reply as nerd_llm_claude
+ * would.
+ */
+typedef struct {
+    pthread_t thread;
+    const char *system;
+    const char *prompt;
+    char *response;
+    bool started;
+} LlmTask;
+
+static void *llm_task_run(void *arg) {
+    LlmTask *task = arg;
+    task->response = claude_request(task->system, task->prompt, false);
+    return NULL;
+}
+
+static void* llm_start(const char* system, const char* prompt) {
+    pthread_once(&llm_once, llm_init);
+
+    LlmTask *task = calloc(1, sizeof(LlmTask));
+    if (!task) return NULL;
+    task->system = system;
+    task->prompt = prompt;
+    task->started = pthread_create(&task->thread, NULL, llm_task_run, task) == 0;
+    if (!task->started) llm_task_run(task);  // no thread to spare: run it now
+    return task;
+}
+
+void* nerd_llm_claude_start(const char* prompt) {
+    return llm_start(NULL, prompt);
+}
+
+void* nerd_llm_claude_system_start(const char* system, const char* prompt) {
+    return llm_start(system, prompt);
+}
+
+char* nerd_llm_wait(void* handle) {
+    LlmTask *task = handle;
+    if (!task) return NULL;
+    if (task->started) pthread_join(task->thread, NULL);
+    char* response = task->response;
+    free(task);
+    if (response) {
+        printf("%s\n", response);
+    }
+    return response;
 }
 
 void nerd_llm_free(char* ptr) {
@@ -2,13 +2,42 @@
  * NERD MCP Runtime - Model Context Protocol support
  * 
  * Implements JSON-RPC 2.0 over HTTP for remote MCP servers
+ *
+ * Each server URL gets one session, created on first use: a curl handle
+ * kept across requests (so the connection stays alive), the Mcp-Session-Id
+ * the server assigned at initialize, and the next request id. `mcp init`
+ * initializes it; `mcp tools` and `mcp send` reuse it. A session the server
+ * has forgotten (404) is initialized again and the request retried once.
+ * Sessions with an id are ended with DELETE at exit.
  */
 
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
+#include <stdbool.h>
+#include <pthread.h>
 #include <curl/curl.h>
 
+typedef struct {
+    char *url;
+    CURL *curl;
+    char *session_id;       // Mcp-Session-Id from the server, or NULL
+    bool initialized;
+    long next_id;
+    pthread_mutex_t lock;   // one request at a time per handle
+} McpSession;
+
+static pthread_once_t mcp_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t mcp_lock = PTHREAD_MUTEX_INITIALIZER;
+// Each session is allocated on its own, so growing the table never moves
+// one that another thread is using
+static McpSession **mcp_sessions;
+static size_t mcp_session_count;
+static size_t mcp_session_capacity;
+
 // Structure to hold response data
 struct MemoryStruct {
     char *memory;
@@ -34,57 +63,249 @@ static size_t WriteMemoryCallback(void *contents, size_t size, size_t nmemb, voi
     return realsize;
 }
 
-// Internal: Make a JSON-RPC POST request
-static char* mcp_post(const char* url, const char* json_body) {
-    CURL *curl_handle;
+// Header callback: remember the session id the server assigns
+static size_t HeaderCallback(char *buffer, size_t size, size_t nitems, void *userp) {
+    size_t len = size * nitems;
+    McpSession *session = (McpSession *)userp;
+    const char *name = "Mcp-Session-Id:";
+    size_t name_len = strlen(name);
+
+    if (len > name_len && strncasecmp(buffer, name, name_len) == 0) {
+        const char *value = buffer + name_len;
+        const char *end = buffer + len;
+        while (value < end && (*value == ' ' || *value == '\t')) value++;
+        while (end > value && (end[-1] == '\r' || end[-1] == '\n' || end[-1] == ' ')) end--;
+        char *id = malloc((size_t)(end - value) + 1);
+        if (id) {
+            memcpy(id, value, (size_t)(end - value));
+            id[end - value] = '\0';
+            free(session->session_id);
+            session->session_id = id;
+        }
+    }
+    return len;
+}
+
+// End the sessions the servers know about, and free them
+static void mcp_cleanup(void) {
+    pthread_mutex_lock(&mcp_lock);
+    for (size_t i = 0; i < mcp_session_count; i++) {
+        McpSession *session = mcp_sessions[i];
+        if (session->session_id) {
+            char header[1024];
+            snprintf(header, sizeof(header), "Mcp-Session-Id: %s", session->session_id);
+            struct curl_slist *headers = curl_slist_append(NULL, header);
+            curl_easy_reset(session->curl);
+            curl_easy_setopt(session->curl, CURLOPT_URL, session->url);
+            curl_easy_setopt(session->curl, CURLOPT_CUSTOMREQUEST, "DELETE");
+            curl_easy_setopt(session->curl, CURLOPT_HTTPHEADER, headers);
+            curl_easy_setopt(session->curl, CURLOPT_NOBODY, 1L);
+            curl_easy_setopt(session->curl, CURLOPT_TIMEOUT, 2L);
+            curl_easy_perform(session->curl);
+            curl_slist_free_all(headers);
+        }
+        curl_easy_cleanup(session->curl);
+        pthread_mutex_destroy(&session->lock);
+        free(session->session_id);
+        free(session->url);
+        free(session);
+    }
+    free(mcp_sessions);
+    mcp_sessions = NULL;
+    mcp_session_count = mcp_session_capacity = 0;
+    pthread_mutex_unlock(&mcp_lock);
+}
+
+static void mcp_global_init(void) {
+    curl_global_init(CURL_GLOBAL_ALL);
+    atexit(mcp_cleanup);
+}
+
+// The session for url, created (uninitialized) if there is none
+static McpSession *mcp_session(const char *url) {
+    pthread_once(&mcp_once, mcp_global_init);
+
+    McpSession *session = NULL;
+    pthread_mutex_lock(&mcp_lock);
+    for (size_t i = 0; i < mcp_session_count; i++) {
+        if (strcmp(mcp_sessions[i]->url, url) == 0) {
+            session = mcp_sessions[i];
+            break;
+        }
+    }
+    if (!session && mcp_session_count == mcp_session_capacity) {
+        size_t capacity = mcp_session_capacity ? mcp_session_capacity * 2 : 16;
+        McpSession **grown = realloc(mcp_sessions, sizeof(McpSession *) * capacity);
+        if (grown) {
+            mcp_sessions = grown;
+            mcp_session_capacity = capacity;
+        }
+    }
+    if (!session && mcp_session_count < mcp_session_capacity) {
+        McpSession *s = calloc(1, sizeof(McpSession));
+        if (s) {
+            s->url = malloc(strlen(url) + 1);
+            s->curl = curl_easy_init();
+        }
+        if (s && s->url && s->curl) {
+            strcpy(s->url, url);
+            pthread_mutex_init(&s->lock, NULL);
+            s->next_id = 1;
+            session = s;
+            mcp_sessions[mcp_session_count++] = s;
+        } else if (s) {
+            free(s->url);
+            if (s->curl) curl_easy_cleanup(s->curl);
+            free(s);
+        }
+    }
+    pthread_mutex_unlock(&mcp_lock);
+    if (!session) fprintf(stderr, "MCP: cannot open a session for %s\n", url);
+    return session;
+}
+
+// Internal: Make a JSON-RPC POST request on the session's connection.
+// Sets *status to the HTTP status code.
+static char* mcp_post(McpSession *session, const char* json_body, long *status) {
+    CURL *curl_handle = session->curl;
     CURLcode res;
     struct MemoryStruct chunk;
     struct curl_slist *headers = NULL;
 
     chunk.memory = malloc(1);
     chunk.size = 0;
+    *status = 0;
 
-    curl_global_init(CURL_GLOBAL_ALL);
-    curl_handle = curl_easy_init();
+    // Options are set afresh per request; the connection is kept
+    curl_easy_reset(curl_handle);
+    curl_easy_setopt(curl_handle, CURLOPT_URL, session->url);
+    curl_easy_setopt(curl_handle, CURLOPT_WRITEFUNCTION, WriteMemoryCallback);
+    curl_easy_setopt(curl_handle, CURLOPT_WRITEDATA, (void *)&chunk);
+    curl_easy_setopt(curl_handle, CURLOPT_HEADERFUNCTION, HeaderCallback);
+    curl_easy_setopt(curl_handle, CURLOPT_HEADERDATA, (void *)session);
+    curl_easy_setopt(curl_handle, CURLOPT_USERAGENT, "nerd-mcp/1.0");
+    curl_easy_setopt(curl_handle, CURLOPT_FOLLOWLOCATION, 1L);
+    curl_easy_setopt(curl_handle, CURLOPT_TCP_KEEPALIVE, 1L);
+    curl_easy_setopt(curl_handle, CURLOPT_NOSIGNAL, 1L);
 
-    if (curl_handle) {
-        curl_easy_setopt(curl_handle, CURLOPT_URL, url);
-        curl_easy_setopt(curl_handle, CURLOPT_WRITEFUNCTION, WriteMemoryCallback);
-        curl_easy_setopt(curl_handle, CURLOPT_WRITEDATA, (void *)&chunk);
-        curl_easy_setopt(curl_handle, CURLOPT_USERAGENT, "nerd-mcp/1.0");
-        curl_easy_setopt(curl_handle, CURLOPT_FOLLOWLOCATION, 1L);
+    // MCP requires specific headers
+    headers = curl_slist_append(headers, "Content-Type: application/json");
+    headers = curl_slist_append(headers, "Accept: application/json, text/event-stream");
+    if (session->session_id) {
+        char header[1024];
+        snprintf(header, sizeof(header), "Mcp-Session-Id: %s", session->session_id);
+        headers = curl_slist_append(headers, header);
+    }
+    curl_easy_setopt(curl_handle, CURLOPT_HTTPHEADER, headers);
 
-        // MCP requires specific headers
-        headers = curl_slist_append(headers, "Content-Type: application/json");
-        headers = curl_slist_append(headers, "Accept: application/json, text/event-stream");
-        curl_easy_setopt(curl_handle, CURLOPT_HTTPHEADER, headers);
+    curl_easy_setopt(curl_handle, CURLOPT_POSTFIELDS, json_body);
+    curl_easy_setopt(curl_handle, CURLOPT_POSTFIELDSIZE, (long)strlen(json_body));
 
-        curl_easy_setopt(curl_handle, CURLOPT_POSTFIELDS, json_body);
-        curl_easy_setopt(curl_handle, CURLOPT_POSTFIELDSIZE, (long)strlen(json_body));
+    res = curl_easy_perform(curl_handle);
 
-        res = curl_easy_perform(curl_handle);
+    if (res != CURLE_OK) {
+        fprintf(stderr, "MCP request failed: %s\n", curl_easy_strerror(res));
+        if (chunk.memory) free(chunk.memory);
+        chunk.memory = NULL;
+    } else {
+        curl_easy_getinfo(curl_handle, CURLINFO_RESPONSE_CODE, status);
+    }
 
-        if (res != CURLE_OK) {
-            fprintf(stderr, "MCP request failed: %s\n", curl_easy_strerror(res));
-            if (chunk.memory) free(chunk.memory);
-            chunk.memory = NULL;
-        }
+    curl_slist_free_all(headers);
+    return chunk.memory;
+}
+
+// initialize, then the initialized notification the protocol expects
+static char* mcp_initialize(McpSession *session) {
+    const char* request = "{\"jsonrpc\":\"2.0\",\"method\":\"initialize\",\"params\":{\"protocolVersion\":\"2024-11-05\",\"capabilities\":{},\"clientInfo\":{\"name\":\"nerd\",\"version\":\"0.1.0\"}},\"id\":0}";
+    const char* notification = "{\"jsonrpc\":\"2.0\",\"method\":\"notifications/initialized\"}";
 
-        curl_easy_cleanup(curl_handle);
-        curl_slist_free_all(headers);
+    free(session->session_id);
+    session->session_id = NULL;
+    long status;
+    char* response = mcp_post(session, request, &status);
+    if (response && status < 400) {
+        session->initialized = true;
+        free(mcp_post(session, notification, &status));
     }
+    return response;
+}
 
-    curl_global_cleanup();
-    return chunk.memory;
+// A request on the session; re-initializes and retries once if the
+// server no longer knows the session
+static char* mcp_request(McpSession *session, const char* method, const char* params) {
+    size_t request_size = 128 + strlen(method) + (params ? strlen(params) : 0);
+    char* request = malloc(request_size);
+    if (!request) {
+        fprintf(stderr, "MCP: failed to allocate request buffer\n");
+        return NULL;
+    }
+
+    pthread_mutex_lock(&session->lock);
+    char* response = NULL;
+    for (int attempt = 0; attempt < 2; attempt++) {
+        snprintf(request, request_size, "{\"jsonrpc\":\"2.0\",\"method\":\"%s\"%s%s,\"id\":%ld}",
+                 method, params ? ",\"params\":" : "", params ? params : "", session->next_id++);
+        long status;
+        response = mcp_post(session, request, &status);
+        if (status != 404 || !session->session_id || !session->initialized || attempt > 0) break;
+
+        free(response);
+        response = NULL;
+        free(mcp_initialize(session));
+    }
+    pthread_mutex_unlock(&session->lock);
+
+    free(request);
+    return response;
+}
+
+// tools/list on the server's session (does not print)
+static char* mcp_list(const char* url) {
+    McpSession *session = mcp_session(url);
+    if (!session) return NULL;
+
+    // JSON-RPC request for tools/list
+    return mcp_request(session, "tools/list", NULL);
+}
+
+// tools/call on the server's session (does not print)
+static char* mcp_send(const char* url, const char* tool_name, const char* args_json) {
+    McpSession *session = mcp_session(url);
+    if (!session) return NULL;
+
+    // Build JSON-RPC params for tools/call
+    // Format: {"name":"...","arguments":{...}}
+    
+    size_t params_size = 64 + strlen(tool_name) + strlen(args_json);
+    char* params = malloc(params_size);
+    if (!params) {
+        fprintf(stderr, "MCP: failed to allocate request buffer\n");
+        return NULL;
+    }
+    
+    snprintf(params, params_size, "{\"name\":\"%s\",\"arguments\":%s}", tool_name, args_json);
+    
+    char* response = mcp_request(session, "tools/call", params);
+    free(params);
+    return response;
+}
+
+// initialize on the server's session (does not print)
+static char* mcp_init(const char* url) {
+    McpSession *session = mcp_session(url);
+    if (!session) return NULL;
+
+    pthread_mutex_lock(&session->lock);
+    char* response = mcp_initialize(session);
+    pthread_mutex_unlock(&session->lock);
+    return response;
 }
 
 // List available tools from an MCP server
 // Returns JSON response (caller must free)
 char* nerd_mcp_list(const char* url) {
-    // JSON-RPC request for tools/list
-    const char* request = "{\"jsonrpc\":\"2.0\",\"method\":\"tools/list\",\"id\":1}";
-    
-    char* response = mcp_post(url, request);
+    char* response = mcp_list(url);
     
     if (response) {
         printf("%s\n", response);
@@ -96,22 +317,7 @@ char* nerd_mcp_list(const char* url) {
 // Call a tool on an MCP server
 // Returns JSON response (caller must free)
 char* nerd_mcp_send(const char* url, const char* tool_name, const char* args_json) {
-    // Build JSON-RPC request for tools/call
-    // Format: {"jsonrpc":"2.0","method":"tools/call","params":{"name":"...","arguments":{...}},"id":2}
-    
-    size_t request_size = 256 + strlen(tool_name) + strlen(args_json);
-    char* request = malloc(request_size);
-    if (!request) {
-        fprintf(stderr, "MCP: failed to allocate request buffer\n");
-        return NULL;
-    }
-    
-    snprintf(request, request_size,
-        "{\"jsonrpc\":\"2.0\",\"method\":\"tools/call\",\"params\":{\"name\":\"%s\",\"arguments\":%s},\"id\":2}",
-        tool_name, args_json);
-    
-    char* response = mcp_post(url, request);
-    free(request);
+    char* response = mcp_send(url, tool_name, args_json);
     
     if (response) {
         printf("%s\n", response);
@@ -122,10 +328,7 @@ char* nerd_mcp_send(const char* url, const char* tool_name, const char* args_jso
 
 // Initialize an MCP session (optional for some servers)
 char* nerd_mcp_init(const char* url) {
-    // JSON-RPC request for initialize
-    const char* request = "{\"jsonrpc\":\"2.0\",\"method\":\"initialize\",\"params\":{\"protocolVersion\":\"2024-11-05\",\"capabilities\":{},\"clientInfo\":{\"name\":\"nerd\",\"version\":\"0.1.0\"}},\"id\":0}";
-    
-    char* response = mcp_post(url, request);
+    char* response = mcp_init(url);
     
     if (response) {
         printf("%s\n", response);
@@ -134,6 +337,75 @@ char* nerd_mcp_init(const char* url) {
     return response;
 }
 
+/*
+ * Background requests for the compiler's concurrent network statements.
+ * *_start runs the request on its own thread; nerd_mcp_wait joins it,
+ * prints the response as the blocking call would, and returns it.
+ * Requests to one server still go one at a time on its session.
+ */
+typedef enum { MCP_TASK_LIST, MCP_TASK_SEND, MCP_TASK_INIT } McpTaskKind;
+
+typedef struct {
+    pthread_t thread;
+    McpTaskKind kind;
+    const char *url;
+    const char *tool_name;
+    const char *args_json;
+    char *response;
+    bool started;
+} McpTask;
+
+static void *mcp_task_run(void *arg) {
+    McpTask *task = arg;
+    switch (task->kind) {
+        case MCP_TASK_LIST: task->response = mcp_list(task->url); break;
+        case MCP_TASK_SEND: task->response = mcp_send(task->url, task->tool_name, task->args_json); break;
+        case MCP_TASK_INIT: task->response = mcp_init(task->url); break;
+    }
+    return NULL;
+}
+
+static void *mcp_start(McpTaskKind kind, const char *url, const char *tool_name, const char *args_json) {
+    // Global curl setup is not thread-safe: do it here, on the caller's thread
+    pthread_once(&mcp_once, mcp_global_init);
+
+    McpTask *task = calloc(1, sizeof(McpTask));
+    if (!task) return NULL;
+    task->kind = kind;
+    task->url = url;
+    task->tool_name = tool_name;
+    task->args_json = args_json;
+    task->started = pthread_create(&task->thread, NULL, mcp_task_run, task) == 0;
+    if (!task->started) mcp_task_run(task);  // no thread to spare: run it now
+    return task;
+}
+
+void* nerd_mcp_list_start(const char* url) {
+    return mcp_start(MCP_TASK_LIST, url, NULL, NULL);
+}
+
+void* nerd_mcp_send_start(const char* url, const char* tool_name, const char* args_json) {
+    return mcp_start(MCP_TASK_SEND, url, tool_name, args_json);
+}
+
+void* nerd_mcp_init_start(const char* url) {
+    return mcp_start(MCP_TASK_INIT, url, NULL, NULL);
+}
+
+char* nerd_mcp_wait(void* handle) {
+    McpTask *task = handle;
+    if (!task) return NULL;
+    if (task->started) pthread_join(task->thread, NULL);
+    char* response = task->response;
+    free(task);
+
+    if (response) {
+        printf("%s\n", response);
+    }
+
+    return response;
+}
+
 // Free memory allocated by MCP functions
 void nerd_mcp_free(char* ptr) {
     if (ptr) {
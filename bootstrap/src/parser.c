@@ -29,6 +29,7 @@ void ast_free(ASTNode *node) {
         case NODE_PROGRAM:
             ast_list_free(&node->data.program.types);
             ast_list_free(&node->data.program.functions);
+            ast_list_free(&node->data.program.imports);
             break;
         case NODE_FUNC_DEF:
             free(node->data.func_def.name);
@@ -36,6 +37,9 @@ void ast_free(ASTNode *node) {
             ast_free(node->data.func_def.return_type);
             ast_list_free(&node->data.func_def.body);
             break;
+        case NODE_IMPORT:
+            free(node->data.import.name);
+            break;
         case NODE_TYPE_DEF:
             free(node->data.type_def.name);
             ast_list_free(&node->data.type_def.fields);
@@ -108,6 +112,135 @@ void ast_free(ASTNode *node) {
     free(node);
 }
 
+/*
+ * Deep-copy an AST node (used by optimization passes that clone functions)
+ */
+ASTNode *ast_clone(const ASTNode *node) {
+    if (!node) return NULL;
+
+    ASTNode *copy = ast_create(node->type, node->line);
+    if (!copy) return NULL;
+    copy->data = node->data;
+
+    switch (node->type) {
+        case NODE_PROGRAM:
+            ast_list_clone(&copy->data.program.types, &node->data.program.types);
+            ast_list_clone(&copy->data.program.functions, &node->data.program.functions);
+            ast_list_clone(&copy->data.program.imports, &node->data.program.imports);
+            break;
+        case NODE_FUNC_DEF:
+            copy->data.func_def.name = nerd_strdup(node->data.func_def.name);
+            ast_list_clone(&copy->data.func_def.params, &node->data.func_def.params);
+            copy->data.func_def.return_type = ast_clone(node->data.func_def.return_type);
+            ast_list_clone(&copy->data.func_def.body, &node->data.func_def.body);
+            break;
+        case NODE_TYPE_DEF:
+            copy->data.type_def.name = nerd_strdup(node->data.type_def.name);
+            ast_list_clone(&copy->data.type_def.fields, &node->data.type_def.fields);
+            copy->data.type_def.ok_type = ast_clone(node->data.type_def.ok_type);
+            copy->data.type_def.err_type = ast_clone(node->data.type_def.err_type);
+            break;
+        case NODE_PARAM:
+            copy->data.param.name = nerd_strdup(node->data.param.name);
+            copy->data.param.param_type = ast_clone(node->data.param.param_type);
+            break;
+        case NODE_RETURN:
+            copy->data.ret.value = ast_clone(node->data.ret.value);
+            break;
+        case NODE_IF:
+            copy->data.if_stmt.condition = ast_clone(node->data.if_stmt.condition);
+            copy->data.if_stmt.then_stmt = ast_clone(node->data.if_stmt.then_stmt);
+            copy->data.if_stmt.else_stmt = ast_clone(node->data.if_stmt.else_stmt);
+            break;
+        case NODE_OUT:
+            copy->data.out.value = ast_clone(node->data.out.value);
+            break;
+        case NODE_REPEAT:
+            copy->data.repeat.count = ast_clone(node->data.repeat.count);
+            copy->data.repeat.var_name = nerd_strdup(node->data.repeat.var_name);
+            ast_list_clone(&copy->data.repeat.body, &node->data.repeat.body);
+            break;
+        case NODE_WHILE:
+            copy->data.while_loop.condition = ast_clone(node->data.while_loop.condition);
+            ast_list_clone(&copy->data.while_loop.body, &node->data.while_loop.body);
+            break;
+        case NODE_INC:
+            copy->data.inc.var_name = nerd_strdup(node->data.inc.var_name);
+            copy->data.inc.amount = ast_clone(node->data.inc.amount);
+            break;
+        case NODE_DEC:
+            copy->data.dec.var_name = nerd_strdup(node->data.dec.var_name);
+            copy->data.dec.amount = ast_clone(node->data.dec.amount);
+            break;
+        case NODE_LET:
+            copy->data.let.name = nerd_strdup(node->data.let.name);
+            copy->data.let.value = ast_clone(node->data.let.value);
+            break;
+        case NODE_EXPR_STMT:
+            copy->data.expr_stmt.expr = ast_clone(node->data.expr_stmt.expr);
+            break;
+        case NODE_BINOP:
+            copy->data.binop.op = nerd_strdup(node->data.binop.op);
+            copy->data.binop.left = ast_clone(node->data.binop.left);
+            copy->data.binop.right = ast_clone(node->data.binop.right);
+            break;
+        case NODE_UNARYOP:
+            copy->data.unaryop.op = nerd_strdup(node->data.unaryop.op);
+            copy->data.unaryop.operand = ast_clone(node->data.unaryop.operand);
+            break;
+        case NODE_CALL:
+            copy->data.call.module = nerd_strdup(node->data.call.module);
+            copy->data.call.func = nerd_strdup(node->data.call.func);
+            ast_list_clone(&copy->data.call.args, &node->data.call.args);
+            break;
+        case NODE_STR:
+            copy->data.str.value = nerd_strdup(node->data.str.value);
+            break;
+        case NODE_VAR:
+            copy->data.var.name = nerd_strdup(node->data.var.name);
+            break;
+        default:
+            break;
+    }
+
+    return copy;
+}
+
+/*
+ * Check whether a statement (list) assigns to a name (let/inc/dec/repeat as)
+ */
+bool ast_stmt_writes(ASTNode *node, const char *name) {
+    if (!node) return false;
+
+    switch (node->type) {
+        case NODE_LET:
+            return strcmp(node->data.let.name, name) == 0;
+        case NODE_INC:
+            return strcmp(node->data.inc.var_name, name) == 0;
+        case NODE_DEC:
+            return strcmp(node->data.dec.var_name, name) == 0;
+        case NODE_IF:
+            return ast_stmt_writes(node->data.if_stmt.then_stmt, name) ||
+                   ast_stmt_writes(node->data.if_stmt.else_stmt, name);
+        case NODE_REPEAT:
+            if (node->data.repeat.var_name && strcmp(node->data.repeat.var_name, name) == 0) {
+                return true;
+            }
+            return ast_list_writes(&node->data.repeat.body, name);
+        case NODE_WHILE:
+            return ast_list_writes(&node->data.while_loop.body, name);
+        default:
+            return false;
+    }
+}
+
+bool ast_list_writes(ASTList *list, const char *name) {
+    for (size_t i = 0; i < list->count; i++) {
+        if (ast_stmt_writes(list->nodes[i], name)) return true;
+    }
+    return false;
+}
+
 /*
  * AST List operations
  */
@@ -122,7 +255,7 @@ void ast_list_push(ASTList *list, ASTNode *node) {
         size_t new_capacity = list->capacity == 0 ? 8 : list->capacity * 2;
         ASTNode **new_nodes = realloc(list->nodes, sizeof(ASTNode*) * new_capacity);
         if (!new_nodes) {
-            fprintf(stderr, "Error: Out of memory\n");
+            fprintf(nerd_diag(), "Error: Out of memory\n");
             return;
         }
         list->nodes = new_nodes;
@@ -131,6 +264,13 @@ void ast_list_push(ASTList *list, ASTNode *node) {
     list->nodes[list->count++] = node;
 }
 
+void ast_list_clone(ASTList *dst, const ASTList *src) {
+    ast_list_init(dst);
+    for (size_t i = 0; i < src->count; i++) {
+        ast_list_push(dst, ast_clone(src->nodes[i]));
+    }
+}
+
 void ast_list_free(ASTList *list) {
     for (size_t i = 0; i < list->count; i++) {
         ast_free(list->nodes[i]);
@@ -191,7 +331,7 @@ static Token *parser_expect(Parser *parser, TokenType type, const char *msg) {
     if (parser_check(parser, type)) {
         return parser_advance(parser);
     }
-    fprintf(stderr, "Error at line %d: %s (got %d)\n",
+    fprintf(nerd_diag(), "Error at line %d: %s (got %d)\n",
             parser_current(parser)->line, msg, parser_current(parser)->type);
     return NULL;
 }
@@ -289,6 +429,40 @@ static int positional_index(TokenType type) {
     }
 }
 
+/*
+ * Replace a list of string literals with one literal holding them joined
+ * by "\n" escapes. Lists with other expressions are left alone.
+ */
+static bool join_string_args(ASTList *args) {
+    size_t len = 0;
+    for (size_t i = 0; i < args->count; i++) {
+        if (args->nodes[i]->type != NODE_STR) return true;
+        len += strlen(args->nodes[i]->data.str.value) + 2;
+    }
+
+    char *joined = malloc(len + 1);
+    if (!joined) return false;
+    size_t n = 0;
+    for (size_t i = 0; i < args->count; i++) {
+        const char *value = args->nodes[i]->data.str.value;
+        if (i > 0) {
+            joined[n++] = '\\';
+            joined[n++] = 'n';
+        }
+        memcpy(joined + n, value, strlen(value));
+        n += strlen(value);
+    }
+    joined[n] = '\0';
+
+    free(args->nodes[0]->data.str.value);
+    args->nodes[0]->data.str.value = joined;
+    for (size_t i = 1; i < args->count; i++) {
+        ast_free(args->nodes[i]);
+    }
+    args->count = 1;
+    return true;
+}
+
 /*
  * Forward declarations for recursive descent
  */
@@ -359,7 +533,7 @@ static ASTNode *parse_primary(Parser *parser) {
         return node;
     }
 
-    fprintf(stderr, "Error at line %d: Unexpected token in expression\n", line);
+    fprintf(nerd_diag(), "Error at line %d: Unexpected token in expression\n", line);
     return NULL;
 }
 
@@ -413,6 +587,14 @@ static ASTNode *parse_call(Parser *parser) {
             ast_list_push(&node->data.call.args, arg);
         }
 
+        // http getall "u1" "u2" ...: the runtime takes the URLs as one
+        // newline-separated list
+        if (strcmp(node->data.call.module, "http") == 0 && strcmp(node->data.call.func, "getall") == 0 &&
+            node->data.call.args.count > 1 && !join_string_args(&node->data.call.args)) {
+            ast_free(node);
+            return NULL;
+        }
+
         return node;
     }
 
@@ -993,7 +1175,8 @@ static ASTNode *parse_func_def(Parser *parser) {
     // Parse body
     while (!parser_at_end(parser) &&
            !parser_check(parser, TOK_FN) &&
-           !parser_check(parser, TOK_TYPE)) {
+           !parser_check(parser, TOK_TYPE) &&
+           !parser_check(parser, TOK_IMPORT)) {
         if (parser_match(parser, TOK_NEWLINE)) continue;
 
         ASTNode *stmt = parse_stmt(parser);
@@ -1053,6 +1236,23 @@ static ASTNode *parse_type_def(Parser *parser) {
     return node;
 }
 
+/*
+ * Parse import: import <module>
+ */
+static ASTNode *parse_import(Parser *parser) {
+    int line = parser_current(parser)->line;
+    parser_expect(parser, TOK_IMPORT, "Expected 'import'");
+
+    Token *name_tok = parser_expect(parser, TOK_IDENT, "Expected module name after 'import'");
+    if (!name_tok) return NULL;
+
+    ASTNode *node = ast_create(NODE_IMPORT, line);
+    node->data.import.name = nerd_strdup(name_tok->value);
+
+    parser_match(parser, TOK_NEWLINE);
+    return node;
+}
+
 /*
  * Parse program (supports implicit main)
  */
@@ -1060,6 +1260,7 @@ ASTNode *parser_parse(Parser *parser) {
     ASTNode *program = ast_create(NODE_PROGRAM, 1);
     ast_list_init(&program->data.program.types);
     ast_list_init(&program->data.program.functions);
+    ast_list_init(&program->data.program.imports);
 
     // Collect top-level statements for implicit main
     ASTList top_level_stmts;
@@ -1077,6 +1278,14 @@ ASTNode *parser_parse(Parser *parser) {
                 return NULL;
             }
             ast_list_push(&program->data.program.types, type_def);
+        } else if (parser_check(parser, TOK_IMPORT)) {
+            ASTNode *import = parse_import(parser);
+            if (!import) {
+                ast_list_free(&top_level_stmts);
+                ast_free(program);
+                return NULL;
+            }
+            ast_list_push(&program->data.program.imports, import);
         } else if (parser_check(parser, TOK_FN)) {
             ASTNode *func_def = parse_func_def(parser);
             if (!func_def) {
@@ -1113,7 +1322,7 @@ ASTNode *parser_parse(Parser *parser) {
         implicit_main->data.func_def.body = top_level_stmts;
         ast_list_push(&program->data.program.functions, implicit_main);
     } else if (top_level_stmts.count > 0 && has_explicit_main) {
-        fprintf(stderr, "Error: Cannot mix top-level statements with explicit main\n");
+        fprintf(nerd_diag(), "Error: Cannot mix top-level statements with explicit main\n");
         ast_list_free(&top_level_stmts);
         ast_free(program);
         return NULL;
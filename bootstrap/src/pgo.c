@@ -0,0 +1,303 @@
+/*
+ * NERD PGO - Profile-guided builds
+ *
+ * `nerd build --pgo` first builds the program with NERD's own counters
+ * (codegen.c: one slot per function for calls, two per if/while/repeat
+ * condition for times false and true) and runs it on the user's workload.
+ * Each run appends its counters to $NERD_PROFILE; the records are summed
+ * into a profile kept next to the source as prog.nerdprof:
+ *
+ *     nerd-profile 1
+ *     fib 3 177 11 166
+ *
+ * The real build then weights branches with the counts, and marks the
+ * functions taking 99% of the calls hot and those never called cold, so
+ * they are laid out apart. The counts of a function are part of its
+ * object's cache key.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <inttypes.h>
+#include "nerd.h"
+
+#define PROFILE_MAGIC "nerd-profile 1"
+#define PROFILE_HOT_SHARE 0.99      // hot: the busiest functions covering this share of calls
+
+static int func_cmp(const void *a, const void *b) {
+    return strcmp(((const ProfileFunc *)a)->name, ((const ProfileFunc *)b)->name);
+}
+
+static int calls_cmp(const void *a, const void *b) {
+    uint64_t x = (*(ProfileFunc *const *)a)->counts[0];
+    uint64_t y = (*(ProfileFunc *const *)b)->counts[0];
+    return x > y ? -1 : x < y;
+}
+
+void profile_free(Profile *profile) {
+    for (size_t i = 0; i < profile->count; i++) {
+        free(profile->funcs[i].name);
+        free(profile->funcs[i].counts);
+    }
+    free(profile->funcs);
+    profile->funcs = NULL;
+    profile->count = 0;
+}
+
+const ProfileFunc *profile_find(const Profile *profile, const char *name) {
+    if (!profile || profile->count == 0) return NULL;
+    ProfileFunc probe = {0};
+    probe.name = (char *)name;
+    return bsearch(&probe, profile->funcs, profile->count, sizeof(ProfileFunc), func_cmp);
+}
+
+/*
+ * Add one `name n c0 ... cn-1` record, summing it into an earlier record
+ * of the same function and shape
+ */
+static bool add_record(Profile *profile, size_t *capacity, char *line) {
+    char *save = NULL;
+    char *name = strtok_r(line, " \t\r\n", &save);
+    char *n_str = strtok_r(NULL, " \t\r\n", &save);
+    if (!name) return true;  // blank line
+    char *end;
+    unsigned long long n = n_str ? strtoull(n_str, &end, 10) : 0;
+    if (!n_str || *end || n == 0 || n > (1u << 20)) return false;
+
+    uint64_t *counts = calloc(n, sizeof(uint64_t));
+    if (!counts) return false;
+    for (size_t i = 0; i < n; i++) {
+        char *tok = strtok_r(NULL, " \t\r\n", &save);
+        if (!tok) {
+            free(counts);
+            return false;
+        }
+        counts[i] = strtoull(tok, &end, 10);
+        if (*end) {
+            free(counts);
+            return false;
+        }
+    }
+
+    for (size_t i = 0; i < profile->count; i++) {
+        ProfileFunc *f = &profile->funcs[i];
+        if (strcmp(f->name, name) != 0) continue;
+        if (f->count == n) {
+            for (size_t j = 0; j < n; j++) f->counts[j] += counts[j];
+        } else {
+            // Written by a different version of the function: keep the newest
+            free(f->counts);
+            f->counts = counts;
+            f->count = n;
+            return true;
+        }
+        free(counts);
+        return true;
+    }
+
+    if (profile->count == *capacity) {
+        size_t grown_cap = *capacity ? *capacity * 2 : 16;
+        ProfileFunc *grown = realloc(profile->funcs, sizeof(ProfileFunc) * grown_cap);
+        if (!grown) {
+            free(counts);
+            return false;
+        }
+        profile->funcs = grown;
+        *capacity = grown_cap;
+    }
+    ProfileFunc *f = &profile->funcs[profile->count++];
+    memset(f, 0, sizeof(*f));
+    f->name = nerd_strdup(name);
+    f->counts = counts;
+    f->count = n;
+    return true;
+}
+
+/*
+ * Sort by name and mark hot and cold functions
+ */
+static void classify(Profile *profile) {
+    qsort(profile->funcs, profile->count, sizeof(ProfileFunc), func_cmp);
+
+    ProfileFunc **by_calls = malloc(sizeof(ProfileFunc *) * (profile->count ? profile->count : 1));
+    if (!by_calls) return;
+    uint64_t total = 0;
+    for (size_t i = 0; i < profile->count; i++) {
+        by_calls[i] = &profile->funcs[i];
+        total += profile->funcs[i].counts[0];
+    }
+    qsort(by_calls, profile->count, sizeof(ProfileFunc *), calls_cmp);
+
+    uint64_t covered = 0;
+    for (size_t i = 0; i < profile->count; i++) {
+        ProfileFunc *f = by_calls[i];
+        f->cold = f->counts[0] == 0;
+        f->hot = !f->cold && covered < PROFILE_HOT_SHARE * total;
+        covered += f->counts[0];
+    }
+    free(by_calls);
+}
+
+/*
+ * Read a profile: records as written by instrumented programs, with or
+ * without the header, in any number
+ */
+bool profile_load(const char *path, Profile *profile) {
+    memset(profile, 0, sizeof(*profile));
+    FILE *in = fopen(path, "r");
+    if (!in) {
+        fprintf(stderr, "Error: Cannot read profile %s\n", path);
+        return false;
+    }
+
+    size_t capacity = 0, line_no = 0;
+    char *line = NULL;
+    size_t line_size = 0;
+    bool ok = true;
+    while (getline(&line, &line_size, in) != -1) {
+        line_no++;
+        if (line_no == 1 && strncmp(line, PROFILE_MAGIC, strlen(PROFILE_MAGIC)) == 0) continue;
+        if (!add_record(profile, &capacity, line)) {
+            fprintf(stderr, "Error: %s:%zu: Bad profile record\n", path, line_no);
+            ok = false;
+            break;
+        }
+    }
+    free(line);
+    fclose(in);
+
+    if (!ok) {
+        profile_free(profile);
+        return false;
+    }
+    classify(profile);
+    return true;
+}
+
+/*
+ * Write the profile atomically, so a concurrent build never reads half of it
+ */
+bool profile_save(const Profile *profile, const char *path) {
+    char tmp[4096 + 16];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    FILE *out = fopen(tmp, "w");
+    if (!out) {
+        fprintf(stderr, "Error: Cannot write profile %s\n", tmp);
+        return false;
+    }
+    fprintf(out, "%s\n", PROFILE_MAGIC);
+    for (size_t i = 0; i < profile->count; i++) {
+        const ProfileFunc *f = &profile->funcs[i];
+        fprintf(out, "%s %zu", f->name, f->count);
+        for (size_t j = 0; j < f->count; j++) {
+            fprintf(out, " %" PRIu64, f->counts[j]);
+        }
+        fprintf(out, "\n");
+    }
+    bool ok = fclose(out) == 0 && rename(tmp, path) == 0;
+    if (!ok) {
+        fprintf(stderr, "Error: Cannot write profile %s\n", path);
+        remove(tmp);
+    }
+    return ok;
+}
+
+/*
+ * What the profile changes in the code of `name`
+ */
+void profile_key(const Profile *profile, const char *name, CacheKey *key) {
+    const ProfileFunc *f = profile_find(profile, name);
+    if (!f) return;
+    cache_key_add_str(key, f->hot ? "pgo-hot" : f->cold ? "pgo-cold" : "pgo");
+    cache_key_add(key, f->counts, sizeof(uint64_t) * f->count);
+}
+
+/*
+ * prog.nerd -> prog.nerdprof, next to the source
+ */
+void profile_path(const char *input, char *buf, size_t size) {
+    size_t len = strlen(input);
+    if (len > 5 && strcmp(input + len - 5, ".nerd") == 0) len -= 5;
+    snprintf(buf, size, "%.*s.nerdprof", (int)len, input);
+}
+
+/*
+ * Split a --pgo-run argument string on whitespace into argv[first...]
+ */
+static int split_args(char *args, char **argv, int first, int max) {
+    int n = first;
+    char *save = NULL;
+    for (char *tok = strtok_r(args, " \t", &save); tok && n < max; tok = strtok_r(NULL, " \t", &save)) {
+        argv[n++] = tok;
+    }
+    argv[n] = NULL;
+    return n;
+}
+
+/*
+ * Build `input` instrumented, run it once per entry of `runs` (once with
+ * no arguments if there are none), and save the summed counts to `output`
+ */
+bool pgo_train(const char *input, const char *source, size_t source_len, const RunOptions *opts,
+               char **runs, size_t run_count, const char *output) {
+    RunEnv env;
+    run_env_init(&env);
+
+    RunOptions train = *opts;
+    train.instrument = true;
+    train.x86 = false;
+    train.bitcode = false;
+
+    char bin[4096];
+    bool cached;
+    char *dir = NULL;
+    if (!run_build(&env, &train, input, source, source_len, NULL, bin, sizeof(bin), &cached, &dir)) {
+        if (dir) {
+            toolchain_rmdir(dir);
+            free(dir);
+        }
+        return false;
+    }
+
+    char raw[4096];
+    snprintf(raw, sizeof(raw), "%s/profile.raw", dir);
+    setenv("NERD_PROFILE", raw, 1);
+
+    bool ok = true;
+    for (size_t r = 0; r < (run_count ? run_count : 1) && ok; r++) {
+        char *args = nerd_strdup(run_count ? runs[r] : "");
+        char *argv[64];
+        argv[0] = bin;
+        split_args(args, argv, 1, 63);
+
+        bool has_args = run_count && *runs[r];
+        fprintf(stderr, "pgo: running %s%s%s\n", input, has_args ? " " : "", has_args ? runs[r] : "");
+        fflush(stdout);
+        int pid;
+        if (toolchain_spawn(argv, NULL, &pid)) {
+            int status = toolchain_wait(pid);
+            if (status != 0) {
+                fprintf(stderr, "Warning: Training run exited with status %d\n", status);
+            }
+        } else {
+            ok = false;
+        }
+        free(args);
+    }
+    unsetenv("NERD_PROFILE");
+
+    Profile profile;
+    if (ok && profile_load(raw, &profile)) {
+        ok = profile_save(&profile, output);
+        profile_free(&profile);
+    } else {
+        ok = false;
+    }
+
+    toolchain_rmdir(dir);
+    free(dir);
+    return ok;
+}
@@ -0,0 +1,211 @@
+/*
+ * NERD Run - Source file to a runnable executable
+ *
+ * `nerd run`, and `nerd serve` on its behalf, hash everything that can
+ * change the executable (source and imported files, compiler, runtime
+ * objects, flags) and look the key up in the cache. On a miss the IR is
+ * streamed straight into clang's stdin, or the x86 backend writes an
+ * object for cc, and the binary is linked into the cache directory.
+ *
+ * The part of the key that depends only on the compiler and the runtime
+ * objects is computed once per RunEnv, which is what the daemon keeps warm.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <signal.h>
+#include "nerd.h"
+
+/*
+ * Runtime objects live next to the nerd executable
+ */
+void run_env_init(RunEnv *env) {
+    char exe_dir[1024] = "";
+    toolchain_runtime_dir(exe_dir, sizeof(exe_dir));
+    snprintf(env->http_lib, sizeof(env->http_lib), "%sbuild/nerd_http.o", exe_dir);
+    snprintf(env->mcp_lib, sizeof(env->mcp_lib), "%sbuild/nerd_mcp.o", exe_dir);
+    snprintf(env->llm_lib, sizeof(env->llm_lib), "%sbuild/nerd_llm.o", exe_dir);
+
+    cache_key_init(&env->prefix);
+    cache_key_add_str(&env->prefix, NERD_VERSION);
+
+    // The compiler itself (covers codegen changes between releases)
+    char exe[1024];
+    if (toolchain_exe_path(exe, sizeof(exe))) {
+        cache_key_add_file(&env->prefix, exe);
+    }
+    cache_key_add_file(&env->prefix, env->http_lib);
+    cache_key_add_file(&env->prefix, env->mcp_lib);
+    cache_key_add_file(&env->prefix, env->llm_lib);
+}
+
+/*
+ * Cache key for `nerd run`: everything that can change the executable
+ */
+void run_cache_key(CacheKey *key, const RunEnv *env, const RunOptions *opts,
+                   const char *input, const char *source, size_t source_len) {
+    *key = env->prefix;
+    cache_key_add_str(key, opts->opt_level);
+    cache_key_add_str(key, opts->no_specialize ? "no-specialize" : "");
+    cache_key_add_str(key, opts->fast_math ? "fast-math" : "");
+    cache_key_add_str(key, opts->march);
+    cache_key_add_str(key, opts->x86 ? "x86" : opts->bitcode ? "llvm-bc" : "llvm");
+
+    // --march=native resolves differently per host
+    TargetInfo target;
+    if (opts->march && target_host(opts->march, &target)) {
+        cache_key_add_str(key, target.cpu);
+        cache_key_add_str(key, target.features);
+    }
+
+    cache_key_add(key, source, source_len);
+    module_hash_imports(key, source, input);
+}
+
+/*
+ * Compile and link `input` into an executable. With a key the binary is
+ * published in the cache (*cached set); otherwise, or if the cache is
+ * unusable, it goes to a private temp dir returned in *tmp_dir for the
+ * caller to remove. A binary left in neither place (the store failed) is
+ * the caller's to remove.
+ */
+bool run_build(const RunEnv *env, const RunOptions *opts, const char *input,
+               const char *source, size_t source_len, const CacheKey *key,
+               char *bin, size_t size, bool *cached, char **tmp_dir) {
+    *cached = false;
+    *tmp_dir = NULL;
+
+    // Lex
+    Lexer *lexer = lexer_create(source, source_len);
+    if (!lexer || !lexer_tokenize(lexer)) {
+        if (lexer) lexer_free(lexer);
+        return false;
+    }
+
+    // Check which modules are used
+    bool needs_http = false, needs_mcp = false, needs_llm = false;
+    for (size_t i = 0; i < lexer->token_count; i++) {
+        if (lexer->tokens[i].type == TOK_HTTP) needs_http = true;
+        if (lexer->tokens[i].type == TOK_MCP) needs_mcp = true;
+        if (lexer->tokens[i].type == TOK_LLM) needs_llm = true;
+    }
+
+    // Parse
+    Parser *parser = parser_create(lexer->tokens, lexer->token_count);
+    ASTNode *ast = parser ? parser_parse(parser) : NULL;
+    if (!ast || !module_import_all(input, ast, &needs_http, &needs_mcp, &needs_llm)) {
+        ast_free(ast);
+        if (parser) parser_free(parser);
+        lexer_free(lexer);
+        return false;
+    }
+
+    // Link into the cache directory when caching, else a private temp dir
+    char tmp_bin[4096];
+    bool use_cache = key && cache_tmp_path(key, tmp_bin, sizeof(tmp_bin));
+    if (!use_cache) {
+        *tmp_dir = toolchain_tmpdir();
+        if (!*tmp_dir) {
+            ast_free(ast);
+            parser_free(parser);
+            lexer_free(lexer);
+            return false;
+        }
+        snprintf(tmp_bin, sizeof(tmp_bin), "%s/prog", *tmp_dir);
+    }
+
+    NerdContext ctx = {0};
+    ctx.filename = input;
+    ctx.source = source;
+    ctx.ast = ast;
+    ctx.no_specialize = opts->no_specialize;
+    ctx.fast_math = opts->fast_math;
+    ctx.march = opts->march;
+    ctx.emit_entry = true;
+    ctx.instrument = opts->instrument;
+
+    bool needs_curl = needs_http || needs_mcp || needs_llm;
+    bool built = false;
+
+    if (opts->x86) {
+        // Object next to the executable, then cc -o prog prog.o <runtime objects> -lm [-lcurl]
+        char obj_path[4096 + 8];
+        snprintf(obj_path, sizeof(obj_path), "%s.o", tmp_bin);
+
+        if (compile_x86_object(ast, opts->no_specialize, true, obj_path)) {
+            char *cc_argv[16];
+            int n = 0;
+            cc_argv[n++] = "cc";
+            cc_argv[n++] = "-o";
+            cc_argv[n++] = tmp_bin;
+            cc_argv[n++] = obj_path;
+            if (needs_http) cc_argv[n++] = (char *)env->http_lib;
+            if (needs_mcp) cc_argv[n++] = (char *)env->mcp_lib;
+            if (needs_llm) cc_argv[n++] = (char *)env->llm_lib;
+            cc_argv[n++] = "-lm";
+            if (needs_curl) cc_argv[n++] = "-lcurl";
+            cc_argv[n] = NULL;
+
+            int cc_pid;
+            if (toolchain_spawn(cc_argv, NULL, &cc_pid)) {
+                built = toolchain_wait(cc_pid) == 0;
+                if (!built) fprintf(stderr, "Error: Linking failed\n");
+            }
+        }
+        remove(obj_path);
+    } else {
+        // clang [-O] -o prog -x ir - -x none <runtime objects> [-lcurl]
+        char *clang_argv[16];
+        int n = 0;
+        clang_argv[n++] = "clang";
+        clang_argv[n++] = "-w";
+        if (opts->opt_level) clang_argv[n++] = (char *)opts->opt_level;
+        clang_argv[n++] = "-o";
+        clang_argv[n++] = tmp_bin;
+        clang_argv[n++] = "-x";
+        clang_argv[n++] = "ir";
+        clang_argv[n++] = "-";
+        clang_argv[n++] = "-x";
+        clang_argv[n++] = "none";
+        if (needs_http) clang_argv[n++] = (char *)env->http_lib;
+        if (needs_mcp) clang_argv[n++] = (char *)env->mcp_lib;
+        if (needs_llm) clang_argv[n++] = (char *)env->llm_lib;
+        if (needs_curl) clang_argv[n++] = "-lcurl";
+        clang_argv[n] = NULL;
+
+        // A clang that exits early must not kill us with SIGPIPE
+        signal(SIGPIPE, SIG_IGN);
+
+        FILE *ir = NULL;
+        int clang_pid;
+        if (toolchain_spawn(clang_argv, &ir, &clang_pid)) {
+            bool ok = opts->bitcode ? codegen_bitcode_stream(&ctx, ir) : codegen_llvm_stream(&ctx, ir);
+            fclose(ir);
+            int status = toolchain_wait(clang_pid);
+
+            if (!ok) {
+                fprintf(stderr, "Error: %s\n", ctx.error_msg ? ctx.error_msg : "code generation failed");
+            } else if (status != 0) {
+                fprintf(stderr, "Error: clang compilation failed (re-run with `nerd compile` to inspect the IR)\n");
+            } else {
+                built = true;
+            }
+        }
+    }
+
+    snprintf(bin, size, "%s", tmp_bin);
+    if (built && use_cache && cache_store(tmp_bin, key, bin, size)) {
+        *cached = true;
+    } else if (!built && use_cache) {
+        remove(tmp_bin);  // only left behind if the link failed half way
+    }
+
+    free(ctx.error_msg);
+    ast_free(ast);
+    parser_free(parser);
+    lexer_free(lexer);
+    return built;
+}
@@ -0,0 +1,457 @@
+/*
+ * NERD Serve - Compiler daemon for `nerd run`
+ *
+ * `nerd serve` listens on a Unix domain socket and builds executables for
+ * `nerd run` on a pool of worker threads. It hashes the compiler and the
+ * runtime objects once at startup (the part of every run cache key that
+ * the client would otherwise recompute by reading about a megabyte of
+ * files) and then serves requests until stopped.
+ *
+ * The client sends the source path and flags and gets back the path of the
+ * cached executable, which it execs itself, so the program runs with the
+ * client's stdio, environment and working directory. Anything the daemon
+ * can't serve (a compile error, a rebuilt `nerd` or runtime object, a
+ * different NERD_PATH) is answered with `error` and the client builds
+ * locally, which prints the diagnostics where the user sees them.
+ *
+ * Protocol, one request per connection, plain text:
+ *
+ *   nerd-serve 1            nerd-serve 1         nerd-serve 1
+ *   build                   ping                 stop
+ *   exe <nerd binary>       <blank line>         <blank line>
+ *   cwd <dir>
+ *   file <source>
+ *   path <NERD_PATH>
+ *   opt -O2 / march <cpu> / no-specialize / fast-math / x86 / bitcode
+ *   <blank line>
+ *
+ * answered with `ok <executable>`, `ok <requests served>` or `error <why>`.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "nerd.h"
+
+#define SERVE_HEADER "nerd-serve 1"
+#define SERVE_MAX_REQUEST 16384
+#define SERVE_MAX_THREADS 64
+#define SERVE_TIMEOUT 5     // seconds a client may take to send its request
+
+/*
+ * Size and mtime of a file the prefix key was computed from
+ */
+typedef struct {
+    const char *path;
+    off_t size;
+    time_t mtime;
+} Stamp;
+
+typedef struct {
+    int fd;
+    RunEnv env;
+    char exe[1024];
+    const char *nerd_path;
+    Stamp stamps[4];
+    int stamp_count;
+    atomic_size_t served;
+    atomic_bool stopping;
+} Server;
+
+static Server server;
+static volatile sig_atomic_t listen_fd = -1;
+
+/*
+ * $NERD_SERVE_SOCKET, else serve.sock in the cache directory
+ */
+bool serve_socket_path(char *buf, size_t size) {
+    const char *env = getenv("NERD_SERVE_SOCKET");
+    int len;
+    if (env && *env) {
+        len = snprintf(buf, size, "%s", env);
+    } else {
+        char dir[4096];
+        if (!cache_dir(dir, sizeof(dir))) return false;
+        len = snprintf(buf, size, "%s/serve.sock", dir);
+    }
+    return len > 0 && (size_t)len < size && (size_t)len < sizeof(((struct sockaddr_un *)0)->sun_path);
+}
+
+/*
+ * Stream socket that children spawned by other threads don't inherit
+ */
+static int cloexec_socket(void) {
+#ifdef __APPLE__
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd >= 0) fcntl(fd, F_SETFD, FD_CLOEXEC);
+    return fd;
+#else
+    return socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+#endif
+}
+
+static int serve_connect(void) {
+    char path[4096];
+    if (!serve_socket_path(path, sizeof(path))) return -1;
+
+    int fd = cloexec_socket();
+    if (fd < 0) return -1;
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    memcpy(addr.sun_path, path, strlen(path) + 1);
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static bool write_all(int fd, const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        buf += n;
+        len -= n;
+    }
+    return true;
+}
+
+/*
+ * Read until `end` has been seen or the peer closes; NUL-terminated
+ */
+static size_t read_until(int fd, char *buf, size_t size, const char *end) {
+    size_t len = 0;
+    buf[0] = '\0';
+    while (len + 1 < size && !strstr(buf, end)) {
+        ssize_t n = read(fd, buf + len, size - 1 - len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        len += n;
+        buf[len] = '\0';
+    }
+    return len;
+}
+
+/*
+ * Send one request and read the `ok`/`error` line back
+ */
+static bool serve_request(const char *request, size_t len, char *reply, size_t size) {
+    int fd = serve_connect();
+    if (fd < 0) return false;
+    bool ok = write_all(fd, request, len) && read_until(fd, reply, size, "\n") > 0;
+    close(fd);
+    if (!ok || !strchr(reply, '\n')) return false;
+    reply[strcspn(reply, "\n")] = '\0';
+    return strncmp(reply, "ok ", 3) == 0;
+}
+
+/*
+ * Client side of `nerd run`: ask a running daemon for the executable of
+ * `input`. False, quietly, if there is no daemon or it can't build it.
+ */
+bool serve_build(const char *input, const RunOptions *opts, char *bin, size_t size) {
+    char exe[1024], cwd[4096];
+    if (!toolchain_exe_path(exe, sizeof(exe)) || !getcwd(cwd, sizeof(cwd))) return false;
+    const char *nerd_path = getenv("NERD_PATH");
+
+    char request[SERVE_MAX_REQUEST];
+    int len = snprintf(request, sizeof(request),
+                       SERVE_HEADER "\nbuild\nexe %s\ncwd %s\nfile %s\npath %s\n%s%s%s%s%s%s%s%s%s\n",
+                       exe, cwd, input, nerd_path ? nerd_path : "",
+                       opts->opt_level ? "opt " : "", opts->opt_level ? opts->opt_level : "",
+                       opts->opt_level ? "\n" : "",
+                       opts->march ? "march " : "", opts->march ? opts->march : "",
+                       opts->march ? "\n" : "",
+                       opts->no_specialize ? "no-specialize\n" : "",
+                       opts->fast_math ? "fast-math\n" : "",
+                       opts->x86 ? "x86\n" : opts->bitcode ? "bitcode\n" : "");
+    if (len <= 0 || (size_t)len >= sizeof(request)) return false;
+
+    // A newline in any field would be read as another field
+    size_t fields = 0;
+    for (int i = 0; i < len; i++) {
+        if (request[i] == '\n') fields++;
+    }
+    size_t expected = 7 + (opts->opt_level != NULL) + (opts->march != NULL) + opts->no_specialize +
+                      opts->fast_math + (opts->x86 || opts->bitcode);
+    if (fields != expected) return false;
+
+    char reply[4096 + 8];
+    if (!serve_request(request, len, reply, sizeof(reply))) return false;
+    snprintf(bin, size, "%s", reply + 3);
+    return access(bin, X_OK) == 0;
+}
+
+int serve_stop(void) {
+    char reply[256];
+    const char *request = SERVE_HEADER "\nstop\n\n";
+    if (!serve_request(request, strlen(request), reply, sizeof(reply))) {
+        fprintf(stderr, "Error: No nerd serve is running\n");
+        return 1;
+    }
+    printf("Stopped nerd serve\n");
+    return 0;
+}
+
+int serve_status(void) {
+    char path[4096], reply[256];
+    const char *request = SERVE_HEADER "\nping\n\n";
+    if (!serve_socket_path(path, sizeof(path)) ||
+        !serve_request(request, strlen(request), reply, sizeof(reply))) {
+        printf("nerd serve is not running\n");
+        return 1;
+    }
+    printf("nerd serve is running on %s (%s requests served)\n", path, reply + 3);
+    return 0;
+}
+
+static void stamp_add(const char *path) {
+    Stamp *s = &server.stamps[server.stamp_count++];
+    struct stat st;
+    s->path = path;
+    s->size = stat(path, &st) == 0 ? st.st_size : -1;
+    s->mtime = s->size >= 0 ? st.st_mtime : 0;
+}
+
+/*
+ * Has the compiler or a runtime object changed since startup?
+ */
+static bool stamps_changed(void) {
+    for (int i = 0; i < server.stamp_count; i++) {
+        const Stamp *s = &server.stamps[i];
+        struct stat st;
+        off_t size = stat(s->path, &st) == 0 ? st.st_size : -1;
+        if (size != s->size || (size >= 0 && st.st_mtime != s->mtime)) return true;
+    }
+    return false;
+}
+
+static char *read_source(const char *path, size_t *len) {
+    FILE *f = fopen(path, "rb");
+    if (!f) return NULL;
+
+    fseek(f, 0, SEEK_END);
+    *len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    char *buf = malloc(*len + 1);
+    if (buf && fread(buf, 1, *len, f) != *len) {
+        free(buf);
+        buf = NULL;
+    }
+    if (buf) buf[*len] = '\0';
+    fclose(f);
+    return buf;
+}
+
+/*
+ * Build (or find) the executable for a `build` request. Returns NULL and
+ * the path in `bin`, or the reason it can't.
+ */
+static const char *serve_one(char *request, char *bin, size_t size) {
+    const char *exe = NULL, *cwd = NULL, *file = NULL, *nerd_path = NULL;
+    RunOptions opts = {0};
+
+    for (char *line = request; *line; ) {
+        char *next = line + strcspn(line, "\n");
+        if (*next) *next++ = '\0';
+        if (strncmp(line, "exe ", 4) == 0) exe = line + 4;
+        else if (strncmp(line, "cwd ", 4) == 0) cwd = line + 4;
+        else if (strncmp(line, "file ", 5) == 0) file = line + 5;
+        else if (strncmp(line, "path ", 5) == 0) nerd_path = line + 5;
+        else if (strncmp(line, "opt ", 4) == 0) opts.opt_level = line + 4;
+        else if (strncmp(line, "march ", 6) == 0) opts.march = line + 6;
+        else if (strcmp(line, "no-specialize") == 0) opts.no_specialize = true;
+        else if (strcmp(line, "fast-math") == 0) opts.fast_math = true;
+        else if (strcmp(line, "x86") == 0) opts.x86 = true;
+        else if (strcmp(line, "bitcode") == 0) opts.bitcode = true;
+        line = next;
+    }
+
+    if (!exe || !cwd || !file || !nerd_path) return "malformed request";
+    if (strcmp(exe, server.exe) != 0) return "different nerd binary";
+    if (strcmp(nerd_path, server.nerd_path) != 0) return "different NERD_PATH";
+    if (stamps_changed()) return "nerd or its runtime objects changed; restart nerd serve";
+
+    char input[8192];
+    snprintf(input, sizeof(input), "%s%s%s", file[0] == '/' ? "" : cwd, file[0] == '/' ? "" : "/", file);
+
+    size_t source_len;
+    char *source = read_source(input, &source_len);
+    if (!source) return "cannot read source";
+
+    CacheKey key;
+    run_cache_key(&key, &server.env, &opts, input, source, source_len);
+    if (cache_lookup(&key, bin, size)) {
+        free(source);
+        return NULL;
+    }
+
+    bool cached;
+    char *tmp_dir;
+    bool built = run_build(&server.env, &opts, input, source, source_len, &key, bin, size, &cached, &tmp_dir);
+    if (tmp_dir) {
+        toolchain_rmdir(tmp_dir);
+        free(tmp_dir);
+    } else if (built && !cached) {
+        remove(bin);
+    }
+    free(source);
+    return built && cached ? NULL : "build failed";
+}
+
+static void serve_client(int fd) {
+    struct timeval timeout = { .tv_sec = SERVE_TIMEOUT };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    char *request = malloc(SERVE_MAX_REQUEST);
+    if (!request) return;
+    size_t len = read_until(fd, request, SERVE_MAX_REQUEST, "\n\n");
+    char *body = request + strlen(SERVE_HEADER) + 1;
+
+    char reply[4096 + 64];
+    if (len < strlen(SERVE_HEADER) + 1 || strncmp(request, SERVE_HEADER "\n", strlen(SERVE_HEADER) + 1) != 0 ||
+        !strstr(request, "\n\n")) {
+        snprintf(reply, sizeof(reply), "error malformed request\n");
+    } else if (strncmp(body, "ping\n", 5) == 0) {
+        snprintf(reply, sizeof(reply), "ok %zu\n", atomic_load(&server.served));
+    } else if (strncmp(body, "stop\n", 5) == 0) {
+        snprintf(reply, sizeof(reply), "ok stopping\n");
+        atomic_store(&server.stopping, true);
+    } else if (strncmp(body, "build\n", 6) == 0) {
+        char bin[4096];
+        const char *error = serve_one(body + 6, bin, sizeof(bin));
+        if (error) {
+            snprintf(reply, sizeof(reply), "error %s\n", error);
+        } else {
+            snprintf(reply, sizeof(reply), "ok %s\n", bin);
+            atomic_fetch_add(&server.served, 1);
+        }
+    } else {
+        snprintf(reply, sizeof(reply), "error unknown request\n");
+    }
+
+    write_all(fd, reply, strlen(reply));
+    free(request);
+
+    // Wakes every worker blocked in accept
+    if (atomic_load(&server.stopping)) shutdown(server.fd, SHUT_RDWR);
+}
+
+/*
+ * Each worker accepts and serves connections until the socket is shut down
+ */
+static void *serve_worker(void *arg) {
+    (void)arg;
+    while (!atomic_load(&server.stopping)) {
+#ifdef __APPLE__
+        int fd = accept(server.fd, NULL, NULL);
+        if (fd >= 0) fcntl(fd, F_SETFD, FD_CLOEXEC);
+#else
+        int fd = accept4(server.fd, NULL, NULL, SOCK_CLOEXEC);
+#endif
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            break;
+        }
+        serve_client(fd);
+        close(fd);
+    }
+    return NULL;
+}
+
+static void on_signal(int sig) {
+    (void)sig;
+    if (listen_fd >= 0) shutdown(listen_fd, SHUT_RDWR);
+}
+
+/*
+ * `nerd serve`: listen until `nerd serve --stop`, SIGINT or SIGTERM
+ */
+int serve_main(int jobs) {
+    char path[4096];
+    if (!serve_socket_path(path, sizeof(path))) {
+        fprintf(stderr, "Error: Cannot determine the socket path (set NERD_SERVE_SOCKET)\n");
+        return 1;
+    }
+
+    int probe = serve_connect();
+    if (probe >= 0) {
+        close(probe);
+        fprintf(stderr, "Error: nerd serve is already running on %s\n", path);
+        return 1;
+    }
+
+    if (jobs <= 0) jobs = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (jobs < 1) jobs = 1;
+    if (jobs > SERVE_MAX_THREADS) jobs = SERVE_MAX_THREADS;
+
+    // Warm state: the key prefix and what it was computed from
+    run_env_init(&server.env);
+    if (!toolchain_exe_path(server.exe, sizeof(server.exe))) {
+        fprintf(stderr, "Error: Cannot locate the nerd executable\n");
+        return 1;
+    }
+    const char *nerd_path = getenv("NERD_PATH");
+    server.nerd_path = nerd_path ? nerd_path : "";
+    stamp_add(server.exe);
+    stamp_add(server.env.http_lib);
+    stamp_add(server.env.mcp_lib);
+    stamp_add(server.env.llm_lib);
+    atomic_init(&server.served, 0);
+    atomic_init(&server.stopping, false);
+
+    // A socket left behind by a daemon that was killed
+    unlink(path);
+
+    server.fd = cloexec_socket();
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    memcpy(addr.sun_path, path, strlen(path) + 1);
+    mode_t mask = umask(077);
+    bool bound = server.fd >= 0 && bind(server.fd, (struct sockaddr *)&addr, sizeof(addr)) == 0;
+    umask(mask);
+    if (!bound || listen(server.fd, 128) != 0) {
+        fprintf(stderr, "Error: Cannot listen on %s: %s\n", path, strerror(errno));
+        if (server.fd >= 0) close(server.fd);
+        return 1;
+    }
+    listen_fd = server.fd;
+
+    // Clients that hang up early must not kill the daemon
+    signal(SIGPIPE, SIG_IGN);
+    struct sigaction sa = { .sa_handler = on_signal };
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    printf("nerd serve: listening on %s (%d worker%s)\n", path, jobs, jobs == 1 ? "" : "s");
+    fflush(stdout);
+
+    pthread_t threads[SERVE_MAX_THREADS];
+    int started = 0;
+    for (int t = 1; t < jobs; t++) {
+        if (pthread_create(&threads[started], NULL, serve_worker, NULL) == 0) started++;
+    }
+    serve_worker(NULL);
+    for (int t = 0; t < started; t++) {
+        pthread_join(threads[t], NULL);
+    }
+
+    listen_fd = -1;
+    close(server.fd);
+    unlink(path);
+    printf("nerd serve: stopped after %zu requests\n", atomic_load(&server.served));
+    return 0;
+}
@@ -0,0 +1,712 @@
+/*
+ * NERD Specializer - Clones functions for constant call arguments
+ *
+ * A call like `call scale 3 x` is retargeted to a clone of `scale` whose
+ * first parameter has been replaced by the literal 3. Every function body
+ * is then constant-folded, so generic helpers called with literals turn
+ * into straight-line code before codegen ever sees them.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+#include "nerd.h"
+
+#define SPEC_MAX_CLONES 64      // clones per program
+#define SPEC_MAX_PER_FUNC 8     // clones per original function
+
+/*
+ * One specialization: callee + constant argument pattern -> clone
+ */
+typedef struct {
+    ASTNode *origin;    // original function
+    char *key;          // e.g. "scale(0x1.8p+1,_)"
+    char *clone_name;
+} SpecEntry;
+
+typedef struct {
+    ASTNode *program;
+    SpecEntry *entries;
+    size_t entry_count;
+    size_t entry_capacity;
+} Specializer;
+
+/*
+ * Constant helpers
+ */
+static bool is_const(ASTNode *node) {
+    return node && (node->type == NODE_NUM || node->type == NODE_BOOL);
+}
+
+static double const_value(ASTNode *node) {
+    if (node->type == NODE_BOOL) return node->data.boolean.value ? 1.0 : 0.0;
+    return node->data.num.value;
+}
+
+// Mirrors `fcmp one x, 0.0` used by codegen for conditions
+static bool const_truthy(double v) {
+    return v < 0.0 || v > 0.0;
+}
+
+/*
+ * Replace *slot with a number literal
+ */
+static void replace_with_num(ASTNode **slot, double value) {
+    ASTNode *num = ast_create(NODE_NUM, (*slot)->line);
+    num->data.num.value = value;
+    ast_free(*slot);
+    *slot = num;
+}
+
+/*
+ * Evaluate a binary operator on constants (same semantics as codegen)
+ */
+static bool fold_binop(const char *op, double l, double r, double *out) {
+    if (strcmp(op, "plus") == 0) *out = l + r;
+    else if (strcmp(op, "minus") == 0) *out = l - r;
+    else if (strcmp(op, "times") == 0) *out = l * r;
+    else if (strcmp(op, "over") == 0) *out = l / r;
+    else if (strcmp(op, "mod") == 0) *out = fmod(l, r);
+    else if (strcmp(op, "eq") == 0) *out = l == r;
+    else if (strcmp(op, "neq") == 0) *out = l < r || l > r;
+    else if (strcmp(op, "lt") == 0) *out = l < r;
+    else if (strcmp(op, "gt") == 0) *out = l > r;
+    else if (strcmp(op, "lte") == 0) *out = l <= r;
+    else if (strcmp(op, "gte") == 0) *out = l >= r;
+    else if (strcmp(op, "and") == 0) *out = const_truthy(l) && const_truthy(r);
+    else if (strcmp(op, "or") == 0) *out = const_truthy(l) || const_truthy(r);
+    else return false;
+    return true;
+}
+
+/*
+ * Evaluate a math module call on constants
+ */
+static bool fold_math(const char *func, ASTList *args, double *out) {
+    double a = const_value(args->nodes[0]);
+
+    if (strcmp(func, "abs") == 0) *out = fabs(a);
+    else if (strcmp(func, "sqrt") == 0) *out = sqrt(a);
+    else if (strcmp(func, "floor") == 0) *out = floor(a);
+    else if (strcmp(func, "ceil") == 0) *out = ceil(a);
+    else if (strcmp(func, "sin") == 0) *out = sin(a);
+    else if (strcmp(func, "cos") == 0) *out = cos(a);
+    else if (args->count > 1) {
+        double b = const_value(args->nodes[1]);
+        if (strcmp(func, "min") == 0) *out = fmin(a, b);
+        else if (strcmp(func, "max") == 0) *out = fmax(a, b);
+        else if (strcmp(func, "pow") == 0) *out = pow(a, b);
+        else return false;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Constant-fold an expression in place
+ */
+static void fold_expr(ASTNode **slot) {
+    ASTNode *node = *slot;
+    if (!node) return;
+
+    switch (node->type) {
+        case NODE_BOOL:
+            replace_with_num(slot, const_value(node));
+            break;
+
+        case NODE_BINOP: {
+            fold_expr(&node->data.binop.left);
+            fold_expr(&node->data.binop.right);
+            double v;
+            if (is_const(node->data.binop.left) && is_const(node->data.binop.right) &&
+                fold_binop(node->data.binop.op, const_value(node->data.binop.left),
+                           const_value(node->data.binop.right), &v)) {
+                replace_with_num(slot, v);
+            }
+            break;
+        }
+
+        case NODE_UNARYOP: {
+            fold_expr(&node->data.unaryop.operand);
+            if (!is_const(node->data.unaryop.operand)) break;
+            double v = const_value(node->data.unaryop.operand);
+            if (strcmp(node->data.unaryop.op, "not") == 0) {
+                replace_with_num(slot, v == 0.0);
+            } else if (strcmp(node->data.unaryop.op, "neg") == 0) {
+                replace_with_num(slot, 0.0 - v);
+            }
+            break;
+        }
+
+        case NODE_CALL: {
+            ASTList *args = &node->data.call.args;
+            bool all_const = args->count > 0;
+            for (size_t i = 0; i < args->count; i++) {
+                fold_expr(&args->nodes[i]);
+                if (!is_const(args->nodes[i])) all_const = false;
+            }
+            double v;
+            if (all_const && node->data.call.module &&
+                strcmp(node->data.call.module, "math") == 0 &&
+                fold_math(node->data.call.func, args, &v)) {
+                replace_with_num(slot, v);
+            }
+            break;
+        }
+
+        default:
+            break;
+    }
+}
+
+/*
+ * Statement placeholder for a branch that folded away
+ */
+static ASTNode *empty_stmt(int line) {
+    ASTNode *node = ast_create(NODE_EXPR_STMT, line);
+    node->data.expr_stmt.expr = ast_create(NODE_NUM, line);
+    return node;
+}
+
+static void fold_list(ASTList *list);
+
+/*
+ * Constant-fold a statement. Returns the replacement statement, which may
+ * be NULL when the statement folds away entirely.
+ */
+static ASTNode *fold_stmt(ASTNode *node) {
+    if (!node) return NULL;
+
+    switch (node->type) {
+        case NODE_RETURN:
+            fold_expr(&node->data.ret.value);
+            return node;
+
+        case NODE_OUT:
+            fold_expr(&node->data.out.value);
+            return node;
+
+        case NODE_LET:
+            fold_expr(&node->data.let.value);
+            return node;
+
+        case NODE_EXPR_STMT:
+            fold_expr(&node->data.expr_stmt.expr);
+            return node;
+
+        case NODE_INC:
+            fold_expr(&node->data.inc.amount);
+            return node;
+
+        case NODE_DEC:
+            fold_expr(&node->data.dec.amount);
+            return node;
+
+        case NODE_IF: {
+            fold_expr(&node->data.if_stmt.condition);
+            node->data.if_stmt.then_stmt = fold_stmt(node->data.if_stmt.then_stmt);
+            node->data.if_stmt.else_stmt = fold_stmt(node->data.if_stmt.else_stmt);
+
+            if (is_const(node->data.if_stmt.condition)) {
+                bool taken = const_truthy(const_value(node->data.if_stmt.condition));
+                ASTNode *branch = taken ? node->data.if_stmt.then_stmt : node->data.if_stmt.else_stmt;
+                if (taken) node->data.if_stmt.then_stmt = NULL;
+                else node->data.if_stmt.else_stmt = NULL;
+                ast_free(node);
+                return branch;
+            }
+
+            // Codegen requires a then branch
+            if (!node->data.if_stmt.then_stmt) {
+                node->data.if_stmt.then_stmt = empty_stmt(node->line);
+            }
+            return node;
+        }
+
+        case NODE_REPEAT:
+            fold_expr(&node->data.repeat.count);
+            if (is_const(node->data.repeat.count) && !(const_value(node->data.repeat.count) >= 1.0)) {
+                ast_free(node);
+                return NULL;
+            }
+            fold_list(&node->data.repeat.body);
+            return node;
+
+        case NODE_WHILE:
+            fold_expr(&node->data.while_loop.condition);
+            if (is_const(node->data.while_loop.condition) &&
+                !const_truthy(const_value(node->data.while_loop.condition))) {
+                ast_free(node);
+                return NULL;
+            }
+            fold_list(&node->data.while_loop.body);
+            return node;
+
+        default:
+            return node;
+    }
+}
+
+/*
+ * Fold a statement list, dropping removed statements and dead code after
+ * an unconditional return
+ */
+static void fold_list(ASTList *list) {
+    size_t out = 0;
+    for (size_t i = 0; i < list->count; i++) {
+        ASTNode *stmt = fold_stmt(list->nodes[i]);
+        if (!stmt) continue;
+        list->nodes[out++] = stmt;
+        if (stmt->type == NODE_RETURN) {
+            for (size_t j = i + 1; j < list->count; j++) {
+                ast_free(list->nodes[j]);
+            }
+            break;
+        }
+    }
+    list->count = out;
+}
+
+/*
+ * Name substitution. Reads of `names[i]` with `is_const[i]` set become
+ * `values[i]`; when `new_index` is given (parameters of a clone), the
+ * remaining positional references are renumbered to `new_index[i]`.
+ */
+typedef struct {
+    const char **names;
+    const bool *is_const;
+    const double *values;
+    const int *new_index;
+    size_t count;
+} Substitution;
+
+static void subst_list(ASTList *list, const Substitution *sub);
+
+static void subst_expr(ASTNode **slot, const Substitution *sub) {
+    ASTNode *node = *slot;
+    if (!node) return;
+
+    switch (node->type) {
+        case NODE_VAR:
+            for (size_t i = 0; i < sub->count; i++) {
+                if (sub->is_const[i] && strcmp(sub->names[i], node->data.var.name) == 0) {
+                    replace_with_num(slot, sub->values[i]);
+                    return;
+                }
+            }
+            break;
+        case NODE_POSITIONAL: {
+            int idx = node->data.positional.index;
+            if (!sub->new_index || idx < 0 || (size_t)idx >= sub->count) break;
+            if (sub->is_const[idx]) {
+                replace_with_num(slot, sub->values[idx]);
+            } else {
+                node->data.positional.index = sub->new_index[idx];
+            }
+            break;
+        }
+        case NODE_BINOP:
+            subst_expr(&node->data.binop.left, sub);
+            subst_expr(&node->data.binop.right, sub);
+            break;
+        case NODE_UNARYOP:
+            subst_expr(&node->data.unaryop.operand, sub);
+            break;
+        case NODE_CALL:
+            for (size_t i = 0; i < node->data.call.args.count; i++) {
+                subst_expr(&node->data.call.args.nodes[i], sub);
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+static void subst_stmt(ASTNode *node, const Substitution *sub) {
+    if (!node) return;
+
+    switch (node->type) {
+        case NODE_RETURN:
+            subst_expr(&node->data.ret.value, sub);
+            break;
+        case NODE_OUT:
+            subst_expr(&node->data.out.value, sub);
+            break;
+        case NODE_LET:
+            subst_expr(&node->data.let.value, sub);
+            break;
+        case NODE_EXPR_STMT:
+            subst_expr(&node->data.expr_stmt.expr, sub);
+            break;
+        case NODE_INC:
+            subst_expr(&node->data.inc.amount, sub);
+            break;
+        case NODE_DEC:
+            subst_expr(&node->data.dec.amount, sub);
+            break;
+        case NODE_IF:
+            subst_expr(&node->data.if_stmt.condition, sub);
+            subst_stmt(node->data.if_stmt.then_stmt, sub);
+            subst_stmt(node->data.if_stmt.else_stmt, sub);
+            break;
+        case NODE_REPEAT:
+            subst_expr(&node->data.repeat.count, sub);
+            subst_list(&node->data.repeat.body, sub);
+            break;
+        case NODE_WHILE:
+            subst_expr(&node->data.while_loop.condition, sub);
+            subst_list(&node->data.while_loop.body, sub);
+            break;
+        default:
+            break;
+    }
+}
+
+static void subst_list(ASTList *list, const Substitution *sub) {
+    for (size_t i = 0; i < list->count; i++) {
+        subst_stmt(list->nodes[i], sub);
+    }
+}
+
+/*
+ * Count assignments to a name (let/inc/dec/repeat as) in a statement list
+ */
+static size_t list_write_count(ASTList *list, const char *name);
+
+static size_t stmt_write_count(ASTNode *node, const char *name) {
+    if (!node) return 0;
+
+    switch (node->type) {
+        case NODE_LET:
+        case NODE_INC:
+        case NODE_DEC:
+            return ast_stmt_writes(node, name) ? 1 : 0;
+        case NODE_IF:
+            return stmt_write_count(node->data.if_stmt.then_stmt, name) +
+                   stmt_write_count(node->data.if_stmt.else_stmt, name);
+        case NODE_REPEAT: {
+            size_t count = 0;
+            if (node->data.repeat.var_name && strcmp(node->data.repeat.var_name, name) == 0) count++;
+            return count + list_write_count(&node->data.repeat.body, name);
+        }
+        case NODE_WHILE:
+            return list_write_count(&node->data.while_loop.body, name);
+        default:
+            return 0;
+    }
+}
+
+static size_t list_write_count(ASTList *list, const char *name) {
+    size_t count = 0;
+    for (size_t i = 0; i < list->count; i++) {
+        count += stmt_write_count(list->nodes[i], name);
+    }
+    return count;
+}
+
+/*
+ * Find a `let` with a constant value whose local is never reassigned and
+ * is not listed in `done`
+ */
+static ASTNode *find_const_let(ASTList *list, ASTNode *func, ASTList *done);
+
+static ASTNode *find_const_let_stmt(ASTNode *node, ASTNode *func, ASTList *done) {
+    if (!node) return NULL;
+
+    switch (node->type) {
+        case NODE_LET: {
+            if (!is_const(node->data.let.value)) return NULL;
+            for (size_t i = 0; i < done->count; i++) {
+                if (done->nodes[i] == node) return NULL;
+            }
+            const char *name = node->data.let.name;
+            ASTList *params = &func->data.func_def.params;
+            for (size_t i = 0; i < params->count; i++) {
+                if (strcmp(params->nodes[i]->data.param.name, name) == 0) return NULL;
+            }
+            if (list_write_count(&func->data.func_def.body, name) != 1) return NULL;
+            return node;
+        }
+        case NODE_IF: {
+            ASTNode *found = find_const_let_stmt(node->data.if_stmt.then_stmt, func, done);
+            return found ? found : find_const_let_stmt(node->data.if_stmt.else_stmt, func, done);
+        }
+        case NODE_REPEAT:
+            return find_const_let(&node->data.repeat.body, func, done);
+        case NODE_WHILE:
+            return find_const_let(&node->data.while_loop.body, func, done);
+        default:
+            return NULL;
+    }
+}
+
+static ASTNode *find_const_let(ASTList *list, ASTNode *func, ASTList *done) {
+    for (size_t i = 0; i < list->count; i++) {
+        ASTNode *found = find_const_let_stmt(list->nodes[i], func, done);
+        if (found) return found;
+    }
+    return NULL;
+}
+
+/*
+ * Fold a function body, propagating single-assignment constant locals
+ * until nothing changes
+ */
+static void fold_func(ASTNode *func) {
+    ASTList *body = &func->data.func_def.body;
+    ASTList done;
+    ast_list_init(&done);
+
+    fold_list(body);
+
+    ASTNode *let;
+    while ((let = find_const_let(body, func, &done)) != NULL) {
+        const char *name = let->data.let.name;
+        bool is_const_local = true;
+        double value = const_value(let->data.let.value);
+        Substitution sub = { &name, &is_const_local, &value, NULL, 1 };
+        subst_list(body, &sub);
+        ast_list_push(&done, let);
+        fold_list(body);
+    }
+
+    // `done` only borrows nodes from the body
+    free(done.nodes);
+}
+
+/*
+ * Find a user function by name
+ */
+static ASTNode *find_func(Specializer *sp, const char *name) {
+    ASTList *funcs = &sp->program->data.program.functions;
+    for (size_t i = 0; i < funcs->count; i++) {
+        if (strcmp(funcs->nodes[i]->data.func_def.name, name) == 0) {
+            return funcs->nodes[i];
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Create (or reuse) a clone of `callee` for the constant arguments of
+ * `call`. Returns the clone name, or NULL when nothing is specialized.
+ */
+static const char *specialize_call(Specializer *sp, ASTNode *callee, ASTNode *call) {
+    ASTList *params = &callee->data.func_def.params;
+    ASTList *args = &call->data.call.args;
+    size_t n = params->count;
+
+    bool *is_const_arg = calloc(n, sizeof(bool));
+    double *values = calloc(n, sizeof(double));
+    int *new_index = calloc(n, sizeof(int));
+    if (!is_const_arg || !values || !new_index) {
+        free(is_const_arg); free(values); free(new_index);
+        return NULL;
+    }
+
+    // Build the dedup key and decide which params become constants
+    size_t key_cap = strlen(callee->data.func_def.name) + 3 + n * 32;
+    char *key = malloc(key_cap);
+    size_t key_len = (size_t)snprintf(key, key_cap, "%s(", callee->data.func_def.name);
+    size_t const_count = 0;
+    int kept = 0;
+    for (size_t i = 0; i < n; i++) {
+        ASTNode *param = params->nodes[i];
+        if (is_const(args->nodes[i]) &&
+            !ast_list_writes(&callee->data.func_def.body, param->data.param.name)) {
+            is_const_arg[i] = true;
+            values[i] = const_value(args->nodes[i]);
+            key_len += (size_t)snprintf(key + key_len, key_cap - key_len, "%s%a", i ? "," : "", values[i]);
+            const_count++;
+        } else {
+            new_index[i] = kept++;
+            key_len += (size_t)snprintf(key + key_len, key_cap - key_len, "%s_", i ? "," : "");
+        }
+    }
+    snprintf(key + key_len, key_cap - key_len, ")");
+
+    const char *result = NULL;
+    if (const_count == 0) goto done;
+
+    // Reuse an existing clone with the same pattern
+    size_t per_func = 0;
+    for (size_t i = 0; i < sp->entry_count; i++) {
+        if (strcmp(sp->entries[i].key, key) == 0) {
+            result = sp->entries[i].clone_name;
+            goto done;
+        }
+        if (sp->entries[i].origin == callee) per_func++;
+    }
+
+    // Respect clone budgets
+    if (sp->entry_count >= SPEC_MAX_CLONES || per_func >= SPEC_MAX_PER_FUNC) goto done;
+
+    if (sp->entry_count >= sp->entry_capacity) {
+        sp->entry_capacity = sp->entry_capacity ? sp->entry_capacity * 2 : 8;
+        sp->entries = realloc(sp->entries, sizeof(SpecEntry) * sp->entry_capacity);
+    }
+
+    // Clone the function and drop the constant parameters
+    ASTNode *clone = ast_clone(callee);
+    size_t name_len = strlen(callee->data.func_def.name) + 32;
+    char *clone_name = malloc(name_len);
+    snprintf(clone_name, name_len, "%s.spec%zu", callee->data.func_def.name, per_func);
+    free(clone->data.func_def.name);
+    clone->data.func_def.name = clone_name;
+    clone->data.func_def.specialized = true;
+
+    ASTList *clone_params = &clone->data.func_def.params;
+    const char **names = malloc(sizeof(char*) * n);
+    for (size_t i = 0; i < n; i++) {
+        names[i] = clone_params->nodes[i]->data.param.name;
+    }
+    Substitution sub = { names, is_const_arg, values, new_index, n };
+    subst_list(&clone->data.func_def.body, &sub);
+    free(names);
+
+    size_t out = 0;
+    for (size_t i = 0; i < clone_params->count; i++) {
+        if (is_const_arg[i]) {
+            ast_free(clone_params->nodes[i]);
+        } else {
+            clone_params->nodes[out++] = clone_params->nodes[i];
+        }
+    }
+    clone_params->count = out;
+
+    ast_list_push(&sp->program->data.program.functions, clone);
+
+    SpecEntry *entry = &sp->entries[sp->entry_count++];
+    entry->origin = callee;
+    entry->key = key;
+    entry->clone_name = clone_name;
+    key = NULL;
+    result = clone_name;
+
+done:
+    // Retarget the call site and drop the now-constant arguments
+    if (result) {
+        free(call->data.call.func);
+        call->data.call.func = nerd_strdup(result);
+        size_t out_args = 0;
+        for (size_t i = 0; i < args->count; i++) {
+            if (is_const_arg[i]) {
+                ast_free(args->nodes[i]);
+            } else {
+                args->nodes[out_args++] = args->nodes[i];
+            }
+        }
+        args->count = out_args;
+    }
+
+    free(key);
+    free(is_const_arg);
+    free(values);
+    free(new_index);
+    return result;
+}
+
+/*
+ * Walk calls in a function body and specialize those with constant args
+ */
+static void spec_list(Specializer *sp, ASTList *list);
+
+static void spec_expr(Specializer *sp, ASTNode *node) {
+    if (!node) return;
+
+    switch (node->type) {
+        case NODE_BINOP:
+            spec_expr(sp, node->data.binop.left);
+            spec_expr(sp, node->data.binop.right);
+            break;
+        case NODE_UNARYOP:
+            spec_expr(sp, node->data.unaryop.operand);
+            break;
+        case NODE_CALL: {
+            for (size_t i = 0; i < node->data.call.args.count; i++) {
+                spec_expr(sp, node->data.call.args.nodes[i]);
+            }
+            if (node->data.call.module) break;
+
+            ASTNode *callee = find_func(sp, node->data.call.func);
+            if (callee && !callee->data.func_def.specialized &&
+                strcmp(callee->data.func_def.name, "main") != 0 &&
+                callee->data.func_def.params.count == node->data.call.args.count) {
+                specialize_call(sp, callee, node);
+            }
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+static void spec_stmt(Specializer *sp, ASTNode *node) {
+    if (!node) return;
+
+    switch (node->type) {
+        case NODE_RETURN:
+            spec_expr(sp, node->data.ret.value);
+            break;
+        case NODE_OUT:
+            spec_expr(sp, node->data.out.value);
+            break;
+        case NODE_LET:
+            spec_expr(sp, node->data.let.value);
+            break;
+        case NODE_EXPR_STMT:
+            spec_expr(sp, node->data.expr_stmt.expr);
+            break;
+        case NODE_INC:
+            spec_expr(sp, node->data.inc.amount);
+            break;
+        case NODE_DEC:
+            spec_expr(sp, node->data.dec.amount);
+            break;
+        case NODE_IF:
+            spec_expr(sp, node->data.if_stmt.condition);
+            spec_stmt(sp, node->data.if_stmt.then_stmt);
+            spec_stmt(sp, node->data.if_stmt.else_stmt);
+            break;
+        case NODE_REPEAT:
+            spec_expr(sp, node->data.repeat.count);
+            spec_list(sp, &node->data.repeat.body);
+            break;
+        case NODE_WHILE:
+            spec_expr(sp, node->data.while_loop.condition);
+            spec_list(sp, &node->data.while_loop.body);
+            break;
+        default:
+            break;
+    }
+}
+
+static void spec_list(Specializer *sp, ASTList *list) {
+    for (size_t i = 0; i < list->count; i++) {
+        spec_stmt(sp, list->nodes[i]);
+    }
+}
+
+/*
+ * Specialize a program in place. Clones are appended to the function list
+ * and processed in turn, so constants keep propagating through call chains
+ * until the clone budget runs out.
+ */
+void specialize_program(ASTNode *program) {
+    Specializer sp = {0};
+    sp.program = program;
+
+    ASTList *funcs = &program->data.program.functions;
+    for (size_t i = 0; i < funcs->count; i++) {
+        ASTNode *func = funcs->nodes[i];
+        fold_func(func);
+        spec_list(&sp, &func->data.func_def.body);
+    }
+
+    for (size_t i = 0; i < sp.entry_count; i++) {
+        free(sp.entries[i].key);
+    }
+    free(sp.entries);
+}
@@ -0,0 +1,128 @@
+/*
+ * NERD Target Description - Host triple, datalayout and CPU features
+ *
+ * Used by `--march` to stamp the generated module with the host target,
+ * so LLVM can select FMA and wide vector instructions. The triple and
+ * datalayout come from the Makefile (queried from the installed clang)
+ * when available. Otherwise the triple comes from the table below and the
+ * datalayout is left out: its string changes between LLVM releases, and
+ * clang fills in its own from the triple.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include "nerd.h"
+
+#if defined(__x86_64__) && defined(__APPLE__)
+#define HOST_TRIPLE "x86_64-apple-macosx"
+#elif defined(__x86_64__)
+#define HOST_TRIPLE "x86_64-pc-linux-gnu"
+#elif defined(__aarch64__) && defined(__APPLE__)
+#define HOST_TRIPLE "arm64-apple-macosx"
+#elif defined(__aarch64__)
+#define HOST_TRIPLE "aarch64-unknown-linux-gnu"
+#endif
+
+// Build-time values from the toolchain take precedence
+#if defined(NERD_HOST_TRIPLE) && defined(NERD_HOST_DATALAYOUT)
+#undef HOST_TRIPLE
+#define HOST_TRIPLE NERD_HOST_TRIPLE
+#define HOST_DATALAYOUT NERD_HOST_DATALAYOUT
+#endif
+
+static void add_feature(TargetInfo *t, const char *feature) {
+    size_t len = strlen(t->features);
+    snprintf(t->features + len, sizeof(t->features) - len, "%s+%s", len ? "," : "", feature);
+}
+
+/*
+ * Detect the host CPU. x86 hosts map onto the x86-64 micro-architecture
+ * levels (v2/v3/v4) plus the individual features we can probe.
+ */
+static void detect_host_cpu(TargetInfo *t) {
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+    __builtin_cpu_init();
+
+    static const char *probe[] = {
+        "sse3", "ssse3", "sse4.1", "sse4.2", "popcnt", "aes", "pclmul",
+        "avx", "avx2", "fma", "bmi", "bmi2",
+        "avx512f", "avx512cd", "avx512bw", "avx512dq", "avx512vl",
+    };
+    bool has[sizeof(probe) / sizeof(probe[0])];
+
+    // __builtin_cpu_supports needs a string literal, so probe one by one
+    has[0] = __builtin_cpu_supports("sse3");
+    has[1] = __builtin_cpu_supports("ssse3");
+    has[2] = __builtin_cpu_supports("sse4.1");
+    has[3] = __builtin_cpu_supports("sse4.2");
+    has[4] = __builtin_cpu_supports("popcnt");
+    has[5] = __builtin_cpu_supports("aes");
+    has[6] = __builtin_cpu_supports("pclmul");
+    has[7] = __builtin_cpu_supports("avx");
+    has[8] = __builtin_cpu_supports("avx2");
+    has[9] = __builtin_cpu_supports("fma");
+    has[10] = __builtin_cpu_supports("bmi");
+    has[11] = __builtin_cpu_supports("bmi2");
+    has[12] = __builtin_cpu_supports("avx512f");
+    has[13] = __builtin_cpu_supports("avx512cd");
+    has[14] = __builtin_cpu_supports("avx512bw");
+    has[15] = __builtin_cpu_supports("avx512dq");
+    has[16] = __builtin_cpu_supports("avx512vl");
+
+    add_feature(t, "sse2");
+    for (size_t i = 0; i < sizeof(probe) / sizeof(probe[0]); i++) {
+        if (has[i]) add_feature(t, probe[i]);
+    }
+
+    bool v2 = has[1] && has[3] && has[4];
+    bool v3 = v2 && has[7] && has[8] && has[9] && has[10] && has[11];
+    bool v4 = v3 && has[12] && has[13] && has[14] && has[15] && has[16];
+    snprintf(t->cpu, sizeof(t->cpu), "%s",
+             v4 ? "x86-64-v4" : v3 ? "x86-64-v3" : v2 ? "x86-64-v2" : "x86-64");
+#elif defined(__aarch64__) && defined(__APPLE__)
+    snprintf(t->cpu, sizeof(t->cpu), "apple-m1");
+    add_feature(t, "neon");
+    add_feature(t, "fp-armv8");
+#elif defined(__aarch64__)
+    snprintf(t->cpu, sizeof(t->cpu), "generic");
+    add_feature(t, "neon");
+    add_feature(t, "fp-armv8");
+#else
+    snprintf(t->cpu, sizeof(t->cpu), "generic");
+#endif
+}
+
+/*
+ * Describe the host target for `march` ("native" or an LLVM CPU name).
+ * Returns false if the host is unknown or the CPU name is malformed.
+ */
+bool target_host(const char *march, TargetInfo *t) {
+    memset(t, 0, sizeof(*t));
+
+#ifdef HOST_TRIPLE
+    t->triple = HOST_TRIPLE;
+#ifdef HOST_DATALAYOUT
+    t->datalayout = HOST_DATALAYOUT;
+#endif
+#else
+    return false;
+#endif
+
+    if (strcmp(march, "native") == 0) {
+        detect_host_cpu(t);
+        return true;
+    }
+
+    // Explicit CPU: let LLVM derive the features from its own tables
+    size_t len = strlen(march);
+    if (len == 0 || len >= sizeof(t->cpu)) return false;
+    for (size_t i = 0; i < len; i++) {
+        char c = march[i];
+        bool ok = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+                  (c >= '0' && c <= '9') || c == '-' || c == '_' || c == '.';
+        if (!ok) return false;
+    }
+    memcpy(t->cpu, march, len + 1);
+    return true;
+}
@@ -0,0 +1,296 @@
+/*
+ * NERD Tiered Execution - Background native compilation of hot functions
+ *
+ * With `--tiered`, the interpreter counts calls and loop back-edges per
+ * function. A function crossing NERD_TIER_THRESHOLD is queued here; a
+ * worker thread runs it (plus everything it calls) through codegen_llvm
+ * and clang into a shared object, dlopens it and publishes the entry
+ * points. From then on the VM's CALL goes straight to native code.
+ *
+ * There is no on-stack replacement: a frame that is already running keeps
+ * interpreting, only later calls switch. Functions that touch the network
+ * runtime and `main` stay interpreted.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <signal.h>
+#include <time.h>
+#include <pthread.h>
+#include <dlfcn.h>
+#include "nerd.h"
+
+#define TIER_MAX_ARGS 8     // arities the VM can call natively
+
+enum {
+    TIER_COLD,
+    TIER_QUEUED,            // queued, compiling or compiled
+    TIER_REJECTED,          // not eligible or failed to compile
+};
+
+struct Tier {
+    BcProgram *prog;
+    ASTNode *program;
+    uint8_t *state;         // per function, main thread only
+    bool log;
+
+    pthread_t thread;
+    bool started;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int *queue;
+    size_t queue_count;
+    size_t queue_capacity;
+    bool stopping;          // guarded by lock
+    int clang_pid;          // running compile (0 if none), guarded by lock
+
+    // Worker thread only
+    char *dir;
+    int module_count;
+    bool broken;            // clang unavailable: stop trying
+};
+
+/*
+ * Functions reachable from `root` through CALL, root first.
+ * Returns false if any of them can't run natively (also used by bench.c).
+ */
+bool tier_closure(BcProgram *prog, int root, int **out, size_t *count) {
+    bool *seen = calloc(prog->func_count, sizeof(bool));
+    int *list = malloc(sizeof(int) * prog->func_count);
+    size_t n = 0;
+    bool ok = true;
+
+    list[n++] = root;
+    seen[root] = true;
+    for (size_t i = 0; i < n && ok; i++) {
+        BcFunc *fn = &prog->funcs[list[i]];
+        if (list[i] == prog->main_index) ok = false;
+        for (size_t pc = 0; pc < fn->code_count && ok; pc++) {
+            const BcInstr *ins = &fn->code[pc];
+            switch (ins->op) {
+                case BC_HTTP_GET: case BC_HTTP_GETALL: case BC_HTTP_POST: case BC_MCP_TOOLS:
+                case BC_MCP_SEND: case BC_MCP_INIT: case BC_LLM_CLAUDE: case BC_LLM_SYSTEM:
+                    ok = false;
+                    break;
+                case BC_CALL:
+                    if (!seen[ins->b]) {
+                        seen[ins->b] = true;
+                        list[n++] = ins->b;
+                    }
+                    break;
+                default:
+                    break;
+            }
+        }
+    }
+
+    free(seen);
+    if (!ok) {
+        free(list);
+        return false;
+    }
+    *out = list;
+    *count = n;
+    return true;
+}
+
+static double elapsed_ms(const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1e3 + (now.tv_nsec - start->tv_nsec) / 1e6;
+}
+
+/*
+ * Compile `root` and its callees into a shared object and publish them
+ */
+static void compile_job(Tier *tier, int root) {
+    BcProgram *prog = tier->prog;
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    int *funcs;
+    size_t count;
+    if (tier->broken || !tier_closure(prog, root, &funcs, &count)) return;
+
+    if (!tier->dir) {
+        tier->dir = toolchain_tmpdir();
+        if (!tier->dir) {
+            tier->broken = true;
+            free(funcs);
+            return;
+        }
+    }
+
+    // Module with just these functions (nodes are borrowed from the AST,
+    // which is already specialized and is not touched by the VM)
+    ASTNode module = {0};
+    module.type = NODE_PROGRAM;
+    ast_list_init(&module.data.program.types);
+    ast_list_init(&module.data.program.functions);
+    for (size_t i = 0; i < count; i++) {
+        ast_list_push(&module.data.program.functions, tier->program->data.program.functions.nodes[funcs[i]]);
+    }
+
+    char so_path[4096];
+    snprintf(so_path, sizeof(so_path), "%s/tier%d.so", tier->dir, tier->module_count++);
+
+    char *clang_argv[] = {
+        "clang", "-w", "-O2", "-shared", "-fPIC",
+#ifndef __APPLE__
+        "-Wl,-Bsymbolic",   // calls inside the module must not bind to libm & co
+#endif
+        "-o", so_path, "-x", "ir", "-", NULL,
+    };
+
+    NerdContext ctx = {0};
+    ctx.ast = &module;
+    ctx.no_specialize = true;
+
+    FILE *ir = NULL;
+    int pid;
+    bool ok = false;
+    bool stopping = false;
+    if (toolchain_spawn(clang_argv, &ir, &pid)) {
+        pthread_mutex_lock(&tier->lock);
+        tier->clang_pid = pid;
+        stopping = tier->stopping;
+        pthread_mutex_unlock(&tier->lock);
+        if (stopping) kill(pid, SIGTERM);
+
+        bool generated = codegen_llvm_stream(&ctx, ir);
+        fclose(ir);
+        int status = toolchain_wait(pid);
+
+        pthread_mutex_lock(&tier->lock);
+        tier->clang_pid = 0;
+        stopping = tier->stopping;
+        pthread_mutex_unlock(&tier->lock);
+
+        ok = generated && status == 0 && !stopping;
+    } else {
+        tier->broken = true;
+    }
+    free(ctx.error_msg);
+    free(module.data.program.functions.nodes);
+
+    void *handle = ok ? dlopen(so_path, RTLD_NOW | RTLD_LOCAL) : NULL;
+    if (handle) {
+        for (size_t i = 0; i < count; i++) {
+            BcFunc *fn = &prog->funcs[funcs[i]];
+            if (fn->param_count > TIER_MAX_ARGS) continue;
+            void *entry = dlsym(handle, fn->name);
+            void *expected = NULL;
+            if (entry) {
+                atomic_compare_exchange_strong_explicit(&fn->native, &expected, entry,
+                                                        memory_order_release, memory_order_relaxed);
+            }
+        }
+    }
+
+    if (tier->log && !stopping) {
+        fprintf(stderr, "tier: %s '%s' (+%zu callees) in %.0f ms\n",
+                handle ? "compiled" : "failed to compile", prog->funcs[root].name,
+                count - 1, elapsed_ms(&start));
+    }
+    free(funcs);
+}
+
+static void *worker_main(void *arg) {
+    Tier *tier = arg;
+
+    pthread_mutex_lock(&tier->lock);
+    for (;;) {
+        while (tier->queue_count == 0 && !tier->stopping) {
+            pthread_cond_wait(&tier->cond, &tier->lock);
+        }
+        if (tier->stopping) break;
+
+        int job = tier->queue[0];
+        tier->queue_count--;
+        memmove(tier->queue, tier->queue + 1, sizeof(int) * tier->queue_count);
+        pthread_mutex_unlock(&tier->lock);
+
+        compile_job(tier, job);
+
+        pthread_mutex_lock(&tier->lock);
+    }
+    pthread_mutex_unlock(&tier->lock);
+    return NULL;
+}
+
+/*
+ * Start tiering for a program compiled from `program`
+ */
+Tier *tier_start(BcProgram *prog, ASTNode *program) {
+    Tier *tier = calloc(1, sizeof(Tier));
+    if (!tier) return NULL;
+
+    tier->prog = prog;
+    tier->program = program;
+    tier->state = calloc(prog->func_count ? prog->func_count : 1, 1);
+    const char *log = getenv("NERD_TIER_LOG");
+    tier->log = log && log[0] && strcmp(log, "0") != 0;
+    pthread_mutex_init(&tier->lock, NULL);
+    pthread_cond_init(&tier->cond, NULL);
+
+    // A clang killed at shutdown must not take us down with SIGPIPE
+    signal(SIGPIPE, SIG_IGN);
+    return tier;
+}
+
+/*
+ * Hot function reported by the VM (main thread)
+ */
+void tier_hot(Tier *tier, int func) {
+    if (!tier || tier->state[func] != TIER_COLD) return;
+
+    int *closure;
+    size_t count;
+    if (tier->prog->funcs[func].param_count > TIER_MAX_ARGS ||
+        !tier_closure(tier->prog, func, &closure, &count)) {
+        tier->state[func] = TIER_REJECTED;
+        return;
+    }
+    free(closure);
+    tier->state[func] = TIER_QUEUED;
+
+    pthread_mutex_lock(&tier->lock);
+    if (tier->queue_count >= tier->queue_capacity) {
+        tier->queue_capacity = tier->queue_capacity ? tier->queue_capacity * 2 : 8;
+        tier->queue = realloc(tier->queue, sizeof(int) * tier->queue_capacity);
+    }
+    tier->queue[tier->queue_count++] = func;
+    if (!tier->started) {
+        tier->started = pthread_create(&tier->thread, NULL, worker_main, tier) == 0;
+    }
+    pthread_cond_signal(&tier->cond);
+    pthread_mutex_unlock(&tier->lock);
+}
+
+/*
+ * Stop the worker (killing an in-flight clang) and remove its files
+ */
+void tier_stop(Tier *tier) {
+    if (!tier) return;
+
+    pthread_mutex_lock(&tier->lock);
+    tier->stopping = true;
+    if (tier->clang_pid > 0) kill(tier->clang_pid, SIGTERM);
+    pthread_cond_signal(&tier->cond);
+    pthread_mutex_unlock(&tier->lock);
+
+    if (tier->started) pthread_join(tier->thread, NULL);
+
+    if (tier->dir) {
+        toolchain_rmdir(tier->dir);
+        free(tier->dir);
+    }
+    pthread_mutex_destroy(&tier->lock);
+    pthread_cond_destroy(&tier->cond);
+    free(tier->queue);
+    free(tier->state);
+    free(tier);
+}
@@ -0,0 +1,250 @@
+/*
+ * NERD Toolchain - Temp directories, runtime lookup and process spawning
+ *
+ * `nerd run` drives clang and the compiled program directly with
+ * posix_spawn: no shell, and each run gets its own mkdtemp directory so
+ * concurrent runs never share paths.
+ *
+ * `nerd serve` and the build pool spawn from several threads at once, so
+ * descriptors are created close-on-exec atomically (pipe2) rather than
+ * flagged afterwards, when another thread's child may already have them.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#ifdef __APPLE__
+#include <mach-o/dyld.h>
+#endif
+#include "nerd.h"
+
+// posix_spawn can set the child's working directory (glibc 2.29, macOS 10.15)
+#if defined(__GLIBC__)
+#if __GLIBC_PREREQ(2, 29)
+#define HAVE_SPAWN_CHDIR 1
+#endif
+#elif defined(__APPLE__)
+#define HAVE_SPAWN_CHDIR 1
+#endif
+
+extern char **environ;
+
+/*
+ * Create a private temp directory under $TMPDIR (or /tmp)
+ */
+char *toolchain_tmpdir(void) {
+    const char *base = getenv("TMPDIR");
+    if (!base || !base[0]) base = "/tmp";
+
+    size_t len = strlen(base) + sizeof("/nerd-XXXXXX");
+    char *dir = malloc(len);
+    if (!dir) return NULL;
+    snprintf(dir, len, "%s/nerd-XXXXXX", base);
+
+    if (!mkdtemp(dir)) {
+        fprintf(stderr, "Error: Cannot create temp directory in '%s': %s\n", base, strerror(errno));
+        free(dir);
+        return NULL;
+    }
+    return dir;
+}
+
+/*
+ * Remove a temp directory and the files directly inside it
+ */
+void toolchain_rmdir(const char *dir) {
+    DIR *d = opendir(dir);
+    if (d) {
+        struct dirent *ent;
+        while ((ent = readdir(d)) != NULL) {
+            if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0) continue;
+            char path[4096];
+            snprintf(path, sizeof(path), "%s/%s", dir, ent->d_name);
+            unlink(path);
+        }
+        closedir(d);
+    }
+    rmdir(dir);
+}
+
+/*
+ * Path of the running nerd executable
+ */
+bool toolchain_exe_path(char *buf, size_t size) {
+#ifdef __APPLE__
+    uint32_t len = (uint32_t)size;
+    return _NSGetExecutablePath(buf, &len) == 0;
+#else
+    ssize_t len = readlink("/proc/self/exe", buf, size - 1);
+    if (len < 0) return false;
+    buf[len] = '\0';
+    return true;
+#endif
+}
+
+/*
+ * Directory holding the nerd executable (runtime objects live in its
+ * build/ subdirectory). Includes the trailing slash.
+ */
+bool toolchain_runtime_dir(char *buf, size_t size) {
+    if (!toolchain_exe_path(buf, size)) return false;
+
+    char *last_slash = strrchr(buf, '/');
+    if (!last_slash) return false;
+    *(last_slash + 1) = '\0';
+    return true;
+}
+
+/*
+ * Spawn argv[0] from PATH. If stdin_pipe is non-NULL, the child's stdin is
+ * connected to a pipe returned there for writing.
+ */
+bool toolchain_spawn(char *const argv[], FILE **stdin_pipe, int *pid) {
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+
+    int fds[2] = {-1, -1};
+    if (stdin_pipe) {
+        // Not inherited by children other threads spawn (`nerd serve`), or
+        // their clang would hold our pipe open and ours never see EOF
+#ifdef __APPLE__
+        bool piped = pipe(fds) == 0;
+        if (piped) {
+            fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+            fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+        }
+#else
+        bool piped = pipe2(fds, O_CLOEXEC) == 0;
+#endif
+        if (!piped) {
+            fprintf(stderr, "Error: Cannot create pipe: %s\n", strerror(errno));
+            posix_spawn_file_actions_destroy(&actions);
+            return false;
+        }
+        posix_spawn_file_actions_adddup2(&actions, fds[0], STDIN_FILENO);
+    }
+
+    pid_t child;
+    int err = posix_spawnp(&child, argv[0], &actions, NULL, argv, environ);
+    posix_spawn_file_actions_destroy(&actions);
+
+    if (stdin_pipe) close(fds[0]);
+    if (err != 0) {
+        fprintf(stderr, "Error: Cannot run '%s': %s\n", argv[0], strerror(err));
+        if (stdin_pipe) close(fds[1]);
+        return false;
+    }
+
+    if (stdin_pipe) {
+        *stdin_pipe = fdopen(fds[1], "w");
+        if (!*stdin_pipe) {
+            close(fds[1]);
+            toolchain_wait(child);
+            return false;
+        }
+    }
+    *pid = child;
+    return true;
+}
+
+#ifndef HAVE_SPAWN_CHDIR
+/*
+ * Resolve `name` the way execvp would, for the fork fallback below
+ */
+static bool find_in_path(const char *name, char *buf, size_t size) {
+    if (strchr(name, '/')) {
+        snprintf(buf, size, "%s", name);
+        return true;
+    }
+    const char *search = getenv("PATH");
+    if (!search || !*search) search = "/usr/bin:/bin";
+    while (*search) {
+        size_t len = strcspn(search, ":");
+        int n = len ? snprintf(buf, size, "%.*s/%s", (int)len, search, name)
+                    : snprintf(buf, size, "%s", name);
+        if (n > 0 && (size_t)n < size && access(buf, X_OK) == 0) return true;
+        search += len;
+        if (*search == ':') search++;
+    }
+    return false;
+}
+#endif
+
+/*
+ * Spawn argv[0] from PATH with `dir` as its working directory (for tools
+ * that name their outputs after their inputs, like `clang -c a.ll b.ll`)
+ */
+bool toolchain_spawn_in(char *const argv[], const char *dir, int *pid) {
+#ifdef HAVE_SPAWN_CHDIR
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addchdir_np(&actions, dir);
+
+    pid_t child;
+    int err = posix_spawnp(&child, argv[0], &actions, NULL, argv, environ);
+    posix_spawn_file_actions_destroy(&actions);
+    if (err != 0) {
+        fprintf(stderr, "Error: Cannot run '%s' in '%s': %s\n", argv[0], dir, strerror(err));
+        return false;
+    }
+    *pid = child;
+    return true;
+#else
+    // The caller may be multithreaded, so the child only calls
+    // async-signal-safe functions: the PATH search and the error message
+    // are done before the fork
+    char path[4096];
+    if (!find_in_path(argv[0], path, sizeof(path))) {
+        fprintf(stderr, "Error: Cannot run '%s': not found in PATH\n", argv[0]);
+        return false;
+    }
+    char msg[4096 + 64];
+    int msg_len = snprintf(msg, sizeof(msg), "Error: Cannot run '%s' in '%s'\n", argv[0], dir);
+    if (msg_len < 0 || (size_t)msg_len >= sizeof(msg)) msg_len = 0;
+
+    fflush(NULL);
+    pid_t child = fork();
+    if (child < 0) {
+        fprintf(stderr, "Error: Cannot run '%s': %s\n", argv[0], strerror(errno));
+        return false;
+    }
+    if (child == 0) {
+        if (chdir(dir) == 0) execve(path, argv, environ);
+        ssize_t written = write(STDERR_FILENO, msg, (size_t)msg_len);
+        (void)written;
+        _exit(127);
+    }
+    *pid = child;
+    return true;
+#endif
+}
+
+/*
+ * Replace this process with argv[0]. Only returns on failure.
+ */
+void toolchain_exec(char *const argv[]) {
+    fflush(NULL);
+    execv(argv[0], argv);
+}
+
+/*
+ * Wait for a spawned process. Returns its exit status, or 128 + signal
+ * number if it was killed (shell convention).
+ */
+int toolchain_wait(int pid) {
+    int status;
+    while (waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR) return -1;
+    }
+    if (WIFEXITED(status)) return WEXITSTATUS(status);
+    if (WIFSIGNALED(status)) return 128 + WTERMSIG(status);
+    return -1;
+}
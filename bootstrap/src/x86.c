@@ -0,0 +1,978 @@
+/*
+ * NERD x86-64 Backend - Machine code straight from bytecode, no clang
+ *
+ * `--backend=x86` lowers the register bytecode from bytecode.c one
+ * instruction at a time and writes an ELF relocatable object (elf.c) for
+ * the system linker. Every value is a double, so XMM is the only register
+ * class: bytecode registers get live intervals and a linear scan assigns
+ * xmm8-xmm15, spilling the rest to the frame. SysV preserves no XMM
+ * registers across calls, so anything live across a call (including libm
+ * and printf) lives in the frame. xmm0-xmm7 carry arguments and xmm0/xmm1
+ * double as scratch, which is why allocation starts at xmm8.
+ *
+ * The aim is compile speed for the edit-run loop; `nerd run -O2` still
+ * produces the faster code.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include "nerd.h"
+
+#define X86_FIRST_ALLOC 8       // xmm8..xmm15 are allocatable
+#define X86_ALLOC_COUNT 8
+#define X86_MAX_ARGS 8          // arguments passed in xmm0..xmm7, the rest on the stack
+
+// SSE2 opcodes (after the 0x0F escape)
+#define OP_CVTSI2SD 0x2A
+#define OP_UCOMISD 0x2E
+#define OP_MOVSD_LOAD 0x10
+#define OP_MOVSD_STORE 0x11
+#define OP_SQRTSD 0x51
+#define OP_ANDPD 0x54
+#define OP_XORPD 0x57
+#define OP_ADDSD 0x58
+#define OP_MULSD 0x59
+#define OP_SUBSD 0x5C
+#define OP_DIVSD 0x5E
+
+// Condition codes (low nibble of Jcc / SETcc)
+#define CC_B 0x2
+#define CC_AE 0x3
+#define CC_E 0x4
+#define CC_NE 0x5
+#define CC_A 0x7
+#define CC_P 0xA
+#define CC_NP 0xB
+#define CC_ALWAYS -1
+
+enum { RAX = 0, RCX = 1, RDX = 2, RSI = 6, RDI = 7 };
+
+typedef struct {
+    bool in_reg;
+    int reg;                // xmm number
+    int32_t disp;           // [rbp + disp] when not in a register
+} Loc;
+
+typedef struct {
+    int vreg;
+    int start;
+    int end;
+} Interval;
+
+typedef struct {
+    size_t pos;             // rel32 field in .text
+    int target;             // bytecode pc (jumps) or function index (calls)
+} Fixup;
+
+typedef struct {
+    ElfObject obj;
+    BcProgram *prog;
+    bool emit_entry;
+    bool failed;
+
+    // Current function
+    BcFunc *fn;
+    Loc *locs;
+    size_t *pc_offset;
+    Fixup *jumps;
+    size_t jump_count;
+    size_t jump_capacity;
+    int32_t scratch;        // frame slot for runtime pointers
+
+    // Whole program
+    size_t *func_offset;
+    Fixup *calls;
+    size_t call_count;
+    size_t call_capacity;
+    size_t *string_symbol;  // per string literal, SIZE_MAX until used
+    size_t fmt_num;
+    size_t fmt_entry;
+    int *regs;              // instr_regs output, sized for the widest call
+} X86;
+
+static void fail(X86 *x, const char *fmt, const char *arg) {
+    if (!x->failed) {
+        fprintf(nerd_diag(), "Error: x86 backend: ");
+        fprintf(nerd_diag(), fmt, arg);
+        fprintf(nerd_diag(), "\n");
+    }
+    x->failed = true;
+}
+
+/*
+ * Raw emission
+ */
+static size_t here(X86 *x) {
+    return x->obj.text.size;
+}
+
+static void emit8(X86 *x, uint8_t b) {
+    elf_append(&x->obj.text, &b, 1);
+}
+
+static void emit32(X86 *x, uint32_t v) {
+    for (int i = 0; i < 4; i++) emit8(x, (v >> (8 * i)) & 0xFF);
+}
+
+static void emit64(X86 *x, uint64_t v) {
+    for (int i = 0; i < 8; i++) emit8(x, (v >> (8 * i)) & 0xFF);
+}
+
+static void patch32(X86 *x, size_t pos, int32_t v) {
+    uint32_t u = (uint32_t)v;
+    for (int i = 0; i < 4; i++) x->obj.text.data[pos + i] = (u >> (8 * i)) & 0xFF;
+}
+
+static void add_fixup(Fixup **list, size_t *count, size_t *capacity, size_t pos, int target) {
+    if (*count >= *capacity) {
+        *capacity = *capacity ? *capacity * 2 : 32;
+        *list = realloc(*list, sizeof(Fixup) * *capacity);
+    }
+    (*list)[*count].pos = pos;
+    (*list)[*count].target = target;
+    (*count)++;
+}
+
+static Loc xmm(int reg) {
+    Loc l = {true, reg, 0};
+    return l;
+}
+
+static Loc frame(int32_t disp) {
+    Loc l = {false, 0, disp};
+    return l;
+}
+
+// Registers the function never touches keep a zeroed Loc: [rbp+0] is no slot
+static bool assigned(Loc l) {
+    return l.in_reg || l.disp != 0;
+}
+
+// ModRM for register field `reg` against an xmm/gpr register or [rbp + disp32]
+static void modrm(X86 *x, int reg, Loc rm) {
+    if (rm.in_reg) {
+        emit8(x, 0xC0 | ((reg & 7) << 3) | (rm.reg & 7));
+    } else {
+        emit8(x, 0x80 | ((reg & 7) << 3) | 5);
+        emit32(x, (uint32_t)rm.disp);
+    }
+}
+
+// prefix [REX] 0F op ModRM: the SSE2 scalar/packed double forms
+static void sse(X86 *x, uint8_t prefix, uint8_t op, int reg, Loc rm) {
+    emit8(x, prefix);
+    uint8_t rex = 0x40 | ((reg >> 3) << 2) | (rm.in_reg ? rm.reg >> 3 : 0);
+    if (rex != 0x40) emit8(x, rex);
+    emit8(x, 0x0F);
+    emit8(x, op);
+    modrm(x, reg, rm);
+}
+
+// ModRM + SIB for [rsp + disp32]: outgoing stack arguments
+static void modrm_rsp(X86 *x, int reg, int32_t disp) {
+    emit8(x, 0x84 | ((reg & 7) << 3));
+    emit8(x, 0x24);
+    emit32(x, (uint32_t)disp);
+}
+
+// sub rsp, imm32 / add rsp, imm32
+static void adjust_rsp(X86 *x, bool sub, int32_t bytes) {
+    emit8(x, 0x48);
+    emit8(x, 0x81);
+    emit8(x, sub ? 0xEC : 0xC4);
+    emit32(x, (uint32_t)bytes);
+}
+
+// mov [rbp + disp], r64 / mov r64, [rbp + disp]
+static void gpr_store(X86 *x, int gpr, int32_t disp) {
+    emit8(x, 0x48);
+    emit8(x, 0x89);
+    modrm(x, gpr, frame(disp));
+}
+
+static void gpr_load(X86 *x, int gpr, int32_t disp) {
+    emit8(x, 0x48);
+    emit8(x, 0x8B);
+    modrm(x, gpr, frame(disp));
+}
+
+static void mov_rax_imm64(X86 *x, uint64_t v) {
+    emit8(x, 0x48);
+    emit8(x, 0xB8);
+    emit64(x, v);
+}
+
+// mov eax, imm32 (printf's vector register count)
+static void mov_eax_imm32(X86 *x, uint32_t v) {
+    emit8(x, 0xB8);
+    emit32(x, v);
+}
+
+static void setcc(X86 *x, int cc, int gpr8) {
+    emit8(x, 0x0F);
+    emit8(x, 0x90 | cc);
+    emit8(x, 0xC0 | gpr8);
+}
+
+/*
+ * XMM moves
+ */
+static void load(X86 *x, Loc src, int reg) {
+    if (src.in_reg && src.reg == reg) return;
+    sse(x, 0xF2, OP_MOVSD_LOAD, reg, src);
+}
+
+static void store(X86 *x, int reg, Loc dst) {
+    if (dst.in_reg) {
+        if (dst.reg != reg) sse(x, 0xF2, OP_MOVSD_LOAD, dst.reg, xmm(reg));
+    } else {
+        sse(x, 0xF2, OP_MOVSD_STORE, reg, dst);
+    }
+}
+
+// Register holding `loc`, loading it into `scratch` if it is spilled
+static int in_reg(X86 *x, Loc loc, int scratch) {
+    if (loc.in_reg) return loc.reg;
+    load(x, loc, scratch);
+    return scratch;
+}
+
+static void load_const(X86 *x, double value, int reg) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    if (bits == 0) {
+        sse(x, 0x66, OP_XORPD, reg, xmm(reg));
+        return;
+    }
+    // mov rax, imm64; movq xmm, rax
+    mov_rax_imm64(x, bits);
+    emit8(x, 0x66);
+    emit8(x, 0x48 | ((reg >> 3) << 2));
+    emit8(x, 0x0F);
+    emit8(x, 0x6E);
+    emit8(x, 0xC0 | ((reg & 7) << 3));
+}
+
+/*
+ * Control flow and symbols
+ */
+static void jump(X86 *x, int cc, int target) {
+    if (cc == CC_ALWAYS) {
+        emit8(x, 0xE9);
+    } else {
+        emit8(x, 0x0F);
+        emit8(x, 0x80 | cc);
+    }
+    add_fixup(&x->jumps, &x->jump_count, &x->jump_capacity, here(x), target);
+    emit32(x, 0);
+}
+
+static size_t extern_symbol(X86 *x, const char *name) {
+    for (size_t i = 0; i < x->obj.symbol_count; i++) {
+        ElfSymbol *sym = &x->obj.symbols[i];
+        if (sym->section == ELF_UNDEF && strcmp(sym->name, name) == 0) return i;
+    }
+    return elf_add_symbol(&x->obj, name, ELF_UNDEF, 0, true, false);
+}
+
+static void call_extern(X86 *x, const char *name) {
+    emit8(x, 0xE8);
+    elf_add_reloc(&x->obj, here(x), extern_symbol(x, name), R_X86_64_PLT32, -4);
+    emit32(x, 0);
+}
+
+static void call_func(X86 *x, int index) {
+    emit8(x, 0xE8);
+    add_fixup(&x->calls, &x->call_count, &x->call_capacity, here(x), index);
+    emit32(x, 0);
+}
+
+// lea gpr, [rip + symbol]
+static void lea_rodata(X86 *x, int gpr, size_t symbol) {
+    emit8(x, 0x48);
+    emit8(x, 0x8D);
+    emit8(x, 0x05 | (gpr << 3));
+    elf_add_reloc(&x->obj, here(x), symbol, R_X86_64_PC32, -4);
+    emit32(x, 0);
+}
+
+static size_t rodata_string(X86 *x, const char *name, const char *s) {
+    size_t offset = elf_append(&x->obj.rodata, s, strlen(s) + 1);
+    return elf_add_symbol(&x->obj, name, ELF_RODATA, offset, false, false);
+}
+
+static size_t string_symbol(X86 *x, int index) {
+    if (x->string_symbol[index] == SIZE_MAX) {
+        char name[32];
+        snprintf(name, sizeof(name), "str.%d", index);
+        x->string_symbol[index] = rodata_string(x, name, x->prog->strings[index]);
+    }
+    return x->string_symbol[index];
+}
+
+static const char *func_symbol(X86 *x, int index) {
+    const char *name = x->prog->funcs[index].name;
+    // Keep `main` free for the entry point, like codegen.c
+    return x->emit_entry && strcmp(name, "main") == 0 ? "nerd_main" : name;
+}
+
+/*
+ * Liveness and register allocation
+ */
+
+// Instructions that call out (and so clobber every XMM register)
+static bool is_call(int op) {
+    switch (op) {
+        case BC_CALL: case BC_MOD: case BC_POW: case BC_MIN: case BC_MAX:
+        case BC_FLOOR: case BC_CEIL: case BC_SIN: case BC_COS:
+        case BC_OUT_NUM: case BC_OUT_STR:
+        case BC_HTTP_GET: case BC_HTTP_GETALL: case BC_HTTP_POST: case BC_MCP_TOOLS:
+        case BC_MCP_SEND: case BC_MCP_INIT: case BC_LLM_CLAUDE: case BC_LLM_SYSTEM:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Registers an instruction reads or writes; returns the count
+static int instr_regs(X86 *x, const BcInstr *ins, int *regs) {
+    switch (ins->op) {
+        case BC_CONST: case BC_OUT_NUM: case BC_RET: case BC_JMPF:
+            regs[0] = ins->a;
+            return 1;
+        case BC_MOV: case BC_NOT: case BC_NEG: case BC_ABS: case BC_SQRT:
+        case BC_FLOOR: case BC_CEIL: case BC_SIN: case BC_COS:
+        case BC_FORPREP: case BC_FORLOOP:
+            regs[0] = ins->a;
+            regs[1] = ins->b;
+            return 2;
+        case BC_ADD: case BC_SUB: case BC_MUL: case BC_DIV: case BC_MOD:
+        case BC_EQ: case BC_NEQ: case BC_LT: case BC_GT: case BC_LTE: case BC_GTE:
+        case BC_AND: case BC_OR: case BC_MIN: case BC_MAX: case BC_POW:
+            regs[0] = ins->a;
+            regs[1] = ins->b;
+            regs[2] = ins->c;
+            return 3;
+        case BC_CALL: {
+            int n = x->prog->funcs[ins->b].param_count;
+            regs[0] = ins->a;
+            for (int i = 0; i < n; i++) regs[1 + i] = ins->c + i;
+            return 1 + n;
+        }
+        default:
+            return 0;
+    }
+}
+
+static int interval_cmp(const void *a, const void *b) {
+    const Interval *ia = a, *ib = b;
+    if (ia->start != ib->start) return ia->start - ib->start;
+    return ia->vreg - ib->vreg;
+}
+
+/*
+ * Assign every bytecode register an xmm register or a frame slot.
+ * Positions: 0 is function entry (parameters), pc + 1 is instruction pc.
+ * Returns the frame size.
+ */
+static int allocate(X86 *x) {
+    BcFunc *fn = x->fn;
+    int count = fn->reg_count;
+    int positions = (int)fn->code_count + 1;
+    int *start = malloc(sizeof(int) * (count + 1));
+    int *end = malloc(sizeof(int) * (count + 1));
+    int *calls_before = calloc(positions + 1, sizeof(int));
+
+    for (int r = 0; r < count; r++) {
+        start[r] = -1;
+        end[r] = -1;
+    }
+
+    for (size_t pc = 0; pc < fn->code_count; pc++) {
+        int pos = (int)pc + 1;
+        int n = instr_regs(x, &fn->code[pc], x->regs);
+        for (int i = 0; i < n; i++) {
+            int r = x->regs[i];
+            if (start[r] < 0) start[r] = pos;
+            end[r] = pos;
+        }
+        calls_before[pos + 1] = calls_before[pos] + (is_call(fn->code[pc].op) ? 1 : 0);
+    }
+    for (int r = 0; r < fn->param_count && r < count; r++) {
+        if (start[r] >= 0) start[r] = 0;
+    }
+
+    // Anything live somewhere in a loop is live across the whole loop
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (size_t pc = 0; pc < fn->code_count; pc++) {
+            const BcInstr *ins = &fn->code[pc];
+            int target;
+            if (ins->op == BC_JMP) target = ins->a;
+            else if (ins->op == BC_FORLOOP) target = ins->c;
+            else continue;
+            if ((size_t)target > pc) continue;
+
+            int head = target + 1, tail = (int)pc + 1;
+            for (int r = 0; r < count; r++) {
+                if (start[r] < 0 || start[r] > tail || end[r] < head) continue;
+                if (start[r] > head) { start[r] = head; changed = true; }
+                if (end[r] < tail) { end[r] = tail; changed = true; }
+            }
+        }
+    }
+
+    // Live across a call: straight to the frame. The rest: linear scan.
+    int slots = 1;              // slot 1 is the runtime-pointer scratch
+    x->scratch = -8;
+    Interval *intervals = malloc(sizeof(Interval) * (count + 1));
+    int interval_count = 0;
+    for (int r = 0; r < count; r++) {
+        if (start[r] < 0) continue;
+        bool crosses = end[r] > start[r] + 1 && calls_before[end[r]] - calls_before[start[r] + 1] > 0;
+        if (crosses) {
+            x->locs[r] = frame(-8 * ++slots);
+        } else {
+            intervals[interval_count].vreg = r;
+            intervals[interval_count].start = start[r];
+            intervals[interval_count].end = end[r];
+            interval_count++;
+        }
+    }
+    qsort(intervals, interval_count, sizeof(Interval), interval_cmp);
+
+    Interval *active[X86_ALLOC_COUNT];
+    int active_count = 0;
+    bool reg_free[X86_ALLOC_COUNT];
+    for (int i = 0; i < X86_ALLOC_COUNT; i++) reg_free[i] = true;
+
+    for (int i = 0; i < interval_count; i++) {
+        Interval *iv = &intervals[i];
+
+        // Expire intervals that ended before this one starts
+        int kept = 0;
+        for (int j = 0; j < active_count; j++) {
+            if (active[j]->end < iv->start) {
+                reg_free[x->locs[active[j]->vreg].reg - X86_FIRST_ALLOC] = true;
+            } else {
+                active[kept++] = active[j];
+            }
+        }
+        active_count = kept;
+
+        int reg = -1;
+        for (int j = 0; j < X86_ALLOC_COUNT && reg < 0; j++) {
+            if (reg_free[j]) reg = j;
+        }
+
+        if (reg >= 0) {
+            reg_free[reg] = false;
+            x->locs[iv->vreg] = xmm(X86_FIRST_ALLOC + reg);
+            active[active_count++] = iv;
+            continue;
+        }
+
+        // No register: spill whichever interval ends last
+        int victim = 0;
+        for (int j = 1; j < active_count; j++) {
+            if (active[j]->end > active[victim]->end) victim = j;
+        }
+        if (active[victim]->end > iv->end) {
+            x->locs[iv->vreg] = x->locs[active[victim]->vreg];
+            x->locs[active[victim]->vreg] = frame(-8 * ++slots);
+            active[victim] = iv;
+        } else {
+            x->locs[iv->vreg] = frame(-8 * ++slots);
+        }
+    }
+
+    free(intervals);
+    free(start);
+    free(end);
+    free(calls_before);
+    return (slots * 8 + 15) & ~15;
+}
+
+/*
+ * Instruction lowering
+ */
+#define L(r) (x->locs[r])
+
+static void lower_binop(X86 *x, uint8_t op, const BcInstr *ins) {
+    Loc a = L(ins->a), b = L(ins->b), c = L(ins->c);
+    if (a.in_reg && !(c.in_reg && c.reg == a.reg)) {
+        load(x, b, a.reg);
+        sse(x, 0xF2, op, a.reg, c);
+    } else {
+        load(x, b, 0);
+        sse(x, 0xF2, op, 0, c);
+        store(x, 0, a);
+    }
+}
+
+// Unary or binary libm call: a = name(b[, c])
+static void lower_libm(X86 *x, const char *name, const BcInstr *ins, bool binary) {
+    load(x, L(ins->b), 0);
+    if (binary) load(x, L(ins->c), 1);
+    call_extern(x, name);
+    store(x, 0, L(ins->a));
+}
+
+// al (0 or 1) -> double in `dst`
+static void bool_result(X86 *x, Loc dst) {
+    emit8(x, 0x0F);             // movzx eax, al
+    emit8(x, 0xB6);
+    emit8(x, 0xC0);
+    int reg = dst.in_reg ? dst.reg : 0;
+    sse(x, 0xF2, OP_CVTSI2SD, reg, xmm(RAX));
+    if (!dst.in_reg) store(x, 0, dst);
+}
+
+// al = value is nonzero and not NaN (codegen's `fcmp one x, 0.0`)
+static void truthy(X86 *x, Loc value) {
+    sse(x, 0x66, OP_XORPD, 1, xmm(1));
+    sse(x, 0x66, OP_UCOMISD, 1, value);
+    setcc(x, CC_NE, RAX);
+    setcc(x, CC_NP, RCX);
+    emit8(x, 0x20);             // and al, cl
+    emit8(x, 0xC8);
+}
+
+static void lower_compare(X86 *x, const BcInstr *ins) {
+    Loc lhs = L(ins->b), rhs = L(ins->c);
+    int cc;
+    switch (ins->op) {
+        case BC_EQ: cc = CC_E; break;
+        case BC_NEQ: cc = CC_NE; break;
+        case BC_GT: cc = CC_A; break;
+        case BC_GTE: cc = CC_AE; break;
+        case BC_LT: cc = CC_A; lhs = L(ins->c); rhs = L(ins->b); break;
+        default: cc = CC_AE; lhs = L(ins->c); rhs = L(ins->b); break;   // LTE
+    }
+
+    // ucomisd: unordered sets ZF, PF and CF, so above/above-or-equal are
+    // already false for NaN; equality needs the parity flag as well
+    sse(x, 0x66, OP_UCOMISD, in_reg(x, lhs, 0), rhs);
+    setcc(x, cc, RAX);
+    if (cc == CC_E || cc == CC_NE) {
+        setcc(x, CC_NP, RCX);
+        emit8(x, 0x20);         // and al, cl
+        emit8(x, 0xC8);
+    }
+    bool_result(x, L(ins->a));
+}
+
+// Print and free a runtime response in rax (skipped when NULL)
+static void print_response(X86 *x, const char *free_fn) {
+    emit8(x, 0x48);             // test rax, rax
+    emit8(x, 0x85);
+    emit8(x, 0xC0);
+    emit8(x, 0x0F);             // je skip
+    emit8(x, 0x84);
+    size_t skip = here(x);
+    emit32(x, 0);
+
+    gpr_store(x, RAX, x->scratch);
+    emit8(x, 0x48);             // mov rdi, rax
+    emit8(x, 0x89);
+    emit8(x, 0xC7);
+    call_extern(x, "puts");
+    gpr_load(x, RDI, x->scratch);
+    call_extern(x, free_fn);
+
+    patch32(x, skip, (int32_t)(here(x) - (skip + 4)));
+}
+
+// Free a runtime response in rax without printing it
+static void discard_response(X86 *x, const char *free_fn) {
+    emit8(x, 0x48);             // mov rdi, rax
+    emit8(x, 0x89);
+    emit8(x, 0xC7);
+    call_extern(x, free_fn);
+}
+
+static void lower(X86 *x, const BcInstr *ins) {
+    // Operand a is a register only for opcodes that list it (not jumps/strings)
+    Loc a = instr_regs(x, ins, x->regs) > 0 ? L(ins->a) : frame(0);
+
+    switch (ins->op) {
+        case BC_CONST: {
+            double value = x->fn->consts[ins->b];
+            if (a.in_reg) {
+                load_const(x, value, a.reg);
+            } else {
+                uint64_t bits;
+                memcpy(&bits, &value, sizeof(bits));
+                mov_rax_imm64(x, bits);
+                gpr_store(x, RAX, a.disp);
+            }
+            break;
+        }
+
+        case BC_MOV: {
+            Loc b = L(ins->b);
+            if (a.in_reg) {
+                load(x, b, a.reg);
+            } else if (b.in_reg) {
+                store(x, b.reg, a);
+            } else {
+                gpr_load(x, RAX, b.disp);
+                gpr_store(x, RAX, a.disp);
+            }
+            break;
+        }
+
+        case BC_ADD: lower_binop(x, OP_ADDSD, ins); break;
+        case BC_SUB: lower_binop(x, OP_SUBSD, ins); break;
+        case BC_MUL: lower_binop(x, OP_MULSD, ins); break;
+        case BC_DIV: lower_binop(x, OP_DIVSD, ins); break;
+        case BC_MOD: lower_libm(x, "fmod", ins, true); break;
+        case BC_POW: lower_libm(x, "pow", ins, true); break;
+        case BC_MIN: lower_libm(x, "fmin", ins, true); break;
+        case BC_MAX: lower_libm(x, "fmax", ins, true); break;
+        case BC_FLOOR: lower_libm(x, "floor", ins, false); break;
+        case BC_CEIL: lower_libm(x, "ceil", ins, false); break;
+        case BC_SIN: lower_libm(x, "sin", ins, false); break;
+        case BC_COS: lower_libm(x, "cos", ins, false); break;
+
+        case BC_EQ: case BC_NEQ: case BC_LT: case BC_GT: case BC_LTE: case BC_GTE:
+            lower_compare(x, ins);
+            break;
+
+        case BC_AND: case BC_OR:
+            truthy(x, L(ins->b));
+            emit8(x, 0x88);     // mov dl, al
+            emit8(x, 0xC2);
+            truthy(x, L(ins->c));
+            emit8(x, ins->op == BC_AND ? 0x20 : 0x08);  // and/or al, dl
+            emit8(x, 0xD0);
+            bool_result(x, a);
+            break;
+
+        case BC_NOT:
+            sse(x, 0x66, OP_XORPD, 1, xmm(1));
+            sse(x, 0x66, OP_UCOMISD, 1, L(ins->b));
+            setcc(x, CC_E, RAX);
+            setcc(x, CC_NP, RCX);
+            emit8(x, 0x20);     // and al, cl
+            emit8(x, 0xC8);
+            bool_result(x, a);
+            break;
+
+        case BC_NEG: {
+            // 0.0 - x, not a sign flip: matches codegen for -0.0
+            Loc b = L(ins->b);
+            int reg = a.in_reg && !(b.in_reg && b.reg == a.reg) ? a.reg : 0;
+            sse(x, 0x66, OP_XORPD, reg, xmm(reg));
+            sse(x, 0xF2, OP_SUBSD, reg, b);
+            store(x, reg, a);
+            break;
+        }
+
+        case BC_ABS:
+            mov_rax_imm64(x, 0x7FFFFFFFFFFFFFFFULL);
+            emit8(x, 0x66);     // movq xmm1, rax
+            emit8(x, 0x48);
+            emit8(x, 0x0F);
+            emit8(x, 0x6E);
+            emit8(x, 0xC8);
+            load(x, L(ins->b), 0);
+            sse(x, 0x66, OP_ANDPD, 0, xmm(1));
+            store(x, 0, a);
+            break;
+
+        case BC_SQRT: {
+            int reg = a.in_reg ? a.reg : 0;
+            sse(x, 0xF2, OP_SQRTSD, reg, L(ins->b));
+            store(x, reg, a);
+            break;
+        }
+
+        case BC_JMP:
+            jump(x, CC_ALWAYS, ins->a);
+            break;
+
+        case BC_JMPF:
+            sse(x, 0x66, OP_XORPD, 1, xmm(1));
+            sse(x, 0x66, OP_UCOMISD, 1, a);
+            jump(x, CC_P, ins->b);      // NaN is falsy
+            jump(x, CC_E, ins->b);
+            break;
+
+        case BC_FORPREP:
+            // if !(counter <= limit) skip the loop (also when unordered)
+            sse(x, 0x66, OP_UCOMISD, in_reg(x, L(ins->b), 0), a);
+            jump(x, CC_B, ins->c);
+            break;
+
+        case BC_FORLOOP:
+            load_const(x, 1.0, 1);
+            if (a.in_reg) {
+                sse(x, 0xF2, OP_ADDSD, a.reg, xmm(1));
+            } else {
+                load(x, a, 0);
+                sse(x, 0xF2, OP_ADDSD, 0, xmm(1));
+                store(x, 0, a);
+            }
+            sse(x, 0x66, OP_UCOMISD, in_reg(x, L(ins->b), 0), a);
+            jump(x, CC_AE, ins->c);
+            break;
+
+        case BC_CALL: {
+            // SysV: the first 8 in xmm0..xmm7, the rest on the stack, with
+            // rsp kept 16-byte aligned at the call
+            int n = x->prog->funcs[ins->b].param_count;
+            int32_t stack = n > X86_MAX_ARGS ? ((n - X86_MAX_ARGS) * 8 + 15) & ~15 : 0;
+            if (stack > 0) {
+                adjust_rsp(x, true, stack);
+                for (int i = X86_MAX_ARGS; i < n; i++) {
+                    int reg = in_reg(x, L(ins->c + i), 0);
+                    emit8(x, 0xF2);     // movsd [rsp + disp], xmm
+                    if (reg >= 8) emit8(x, 0x44);
+                    emit8(x, 0x0F);
+                    emit8(x, OP_MOVSD_STORE);
+                    modrm_rsp(x, reg, (i - X86_MAX_ARGS) * 8);
+                }
+            }
+            for (int i = 0; i < n && i < X86_MAX_ARGS; i++) {
+                load(x, L(ins->c + i), i);
+            }
+            call_func(x, ins->b);
+            if (stack > 0) adjust_rsp(x, false, stack);
+            store(x, 0, a);
+            break;
+        }
+
+        case BC_RET:
+            load(x, a, 0);
+            emit8(x, 0xC9);     // leave
+            emit8(x, 0xC3);     // ret
+            break;
+
+        case BC_OUT_NUM:
+            if (x->fmt_num == SIZE_MAX) x->fmt_num = rodata_string(x, "fmt.num", "%g\n");
+            lea_rodata(x, RDI, x->fmt_num);
+            load(x, a, 0);
+            mov_eax_imm32(x, 1);
+            call_extern(x, "printf");
+            break;
+
+        case BC_OUT_STR:
+            lea_rodata(x, RDI, string_symbol(x, ins->a));
+            call_extern(x, "puts");
+            break;
+
+        case BC_HTTP_GET:
+            lea_rodata(x, RDI, string_symbol(x, ins->a));
+            call_extern(x, "nerd_http_get");
+            print_response(x, "nerd_http_free");
+            break;
+
+        case BC_HTTP_GETALL:
+            lea_rodata(x, RDI, string_symbol(x, ins->a));
+            call_extern(x, "nerd_http_getall");
+            print_response(x, "nerd_http_free");
+            break;
+
+        case BC_HTTP_POST:
+            lea_rodata(x, RDI, string_symbol(x, ins->a));
+            lea_rodata(x, RSI, string_symbol(x, ins->b));
+            call_extern(x, "nerd_http_post");
+            print_response(x, "nerd_http_free");
+            break;
+
+        case BC_MCP_TOOLS:
+            lea_rodata(x, RDI, string_symbol(x, ins->a));
+            call_extern(x, "nerd_mcp_list");
+            discard_response(x, "nerd_mcp_free");
+            break;
+
+        case BC_MCP_SEND:
+            lea_rodata(x, RDI, string_symbol(x, ins->a));
+            lea_rodata(x, RSI, string_symbol(x, ins->b));
+            lea_rodata(x, RDX, string_symbol(x, ins->c));
+            call_extern(x, "nerd_mcp_send");
+            discard_response(x, "nerd_mcp_free");
+            break;
+
+        case BC_MCP_INIT:
+            lea_rodata(x, RDI, string_symbol(x, ins->a));
+            call_extern(x, "nerd_mcp_init");
+            discard_response(x, "nerd_mcp_free");
+            break;
+
+        case BC_LLM_CLAUDE:
+            lea_rodata(x, RDI, string_symbol(x, ins->a));
+            call_extern(x, "nerd_llm_claude");
+            discard_response(x, "nerd_llm_free");
+            break;
+
+        case BC_LLM_SYSTEM:
+            lea_rodata(x, RDI, string_symbol(x, ins->a));
+            lea_rodata(x, RSI, string_symbol(x, ins->b));
+            call_extern(x, "nerd_llm_claude_system");
+            discard_response(x, "nerd_llm_free");
+            break;
+
+        default:
+            fail(x, "unsupported instruction %s", bc_op_name(ins->op));
+            break;
+    }
+}
+
+#undef L
+
+static void prologue(X86 *x, int frame_size) {
+    emit8(x, 0x55);             // push rbp
+    emit8(x, 0x48);             // mov rbp, rsp
+    emit8(x, 0x89);
+    emit8(x, 0xE5);
+    if (frame_size > 0) {
+        emit8(x, 0x48);         // sub rsp, imm32
+        emit8(x, 0x81);
+        emit8(x, 0xEC);
+        emit32(x, (uint32_t)frame_size);
+    }
+}
+
+static void emit_function(X86 *x, int index) {
+    BcFunc *fn = &x->prog->funcs[index];
+    x->fn = fn;
+    x->locs = calloc(fn->reg_count + 1, sizeof(Loc));
+    x->pc_offset = malloc(sizeof(size_t) * (fn->code_count + 1));
+    x->jump_count = 0;
+
+    x->func_offset[index] = here(x);
+    size_t symbol = elf_add_symbol(&x->obj, func_symbol(x, index), ELF_TEXT, here(x), true, true);
+
+    prologue(x, allocate(x));
+    // Register parameters first, so xmm0 is free to stage the stack ones,
+    // which the caller left above the return address
+    for (int i = 0; i < fn->param_count && i < X86_MAX_ARGS; i++) {
+        if (assigned(x->locs[i])) store(x, i, x->locs[i]);
+    }
+    for (int i = X86_MAX_ARGS; i < fn->param_count; i++) {
+        if (!assigned(x->locs[i])) continue;
+        Loc arg = frame(16 + (i - X86_MAX_ARGS) * 8);
+        if (x->locs[i].in_reg) {
+            load(x, arg, x->locs[i].reg);
+        } else {
+            load(x, arg, 0);
+            store(x, 0, x->locs[i]);
+        }
+    }
+
+    for (size_t pc = 0; pc < fn->code_count && !x->failed; pc++) {
+        x->pc_offset[pc] = here(x);
+        lower(x, &fn->code[pc]);
+    }
+    x->pc_offset[fn->code_count] = here(x);
+
+    for (size_t i = 0; i < x->jump_count; i++) {
+        Fixup *j = &x->jumps[i];
+        patch32(x, j->pos, (int32_t)(x->pc_offset[j->target] - (j->pos + 4)));
+    }
+    x->obj.symbols[symbol].size = here(x) - x->func_offset[index];
+
+    free(x->locs);
+    free(x->pc_offset);
+}
+
+/*
+ * int main(): call nerd_main, or run every function with sample
+ * arguments (5, 3, 1, ...) and print the results, as codegen.c does
+ */
+static void emit_entry(X86 *x) {
+    BcProgram *prog = x->prog;
+    size_t start = here(x);
+    size_t symbol = elf_add_symbol(&x->obj, "main", ELF_TEXT, start, true, true);
+
+    prologue(x, 0);
+    if (prog->main_index >= 0) {
+        call_func(x, prog->main_index);
+    } else {
+        x->fmt_entry = rodata_string(x, "fmt.entry", "%s = %.0f\n");
+        for (size_t i = 0; i < prog->func_count; i++) {
+            BcFunc *fn = &prog->funcs[i];
+            if (fn->specialized || fn->imported) continue;
+
+            char name[32];
+            snprintf(name, sizeof(name), "entry.name%zu", i);
+            size_t name_symbol = rodata_string(x, name, fn->name);
+
+            int32_t stack = fn->param_count > X86_MAX_ARGS ?
+                            ((fn->param_count - X86_MAX_ARGS) * 8 + 15) & ~15 : 0;
+            if (stack > 0) {
+                adjust_rsp(x, true, stack);
+                mov_rax_imm64(x, 0x3FF0000000000000ULL);    // 1.0
+                for (int j = X86_MAX_ARGS; j < fn->param_count; j++) {
+                    emit8(x, 0x48);                         // mov [rsp + disp], rax
+                    emit8(x, 0x89);
+                    modrm_rsp(x, RAX, (j - X86_MAX_ARGS) * 8);
+                }
+            }
+            for (int j = 0; j < fn->param_count && j < X86_MAX_ARGS; j++) {
+                load_const(x, j == 0 ? 5.0 : j == 1 ? 3.0 : 1.0, j);
+            }
+            call_func(x, (int)i);
+            if (stack > 0) adjust_rsp(x, false, stack);
+            lea_rodata(x, RDI, x->fmt_entry);
+            lea_rodata(x, RSI, name_symbol);
+            mov_eax_imm32(x, 1);
+            call_extern(x, "printf");
+        }
+    }
+    emit8(x, 0x31);             // xor eax, eax
+    emit8(x, 0xC0);
+    emit8(x, 0x5D);             // pop rbp
+    emit8(x, 0xC3);             // ret
+
+    x->obj.symbols[symbol].size = here(x) - start;
+}
+
+/*
+ * Compile a bytecode program to an x86-64 ELF object at `path`.
+ * With `emit_entry`, the object has an int main() like `nerd run` builds.
+ */
+bool x86_compile(BcProgram *prog, bool emit_entry_point, const char *path) {
+    X86 x = {0};
+    x.prog = prog;
+    x.emit_entry = emit_entry_point;
+    x.fmt_num = SIZE_MAX;
+    x.fmt_entry = SIZE_MAX;
+    x.func_offset = calloc(prog->func_count + 1, sizeof(size_t));
+    int widest = 0;
+    for (size_t i = 0; i < prog->func_count; i++) {
+        if (prog->funcs[i].param_count > widest) widest = prog->funcs[i].param_count;
+    }
+    x.regs = malloc(sizeof(int) * (size_t)(1 + (widest > 3 ? widest : 3)));
+    x.string_symbol = malloc(sizeof(size_t) * (prog->string_count + 1));
+    for (size_t i = 0; i < prog->string_count; i++) {
+        x.string_symbol[i] = SIZE_MAX;
+    }
+
+    for (size_t i = 0; i < prog->func_count && !x.failed; i++) {
+        emit_function(&x, (int)i);
+    }
+    if (!x.failed && emit_entry_point) {
+        emit_entry(&x);
+    }
+
+    // Direct calls between NERD functions need no relocation
+    for (size_t i = 0; i < x.call_count && !x.failed; i++) {
+        Fixup *c = &x.calls[i];
+        patch32(&x, c->pos, (int32_t)(x.func_offset[c->target] - (c->pos + 4)));
+    }
+
+    bool ok = !x.failed && elf_write(&x.obj, path);
+
+    elf_free(&x.obj);
+    free(x.func_offset);
+    free(x.regs);
+    free(x.string_symbol);
+    free(x.jumps);
+    free(x.calls);
+    return ok;
+}